@@ -0,0 +1,158 @@
+/*=========================================================================
+
+Library:   AnatomicAugmentedRealityProjector
+
+Author: Maeliss Jallais
+
+Copyright 2010 Kitware Inc. 28 Corporate Drive,
+Clifton Park, NY, 12065, USA.
+
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+=========================================================================*/
+
+#include "HistogramModeFinder.hpp"
+#include "Logger.hpp"
+#include "Profiler.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+HistogramModeFinder::HistogramModeFinder() :
+  Scale( 100 ),
+  Variance( -1 ),
+  Radius( 0 )
+{
+  for( int axis = 0; axis < 3; axis++ )
+    {
+    this->NbBins[ axis ] = 0;
+    }
+  this->SetVariance( 3 );
+}
+
+void HistogramModeFinder::SetVariance( float variance )
+{
+  if( variance == this->Variance )
+    {
+    return;
+    }
+  this->Variance = variance;
+
+  // Kernel truncated at 3 sigma and normalized
+  float sigma = std::sqrt( std::max( variance, 0.f ) );
+  this->Radius = static_cast<int>( std::ceil( 3 * sigma ) );
+  this->Kernel.resize( 2 * this->Radius + 1 );
+  if( this->Radius == 0 )
+    {
+    this->Kernel[ 0 ] = 1;
+    return;
+    }
+  float sum = 0;
+  for( int k = -this->Radius; k <= this->Radius; k++ )
+    {
+    float value = std::exp( -0.5f * k * k / variance );
+    this->Kernel[ k + this->Radius ] = value;
+    sum += value;
+    }
+  for( auto iter = this->Kernel.begin(); iter != this->Kernel.end(); ++iter )
+    {
+    *iter /= sum;
+    }
+}
+
+int HistogramModeFinder::Resize( int axis, float min, float max )
+{
+  int size = static_cast<int>( std::abs( max - min ) * this->Scale ) + 1;
+  if( static_cast<int>( this->Histograms[ axis ].size() ) < size )
+    {
+    this->Histograms[ axis ].resize( size );
+    }
+  std::fill( this->Histograms[ axis ].begin(), this->Histograms[ axis ].begin() + size, 0.f );
+  this->NbBins[ axis ] = size;
+  return size;
+}
+
+int HistogramModeFinder::FindPeak( int axis ) const
+/*  Smoothing and maximum search fused in one sweep : the smoothed histogram is never stored.
+    The borders are replicated. */
+{
+  const float * histogram = this->Histograms[ axis ].data();
+  const float * kernel = this->Kernel.data();
+  int size = this->NbBins[ axis ];
+  int radius = this->Radius;
+  int best_index = 0;
+  float best_value = -1;
+  for( int i = 0; i < size; i++ )
+    {
+    float value = 0;
+    if( i >= radius && i + radius < size )
+      {
+      const float * h = histogram + i - radius;
+      for( int k = 0; k <= 2 * radius; k++ )
+        {
+        value += kernel[ k ] * h[ k ];
+        }
+      }
+    else
+      {
+      for( int k = -radius; k <= radius; k++ )
+        {
+        int j = std::min( std::max( i + k, 0 ), size - 1 );
+        value += kernel[ k + radius ] * histogram[ j ];
+        }
+      }
+    if( value > best_value )
+      {
+      best_value = value;
+      best_index = i;
+      }
+    }
+  return best_index;
+}
+
+float HistogramModeFinder::ComputeMode( std::vector<cv::Vec3f> const& points, int axis, float min, float max,
+  int filter_axis, float interval_min, float interval_max )
+{
+  Profiler::Scope scope( Profiler::ComputeMaximum );
+  scope.AddItems( points.size() );
+  if( axis < 0 || axis > 2 || filter_axis < 0 || filter_axis > 2 )
+    {
+    LOG_ERROR( Analysis, "Error in the dimension chosen to compute the maximum" );
+    return 0;
+    }
+
+  int size = this->Resize( axis, min, max );
+  float * histogram = this->Histograms[ axis ].data();
+  float offset = min * this->Scale;
+  int nb = 0;
+  for( auto iter = points.cbegin(); iter != points.cend(); ++iter )
+    {
+    if( ( *iter )[ filter_axis ] >= interval_min && ( *iter )[ filter_axis ] <= interval_max )
+      {
+      int index = static_cast<int>( std::floor( ( *iter )[ axis ] * this->Scale - offset ) );
+      if( index >= 0 && index < size )
+        {
+        histogram[ index ] += 1;
+        nb++;
+        }
+      }
+    }
+  if( nb == 0 )
+    {
+    return 0;
+    }
+
+  return ( this->FindPeak( axis ) + offset ) / this->Scale;
+}
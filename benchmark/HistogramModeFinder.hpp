@@ -0,0 +1,69 @@
+/*=========================================================================
+
+Library:   AnatomicAugmentedRealityProjector
+
+Author: Maeliss Jallais
+
+Copyright 2010 Kitware Inc. 28 Corporate Drive,
+Clifton Park, NY, 12065, USA.
+
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+=========================================================================*/
+
+#ifndef __HISTOGRAMMODEFINDER_HPP__
+#define __HISTOGRAMMODEFINDER_HPP__
+
+#include <opencv2/core/core.hpp>
+
+#include <vector>
+
+// Mode of the coordinates of a point set : the points are binned, the histogram is
+// smoothed with a Gaussian kernel and the highest bin is returned.
+// The histogram buffers and the kernel are kept between calls, so nothing is
+// allocated once the engine has seen the largest range.
+// The application finds the centers with DensityPeakFinder : this former search by 1D
+// maxima is only kept by the benchmark, as the reference of the density peaks.
+class HistogramModeFinder
+{
+public:
+  HistogramModeFinder();
+
+  // Number of bins per unit of length (100 : 1 cm bins with coordinates in m)
+  void SetBinsPerUnit( float scale ) { this->Scale = scale; };
+  // Variance of the smoothing kernel, in bins. The kernel is only rebuilt when it changes.
+  void SetVariance( float variance );
+
+  float GetBinsPerUnit() const { return this->Scale; };
+  float GetVariance() const { return this->Variance; };
+
+  // Mode of the coordinate axis over [min, max], counting only the points whose
+  // filter_axis coordinate is in [interval_min, interval_max]. Returns 0 on error.
+  float ComputeMode( std::vector<cv::Vec3f> const& points, int axis, float min, float max,
+    int filter_axis = 0, float interval_min = -9999, float interval_max = 9999 );
+
+private:
+  int Resize( int axis, float min, float max );
+  int FindPeak( int axis ) const;
+
+  float Scale;
+  float Variance;
+  int Radius;
+  std::vector<float> Kernel;
+  std::vector<float> Histograms[ 3 ];
+  int NbBins[ 3 ];
+};
+
+#endif //__HISTOGRAMMODEFINDER_HPP__
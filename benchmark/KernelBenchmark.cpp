@@ -0,0 +1,963 @@
+/*=========================================================================
+
+Library:   AnatomicAugmentedRealityProjector
+
+Author: Maeliss Jallais
+
+Copyright 2010 Kitware Inc. 28 Corporate Drive,
+Clifton Park, NY, 12065, USA.
+
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+=========================================================================*/
+
+
+// Benchmark of the reconstruction and analysis kernels on synthetic inputs, at several camera
+// resolutions and point counts. Every kernel runs until MinTime has passed and at least
+// MinRuns times, and the median time of a run is kept.
+//
+//   KernelBenchmark [--quick] [--filter name] [--output results.csv]
+//                   [--baseline baseline.csv] [--tolerance 0.1]
+//
+// The scans are rendered from a synthetic scene with SceneRenderer, and the lines found by
+// the reconstruction are compared with the ground truth of the scene : the mean error is
+// kept with the times.
+//
+// The model projected on the anatomy is extracted from a synthetic volume at several sizes,
+// then loaded, registered to a scan made from it and rendered for the projector.
+//
+// The results are written as csv, which can be given back as the baseline of a later run :
+// a kernel whose median or error is larger than its baseline by more than the tolerance is
+// reported as a regression, and the exit code is then 1.
+
+#include "CalibrationData.hpp"
+#include "CalibrationRuntime.hpp"
+#include "CameraInput.hpp"
+#include "ColorModel.hpp"
+#include "CubeCornerSolver.hpp"
+#include "DensityPeakFinder.hpp"
+#include "FiducialDetector.hpp"
+#include "HistogramModeFinder.hpp"
+#include "IcpRegistration.hpp"
+#include "ImageConversion.hpp"
+#include "io_util.hpp"
+#include "LineScanner.hpp"
+#include "Logger.hpp"
+#include "MeshLoader.hpp"
+#include "MeshRenderer.hpp"
+#include "PlaneRansac.hpp"
+#include "SceneRenderer.hpp"
+#include "SignedDistanceField.hpp"
+#include "SurfaceExtractor.hpp"
+
+#include <QDir>
+#include <QFile>
+
+#include <opencv2/calib3d/calib3d.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+static const uint64 BenchmarkSeed = 0x2545F4914F6CDD1DULL;
+static const int MinRuns = 5;
+static const int MaxRuns = 10000;
+// Projector of the scans
+static const int ProjectorWidth = 1024;
+static const int ProjectorHeight = 768;
+// Projector lines of a synthetic scan
+static const int NbScanLines = 16;
+// Synthetic anatomy : ellipsoid in a volume of 200 mm, and its distance field
+static const double VolumeExtent = 200.;
+static const cv::Vec3d EllipsoidRadii( 80., 60., 40. );
+static const float FieldSpacing = 0.002f;
+static const float FieldMargin = 0.02f;
+// Sizes of the time targets : a scan of 50k points registered to a model of 200k vertices
+// in 50 ms
+static const int TargetModelU = 500;
+static const int TargetModelV = 400;
+static const int TargetScanStride = 4;
+static const double TargetIcpMs = 50.;
+// and the model rendered at 1920 x 1080 in 8 ms
+static const int TargetProjectorWidth = 1920;
+static const int TargetProjectorHeight = 1080;
+static const double TargetRenderMs = 8.;
+
+struct BenchmarkResult
+{
+  std::string Kernel;
+  std::string Size;
+  long long Items;
+  int Runs;
+  double MedianNs;
+  double MinNs;
+  double MaxNs;
+  // Mean error of the result against the ground truth, negative if it is not measured
+  double Error;
+};
+
+struct BenchmarkSettings
+{
+  // Minimum time spent in each kernel, in seconds
+  double MinTime;
+  // Only the kernels whose name contains the filter are run
+  std::string Filter;
+  std::vector<BenchmarkResult> Results;
+};
+
+// Results of the kernels, so that they are not optimized out
+static volatile double Sink = 0;
+
+// Runs the kernel, which returns any value depending on its result. Only the errors of the
+// kernels are logged while they are timed. Returns NULL if the kernel is filtered out.
+static BenchmarkResult * run_kernel( BenchmarkSettings & settings, std::string const& kernel, std::string const& size, long long items,
+  std::function<double()> const& run )
+{
+  if( kernel.find( settings.Filter ) == std::string::npos )
+    {
+    return NULL;
+    }
+  Logger::SetLevel( Logger::Error );
+
+  // First run to fill the caches and size the buffers of the engines
+  Sink = Sink + run();
+  std::vector<double> times;
+  double total = 0;
+  while( static_cast<int>( times.size() ) < MinRuns || ( total < settings.MinTime * 1e9 && static_cast<int>( times.size() ) < MaxRuns ) )
+    {
+    auto start = std::chrono::steady_clock::now();
+    double value = run();
+    auto stop = std::chrono::steady_clock::now();
+    Sink = Sink + value;
+    times.push_back( std::chrono::duration<double, std::nano>( stop - start ).count() );
+    total += times.back();
+    }
+
+  Logger::Flush();
+  Logger::SetLevel( Logger::Info );
+
+  std::sort( times.begin(), times.end() );
+  BenchmarkResult result;
+  result.Kernel = kernel;
+  result.Size = size;
+  result.Items = items;
+  result.Runs = static_cast<int>( times.size() );
+  result.MedianNs = times[ times.size() / 2 ];
+  result.MinNs = times.front();
+  result.MaxNs = times.back();
+  result.Error = -1;
+  settings.Results.push_back( result );
+
+  std::cout << std::left << std::setw( 28 ) << kernel << std::setw( 12 ) << size << std::right << std::fixed
+    << std::setw( 12 ) << std::setprecision( 3 ) << result.MedianNs * 1e-6 << " ms"
+    << std::setw( 14 ) << std::setprecision( 1 ) << items / ( result.MedianNs * 1e-3 ) << " items/us" << std::endl;
+  return &settings.Results.back();
+}
+
+// Camera looking along z, projector 20 cm above it and tilted towards the scene, 55 cm away
+static CalibrationData synthetic_calibration( cv::Size const& camera, cv::Size const& projector = cv::Size( ProjectorWidth, ProjectorHeight ) )
+{
+  CalibrationData data;
+  double f = 1.2 * camera.width;
+  data.Cam_K = ( cv::Mat_<double>( 3, 3 ) << f, 0, camera.width / 2., 0, f, camera.height / 2., 0, 0, 1 );
+  data.Cam_kc = ( cv::Mat_<double>( 5, 1 ) << -0.1, 0.05, 0, 0, 0 );
+  double fp = 1.5 * projector.width;
+  data.Proj_K = ( cv::Mat_<double>( 3, 3 ) << fp, 0, projector.width / 2., 0, fp, projector.height / 2., 0, 0, 1 );
+  data.Proj_kc = ( cv::Mat_<double>( 5, 1 ) << 0.02, 0, 0, 0, 0 );
+  cv::Matx33d R;
+  cv::Rodrigues( cv::Vec3d( std::atan2( 0.2, 0.55 ), 0, 0 ), R );
+  data.R = cv::Mat( R );
+  data.T = cv::Mat( R * cv::Vec3d( 0, 0.2, 0 ) );
+  data.CamError = data.ProjError = data.StereoError = 0;
+  return data;
+}
+
+// Sheet of paper behind the fiducial cube, which shows a corner to the camera, and a sphere
+// for the anatomy
+static SyntheticScene fiducial_scene()
+{
+  SyntheticScene scene;
+  SyntheticScene::Plane paper = { cv::Vec3d( 0, 0, 1 ), cv::Vec3d( 0, 0, 0.6 ), cv::Vec3b( 200, 200, 200 ) };
+  scene.Planes.push_back( paper );
+  SyntheticScene::Sphere sphere = { cv::Vec3d( -0.12, 0.04, 0.5 ), 0.05, cv::Vec3b( 150, 170, 220 ) };
+  scene.Spheres.push_back( sphere );
+  SyntheticScene::Cube cube;
+  cube.Center = cv::Vec3d( 0.03, 0, 0.5 );
+  cv::Rodrigues( cv::Vec3d( 0.6, -0.75, 0 ), cube.Rotation );
+  cube.Size = 0.08;
+  const cv::Vec3b faces[ 3 ] = { cv::Vec3b( 250, 150, 110 ), cv::Vec3b( 120, 130, 250 ), cv::Vec3b( 140, 240, 130 ) };
+  for( int f = 0; f < 6; f++ )
+    {
+    cube.Colors[ f ] = faces[ f / 2 ];
+    }
+  scene.Cubes.push_back( cube );
+  return scene;
+}
+
+// Reference frame and frames of NbScanLines projector rows spread over the projector, with
+// their ground truth
+static void synthetic_scan( SceneRenderer const& renderer, cv::Mat & reference, std::vector<cv::Mat> & frames, std::vector<SceneLine> & truths )
+{
+  renderer.RenderReference( reference );
+  frames.resize( NbScanLines );
+  truths.resize( NbScanLines );
+  for( int k = 0; k < NbScanLines; k++ )
+    {
+    renderer.RenderRow( ( k + 1 ) * ProjectorHeight / ( NbScanLines + 1. ), frames[ k ], &truths[ k ] );
+    }
+}
+
+// Mean distance in rows between the brightest pixels of the columns and the pixels of the
+// scene nearest to the center of the line, over the columns found in both
+static double line_error( LineScanner const& scanner, cv::Mat const& reference, std::vector<cv::Mat> const& frames,
+  std::vector<SceneLine> const& truths )
+{
+  double sum = 0;
+  long long nb = 0;
+  std::vector<int> truth_rows( reference.cols );
+  ScanLine line;
+  for( size_t k = 0; k < frames.size(); k++ )
+    {
+    std::fill( truth_rows.begin(), truth_rows.end(), -1 );
+    for( auto iter = truths[ k ].Pixels.cbegin(); iter != truths[ k ].Pixels.cend(); ++iter )
+      {
+      truth_rows[ iter->x ] = iter->y;
+      }
+    // The pixels are kept even if the line is rejected
+    scanner.Reconstruct( reference, frames[ k ], &line );
+    for( auto iter = line.Pixels.cbegin(); iter != line.Pixels.cend(); ++iter )
+      {
+      if( truth_rows[ iter->x ] >= 0 )
+        {
+        sum += std::abs( iter->y - truth_rows[ iter->x ] );
+        nb++;
+        }
+      }
+    }
+  return ( nb > 0 ? sum / nb : -1 );
+}
+
+// Organized cloud with every point valid, colored like the faces of the cube
+static void synthetic_cloud( cv::Size const& size, ColorModelSet const& models, cv::Mat & points, cv::Mat & colors )
+{
+  cv::RNG rng( BenchmarkSeed );
+  points.create( size, CV_32FC3 );
+  colors.create( size, CV_8UC3 );
+  for( int row = 0; row < size.height; row++ )
+    {
+    for( int col = 0; col < size.width; col++ )
+      {
+      points.at<cv::Vec3f>( row, col ) = cv::Vec3f( rng.uniform( -0.2f, 0.2f ), rng.uniform( -0.2f, 0.2f ), rng.uniform( 0.4f, 0.6f ) );
+      cv::Vec3d const& mean = models.GetModel( static_cast<ColorModelSet::ColorClass>( rng.uniform( 0, 3 ) ) ).Mean;
+      cv::Vec3b & color = colors.at<cv::Vec3b>( row, col );
+      for( int c = 0; c < 3; c++ )
+        {
+        color[ c ] = cv::saturate_cast<uchar>( mean[ c ] + rng.gaussian( 15 ) );
+        }
+      }
+    }
+}
+
+// 70% of the points on a plane with 2 mm of noise, the others anywhere in a 40 cm cube
+static std::vector<cv::Vec3f> synthetic_plane( int nb_points )
+{
+  cv::RNG rng( BenchmarkSeed );
+  std::vector<cv::Vec3f> points( nb_points );
+  for( int k = 0; k < nb_points; k++ )
+    {
+    float x = rng.uniform( -0.2f, 0.2f );
+    float y = rng.uniform( -0.2f, 0.2f );
+    if( rng.uniform( 0.f, 1.f ) < 0.7f )
+      {
+      points[ k ] = cv::Vec3f( x, y, 0.5f + 0.1f * x - 0.2f * y + static_cast<float>( rng.gaussian( 0.002 ) ) );
+      }
+    else
+      {
+      points[ k ] = cv::Vec3f( x, y, rng.uniform( 0.3f, 0.7f ) );
+      }
+    }
+  return points;
+}
+
+static std::string size_name( cv::Size const& size )
+{
+  std::ostringstream name;
+  name << size.width << "x" << size.height;
+  return name.str();
+}
+
+static void benchmark_resolution( BenchmarkSettings & settings, cv::Size const& size, CameraInput & camera )
+{
+  std::string name = size_name( size );
+  long long nb_pixels = static_cast<long long>( size.area() );
+  CalibrationData calibration = synthetic_calibration( size );
+  SceneRenderer renderer;
+  renderer.SetCalibration( calibration );
+  renderer.SetCameraSize( size.width, size.height );
+  renderer.SetProjectorSize( ProjectorWidth, ProjectorHeight );
+  renderer.SetScene( fiducial_scene() );
+  cv::Mat reference;
+  std::vector<cv::Mat> frames;
+  std::vector<SceneLine> truths;
+  synthetic_scan( renderer, reference, frames, truths );
+
+  cv::Mat rendered;
+  run_kernel( settings, "scene_render", name, nb_pixels, [&]()
+    {
+    renderer.RenderRow( ProjectorHeight / 2., rendered );
+    return rendered.data[ 0 ];
+    } );
+
+  // Camera rows of the first and last lines, found like in the application
+  camera.SetTopLine( size.height );
+  camera.SetBottomLine( 0 );
+  for( int k = 0; k < NbScanLines; k++ )
+    {
+    camera.FindTopBottomLines( reference, frames[ k ] );
+    }
+
+  // ComputePointCloud : reconstruction of the lines and organized cloud
+  LineScanner scanner;
+  scanner.SetCalibration( CompiledCalibration::Compile( calibration ) );
+  scanner.SetLines( camera.GetTopLine(), camera.GetBottomLine() );
+  scanner.SetProjectorSize( ProjectorWidth, ProjectorHeight );
+  cv::Mat pointcloud = cv::Mat::zeros( size, CV_32FC3 );
+  cv::Mat pointcloud_colors = cv::Mat::zeros( size, CV_8UC3 );
+  ScanLine line;
+  BenchmarkResult * scan = run_kernel( settings, "compute_point_cloud", name, static_cast<long long>( NbScanLines ) * size.width, [&]()
+    {
+    int nb_points = 0;
+    for( int k = 0; k < NbScanLines; k++ )
+      {
+      if( !scanner.Reconstruct( reference, frames[ k ], &line ) )
+        {
+        continue;
+        }
+      for( size_t p = 0; p < line.Pixels.size(); p++ )
+        {
+        pointcloud.at<cv::Vec3f>( line.Pixels[ p ] ) = line.Points[ p ];
+        pointcloud_colors.at<cv::Vec3b>( line.Pixels[ p ] ) = line.Colors[ p ];
+        }
+      nb_points += static_cast<int>( line.Pixels.size() );
+      }
+    return nb_points;
+    } );
+  if( scan != NULL )
+    {
+    scan->Error = line_error( scanner, reference, frames, truths );
+    std::cout << std::left << std::setw( 40 ) << "  line error" << std::right << std::setw( 12 ) << std::setprecision( 3 ) << scan->Error << " px" << std::endl;
+    }
+
+  run_kernel( settings, "find_top_bottom_lines", name, nb_pixels, [&]()
+    {
+    camera.SetTopLine( size.height );
+    camera.SetBottomLine( 0 );
+    camera.FindTopBottomLines( reference, frames[ NbScanLines / 2 ] );
+    return camera.GetBottomLine() - camera.GetTopLine();
+    } );
+
+  // density_probability : classification of every point of the cloud by the color models,
+  // with the class image of the export
+  ColorModelSet models;
+  cv::Mat cloud, cloud_colors;
+  synthetic_cloud( size, models, cloud, cloud_colors );
+  cv::Mat classes = cloud_colors.clone();
+  MemoryTracker::Vector<cv::Vec3f> points_B, points_G, points_R;
+  run_kernel( settings, "density_probability", name, nb_pixels, [&]()
+    {
+    points_B.clear();
+    points_G.clear();
+    points_R.clear();
+    cv::Vec3f box_min( 9999, 9999, 9999 ), box_max( -9999, -9999, -9999 );
+    FiducialDetector::ClassifyCloud( cloud, cloud_colors, models, &points_B, &points_G, &points_R, &box_min, &box_max, classes );
+    return points_B.size();
+    } );
+
+  cv::Mat gray;
+  cv::cvtColor( frames[ 0 ], gray, cv::COLOR_BGR2GRAY );
+  run_kernel( settings, "cv_mat_to_qimage_bgr", name, nb_pixels, [&]()
+    {
+    return cvMatToQImage( frames[ 0 ] ).constBits()[ 0 ];
+    } );
+  run_kernel( settings, "cv_mat_to_qimage_gray", name, nb_pixels, [&]()
+    {
+    return cvMatToQImage( gray ).constBits()[ 0 ];
+    } );
+}
+
+static void benchmark_point_count( BenchmarkSettings & settings, int nb_points )
+{
+  std::string name = std::to_string( nb_points );
+  std::vector<cv::Vec3f> plane = synthetic_plane( nb_points );
+
+  // ransac : settings of the first face of the corner detection
+  PlaneRansac engine;
+  engine.SetMaxIterations( 100 );
+  engine.SetThreshold( 0.01f );
+  engine.SetMinInliers( 10 );
+  run_kernel( settings, "ransac", name, nb_points, [&]()
+    {
+    engine.SetSeed( BenchmarkSeed );
+    engine.Fit( plane );
+    return engine.GetNbInliers();
+    } );
+
+  // histogram_mode : the former search of the centers, 1 cm bins smoothed over 3 bins
+  HistogramModeFinder finder;
+  finder.SetBinsPerUnit( 100 );
+  finder.SetVariance( 3 );
+  run_kernel( settings, "histogram_mode", name, nb_points, [&]()
+    {
+    return finder.ComputeMode( plane, 2, 0.3f, 0.7f );
+    } );
+
+  // find_centers : density peak of one face, with the voxels and the blur of the analysis
+  DensityPeakFinder peak_finder;
+  peak_finder.SetVoxelSize( 0.01f );
+  peak_finder.SetSigma( std::sqrt( 3.f ) );
+  MemoryTracker::Vector<cv::Vec3f> face( plane.begin(), plane.end() );
+  run_kernel( settings, "find_centers", name, nb_points, [&]()
+    {
+    cv::Vec3f center( 0, 0, 0 );
+    peak_finder.SetPoints( face );
+    peak_finder.FindPeak( center );
+    return center[ 2 ];
+    } );
+
+  // approximate_ray_plane_intersection : camera rays against the planes of the projector rows
+  cv::RNG rng( BenchmarkSeed );
+  std::vector<cv::Point3d> rays( nb_points );
+  std::vector<cv::Point3d> normals( ProjectorHeight ), origins( ProjectorHeight );
+  for( int k = 0; k < nb_points; k++ )
+    {
+    rays[ k ] = cv::Point3d( rng.uniform( -250., 250. ), rng.uniform( -200., 200. ), 500. );
+    }
+  for( int row = 0; row < ProjectorHeight; row++ )
+    {
+    normals[ row ] = cv::Point3d( rng.uniform( -0.1, 0.1 ), 1, rng.uniform( -0.5, 0.5 ) );
+    origins[ row ] = cv::Point3d( 0, rng.uniform( -0.2, 0.2 ), rng.uniform( 0.4, 0.6 ) );
+    }
+  run_kernel( settings, "ray_plane_intersection", name, nb_points, [&]()
+    {
+    double sum = 0;
+    for( int k = 0; k < nb_points; k++ )
+      {
+      int row = k % ProjectorHeight;
+      sum += LineScanner::RayPlaneIntersection( rays[ k ], rays[ k ], normals[ row ], origins[ row ] ).z;
+      }
+    return sum;
+    } );
+
+  // three_planes_intersection : one corner per triplet of random planes
+  int nb_triplets = nb_points / 3;
+  std::vector<cv::Vec3f> planes( 6 * nb_triplets );
+  for( size_t k = 0; k < planes.size(); k++ )
+    {
+    planes[ k ] = cv::Vec3f( rng.uniform( -1.f, 1.f ), rng.uniform( -1.f, 1.f ), rng.uniform( -1.f, 1.f ) );
+    }
+  run_kernel( settings, "three_planes_intersection", name, nb_triplets, [&]()
+    {
+    double sum = 0;
+    cv::Vec3f corner;
+    for( int k = 0; k < nb_triplets; k++ )
+      {
+      cv::Vec3f const* p = &planes[ 6 * k ];
+      CubeCornerSolver::IntersectPlanes( p[ 0 ], p[ 1 ], p[ 2 ], p[ 3 ], p[ 4 ], p[ 5 ], corner );
+      sum += corner[ 0 ];
+      }
+    return sum;
+    } );
+
+  // write_ply : binary cloud with colors and normals
+  cv::Mat points( nb_points, 1, CV_32FC3 ), colors( nb_points, 1, CV_8UC3 ), point_normals( nb_points, 1, CV_32FC3 );
+  for( int k = 0; k < nb_points; k++ )
+    {
+    points.at<cv::Vec3f>( k ) = plane[ k ];
+    colors.at<cv::Vec3b>( k ) = cv::Vec3b( k % 256, ( k / 256 ) % 256, 128 );
+    point_normals.at<cv::Vec3f>( k ) = cv::Vec3f( -0.1f, 0.2f, 1.f );
+    }
+  std::string filename = QDir::temp().filePath( "KernelBenchmark.ply" ).toStdString();
+  run_kernel( settings, "write_ply", name, nb_points, [&]()
+    {
+    return io_util::write_ply( filename, points, colors, point_normals );
+    } );
+  std::remove( filename.c_str() );
+
+  // write_archive, read_archive : compressed cloud with colors
+  std::string archive = QDir::temp().filePath( "KernelBenchmark.archive" ).toStdString();
+  run_kernel( settings, "write_archive", name, nb_points, [&]()
+    {
+    return io_util::write_archive( archive, points, colors );
+    } );
+  cv::Mat archive_points, archive_colors;
+  run_kernel( settings, "read_archive", name, nb_points, [&]()
+    {
+    return io_util::read_archive( archive, archive_points, archive_colors ) ? archive_points.rows : 0;
+    } );
+  std::remove( archive.c_str() );
+}
+
+// Approximate distance in millimeters to the ellipsoid, centered in the volume, on n^3 points
+static std::vector<float> synthetic_volume( int n )
+{
+  double spacing = VolumeExtent / ( n - 1 );
+  std::vector<float> values( static_cast<size_t>( n ) * n * n );
+  for( int k = 0; k < n; k++ )
+    {
+    for( int j = 0; j < n; j++ )
+      {
+      for( int i = 0; i < n; i++ )
+        {
+        cv::Vec3d p = cv::Vec3d( i, j, k ) * spacing - cv::Vec3d::all( VolumeExtent / 2 );
+        cv::Vec3d q( p[ 0 ] / EllipsoidRadii[ 0 ], p[ 1 ] / EllipsoidRadii[ 1 ], p[ 2 ] / EllipsoidRadii[ 2 ] );
+        values[ ( static_cast<size_t>( k ) * n + j ) * n + i ] = static_cast<float>( ( cv::norm( q ) - 1 ) * EllipsoidRadii[ 2 ] );
+        }
+      }
+    }
+  return values;
+}
+
+// Binary stl of the triangles of the mesh, without their normals
+static bool write_stl( std::string const& filename, TriangleMesh const& mesh )
+{
+  std::ofstream file( filename.c_str(), std::ios::binary );
+  char header[ 80 ] = {};
+  unsigned int nb_triangles = static_cast<unsigned int>( mesh.Triangles.size() );
+  file.write( header, sizeof( header ) );
+  file.write( reinterpret_cast<const char *>( &nb_triangles ), sizeof( nb_triangles ) );
+  const float normal[ 3 ] = { 0, 0, 0 };
+  const char attribute[ 2 ] = { 0, 0 };
+  for( auto iter = mesh.Triangles.cbegin(); iter != mesh.Triangles.cend(); ++iter )
+    {
+    file.write( reinterpret_cast<const char *>( normal ), sizeof( normal ) );
+    for( int k = 0; k < 3; k++ )
+      {
+      file.write( reinterpret_cast<const char *>( &mesh.Vertices[ ( *iter )[ k ] ][ 0 ] ), 3 * sizeof( float ) );
+      }
+    file.write( attribute, sizeof( attribute ) );
+    }
+  return file.good();
+}
+
+// Mean distance in millimeters between the registered scan and the points it was made from
+static double registration_error( std::vector<cv::Vec3f> const& scan, std::vector<cv::Vec3f> const& truth, cv::Matx44f const& pose )
+{
+  double sum = 0;
+  for( size_t k = 0; k < scan.size(); k++ )
+    {
+    cv::Vec3f const& v = scan[ k ];
+    cv::Vec3f moved( pose( 0, 0 ) * v[ 0 ] + pose( 0, 1 ) * v[ 1 ] + pose( 0, 2 ) * v[ 2 ] + pose( 0, 3 ),
+      pose( 1, 0 ) * v[ 0 ] + pose( 1, 1 ) * v[ 1 ] + pose( 1, 2 ) * v[ 2 ] + pose( 1, 3 ),
+      pose( 2, 0 ) * v[ 0 ] + pose( 2, 1 ) * v[ 1 ] + pose( 2, 2 ) * v[ 2 ] + pose( 2, 3 ) );
+    sum += cv::norm( moved - truth[ k ] );
+    }
+  return 1000 * sum / scan.size();
+}
+
+// Kernels of the model projected on the anatomy : extraction of the surface from a volume of
+// n^3 voxels, loading of the mesh, distance field, registration to a scan and rendering
+static void benchmark_model( BenchmarkSettings & settings, int n )
+{
+  std::string name = std::to_string( n ) + "^3";
+  std::vector<float> volume = synthetic_volume( n );
+  double spacing = VolumeExtent / ( n - 1 );
+  SurfaceExtractor extractor;
+  TriangleMesh mesh;
+  run_kernel( settings, "extract_iso_surface", name, static_cast<long long>( volume.size() ), [&]()
+    {
+    extractor.ExtractIsoSurface( cv::Vec3i( n, n, n ), cv::Vec3d::all( spacing ), cv::Vec3d::all( -VolumeExtent / 2 ), cv::Matx33d::eye(),
+      volume.data(), 0, &mesh );
+    return mesh.Triangles.size();
+    } );
+  // The kernel may be filtered out
+  extractor.ExtractIsoSurface( cv::Vec3i( n, n, n ), cv::Vec3d::all( spacing ), cv::Vec3d::all( -VolumeExtent / 2 ), cv::Matx33d::eye(),
+    volume.data(), 0, &mesh );
+  if( mesh.Triangles.empty() )
+    {
+    return;
+    }
+  if( mesh.Normals.size() != mesh.Vertices.size() )
+    {
+    MeshLoader::ComputeNormals( &mesh );
+    }
+  long long nb_triangles = static_cast<long long>( mesh.Triangles.size() );
+  long long nb_vertices = static_cast<long long>( mesh.Vertices.size() );
+
+  // MeshLoader : parsing and welding of an stl, then its cache
+  QString filename = QDir::temp().filePath( "KernelBenchmark.stl" );
+  write_stl( filename.toStdString(), mesh );
+  MeshLoader loader;
+  loader.SetUseCache( false );
+  TriangleMesh loaded;
+  run_kernel( settings, "mesh_load_stl", name, nb_triangles, [&]()
+    {
+    return loader.Load( filename, &loaded ) ? loaded.Vertices.size() : 0;
+    } );
+  QString cache = MeshLoader::GetCacheFilename( filename );
+  MeshLoader::SaveCache( cache, mesh );
+  run_kernel( settings, "mesh_load_cache", name, nb_triangles, [&]()
+    {
+    return MeshLoader::LoadCache( cache, &loaded ) ? loaded.Vertices.size() : 0;
+    } );
+  QFile::remove( filename );
+  QFile::remove( cache );
+
+  // SignedDistanceField : field of the model, then sampled at the points of a scan
+  SignedDistanceField field;
+  run_kernel( settings, "sdf_compute", name, nb_vertices, [&]()
+    {
+    return field.Compute( mesh.Vertices, mesh.Normals, FieldSpacing, FieldMargin );
+    } );
+  if( !field.IsValid() )
+    {
+    field.Compute( mesh.Vertices, mesh.Normals, FieldSpacing, FieldMargin );
+    }
+
+  // The scan is the model moved by 5 mm and 3 degrees, with 0.5 mm of noise
+  cv::RNG rng( BenchmarkSeed );
+  cv::Matx33f R;
+  cv::Rodrigues( cv::Vec3f( 0.03f, -0.04f, 0.02f ), R );
+  cv::Vec3f t( 0.003f, -0.002f, 0.003f );
+  std::vector<cv::Vec3f> scan( mesh.Vertices.size() );
+  for( size_t k = 0; k < scan.size(); k++ )
+    {
+    cv::Vec3f noise( static_cast<float>( rng.gaussian( 0.0005 ) ), static_cast<float>( rng.gaussian( 0.0005 ) ), static_cast<float>( rng.gaussian( 0.0005 ) ) );
+    scan[ k ] = R * mesh.Vertices[ k ] + t + noise;
+    }
+  run_kernel( settings, "sdf_sample", name, nb_vertices, [&]()
+    {
+    double sum = 0;
+    float distance;
+    cv::Vec3f gradient;
+    for( auto iter = scan.cbegin(); iter != scan.cend(); ++iter )
+      {
+      if( field.Sample( *iter, &distance, &gradient ) )
+        {
+        sum += distance;
+        }
+      }
+    return sum;
+    } );
+
+  // IcpRegistration : from the identity, with the normals of the mesh or with the field
+  IcpRegistration registration;
+  registration.SetModel( mesh.Vertices, mesh.Normals );
+  registration.SetDistanceField( &field );
+  const IcpRegistration::Metric metrics[ 2 ] = { IcpRegistration::PointToPlane, IcpRegistration::SignedDistance };
+  const char * kernels[ 2 ] = { "icp_point_to_plane", "icp_signed_distance" };
+  for( int m = 0; m < 2; m++ )
+    {
+    registration.SetMetric( metrics[ m ] );
+    cv::Matx44f pose;
+    BenchmarkResult * result = run_kernel( settings, kernels[ m ], name, nb_vertices, [&]()
+      {
+      pose = cv::Matx44f::eye();
+      registration.Register( scan, &pose );
+      return registration.GetRmsError();
+      } );
+    if( result != NULL )
+      {
+      result->Error = registration_error( scan, mesh.Vertices, pose );
+      std::cout << std::left << std::setw( 40 ) << "  registration error" << std::right << std::setw( 12 ) << std::setprecision( 3 ) << result->Error << " mm" << std::endl;
+      }
+    }
+
+  // MeshRenderer : the model 50 cm in front of the camera, at the resolution of the projector
+  MeshRenderer renderer;
+  renderer.SetCalibration( CompiledCalibration::Compile( synthetic_calibration( cv::Size( 1280, 960 ) ) ) );
+  renderer.SetSize( ProjectorWidth, ProjectorHeight );
+  cv::Matx44f placement = cv::Matx44f::eye();
+  placement( 2, 3 ) = 0.5f;
+  run_kernel( settings, "mesh_render", name, nb_triangles, [&]()
+    {
+    renderer.Render( mesh, placement );
+    return renderer.GetImage().constBits()[ 0 ];
+    } );
+}
+
+// Ellipsoid of the synthetic anatomy in meters, with its outward normals : nb_u vertices
+// around z on each of the nb_v rings from pole to pole
+static TriangleMesh synthetic_ellipsoid( int nb_u, int nb_v )
+{
+  TriangleMesh mesh;
+  cv::Vec3d radii = EllipsoidRadii * 0.001;
+  for( int j = 0; j < nb_v; j++ )
+    {
+    double theta = CV_PI * ( j + 0.5 ) / nb_v;
+    for( int i = 0; i < nb_u; i++ )
+      {
+      double phi = 2 * CV_PI * i / nb_u;
+      cv::Vec3d s( std::sin( theta ) * std::cos( phi ), std::sin( theta ) * std::sin( phi ), std::cos( theta ) );
+      mesh.Vertices.push_back( cv::Vec3f( s.mul( radii ) ) );
+      cv::Vec3d normal( s[ 0 ] / radii[ 0 ], s[ 1 ] / radii[ 1 ], s[ 2 ] / radii[ 2 ] );
+      mesh.Normals.push_back( cv::Vec3f( normal / cv::norm( normal ) ) );
+      }
+    }
+  for( int j = 0; j + 1 < nb_v; j++ )
+    {
+    for( int i = 0; i < nb_u; i++ )
+      {
+      int a = j * nb_u + i;
+      int b = j * nb_u + ( i + 1 ) % nb_u;
+      mesh.Triangles.push_back( cv::Vec3i( a, b, b + nb_u ) );
+      mesh.Triangles.push_back( cv::Vec3i( a, b + nb_u, a + nb_u ) );
+      }
+    }
+  return mesh;
+}
+
+// Compares the median time of the kernel to its target
+static void check_target( BenchmarkResult const* result, double target_ms )
+{
+  if( result == NULL )
+    {
+    return;
+    }
+  double ms = result->MedianNs * 1e-6;
+  std::cout << std::left << std::setw( 40 ) << "  target" << std::right << std::setw( 12 ) << std::setprecision( 3 ) << target_ms << " ms"
+    << ( ms <= target_ms ? "   met" : "   MISSED" ) << std::endl;
+}
+
+// Kernels at the sizes of the time targets : registration of a 50k points scan to a model
+// of 200k vertices, rendering of this model at the resolution of a 1080p projector
+static void benchmark_targets( BenchmarkSettings & settings )
+{
+  TriangleMesh mesh = synthetic_ellipsoid( TargetModelU, TargetModelV );
+
+  // Every fourth vertex, moved by 5 mm and 3 degrees, with 0.5 mm of noise
+  cv::RNG rng( BenchmarkSeed );
+  cv::Matx33f R;
+  cv::Rodrigues( cv::Vec3f( 0.03f, -0.04f, 0.02f ), R );
+  cv::Vec3f t( 0.003f, -0.002f, 0.003f );
+  std::vector<cv::Vec3f> scan, truth;
+  for( size_t k = 0; k < mesh.Vertices.size(); k += TargetScanStride )
+    {
+    cv::Vec3f noise( static_cast<float>( rng.gaussian( 0.0005 ) ), static_cast<float>( rng.gaussian( 0.0005 ) ), static_cast<float>( rng.gaussian( 0.0005 ) ) );
+    scan.push_back( R * mesh.Vertices[ k ] + t + noise );
+    truth.push_back( mesh.Vertices[ k ] );
+    }
+
+  std::string name = std::to_string( scan.size() / 1000 ) + "k/" + std::to_string( mesh.Vertices.size() / 1000 ) + "k";
+  IcpRegistration registration;
+  registration.SetModel( mesh.Vertices, mesh.Normals );
+  registration.SetMetric( IcpRegistration::PointToPlane );
+  cv::Matx44f pose;
+  BenchmarkResult * result = run_kernel( settings, "icp_point_to_plane", name, static_cast<long long>( scan.size() ), [&]()
+    {
+    pose = cv::Matx44f::eye();
+    registration.Register( scan, &pose );
+    return registration.GetRmsError();
+    } );
+  if( result != NULL )
+    {
+    result->Error = registration_error( scan, truth, pose );
+    std::cout << std::left << std::setw( 40 ) << "  registration error" << std::right << std::setw( 12 ) << std::setprecision( 3 ) << result->Error << " mm" << std::endl;
+    }
+  check_target( result, TargetIcpMs );
+
+  // The model 50 cm in front of the camera
+  cv::Size projector( TargetProjectorWidth, TargetProjectorHeight );
+  MeshRenderer renderer;
+  renderer.SetCalibration( CompiledCalibration::Compile( synthetic_calibration( cv::Size( 1280, 960 ), projector ) ) );
+  renderer.SetSize( projector.width, projector.height );
+  cv::Matx44f placement = cv::Matx44f::eye();
+  placement( 2, 3 ) = 0.5f;
+  result = run_kernel( settings, "mesh_render", std::to_string( projector.width ) + "x" + std::to_string( projector.height ),
+    static_cast<long long>( mesh.Triangles.size() ), [&]()
+    {
+    renderer.Render( mesh, placement );
+    return renderer.GetImage().constBits()[ 0 ];
+    } );
+  check_target( result, TargetRenderMs );
+}
+
+static bool write_results( std::string const& filename, std::vector<BenchmarkResult> const& results )
+{
+  std::ofstream file( filename.c_str() );
+  if( !file.is_open() )
+    {
+    std::cerr << "[KernelBenchmark] Impossible to open " << filename << std::endl;
+    return false;
+    }
+  file << "kernel,size,items,runs,median_ns,min_ns,max_ns,error" << std::endl;
+  for( auto iter = results.cbegin(); iter != results.cend(); ++iter )
+    {
+    file << iter->Kernel << "," << iter->Size << "," << iter->Items << "," << iter->Runs << std::fixed << std::setprecision( 0 )
+      << "," << iter->MedianNs << "," << iter->MinNs << "," << iter->MaxNs << std::setprecision( 4 ) << "," << iter->Error << std::endl;
+    }
+  return file.good();
+}
+
+// Median time and error of a kernel in a result file
+struct BaselineResult
+{
+  double MedianNs;
+  double Error;
+};
+
+// Results of a result file, by kernel and size
+static bool read_baseline( std::string const& filename, std::map<std::string, BaselineResult> & baseline )
+{
+  std::ifstream file( filename.c_str() );
+  if( !file.is_open() )
+    {
+    std::cerr << "[KernelBenchmark] Impossible to open " << filename << std::endl;
+    return false;
+    }
+  std::string line;
+  std::getline( file, line );
+  while( std::getline( file, line ) )
+    {
+    std::vector<std::string> fields;
+    std::istringstream stream( line );
+    std::string field;
+    while( std::getline( stream, field, ',' ) )
+      {
+      fields.push_back( field );
+      }
+    if( fields.size() < 5 )
+      {
+      continue;
+      }
+    BaselineResult result;
+    result.MedianNs = std::atof( fields[ 4 ].c_str() );
+    result.Error = ( fields.size() > 7 ? std::atof( fields[ 7 ].c_str() ) : -1 );
+    baseline[ fields[ 0 ] + "/" + fields[ 1 ] ] = result;
+    }
+  return true;
+}
+
+// Returns the number of regressions, in time or in error
+static int compare_baseline( std::vector<BenchmarkResult> const& results, std::map<std::string, BaselineResult> const& baseline, double tolerance )
+{
+  int nb_regressions = 0;
+  std::cout << std::endl << "Comparison with the baseline, tolerance " << tolerance * 100 << "%" << std::endl;
+  for( auto iter = results.cbegin(); iter != results.cend(); ++iter )
+    {
+    auto previous = baseline.find( iter->Kernel + "/" + iter->Size );
+    std::cout << std::left << std::setw( 28 ) << iter->Kernel << std::setw( 12 ) << iter->Size << std::right;
+    if( previous == baseline.end() || previous->second.MedianNs <= 0 )
+      {
+      std::cout << "   no baseline" << std::endl;
+      continue;
+      }
+    double ratio = iter->MedianNs / previous->second.MedianNs;
+    bool slower = ratio > 1 + tolerance;
+    std::cout << std::fixed << std::setprecision( 2 ) << std::setw( 8 ) << ratio << "x" << ( slower ? "   SLOWER" : "" );
+    // The error is only compared when both runs measured it
+    bool less_accurate = false;
+    if( iter->Error >= 0 && previous->second.Error >= 0 )
+      {
+      less_accurate = iter->Error > previous->second.Error * ( 1 + tolerance ) + 1e-3;
+      std::cout << std::setprecision( 3 ) << "   error " << previous->second.Error << " -> " << iter->Error << ( less_accurate ? "   LESS ACCURATE" : "" );
+      }
+    std::cout << std::endl;
+    nb_regressions += ( slower || less_accurate ? 1 : 0 );
+    }
+  return nb_regressions;
+}
+
+int main( int argc, char *argv[] )
+{
+  BenchmarkSettings settings;
+  settings.MinTime = 0.5;
+  bool quick = false;
+  std::string output = "KernelBenchmark.csv";
+  std::string baseline;
+  double tolerance = 0.1;
+  for( int i = 1; i < argc; i++ )
+    {
+    std::string arg = argv[ i ];
+    bool has_value = i + 1 < argc;
+    if( arg == "--quick" )
+      {
+      quick = true;
+      settings.MinTime = 0.1;
+      }
+    else if( arg == "--filter" && has_value )
+      {
+      settings.Filter = argv[ ++i ];
+      }
+    else if( arg == "--output" && has_value )
+      {
+      output = argv[ ++i ];
+      }
+    else if( arg == "--baseline" && has_value )
+      {
+      baseline = argv[ ++i ];
+      }
+    else if( arg == "--tolerance" && has_value )
+      {
+      tolerance = std::atof( argv[ ++i ] );
+      }
+    else
+      {
+      std::cerr << "Usage : " << argv[ 0 ] << " [--quick] [--filter name] [--output results.csv] [--baseline baseline.csv] [--tolerance 0.1]" << std::endl;
+      return 2;
+      }
+    }
+
+  std::map<std::string, BaselineResult> baseline_results;
+  if( !baseline.empty() && !read_baseline( baseline, baseline_results ) )
+    {
+    return 2;
+    }
+
+  std::vector<cv::Size> resolutions = { cv::Size( 640, 480 ), cv::Size( 1280, 960 ), cv::Size( 2048, 1536 ) };
+  std::vector<int> point_counts = { 10000, 100000, 1000000 };
+  std::vector<int> volume_sizes = { 64, 128, 256 };
+  if( quick )
+    {
+    resolutions.resize( 1 );
+    point_counts.resize( 2 );
+    volume_sizes.resize( 1 );
+    }
+
+  CameraInput camera;
+  for( auto iter = resolutions.cbegin(); iter != resolutions.cend(); ++iter )
+    {
+    benchmark_resolution( settings, *iter, camera );
+    }
+  for( auto iter = point_counts.cbegin(); iter != point_counts.cend(); ++iter )
+    {
+    benchmark_point_count( settings, *iter );
+    }
+  for( auto iter = volume_sizes.cbegin(); iter != volume_sizes.cend(); ++iter )
+    {
+    benchmark_model( settings, *iter );
+    }
+  benchmark_targets( settings );
+
+  if( !write_results( output, settings.Results ) )
+    {
+    return 2;
+    }
+  std::cout << "Results saved in " << output << std::endl;
+  if( !baseline.empty() && compare_baseline( settings.Results, baseline_results, tolerance ) > 0 )
+    {
+    return 1;
+    }
+  return 0;
+}
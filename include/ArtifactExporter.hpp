@@ -0,0 +1,106 @@
+/*=========================================================================
+
+Library:   AnatomicAugmentedRealityProjector
+
+Author: Maeliss Jallais
+
+Copyright 2010 Kitware Inc. 28 Corporate Drive,
+Clifton Park, NY, 12065, USA.
+
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+=========================================================================*/
+
+
+#ifndef __ARTIFACTEXPORTER_HPP__
+#define __ARTIFACTEXPORTER_HPP__
+
+#include <QString>
+
+#include <opencv2/core/core.hpp>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Output of the analysis : point clouds, debug images and results, written by a background
+// thread so that the analysis never waits for the disk. Each kind of artifact has its own
+// output directory and can be disabled, in which case the analysis should not even build it.
+// The settings are meant to be changed from one thread, the one queuing the artifacts.
+class ArtifactExporter
+{
+public:
+  static const int EXPORT_SETTINGS_VERSION = 1;
+
+  enum Artifact { PointCloud = 0, ColorClasses, Centers, Planes, ScanImage, ColorImage, Results, NbArtifacts };
+
+  ArtifactExporter();
+  // Writes what is still queued
+  ~ArtifactExporter();
+
+  // Sets the directory of all the artifacts
+  void SetDirectory( QString const& directory );
+  void SetDirectory( Artifact artifact, QString const& directory ) { this->Directories[ artifact ] = directory; };
+  QString GetDirectory( Artifact artifact ) const { return this->Directories[ artifact ]; };
+  void SetEnabled( Artifact artifact, bool enabled ) { this->Enabled[ artifact ] = enabled; };
+  bool IsEnabled( Artifact artifact ) const { return this->Enabled[ artifact ]; };
+
+  // The settings missing in the file keep their value
+  bool LoadSettings( QString const& filename );
+  bool SaveSettings( QString const& filename ) const;
+
+  // The data is copied : it can be modified as soon as the call returns.
+  // Nothing is done if the artifact is disabled.
+  void ExportPointCloud( Artifact artifact, QString const& name, cv::Mat const& points, cv::Mat const& colors );
+  void ExportImage( Artifact artifact, QString const& name, cv::Mat const& image );
+  void ExportText( Artifact artifact, QString const& name, std::string const& text );
+
+  // Waits until everything queued is written
+  void Flush();
+
+private:
+  ArtifactExporter( ArtifactExporter const& );
+  ArtifactExporter & operator=( ArtifactExporter const& );
+
+  enum JobType { PlyJob, ImageJob, TextJob };
+  struct Job
+    {
+    JobType Type;
+    QString Filename;
+    cv::Mat Points;
+    cv::Mat Colors;
+    cv::Mat Image;
+    std::string Text;
+    };
+
+  QString GetFilename( Artifact artifact, QString const& name, const char * extension ) const;
+  void Queue( Job const& job );
+  void Write();
+
+  QString Directories[ NbArtifacts ];
+  bool Enabled[ NbArtifacts ];
+
+  std::mutex Mutex;
+  std::condition_variable Queued;
+  std::condition_variable Done;
+  std::deque<Job> Jobs;
+  bool Writing;
+  bool Stop;
+  std::thread Writer;
+};
+
+#endif //__ARTIFACTEXPORTER_HPP__
@@ -52,7 +52,7 @@ public:
 
   bool SaveCalibrationMatlab(QString const& filename);
 
-  void Display(std::ostream & stream = std::cout) const;
+  void Display(std::ostream & stream) const;
 
   //data
   cv::Mat Cam_K;
@@ -0,0 +1,102 @@
+/*=========================================================================
+
+Library:   AnatomicAugmentedRealityProjector
+
+Author: Maeliss Jallais
+
+Copyright 2010 Kitware Inc. 28 Corporate Drive,
+Clifton Park, NY, 12065, USA.
+
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+=========================================================================*/
+
+
+#ifndef __CALIBRATIONRUNTIME_HPP__
+#define __CALIBRATIONRUNTIME_HPP__
+
+#include "CalibrationData.hpp"
+
+#include <QFileSystemWatcher>
+#include <QObject>
+#include <QString>
+
+#include <opencv2/core/core.hpp>
+
+#include <memory>
+
+// Calibration in the form used by the reconstruction and the rendering, computed once per
+// load : fixed size intrinsics and extrinsics and the transforms between the camera and
+// the projector frames ( X_proj = R * X_cam + T ). It is never modified once built, so it
+// can be read by any number of threads. Every load gets a new version : a table computed
+// from a calibration keeps its version to know when it has to be computed again.
+struct CompiledCalibration
+{
+  cv::Matx33d CamK;
+  cv::Vec<double, 5> CamKc;
+  cv::Matx33d ProjK;
+  cv::Vec<double, 5> ProjKc;
+  cv::Matx33d R;
+  cv::Vec3d T;
+  // Inverse rotation, projector to camera
+  cv::Matx33d Rt;
+  // Projector center in the camera frame : -Rt * T
+  cv::Vec3d ProjectorCenter;
+  cv::Matx44d CameraToProjector;
+  cv::Matx44d ProjectorToCamera;
+
+  double CamError;
+  double ProjError;
+  double StereoError;
+  QString Filename;
+  // Never 0
+  uint64 Version;
+
+  // Returns NULL if the calibration is not valid
+  static std::shared_ptr<const CompiledCalibration> Compile( CalibrationData const& data );
+};
+
+// Current calibration, read again when its file changes. The new calibration replaces the
+// previous one at once : a reader keeps the calibration it got for as long as it needs it,
+// so a scan started before the change ends with the calibration it started with.
+// The directory of the file is watched too : an editor that replaces the file removes it
+// for a moment, the watch of the file is then lost and is restored when the file is back.
+class CalibrationRuntime : public QObject
+{
+  Q_OBJECT
+
+public:
+  CalibrationRuntime( QObject * parent = 0 );
+
+  // Loads the file and watches it. The previous calibration is kept if the file is invalid.
+  bool Load( QString const& filename );
+
+  // Safe to call from any thread, NULL before the first valid load
+  std::shared_ptr<const CompiledCalibration> Get() const;
+
+signals:
+  void CalibrationChanged( quint64 version );
+
+protected slots:
+  void FileChanged( QString const& filename );
+  void DirectoryChanged( QString const& directory );
+
+private:
+  QFileSystemWatcher Watcher;
+  QString Filename;
+  std::shared_ptr<const CompiledCalibration> Current;
+};
+
+#endif //__CALIBRATIONRUNTIME_HPP__
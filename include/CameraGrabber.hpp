@@ -0,0 +1,94 @@
+/*=========================================================================
+
+Library:   AnatomicAugmentedRealityProjector
+
+Author: Maeliss Jallais
+
+Copyright 2010 Kitware Inc. 28 Corporate Drive,
+Clifton Park, NY, 12065, USA.
+
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+=========================================================================*/
+
+
+#ifndef __CAMERAGRABBER_HPP__
+#define __CAMERAGRABBER_HPP__
+
+#include "CameraInput.hpp"
+
+#include <QObject>
+
+#include <opencv2/core/core.hpp>
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+// Live preview of the camera : the frames are retrieved by a background thread and only the
+// last one is kept. FrameReady is emitted when a frame arrives and the previous one was taken,
+// so the frames the GUI does not have time to show are dropped instead of being queued.
+// The camera must not be used by another thread while the grabber runs.
+// After a failed retrieval the grabber waits before the next one, longer after every failure,
+// and it stops after MAX_FAILURES failures in a row.
+class CameraGrabber : public QObject
+{
+  Q_OBJECT
+
+public:
+  static const int MAX_FAILURES = 20;
+  // Wait after the first failure, doubled after every failure up to MAX_BACKOFF_MS
+  static const int MIN_BACKOFF_MS = 10;
+  static const int MAX_BACKOFF_MS = 500;
+
+  // Called in the thread of the grabber with every frame before it is shown, so that the
+  // frame processed is the frame shown. It must not modify the frame.
+  typedef std::function<void( cv::Mat const& frame )> FrameHandler;
+
+  CameraGrabber( QObject * parent = 0 );
+  ~CameraGrabber();
+
+  // The handler is optional
+  void Start( CameraInput * camera, FrameHandler const& handler = FrameHandler() );
+  // Waits for the frame being retrieved
+  void Stop();
+  // False once the grabber stopped after failures, it can then be started again
+  bool IsRunning() const { return this->Grabber.joinable() && !this->Failed; };
+
+  // Returns false if there is no new frame since the last call
+  bool TakeFrame( cv::Mat & frame );
+  // Frame retrieved by a thread that uses the camera while the grabber is stopped, shown the
+  // same way. The frame must not be modified afterwards.
+  void PostFrame( cv::Mat const& frame );
+
+signals:
+  void FrameReady();
+
+private:
+  void Grab();
+
+  CameraInput * Camera;
+  FrameHandler Handler;
+  std::mutex Mutex;
+  cv::Mat Frame;
+  bool NewFrame;
+  std::atomic<bool> Pending;
+  std::atomic<bool> Stopping;
+  std::atomic<bool> Failed;
+  std::thread Grabber;
+};
+
+#endif //__CAMERAGRABBER_HPP__
@@ -23,6 +23,9 @@ limitations under the License.
 
 =========================================================================*/
 
+#ifndef __CAMERAINPUT_HPP__
+#define __CAMERAINPUT_HPP__
+
 #include "FlyCapture2.h"
 
 #include <QThread>
@@ -75,3 +78,5 @@ private :
   std::vector<cv::Mat> FrameBuffer;
   int BufferSize;
 };
+
+#endif //__CAMERAINPUT_HPP__
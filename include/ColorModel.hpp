@@ -0,0 +1,104 @@
+/*=========================================================================
+
+Library:   AnatomicAugmentedRealityProjector
+
+Author: Maeliss Jallais
+
+Copyright 2010 Kitware Inc. 28 Corporate Drive,
+Clifton Park, NY, 12065, USA.
+
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+=========================================================================*/
+
+#ifndef __COLORMODEL_HPP__
+#define __COLORMODEL_HPP__
+
+#include <QString>
+#include <QStringList>
+
+#include <opencv2/core/core.hpp>
+
+#include <iostream>
+
+// Gaussian model of the BGR color of one face of the fiducial cube
+struct ColorModel
+{
+  cv::Vec3d Mean;
+  cv::Matx33d Covariance;
+};
+
+// Streaming mean / covariance estimator (Welford). Accumulators computed on
+// separate images can be combined with Merge() without a second pass.
+class ColorModelAccumulator
+{
+public:
+  ColorModelAccumulator();
+
+  void Add( cv::Vec3b const& bgr );
+  void Merge( ColorModelAccumulator const& other );
+
+  long long GetCount() const { return this->Count; };
+  // Population covariance, same as calcCovarMatrix with CV_COVAR_SCALE
+  ColorModel GetModel() const;
+
+private:
+  long long Count;
+  cv::Vec3d Mean;
+  cv::Matx33d M2;
+};
+
+class ColorModelSet
+{
+public:
+  static const int COLOR_MODEL_FILE_VERSION = 1;
+
+  enum ColorClass { Blue = 0, Green = 1, Red = 2, NbClasses = 3 };
+
+  ColorModelSet();
+
+  // Models measured on the curved cube, used when no trained file is available
+  void SetDefault();
+
+  bool LoadColorModels( QString const& filename );
+  bool SaveColorModels( QString const& filename ) const;
+
+  // Single pass over every pixel of every image, images processed in parallel.
+  // A pixel is a sample of class c when channel c is the strongest one and is above min_intensity.
+  bool Train( QStringList const& imagenames, int min_intensity = 20 );
+
+  void Display( std::ostream & stream ) const;
+
+  // Gaussian density of the color for class c, same as itk::Statistics::GaussianMembershipFunction
+  double Evaluate( ColorClass c, cv::Vec3b const& bgr ) const;
+  // Class of highest density, or -1 if every density is below threshold.
+  // Ties are resolved green first, then blue, then red. Safe to call from several threads.
+  int Classify( cv::Vec3b const& bgr, double threshold = 1e-9 ) const;
+
+  ColorModel const& GetModel( ColorClass c ) const { return this->Models[ c ]; };
+  long long GetNbSamples( ColorClass c ) const { return this->NbSamples[ c ]; };
+  QString GetFilename() const { return this->Filename; };
+
+private:
+  void UpdateDensities();
+
+  ColorModel Models[ NbClasses ];
+  cv::Matx33d InverseCovariance[ NbClasses ];
+  double Normalization[ NbClasses ];
+  long long NbSamples[ NbClasses ];
+  QString Filename;
+};
+
+#endif //__COLORMODEL_HPP__
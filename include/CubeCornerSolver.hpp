@@ -0,0 +1,90 @@
+/*=========================================================================
+
+Library:   AnatomicAugmentedRealityProjector
+
+Author: Maeliss Jallais
+
+Copyright 2010 Kitware Inc. 28 Corporate Drive,
+Clifton Park, NY, 12065, USA.
+
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+=========================================================================*/
+
+#ifndef __CUBECORNERSOLVER_HPP__
+#define __CUBECORNERSOLVER_HPP__
+
+#include <opencv2/core/core.hpp>
+
+#include <vector>
+
+// Joint RANSAC fit of the three mutually orthogonal faces of the fiducial cube.
+// Every hypothesis is an orthogonal frame built from a minimal sample of 6 points :
+// 3 points on a first face, 2 on a second one (plane orthogonal to the first) and 1 on
+// the last one (plane orthogonal to both). The three point sets are scored in one pass
+// and the best frame is refined by Gauss-Newton on all the inliers.
+class CubeCornerSolver
+{
+public:
+  enum Face { Blue = 0, Red = 1, Green = 2, NbFaces = 3 };
+
+  CubeCornerSolver( uint64 seed = 0x2545F4914F6CDD1DULL );
+
+  void SetSeed( uint64 seed );
+
+  void SetMaxIterations( int iter ) { this->MaxIterations = iter; };
+  void SetThreshold( float thres ) { this->Threshold = thres; };
+  void SetMinInliers( int min_inliers ) { this->MinInliers = min_inliers; };
+  void SetConfidence( double confidence ) { this->Confidence = confidence; };
+
+  // Returns false if no frame with at least MinInliers inliers on every face was found
+  bool Fit( std::vector<cv::Vec3f> const& points_B, std::vector<cv::Vec3f> const& points_R, std::vector<cv::Vec3f> const& points_G );
+
+  cv::Vec3f GetCorner() const { return this->Corner; };
+  // Columns are the unit normals of the blue, red and green faces, oriented towards the camera
+  cv::Matx33f GetFrame() const { return this->Frame; };
+  cv::Vec3f GetNormal( Face face ) const { return cv::Vec3f( this->Frame( 0, face ), this->Frame( 1, face ), this->Frame( 2, face ) ); };
+  // Covariance of the corner position, from the residuals of the refinement
+  cv::Matx33f GetCovariance() const { return this->Covariance; };
+  int GetNbInliers( Face face ) const { return this->NbInliers[ face ]; };
+  int GetNbIterations() const { return this->NbIterations; };
+
+  // Intersection of the three planes of normal n through x, for any three planes.
+  // Returns false if two of the planes are parallel.
+  static bool IntersectPlanes( cv::Vec3f const& n1, cv::Vec3f const& n2, cv::Vec3f const& n3,
+    cv::Vec3f const& x1, cv::Vec3f const& x2, cv::Vec3f const& x3, cv::Vec3f & point );
+
+private:
+  int Score( cv::Matx33f const& frame, cv::Vec3f const& corner, int inliers[ NbFaces ] ) const;
+  void Refine( cv::Matx33d & frame, cv::Vec3d & corner );
+
+  cv::RNG Rng;
+  int MaxIterations;
+  float Threshold;
+  int MinInliers;
+  double Confidence;
+
+  // The three faces one after the other, structure of arrays
+  std::vector<float> X, Y, Z;
+  int Begin[ NbFaces + 1 ];
+
+  cv::Vec3f Corner;
+  cv::Matx33f Frame;
+  cv::Matx33f Covariance;
+  int NbInliers[ NbFaces ];
+  int NbIterations;
+};
+
+#endif //__CUBECORNERSOLVER_HPP__
@@ -0,0 +1,98 @@
+/*=========================================================================
+
+Library:   AnatomicAugmentedRealityProjector
+
+Author: Maeliss Jallais
+
+Copyright 2010 Kitware Inc. 28 Corporate Drive,
+Clifton Park, NY, 12065, USA.
+
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+=========================================================================*/
+
+#ifndef __DENSITYPEAKFINDER_HPP__
+#define __DENSITYPEAKFINDER_HPP__
+
+#include "MemoryTracker.hpp"
+#include "PointCloudIndex.hpp"
+#include "Vec3iHash.hpp"
+
+#include <opencv2/core/core.hpp>
+
+#include <vector>
+
+// 3D mode of a point set. The points are binned in a sparse voxel grid, the counts are
+// blurred with a separable Gaussian and the densest voxel is refined by a few mean-shift
+// steps. The points are indexed by a PointCloudIndex, kept after SetPoints, for the
+// mean-shift and the radius queries.
+// The voxels are visited in the order of their keys, never in the order of the hash maps :
+// the sums and the ties, thus the peak, do not depend on the history of the maps.
+class DensityPeakFinder
+{
+public:
+  DensityPeakFinder();
+
+  // Size of the voxels, in the unit of the points (0.01 : 1 cm with coordinates in m)
+  void SetVoxelSize( float size ) { this->VoxelSize = size; };
+  // Standard deviation of the blur, in voxels
+  void SetSigma( float sigma ) { this->Sigma = sigma; };
+  // Radius of the flat mean-shift kernel, in the unit of the points
+  void SetBandwidth( float bandwidth ) { this->Bandwidth = bandwidth; };
+  void SetMaxMeanShiftIterations( int iter ) { this->MaxMeanShiftIterations = iter; };
+
+  float GetVoxelSize() const { return this->VoxelSize; };
+  float GetSigma() const { return this->Sigma; };
+  float GetBandwidth() const { return this->Bandwidth; };
+
+  // Copies and indexes the points. Must be called before FindPeak and RadiusSearch.
+  void SetPoints( MemoryTracker::Vector<cv::Vec3f> const& points );
+
+  // Returns false if there is no point
+  bool FindPeak( cv::Vec3f & peak );
+
+  // Flat kernel mean-shift from start, stopped after MaxMeanShiftIterations steps or
+  // when the shift becomes negligible
+  cv::Vec3f MeanShift( cv::Vec3f const& start, float bandwidth ) const;
+
+  // Indices of the points closer than radius to center. The indices refer to GetPoint.
+  void RadiusSearch( cv::Vec3f const& center, float radius, std::vector<int> & indices ) const;
+
+  int GetNbPoints() const { return static_cast<int>( this->Points.size() ); };
+  // Points in the order given to SetPoints
+  cv::Vec3f const& GetPoint( int i ) const { return this->Points[ i ]; };
+
+private:
+  typedef MemoryTracker::UnorderedMap<cv::Vec3i, float, Vec3iHash> DensityGrid;
+
+  cv::Vec3i Voxel( cv::Vec3f const& point ) const;
+  void SortKeys( DensityGrid const& grid );
+  void Blur( DensityGrid const& input, int axis, DensityGrid & output );
+
+  float VoxelSize;
+  float Sigma;
+  float Bandwidth;
+  int MaxMeanShiftIterations;
+  std::vector<float> Kernel;
+
+  // Copies of the points, accounted to the stage of SetPoints
+  MemoryTracker::Vector<cv::Vec3f> Points;
+  PointCloudIndex Index;
+
+  DensityGrid Density[ 2 ];
+  MemoryTracker::Vector<cv::Vec3i> SortedKeys;
+};
+
+#endif //__DENSITYPEAKFINDER_HPP__
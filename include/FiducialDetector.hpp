@@ -0,0 +1,102 @@
+/*=========================================================================
+
+Library:   AnatomicAugmentedRealityProjector
+
+Author: Maeliss Jallais
+
+Copyright 2010 Kitware Inc. 28 Corporate Drive,
+Clifton Park, NY, 12065, USA.
+
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+=========================================================================*/
+
+#ifndef __FIDUCIALDETECTOR_HPP__
+#define __FIDUCIALDETECTOR_HPP__
+
+#include "ColorModel.hpp"
+#include "CubeCornerSolver.hpp"
+#include "DensityPeakFinder.hpp"
+#include "PointCloudIndex.hpp"
+
+#include <opencv2/core/core.hpp>
+
+#include <vector>
+
+// Corner of the fiducial cube in a scanned point cloud, with the two methods of the
+// detection study :
+// M1 - the three faces are fitted on the points of each color around the face centers
+// M2 - the three faces are fitted on all the points of small circles around the face centers
+// A detector owns all its buffers : use one detector per thread.
+class FiducialDetector
+{
+public:
+  FiducialDetector( uint64 seed = 0x2545F4914F6CDD1DULL );
+
+  void SetSeed( uint64 seed ) { this->Solver.SetSeed( seed ); };
+  void SetColorModels( ColorModelSet const* models ) { this->ColorModels = models; };
+  // Radius of the selection around the face centers for M1
+  void SetFaceRadius( float radius ) { this->FaceRadius = radius; };
+  // Radius of the circles around the face centers for M2
+  void SetCircleRadius( float radius ) { this->CircleRadius = radius; };
+
+  // Returns false if a step of the detection failed
+  bool Detect( std::vector<cv::Vec3f> const& points, std::vector<cv::Vec3b> const& colors );
+  // Same as Detect, starting from the centers of the last detection instead of the density
+  // peaks. Meant for the few points around a corner that moved a little.
+  bool Refine( std::vector<cv::Vec3f> const& points, std::vector<cv::Vec3b> const& colors );
+
+  cv::Vec3f GetCenter( CubeCornerSolver::Face face ) const { return this->Centers[ face ]; };
+  cv::Vec3f GetCorner() const { return this->Corner; };
+  cv::Vec3f GetCircleCorner() const { return this->CircleCorner; };
+
+  // Mean of the points of the finder closer than dist to both c1 and c2, with an x coordinate
+  // above min_x. The previous center is returned if there is no such point.
+  static cv::Vec3f MeanNearCenters( DensityPeakFinder const& finder, cv::Vec3f const& c1, cv::Vec3f const& c2, float dist,
+    cv::Vec3f const& previous, std::vector<int> & neighbors, float min_x = -9999 );
+
+  // Valid points of an organized cloud sorted by the color models, the 2 pixels of the borders
+  // excepted ( a cloud read back from a file is a single column without borders ). A point is in
+  // the face of highest density if it is above 1e-9. The points are appended to the faces and
+  // box_min / box_max are extended to the valid points. classes, if not empty, gets the color of
+  // the face of every valid point, white for the others.
+  static void ClassifyCloud( cv::Mat const& pointcloud, cv::Mat const& pointcloud_BGR, ColorModelSet const& models,
+    MemoryTracker::Vector<cv::Vec3f> * points_B, MemoryTracker::Vector<cv::Vec3f> * points_G, MemoryTracker::Vector<cv::Vec3f> * points_R,
+    cv::Vec3f * box_min, cv::Vec3f * box_max, cv::Mat classes = cv::Mat() );
+
+private:
+  void ClassifyPoints( std::vector<cv::Vec3f> const& points, std::vector<cv::Vec3b> const& colors );
+  // Pulls the centers towards the corner from start_dist, then fits M1 and M2
+  bool FitCorner( std::vector<cv::Vec3f> const& points, float start_dist );
+
+  ColorModelSet const* ColorModels;
+  float FaceRadius;
+  float CircleRadius;
+
+  DensityPeakFinder PeakFinders[ CubeCornerSolver::NbFaces ];
+  PointCloudIndex CloudIndex;
+  CubeCornerSolver Solver;
+
+  MemoryTracker::Vector<cv::Vec3f> FacePoints[ CubeCornerSolver::NbFaces ];
+  std::vector<cv::Vec3f> Selected[ CubeCornerSolver::NbFaces ];
+  std::vector<int> Neighbors;
+  std::vector< std::vector<int> > Circles;
+
+  cv::Vec3f Centers[ CubeCornerSolver::NbFaces ];
+  cv::Vec3f Corner;
+  cv::Vec3f CircleCorner;
+};
+
+#endif //__FIDUCIALDETECTOR_HPP__
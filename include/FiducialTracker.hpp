@@ -0,0 +1,106 @@
+/*=========================================================================
+
+Library:   AnatomicAugmentedRealityProjector
+
+Author: Maeliss Jallais
+
+Copyright 2010 Kitware Inc. 28 Corporate Drive,
+Clifton Park, NY, 12065, USA.
+
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+=========================================================================*/
+
+
+#ifndef __FIDUCIALTRACKER_HPP__
+#define __FIDUCIALTRACKER_HPP__
+
+#include "ColorModel.hpp"
+#include "FiducialDetector.hpp"
+#include "LineScanner.hpp"
+
+#include <opencv2/core/core.hpp>
+
+#include <vector>
+
+// Live tracking of the corner of the fiducial cube. The lines of the sweep are accumulated
+// over the whole image until a full detection succeeds. The corner is then tracked : the
+// lines are only searched in the camera region where the cube was seen, and the corner is
+// refined from the points of the last lines around it. The tracking is lost after too many
+// misses, lines without points around the corner or failed refinements, and the full
+// detection starts again.
+class FiducialTracker
+{
+public:
+  FiducialTracker();
+
+  void SetSeed( uint64 seed ) { this->Detector.SetSeed( seed ); };
+  void SetScanner( LineScanner const& scanner ) { this->Scanner = scanner; };
+  void SetColorModels( ColorModelSet const* models ) { this->Detector.SetColorModels( models ); };
+  // Half size of the box kept around the corner, in the unit of the point cloud
+  void SetCubeSize( float size ) { this->CubeSize = size; };
+  // Margin added around the projection of the box, in pixels
+  void SetMargin( int margin ) { this->Margin = margin; };
+  // While the corner is not tracked, number of new lines stored between two attempts of the
+  // full detection, 60 by default : the detection runs on all the stored lines, a few more
+  // lines rarely change its result. Once tracking, the corner is refined at every line.
+  void SetDetectionInterval( int nb ) { this->DetectionInterval = nb; };
+  // Number of consecutive misses after which the tracking is lost
+  void SetMaxMisses( int nb ) { this->MaxMisses = nb; };
+
+  // Forgets the lines and the corner
+  void Reset();
+  // Processes one camera frame. Returns true if the corner was updated.
+  bool Update( cv::Mat const& mat_color_ref, cv::Mat const& mat_color );
+
+  bool IsTracking() const { return this->Tracking; };
+  // Camera region where the lines are searched, the whole image if the corner is not tracked
+  cv::Rect GetRoi() const { return this->Roi; };
+  cv::Vec3f GetCorner() const { return this->Corner; };
+  cv::Vec3f GetCircleCorner() const { return this->CircleCorner; };
+
+private:
+  // Stores the line in place of the previous line of the same projector row
+  void StoreLine();
+  // Points of the stored lines, only inside the box around the corner when tracking
+  void GatherPoints();
+  // Camera region of the box around the corner. Returns false if it is outside of the image.
+  bool UpdateRoi( cv::Size const& image_size );
+  bool InBox( cv::Vec3f const& point ) const;
+
+  LineScanner Scanner;
+  FiducialDetector Detector;
+  float CubeSize;
+  int Margin;
+  int DetectionInterval;
+  int MaxMisses;
+
+  bool Tracking;
+  int NbMisses;
+  int NbNewLines;
+  cv::Rect Roi;
+  cv::Vec3f Corner;
+  cv::Vec3f CircleCorner;
+
+  // Last line of every projector row
+  std::vector<ScanLine> Lines;
+  ScanLine Current;
+  std::vector<cv::Vec3f> Points;
+  std::vector<cv::Vec3b> Colors;
+  std::vector<cv::Vec3f> BoxCorners;
+  std::vector<cv::Point2f> BoxPixels;
+};
+
+#endif //__FIDUCIALTRACKER_HPP__
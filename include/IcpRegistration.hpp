@@ -0,0 +1,131 @@
+/*=========================================================================
+
+Library:   AnatomicAugmentedRealityProjector
+
+Author: Maeliss Jallais
+
+Copyright 2010 Kitware Inc. 28 Corporate Drive,
+Clifton Park, NY, 12065, USA.
+
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+=========================================================================*/
+
+
+#ifndef __ICPREGISTRATION_HPP__
+#define __ICPREGISTRATION_HPP__
+
+#include "PointCloudIndex.hpp"
+#include "SignedDistanceField.hpp"
+
+#include <opencv2/core/core.hpp>
+
+#include <vector>
+
+// Rigid registration of a scanned surface on a reference model by Iterative Closest Point.
+// The model is indexed once by a KD-tree, then every scan is aligned starting from the
+// given pose, typically the one of the previous scan. The scan is subsampled on the coarse
+// levels, the correspondences farther than the maximum distance or among the worst ones are
+// rejected, and the 6x6 normal equations are accumulated in parallel over fixed blocks of
+// points so that the result does not depend on the number of threads.
+// With the SignedDistance metric, the closest points are replaced by a precomputed signed
+// distance field of the model : every scan point costs one trilinear sample of the field and
+// of its gradient, and the iterations are Gauss-Newton steps on the sampled distances.
+class IcpRegistration
+{
+public:
+  enum Metric { PointToPoint = 0, PointToPlane = 1, SignedDistance = 2 };
+
+  IcpRegistration();
+
+  void SetMetric( Metric metric ) { this->Method = metric; };
+  // Maximum number of iterations of every level
+  void SetMaxIterations( int iter ) { this->MaxIterations = iter; };
+  // The coarsest level uses one scan point every factor^(nb_levels - 1)
+  void SetNbLevels( int nb ) { this->NbLevels = nb; };
+  void SetSubsamplingFactor( int factor ) { this->SubsamplingFactor = factor; };
+  // Correspondences farther than the distance are rejected, in the unit of the clouds
+  void SetMaxDistance( float distance ) { this->MaxDistance = distance; };
+  // Fraction of the closest correspondences used at every iteration
+  void SetTrimRatio( float ratio ) { this->TrimRatio = ratio; };
+  // The iterations of a level stop when the update is smaller than the tolerance
+  void SetTolerance( double tolerance ) { this->Tolerance = tolerance; };
+  // Neighbors used to estimate the normals of the model
+  void SetNbNormalNeighbors( int nb ) { this->NbNormalNeighbors = nb; };
+
+  // Reference model. The normals are estimated if none are given.
+  void SetModel( std::vector<cv::Vec3f> const& points, std::vector<cv::Vec3f> const& normals = std::vector<cv::Vec3f>() );
+  std::vector<cv::Vec3f> const& GetModelNormals() const { return this->ModelNormals; };
+  // Field used by the SignedDistance metric, instead of the model
+  void SetDistanceField( SignedDistanceField const* field ) { this->DistanceField = field; };
+
+  // Rigid transform such that pose * scan lies on the model. pose is used as the initial guess.
+  // Returns false if there were not enough correspondences.
+  bool Register( std::vector<cv::Vec3f> const& scan, cv::Matx44f * pose );
+
+  // Of the last registration
+  double GetRmsError() const { return this->RmsError; };
+  int GetNbIterations() const { return this->NbIterations; };
+  int GetNbCorrespondences() const { return this->NbCorrespondences; };
+
+  // Normals by principal component analysis of the k nearest neighbors, oriented towards the origin
+  static void EstimateNormals( PointCloudIndex const& index, std::vector<cv::Vec3f> const& points, int k, std::vector<cv::Vec3f> & normals );
+
+private:
+  // Sums of one block of correspondences
+  struct NormalEquations
+    {
+    cv::Matx66d A;
+    cv::Vec6d b;
+    double Error2;
+    int NbPoints;
+    };
+
+  // Correspondences of the moved source points, then the trimming threshold, negative if there is none
+  float MatchPoints( cv::Matx33d const& R, cv::Vec3d const& t );
+  // Solves the linearized problem. Returns false if the system is singular.
+  bool SolveIncrement( float threshold, cv::Vec6d & x );
+
+  Metric Method;
+  int MaxIterations;
+  int NbLevels;
+  int SubsamplingFactor;
+  float MaxDistance;
+  float TrimRatio;
+  double Tolerance;
+  int NbNormalNeighbors;
+
+  PointCloudIndex ModelIndex;
+  std::vector<cv::Vec3f> ModelPoints;
+  std::vector<cv::Vec3f> ModelNormals;
+  SignedDistanceField const* DistanceField;
+
+  // Source points of the current level, moved by the current pose, and their closest model point
+  std::vector<cv::Vec3f> Source;
+  std::vector<cv::Vec3f> Moved;
+  std::vector<int> Matches;
+  std::vector<float> Distances2;
+  // Signed distance and gradient of the field at the moved points, for the SignedDistance metric
+  std::vector<float> FieldDistances;
+  std::vector<cv::Vec3f> FieldGradients;
+  std::vector<float> Sorted;
+  std::vector<NormalEquations> Blocks;
+
+  double RmsError;
+  int NbIterations;
+  int NbCorrespondences;
+};
+
+#endif //__ICPREGISTRATION_HPP__
@@ -0,0 +1,102 @@
+/*=========================================================================
+
+Library:   AnatomicAugmentedRealityProjector
+
+Author: Maeliss Jallais
+
+Copyright 2010 Kitware Inc. 28 Corporate Drive,
+Clifton Park, NY, 12065, USA.
+
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+=========================================================================*/
+
+#ifndef __IMAGECONVERSION_HPP__
+#define __IMAGECONVERSION_HPP__
+
+#include <QDebug>
+#include <QImage>
+#include <QVector>
+
+#include <opencv2/core/core.hpp>
+
+// Conversions between the OpenCV frames and the Qt images shown by the widgets
+
+inline QImage cvMatToQImage(const cv::Mat &mat)
+{
+  switch (mat.type())
+  {
+    // 8-bit, 3 channel
+  case CV_8UC3:
+  {
+    QImage image(mat.data, mat.cols, mat.rows, static_cast<int>(mat.step), QImage::Format_RGB888);
+    return image.rgbSwapped();
+  }
+  // 8-bit, 1 channel
+  case CV_8UC1:
+  {
+    // creating a color table only the first time
+    static QVector<QRgb> sColorTable;
+
+    if (sColorTable.isEmpty())
+    {
+      for (int i = 0; i < 256; i++)
+      {
+        sColorTable.append(qRgb(i, i, i));
+        //NOTE : /!\ takes time
+      }
+    }
+    QImage image(mat.data, mat.cols, mat.rows, static_cast<int>(mat.step), QImage::Format_Indexed8);
+    image.setColorTable(sColorTable);
+    return image;
+  }
+  default:
+    qWarning() << "Type not handled : " << mat.type();
+    break;
+  }
+  return QImage();
+}
+
+// Note : If we know that the lifetime of the cv::Mat is shorter than the QImage, then pass false for the inCloneImageData argument. This will share the QImage data.
+inline cv::Mat QImageToCvMat(const QImage& image, bool inCloneImageData = true)
+{
+  switch (image.format())
+  {
+  case QImage::Format_Indexed8:
+  {
+    //8-bit, 1 channel
+    cv::Mat mat(image.height(), image.width(), CV_8UC1, const_cast<uchar*>(image.bits()), static_cast<size_t>(image.bytesPerLine()));
+    return (inCloneImageData ? mat.clone() : mat);
+  }
+  case QImage::Format_RGB888:
+  {
+    if (!inCloneImageData)
+    {
+      qWarning() << "ASM::QImageToCvMat() - Conversion requires cloning because we use a temporary QImage";
+    }
+
+    QImage   swapped;
+    swapped = image.rgbSwapped();
+
+    return cv::Mat(swapped.height(), swapped.width(), CV_8UC3, const_cast<uchar*>(swapped.bits()), static_cast<size_t>(swapped.bytesPerLine())).clone();
+  }
+  default:
+    qWarning() << "Type not handled : " << image.format();
+    break;
+  }
+  return cv::Mat();
+}
+
+#endif //__IMAGECONVERSION_HPP__
@@ -0,0 +1,109 @@
+/*=========================================================================
+
+Library:   AnatomicAugmentedRealityProjector
+
+Author: Maeliss Jallais
+
+Copyright 2010 Kitware Inc. 28 Corporate Drive,
+Clifton Park, NY, 12065, USA.
+
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+=========================================================================*/
+
+#ifndef __LINESCANNER_HPP__
+#define __LINESCANNER_HPP__
+
+#include "CalibrationRuntime.hpp"
+#include "MemoryTracker.hpp"
+
+#include <opencv2/core/core.hpp>
+
+#include <memory>
+#include <vector>
+
+// 3D points of the projector line seen in one camera frame
+struct ScanLine
+{
+  // Projector row of the line
+  int Row;
+  // Brightest pixel of every column, set even when the line is rejected.
+  // The memory is accounted to the stages that fill the line.
+  MemoryTracker::Vector<cv::Point2i> Pixels;
+  MemoryTracker::Vector<cv::Vec3f> Points;
+  MemoryTracker::Vector<cv::Vec3b> Colors;
+};
+
+// Reconstruction of a single projected line. The scanner only reads its settings,
+// so one scanner can be shared by several threads.
+// The plane of every projector row is computed when the calibration or the projector size
+// change, not for every frame.
+class LineScanner
+{
+public:
+  LineScanner();
+
+  // Nothing is computed again if the calibration has the version of the current one
+  void SetCalibration( std::shared_ptr<const CompiledCalibration> const& calib );
+  // Camera rows between which the projector lines are searched
+  void SetLines( int top_line, int bottom_line ) { this->TopLine = top_line; this->BottomLine = bottom_line; };
+  void SetProjectorSize( int width, int height );
+
+  int GetTopLine() const { return this->TopLine; };
+  int GetBottomLine() const { return this->BottomLine; };
+
+  // Columns of the flat sheet of paper read to find the projector row when the search is
+  // restricted to a region of interest
+  void SetReferenceStep( int step ) { this->ReferenceStep = step; };
+
+  // Returns false if the frames are invalid or if the line is too short or outside of the projector
+  bool Reconstruct( cv::Mat const& mat_color_ref, cv::Mat const& mat_color, ScanLine * line ) const;
+  // Same, but the line is only searched inside roi. The projector row is still read on the
+  // sheet of paper, one column every ReferenceStep, so a valid line may have no point.
+  bool Reconstruct( cv::Mat const& mat_color_ref, cv::Mat const& mat_color, cv::Rect const& roi, ScanLine * line ) const;
+
+  // Camera pixels of reconstructed points : inverse of the reconstruction
+  void ProjectPoints( std::vector<cv::Vec3f> const& points, std::vector<cv::Point2f> & pixels ) const;
+
+  // Intersection of the camera ray qc + lambda.vc with the projector plane of normal vp through qp
+  static cv::Point3d RayPlaneIntersection( cv::Point3d const& vc, cv::Point3d const& qc, cv::Point3d const& vp, cv::Point3d const& qp );
+
+private:
+  // Plane of the light of a projector row, in the camera frame
+  struct ProjectorPlane
+  {
+    cv::Point3d Normal;
+    cv::Point3d Point;
+  };
+
+  void UpdatePlanes();
+
+  std::shared_ptr<const CompiledCalibration> Calib;
+  int TopLine;
+  int BottomLine;
+  int ProjectorWidth;
+  int ProjectorHeight;
+  int ReferenceStep;
+
+  // Indexed by the projector row, from 1 to ProjectorHeight
+  std::vector<ProjectorPlane> Planes;
+  uint64 PlanesVersion;
+  int PlanesWidth;
+
+  // Brightest row of column j of the gray region, averaged over 3 rows, or -1
+  static int BrightestRow( cv::Mat const& gray, int j );
+};
+
+#endif //__LINESCANNER_HPP__
@@ -0,0 +1,145 @@
+/*=========================================================================
+
+Library:   AnatomicAugmentedRealityProjector
+
+Author: Maeliss Jallais
+
+Copyright 2010 Kitware Inc. 28 Corporate Drive,
+Clifton Park, NY, 12065, USA.
+
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+=========================================================================*/
+
+
+#ifndef __LOGGER_HPP__
+#define __LOGGER_HPP__
+
+#include <atomic>
+#include <ostream>
+#include <string>
+
+// Messages of the application, by level and category. A message is formatted by its thread
+// into a slot of the ring buffer of the thread, without lock nor allocation, and a background
+// thread writes the messages of all the threads in the order of their time, every
+// FLUSH_INTERVAL_MS or at once for the errors. When the ring of a thread is full the new
+// messages are dropped and counted : a thread never waits for the terminal. The message of a
+// disabled level is not formatted.
+//
+//   LOG_INFO( Scan, "Line " << row << " : " << nb_points << " points" );
+//   LOG_EVERY_MS( Camera, Info, 1000, "Trigger delay " << delay );
+class Logger
+{
+public:
+  enum Level { Debug = 0, Info, Warning, Error, NbLevels };
+  enum Category { General = 0, Camera, Projector, Scan, Analysis, Calibration, Io, Memory, NbCategories };
+
+  static const int MESSAGES_PER_THREAD = 1 << 10;
+  // Longer messages are truncated
+  static const int MESSAGE_SIZE = 256;
+  static const int FLUSH_INTERVAL_MS = 50;
+
+  // Lowest level written, for every category or for one. Info by default.
+  static void SetLevel( Level level );
+  static void SetLevel( Category category, Level level ) { Levels[ category ].store( level, std::memory_order_relaxed ); };
+  static bool IsEnabled( Category category, Level level ) { return level >= Levels[ category ].load( std::memory_order_relaxed ); };
+
+  static const char * GetCategoryName( Category category );
+  static const char * GetLevelName( Level level );
+
+  // One message per line of the text, for the reports longer than a message
+  static void LogLines( Category category, Level level, std::string const& text );
+
+  // Returns when the messages logged before the call are written
+  static void Flush();
+  // Messages lost because the ring of their thread was full
+  static long long GetNbDropped();
+
+  // One message of the thread, committed when the stream is destroyed
+  class Stream
+  {
+  public:
+    Stream( Category category, Level level ) : Out( Begin( category, level ) ), MessageLevel( level ) {};
+    ~Stream() { Commit( this->MessageLevel ); };
+
+    std::ostream & Get() { return this->Out; };
+
+  private:
+    Stream( Stream const& );
+    Stream & operator=( Stream const& );
+
+    std::ostream & Out;
+    Level MessageLevel;
+  };
+
+  // Lets one message through every interval, for the messages of every frame
+  class RateLimit
+  {
+  public:
+    RateLimit() : Next( 0 ), Skipped( 0 ) {};
+
+    // Returns false if the last message let through is more recent than interval_ms,
+    // otherwise gives the number of messages skipped since
+    bool Allow( int interval_ms, long long * skipped );
+
+  private:
+    std::atomic<long long> Next;
+    std::atomic<long long> Skipped;
+  };
+
+private:
+  // Nanoseconds since the start of the program
+  static long long Now();
+  // Stream of the thread, writing into a free slot of its ring or nowhere if the ring is full
+  static std::ostream & Begin( Category category, Level level );
+  static void Commit( Level level );
+
+  static std::atomic<int> Levels[ NbCategories ];
+};
+
+#define LOG_MESSAGE( category, level, message ) \
+  do \
+    { \
+    if( Logger::IsEnabled( Logger::category, Logger::level ) ) \
+      { \
+      Logger::Stream log_stream_( Logger::category, Logger::level ); \
+      log_stream_.Get() << message; \
+      } \
+    } while( 0 )
+
+#define LOG_DEBUG( category, message ) LOG_MESSAGE( category, Debug, message )
+#define LOG_INFO( category, message ) LOG_MESSAGE( category, Info, message )
+#define LOG_WARNING( category, message ) LOG_MESSAGE( category, Warning, message )
+#define LOG_ERROR( category, message ) LOG_MESSAGE( category, Error, message )
+
+// At most one message every interval_ms from this line, followed by the number of messages
+// skipped meanwhile
+#define LOG_EVERY_MS( category, level, interval_ms, message ) \
+  do \
+    { \
+    static Logger::RateLimit log_limit_; \
+    long long log_skipped_ = 0; \
+    if( Logger::IsEnabled( Logger::category, Logger::level ) && log_limit_.Allow( interval_ms, &log_skipped_ ) ) \
+      { \
+      Logger::Stream log_stream_( Logger::category, Logger::level ); \
+      log_stream_.Get() << message; \
+      if( log_skipped_ > 0 ) \
+        { \
+        log_stream_.Get() << " (" << log_skipped_ << " skipped)"; \
+        } \
+      } \
+    } while( 0 )
+
+#endif //__LOGGER_HPP__
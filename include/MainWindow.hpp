@@ -28,11 +28,29 @@ limitations under the License.
 
 #include "ProjectorWidget.hpp"
 #include "CameraInput.hpp"
-#include "CalibrationData.hpp"
+#include "CameraGrabber.hpp"
+#include "CalibrationRuntime.hpp"
+#include "ArtifactExporter.hpp"
+#include "ColorModel.hpp"
+#include "CubeCornerSolver.hpp"
+#include "DensityPeakFinder.hpp"
+#include "FiducialTracker.hpp"
+#include "IcpRegistration.hpp"
+#include "LineScanner.hpp"
+#include "MemoryTracker.hpp"
+#include "MeshRenderer.hpp"
+#include "PointCloudIndex.hpp"
+#include "SignedDistanceField.hpp"
+#include "TriangleMesh.hpp"
 
 #include <qgraphicsscene.h>
+#include <QGraphicsPixmapItem>
 #include <QMainWindow>
 #include <QLabel>
+#include <QThreadPool>
+
+#include <atomic>
+#include <memory>
 
 
 namespace Ui {
@@ -64,13 +82,13 @@ public:
   void SetCurrentMat( cv::Mat currentMat ) { this->CurrentMat = currentMat; };
   int GetTimerShots() const { return this->TimerShots; };
   void SetTimerShots( int timerShots ) { this->TimerShots = timerShots; };
-  std::vector<cv::Vec3f> ransac( std::vector<cv::Vec3f> points, int min, int iter, float thres, int min_inliers, const cv::Vec3f normal_B = cv::Vec3f( 0, 0, 0 ), const cv::Vec3f normal_R = cv::Vec3f( 0, 0, 0 ) );
-  void density_probability( cv::Mat pointcloud, cv::Mat pointcloud_BGR, std::vector<cv::Vec3f> *points_B, std::vector<cv::Vec3f> *points_G, std::vector<cv::Vec3f> *points_R );
+  std::vector<cv::Vec3f> ransac( const std::vector<cv::Vec3f> & points, int min, int iter, float thres, int min_inliers, const cv::Vec3f normal_B = cv::Vec3f( 0, 0, 0 ), const cv::Vec3f normal_R = cv::Vec3f( 0, 0, 0 ) );
+  void density_probability( cv::Mat pointcloud, cv::Mat pointcloud_BGR, ColorModelSet const& models, MemoryTracker::Vector<cv::Vec3f> *points_B, MemoryTracker::Vector<cv::Vec3f> *points_G, MemoryTracker::Vector<cv::Vec3f> *points_R );
   cv::Vec3f three_planes_intersection( cv::Vec3f n1, cv::Vec3f n2, cv::Vec3f n3, cv::Vec3f x1, cv::Vec3f x2, cv::Vec3f x3 );
-  float compute_maximum( std::vector<cv::Vec3f> points, int axis, float min, float max, float variance, float interval_min = -9999, float interval_max = 9999 );
+  bool find_centers( const MemoryTracker::Vector<cv::Vec3f> & points_B, const MemoryTracker::Vector<cv::Vec3f> & points_R, const MemoryTracker::Vector<cv::Vec3f> & points_G, cv::Vec3f *center_B, cv::Vec3f *center_R, cv::Vec3f *center_G );
   void save_pointcloud_plane_intersection( cv::Mat pointcloud, cv::Mat pointcloud_colors, cv::Vec3f normal_B, cv::Vec3f normal_G, cv::Vec3f normal_R, cv::Vec3f A_B, cv::Vec3f A_G, cv::Vec3f A_R, cv::Vec3f intersection, float size_circles, QString name );
   void save_pointcloud_centers( cv::Mat pointcloud, cv::Mat pointcloud_colors, cv::Vec3f center_B, cv::Vec3f center_G, cv::Vec3f center_R, float size_circles, QString name );
-  void save_pointcloud( cv::Mat pointcloud, cv::Mat pointcloud_colors, QString name );
+  void save_pointcloud( ArtifactExporter::Artifact artifact, cv::Mat pointcloud, cv::Mat pointcloud_colors, QString name );
   void get_true_colors( cv::Mat *pointcloud_colors );
 
 protected slots:
@@ -80,9 +98,16 @@ protected slots:
   void on_cam_display_clicked();
   void on_cam_record_clicked();
   void on_analyze_clicked();
+  void on_track_toggled( bool checked );
+  void on_cancel_clicked();
+  // Timing of the pipeline from the press to the release, then exported as a trace
+  void on_profile_toggled( bool checked );
   void _on_new_projector_image(QPixmap image);
 
-  void DisplayCamera();
+  void ShowGrabbedFrame();
+  void ShowTaskProgress( QString const& stage, int percent );
+  void ShowOverlay( QImage const& image );
+  void ReleaseCamera();
 
   void SetProjectorHeight();
   void SetProjectorWidth();
@@ -95,13 +120,75 @@ protected slots:
   void SetProjectorGreenColor();
   void SetProjectorRedColor();
 
+signals:
+  // Emitted by the worker threads
+  void TaskProgress( QString const& stage, int percent );
+  void ScanFinished();
+  // Model rendered at its registered pose
+  void OverlayReady( QImage const& image );
+
 private:
+  // Preview of a camera frame, in the persistent scene
+  void ShowFrame( cv::Mat const& frame );
+
+  // Set to cancel one task, which stops at its next stage
+  typedef std::shared_ptr< std::atomic<bool> > CancelToken;
+
+  // Tasks of the worker threads. A scan owns the camera until ScanFinished, then queues its
+  // analysis. Each task keeps the color models of its start, the GUI may train new ones
+  // meanwhile, and has its own cancel token.
+  void ScanPointCloud( std::shared_ptr<const ColorModelSet> const& models, CancelToken const& cancel, CancelToken const& analysis_cancel );
+  void AnalyzePointCloud( cv::Mat pointcloud, cv::Mat pointcloud_colors, ColorModelSet const& models, std::atomic<bool> const& cancel );
+  void FindLinesAndStudy( std::shared_ptr<const ColorModelSet> const& models, CancelToken const& cancel, CancelToken const& study_cancel );
+  void RunRepeatabilityStudy( LineScanner const& scanner, QStringList const& framenames, cv::Mat const& mat_color_ref, ColorModelSet const& models,
+    std::atomic<bool> const& cancel );
+  // Loads the model and its distance field. Run by the analysis thread before the first analysis.
+  void LoadModel();
+  // Registers the model to the cloud from its last pose, then renders it for the projector
+  void RegisterModel( cv::Mat pointcloud, std::shared_ptr<const CompiledCalibration> const& calib, int width, int height, std::atomic<bool> const& cancel );
+  // Token of the next scan, or of a new analysis kept until it is finished
+  CancelToken NewCancelToken( bool analysis );
+  // Cancels the scan running, and the analyses if asked
+  void CancelTasks( bool analyses );
+  // Returns false if the task was cancelled, otherwise reports the stage
+  bool NextStage( std::atomic<bool> const& cancel, QString const& stage, int percent );
+  // Frame of a scan, also shown by the preview
+  cv::Mat GrabFrame();
+  // Tracking of the fiducial in the frame shown by the preview
+  void TrackFrame( cv::Mat const& frame );
+
   Ui::MainWindow *ui;
   ProjectorWidget Projector;
   CameraInput CamInput;
-  QTimer *timer;
+  CameraGrabber Grabber;
+  QGraphicsScene *CameraScene;
+  QGraphicsPixmapItem *CameraItem;
+  cv::Mat PreviewBuffer;
+  bool Scanning;
+  bool Tracking;
+  bool ResumePreview;
+  CancelToken ScanCancel;
+  std::vector<CancelToken> AnalysisCancels;
+  QThreadPool AnalysisPool;
   QTimer *AnalyzeTimer;
-  CalibrationData Calib;
+  CalibrationRuntime Calib;
+  // Replaced, never modified : the tasks share them
+  std::shared_ptr<const ColorModelSet> ColorModels;
+  std::shared_ptr<const ColorModelSet> TrackColorModels;
+  ArtifactExporter Exporter;
+  CubeCornerSolver CornerSolver;
+  DensityPeakFinder PeakFinders[ CubeCornerSolver::NbFaces ];
+  PointCloudIndex CloudIndex;
+  LineScanner Scanner;
+  FiducialTracker Tracker;
+  cv::Mat TrackRef;
+  // Model projected on the patient, only used by the analysis thread
+  TriangleMesh Model;
+  SignedDistanceField ModelField;
+  IcpRegistration Registration;
+  MeshRenderer Renderer;
+  cv::Matx44f ModelPose;
+  bool ModelRegistered;
   cv::Mat CurrentMat;
   int TimerShots;
   float max_x, max_y, max_z, min_x, min_y, min_z;
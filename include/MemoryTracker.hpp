@@ -0,0 +1,146 @@
+/*=========================================================================
+
+Library:   AnatomicAugmentedRealityProjector
+
+Author: Maeliss Jallais
+
+Copyright 2010 Kitware Inc. 28 Corporate Drive,
+Clifton Park, NY, 12065, USA.
+
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+=========================================================================*/
+
+
+#ifndef __MEMORYTRACKER_HPP__
+#define __MEMORYTRACKER_HPP__
+
+#include "Profiler.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Memory of the cv::Mat and of the counted STL containers, accounted to the stage of the
+// profiler scope where it is allocated : live bytes, peak, total allocated since the last
+// reset. The Mats use a counting cv::MatAllocator once Install is called, the containers
+// use MemoryTracker::Allocator :
+//
+//   MemoryTracker::Vector<cv::Vec3f> Points;
+//
+// When the live memory exceeds the budget a warning is logged, once until it goes back
+// under 90 % of the budget. A Window reports on one scan and its analysis, even when they
+// overlap with the analysis of the previous scan.
+class MemoryTracker
+{
+public:
+  // Memory allocated outside of any profiler scope
+  static const int Other = Profiler::NbStages;
+  static const int NB_SLOTS = Profiler::NbStages + 1;
+  // Windows whose peaks are followed at the same time
+  static const int MAX_WINDOWS = 4;
+  // 6 GB, to be warned before the 8 GB carts run out of memory
+  static const long long DEFAULT_BUDGET = 6LL << 30;
+  static const int MEMORY_SETTINGS_VERSION = 1;
+
+  // The memory allocated while the tracker is disabled is never accounted, even when released
+  static void SetEnabled( bool enabled ) { Enabled.store( enabled, std::memory_order_relaxed ); };
+  static bool IsEnabled() { return Enabled.load( std::memory_order_relaxed ); };
+
+  // No warning with a budget of 0
+  static void SetBudget( long long bytes ) { Budget.store( bytes, std::memory_order_relaxed ); };
+  static long long GetBudget() { return Budget.load( std::memory_order_relaxed ); };
+
+  // Reads "enabled" and "budget_mb". Returns false if the file can not be read, the
+  // settings are then left unchanged.
+  static bool LoadSettings( std::string const& filename );
+
+  // Makes the counting allocator the default allocator of cv::Mat. The Mats allocated
+  // before keep their allocator and are not accounted.
+  static void Install();
+
+  static long long GetLiveBytes();
+  static long long GetPeakBytes();
+  static long long GetLiveBytes( int stage );
+  static long long GetPeakBytes( int stage );
+  static long long GetTotalBytes( int stage );
+
+  // Starts a new report : the peaks are set to the live memory and the totals to 0
+  static void ResetPeaks();
+  // Allocations, total, peak and live memory of every stage
+  static void PrintReport( std::ostream & stream );
+  // Same report, one message per line
+  static void LogReport();
+
+  // Counters since its creation : allocations and totals are the differences with a snapshot
+  // taken at the creation, the peaks are followed while the window exists. The memory is not
+  // owned by a window : the peaks include all the live memory, also that of the overlapping
+  // windows. When MAX_WINDOWS windows exist the peaks reported are those since ResetPeaks.
+  class Window
+  {
+  public:
+    Window();
+    ~Window();
+
+    void PrintReport( std::ostream & stream ) const;
+    void LogReport() const;
+
+  private:
+    Window( Window const& );
+    Window & operator=( Window const& );
+
+    int Slot;
+    long long Totals[ NB_SLOTS ];
+    long long NbAllocations[ NB_SLOTS ];
+  };
+
+  // Allocator of the STL containers whose memory is accounted
+  template<typename T> class Allocator
+  {
+  public:
+    typedef T value_type;
+
+    Allocator() {};
+    template<typename U> Allocator( Allocator<U> const& ) {};
+
+    T * allocate( std::size_t n ) { return static_cast<T*>( AllocateBlock( n * sizeof( T ) ) ); };
+    void deallocate( T * p, std::size_t n ) { ReleaseBlock( p, n * sizeof( T ) ); };
+
+    template<typename U> bool operator==( Allocator<U> const& ) const { return true; };
+    template<typename U> bool operator!=( Allocator<U> const& ) const { return false; };
+  };
+
+  template<typename T> using Vector = std::vector< T, Allocator<T> >;
+  template<typename Key, typename T, typename Hash = std::hash<Key> > using UnorderedMap =
+    std::unordered_map< Key, T, Hash, std::equal_to<Key>, Allocator< std::pair<const Key, T> > >;
+
+  // Accounting of the allocators. stage is the stage recorded at the allocation.
+  static void Allocated( int stage, long long bytes );
+  static void Released( int stage, long long bytes );
+
+private:
+  // The stage of a block is written before it
+  static void * AllocateBlock( std::size_t bytes );
+  static void ReleaseBlock( void * pointer, std::size_t bytes );
+
+  static std::atomic<bool> Enabled;
+  static std::atomic<long long> Budget;
+};
+
+#endif //__MEMORYTRACKER_HPP__
@@ -0,0 +1,73 @@
+/*=========================================================================
+
+Library:   AnatomicAugmentedRealityProjector
+
+Author: Maeliss Jallais
+
+Copyright 2010 Kitware Inc. 28 Corporate Drive,
+Clifton Park, NY, 12065, USA.
+
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+=========================================================================*/
+
+
+#ifndef __MESHLOADER_HPP__
+#define __MESHLOADER_HPP__
+
+#include "TriangleMesh.hpp"
+
+#include <QString>
+
+#include <opencv2/core/core.hpp>
+
+// Loading of large binary STL and PLY surface meshes. The file is mapped in memory and the
+// vertices and faces are parsed in parallel, the duplicate vertices are welded through a hash
+// of their position and the vertex normals are computed. The result is cached next to the file
+// (filename + ".mesh") as contiguous arrays and the cache is used while the file is unchanged.
+class MeshLoader
+{
+public:
+  static const int MESH_CACHE_VERSION = 1;
+
+  MeshLoader();
+
+  // The vertices in the same cube of side tolerance, floor( v / tolerance ), are welded : two
+  // vertices closer than the tolerance on both sides of a cube face are kept apart.
+  // 0 only welds identical positions.
+  void SetWeldTolerance( float tolerance ) { this->WeldTolerance = tolerance; };
+  void SetUseCache( bool use ) { this->UseCache = use; };
+
+  bool Load( QString const& filename, TriangleMesh * mesh ) const;
+
+  static QString GetCacheFilename( QString const& filename ) { return filename + ".mesh"; };
+  // The size and the modification time of the source file are stored to check the cache,
+  // they are not checked when negative
+  static bool SaveCache( QString const& filename, TriangleMesh const& mesh, qint64 source_size = -1, qint64 source_time = -1 );
+  static bool LoadCache( QString const& filename, TriangleMesh * mesh, qint64 source_size = -1, qint64 source_time = -1 );
+
+  // Area weighted vertex normals
+  static void ComputeNormals( TriangleMesh * mesh );
+
+private:
+  bool ReadStl( const uchar * data, qint64 size, TriangleMesh * mesh ) const;
+  bool ReadPly( const uchar * data, qint64 size, TriangleMesh * mesh ) const;
+  void Weld( TriangleMesh * mesh ) const;
+
+  float WeldTolerance;
+  bool UseCache;
+};
+
+#endif //__MESHLOADER_HPP__
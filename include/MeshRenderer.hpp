@@ -0,0 +1,91 @@
+/*=========================================================================
+
+Library:   AnatomicAugmentedRealityProjector
+
+Author: Maeliss Jallais
+
+Copyright 2010 Kitware Inc. 28 Corporate Drive,
+Clifton Park, NY, 12065, USA.
+
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+=========================================================================*/
+
+
+#ifndef __MESHRENDERER_HPP__
+#define __MESHRENDERER_HPP__
+
+#include "CalibrationRuntime.hpp"
+#include "TriangleMesh.hpp"
+
+#include <QImage>
+
+#include <opencv2/core/core.hpp>
+
+#include <memory>
+#include <vector>
+
+// Software rendering of a mesh as seen by the projector, for the overlay on the patient.
+// The vertices are projected through R, T and the intrinsics and distortion of the projector,
+// then the triangles are sorted into square tiles of the image and the tiles are rasterized
+// in parallel, each with its own z-buffer. The triangles are flat shaded with a light at the
+// projector. Triangles with a vertex behind the projector are skipped.
+// The frames are drawn directly in two QImage alternately : the widget can keep the last
+// frame while the next one is drawn, without copy nor conversion.
+class MeshRenderer
+{
+public:
+  MeshRenderer();
+
+  void SetCalibration( std::shared_ptr<const CompiledCalibration> const& calib ) { this->Calib = calib; };
+  // Projector resolution
+  void SetSize( int width, int height ) { this->Width = width; this->Height = height; };
+  void SetTileSize( int size ) { this->TileSize = size; };
+  void SetColor( QRgb color ) { this->Color = color; };
+
+  // Renders the mesh, placed by pose in the camera frame of the calibration.
+  // Returns false if the calibration is missing.
+  bool Render( TriangleMesh const& mesh, cv::Matx44f const& pose );
+
+  // Last frame rendered
+  QImage const& GetImage() const { return this->Images[ this->Current ]; };
+
+private:
+  void ProjectVertices( TriangleMesh const& mesh, cv::Matx44f const& pose );
+  void SetupTriangles( TriangleMesh const& mesh );
+  void BinTriangles( TriangleMesh const& mesh );
+  void RasterizeTile( TriangleMesh const& mesh, int tile, uchar * bits, int bytes_per_line, std::vector<float> & depth ) const;
+
+  std::shared_ptr<const CompiledCalibration> Calib;
+  int Width;
+  int Height;
+  int TileSize;
+  QRgb Color;
+
+  // Vertices in the projector frame, then their pixel and inverse depth, 0 behind the projector
+  std::vector<cv::Vec3f> Positions;
+  std::vector<cv::Vec3f> Screen;
+  // Color of the triangles, 0 for the skipped ones
+  std::vector<QRgb> Shades;
+  // Triangles of every tile, for every block of triangles : Bins[ block * NbTiles + tile ]
+  std::vector< std::vector<int> > Bins;
+  int NbTilesX;
+  int NbTilesY;
+
+  QImage Images[ 2 ];
+  int Current;
+};
+
+#endif //__MESHRENDERER_HPP__
@@ -0,0 +1,94 @@
+/*=========================================================================
+
+Library:   AnatomicAugmentedRealityProjector
+
+Author: Maeliss Jallais
+
+Copyright 2010 Kitware Inc. 28 Corporate Drive,
+Clifton Park, NY, 12065, USA.
+
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+=========================================================================*/
+
+#ifndef __PLANERANSAC_HPP__
+#define __PLANERANSAC_HPP__
+
+#include <opencv2/core/core.hpp>
+
+#include <vector>
+
+// RANSAC plane fitting.
+// The points are copied once into structure-of-arrays buffers that are kept between
+// calls, so one engine per thread does not allocate in steady state.
+// The number of iterations adapts to the inlier ratio of the best model, hypotheses
+// are first tested on a random subset of the points, and the best model is refined
+// by least squares on its inliers.
+class PlaneRansac
+{
+public:
+  PlaneRansac( uint64 seed = 0x2545F4914F6CDD1DULL );
+
+  // The same seed and the same inputs give the same results
+  void SetSeed( uint64 seed );
+
+  void SetMaxIterations( int iter ) { this->MaxIterations = iter; };
+  void SetThreshold( float thres ) { this->Threshold = thres; };
+  void SetMinInliers( int min_inliers ) { this->MinInliers = min_inliers; };
+  void SetConfidence( double confidence ) { this->Confidence = confidence; };
+  void SetPreemptiveSubsetSize( int size ) { this->PreemptiveSubsetSize = size; };
+  // Normals to which the plane must be orthogonal, (0, 0, 0) to disable. The tolerance is a cosine.
+  void SetOrthogonalTo( cv::Vec3f const& normal_1, cv::Vec3f const& normal_2 = cv::Vec3f( 0, 0, 0 ) );
+  void SetOrthogonalTolerance( float tolerance ) { this->OrthogonalTolerance = tolerance; };
+
+  int GetMaxIterations() const { return this->MaxIterations; };
+  float GetThreshold() const { return this->Threshold; };
+  int GetMinInliers() const { return this->MinInliers; };
+
+  // Returns false if no plane with at least MinInliers inliers was found
+  bool Fit( std::vector<cv::Vec3f> const& points );
+
+  // Unit normal and a point of the plane (centroid of the inliers)
+  cv::Vec3f GetNormal() const { return this->Normal; };
+  cv::Vec3f GetPoint() const { return this->Point; };
+  int GetNbInliers() const { return this->NbInliers; };
+  int GetNbIterations() const { return this->NbIterations; };
+
+  // Number of the n points (x[i], y[i], z[i]) closer than thres to the plane normal.p = d (unit normal)
+  static int CountPlaneInliers( const float * x, const float * y, const float * z, int n, cv::Vec3f const& normal, float d, float thres );
+
+private:
+  int CountInliers( cv::Vec3f const& normal, float d, int begin, int end, int stop_below = -1 ) const;
+  bool IsOrthogonal( cv::Vec3f const& normal ) const;
+  bool Refine( cv::Vec3f & normal, float & d ) const;
+
+  cv::RNG Rng;
+  int MaxIterations;
+  float Threshold;
+  int MinInliers;
+  double Confidence;
+  int PreemptiveSubsetSize;
+  cv::Vec3f Orthogonal[ 2 ];
+  float OrthogonalTolerance;
+
+  std::vector<float> X, Y, Z;
+
+  cv::Vec3f Normal;
+  cv::Vec3f Point;
+  int NbInliers;
+  int NbIterations;
+};
+
+#endif //__PLANERANSAC_HPP__
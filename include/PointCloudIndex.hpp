@@ -0,0 +1,79 @@
+/*=========================================================================
+
+Library:   AnatomicAugmentedRealityProjector
+
+Author: Maeliss Jallais
+
+Copyright 2010 Kitware Inc. 28 Corporate Drive,
+Clifton Park, NY, 12065, USA.
+
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+=========================================================================*/
+
+#ifndef __POINTCLOUDINDEX_HPP__
+#define __POINTCLOUDINDEX_HPP__
+
+#include "MemoryTracker.hpp"
+
+#include <opencv2/core/core.hpp>
+
+#include <vector>
+
+// KD-tree over a point cloud, built once and queried many times.
+// The tree is implicit : the points are reordered so that the median of every range
+// [begin, end) is at (begin + end) / 2, the split axis being stored at the median position.
+// The levels are partitioned in parallel. All the distances are compared squared.
+// Queries return the ids of the points : their index in the vector, or row * cols + col
+// for an organized cloud.
+class PointCloudIndex
+{
+public:
+  PointCloudIndex();
+
+  void SetLeafSize( int size ) { this->LeafSize = size; };
+  int GetLeafSize() const { return this->LeafSize; };
+
+  void Build( std::vector<cv::Vec3f> const& points );
+  void Build( MemoryTracker::Vector<cv::Vec3f> const& points );
+  void Build( cv::Vec3f const* points, int nb_points );
+  // Organized CV_32FC3 cloud, only the points with z > 0 are indexed
+  void Build( cv::Mat const& pointcloud );
+  void Clear();
+
+  int GetNbPoints() const { return static_cast<int>( this->Points.size() ); };
+
+  // Ids of the points closer than radius to center, in no particular order
+  void RadiusSearch( cv::Vec3f const& center, float radius, std::vector<int> & ids ) const;
+  // Ids of the k nearest points sorted by increasing distance, with their squared distances
+  void KnnSearch( cv::Vec3f const& center, int k, std::vector<int> & ids, std::vector<float> & distances2 ) const;
+  // Id of the nearest point closer than sqrt( max_distance2 ), or -1. Does not allocate.
+  int NearestSearch( cv::Vec3f const& center, float max_distance2, float * distance2 ) const;
+
+  // Batched queries, run in parallel over the centers
+  void RadiusSearch( std::vector<cv::Vec3f> const& centers, float radius, std::vector< std::vector<int> > & ids ) const;
+  void KnnSearch( std::vector<cv::Vec3f> const& centers, int k, std::vector< std::vector<int> > & ids, std::vector< std::vector<float> > & distances2 ) const;
+
+private:
+  void BuildTree();
+
+  int LeafSize;
+  // Copy of the points in tree order, accounted to the stage of Build
+  MemoryTracker::Vector<cv::Vec3f> Points;
+  MemoryTracker::Vector<int> Ids;
+  MemoryTracker::Vector<unsigned char> SplitAxis;
+};
+
+#endif //__POINTCLOUDINDEX_HPP__
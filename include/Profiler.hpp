@@ -0,0 +1,107 @@
+/*=========================================================================
+
+Library:   AnatomicAugmentedRealityProjector
+
+Author: Maeliss Jallais
+
+Copyright 2010 Kitware Inc. 28 Corporate Drive,
+Clifton Park, NY, 12065, USA.
+
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+=========================================================================*/
+
+
+#ifndef __PROFILER_HPP__
+#define __PROFILER_HPP__
+
+#include <atomic>
+#include <iostream>
+#include <string>
+
+// Timing of the stages of the pipeline. Each thread records its own events in a ring buffer
+// and its own histograms, without lock : the threads never wait for each other nor for the
+// reports. When the profiler is disabled, a scope costs one relaxed atomic load. The scopes
+// also keep the current stage of their thread, to which the memory is accounted.
+//
+//   Profiler::Scope scope( Profiler::Triangulation );
+//   scope.AddItems( nb_points );
+//
+// The events are exported in the trace event format of chrome://tracing, the latencies
+// are summed up in histograms with power of 2 bins.
+class Profiler
+{
+public:
+  enum Stage { Acquisition = 0, Conversion, Subtraction, PeakSearch, Undistortion, Triangulation, Classification,
+    Ransac, ComputeMaximum, Export, NbStages };
+
+  // Events kept per thread, the oldest are overwritten
+  static const int EVENTS_PER_THREAD = 1 << 14;
+  // Bin b holds the durations in [ 2^b, 2^(b+1) [ ns
+  static const int NB_BINS = 40;
+
+  static void SetEnabled( bool enabled ) { Enabled.store( enabled, std::memory_order_relaxed ); };
+  static bool IsEnabled() { return Enabled.load( std::memory_order_relaxed ); };
+
+  static const char * GetStageName( Stage stage );
+
+  // Stage of the innermost scope of the thread, NbStages outside of any scope
+  static int GetCurrentStage() { return CurrentStage; };
+
+  // Events and histograms of all the threads are cleared. The events recorded meanwhile may
+  // be partly lost.
+  static void Reset();
+
+  // Count, mean and percentiles of the duration of every stage, and the items processed
+  static void PrintHistograms( std::ostream & stream );
+  static bool WriteTrace( std::string const& filename );
+
+  // Times its lifetime when the profiler is enabled at its creation
+  class Scope
+  {
+  public:
+    explicit Scope( Stage stage ) : Start( IsEnabled() ? Now() : -1 ), Items( 0 ), StageId( stage ), ParentStage( CurrentStage ) { CurrentStage = stage; };
+    ~Scope()
+      {
+      CurrentStage = this->ParentStage;
+      if( this->Start >= 0 )
+        {
+        Record( this->StageId, this->Start, Now() - this->Start, this->Items );
+        }
+      };
+
+    // Number of frames, points... processed by the stage
+    void AddItems( long long items ) { this->Items += items; };
+
+  private:
+    Scope( Scope const& );
+    Scope & operator=( Scope const& );
+
+    long long Start;
+    long long Items;
+    Stage StageId;
+    int ParentStage;
+  };
+
+private:
+  // Nanoseconds since the start of the program
+  static long long Now();
+  static void Record( Stage stage, long long start, long long duration, long long items );
+
+  static std::atomic<bool> Enabled;
+  static thread_local int CurrentStage;
+};
+
+#endif //__PROFILER_HPP__
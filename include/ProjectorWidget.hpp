@@ -28,6 +28,7 @@ limitations under the License.
 
 #include <opencv2/core/core.hpp>
 
+#include <QImage>
 #include <QWidget>
 
 #include <stdio.h>
@@ -56,7 +57,9 @@ public:
   unsigned char GetBlueColor() { return this->BlueColor; };
   unsigned char GetGreenColor() { return this->GreenColor; };
   unsigned char GetRedColor() { return this->RedColor; };
-  void SetPixmap(QPixmap image) { this->Pixmap = image; };
+  void SetPixmap(QPixmap image) { this->Pixmap = image; this->Image = QImage(); };
+  // Frame drawn as is, without conversion to a pixmap, until the next SetPixmap
+  void SetImage( QImage const& image ) { this->Image = image; this->update(); };
   void SetWidth(int x) { this->Width = x; };
   void SetHeight(int y) { this->Height = y; };
   void SetLineThickness(int thickness) { this->LineThickness = thickness; };
@@ -75,6 +78,7 @@ protected:
 
 private:
   QPixmap Pixmap;
+  QImage Image;
   int Height;
   int Width;
   int LineThickness;
@@ -0,0 +1,93 @@
+/*=========================================================================
+
+Library:   AnatomicAugmentedRealityProjector
+
+Author: Maeliss Jallais
+
+Copyright 2010 Kitware Inc. 28 Corporate Drive,
+Clifton Park, NY, 12065, USA.
+
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+=========================================================================*/
+
+#ifndef __REPEATABILITYSTUDY_HPP__
+#define __REPEATABILITYSTUDY_HPP__
+
+#include "ColorModel.hpp"
+#include "LineScanner.hpp"
+
+#include <QString>
+#include <QStringList>
+
+#include <opencv2/core/core.hpp>
+
+#include <vector>
+
+struct RepeatabilityResult
+{
+  bool Valid;
+  // Indices of the frames used, in the list given to LoadFrames
+  std::vector<int> Frames;
+  cv::Vec3f Corner;
+  cv::Vec3f CircleCorner;
+};
+
+// Monte-Carlo study of the repeatability of the fiducial detection : every repetition
+// merges a few random recorded frames and detects the corner of the cube.
+// The frames are reconstructed once and shared read-only by all the repetitions, which
+// run in parallel. Each repetition has its own random stream derived from the seed,
+// so the results only depend on the seed, not on the number of threads.
+class RepeatabilityStudy
+{
+public:
+  RepeatabilityStudy();
+
+  void SetSeed( uint64 seed ) { this->Seed = seed; };
+  void SetNbRepetitions( int nb ) { this->NbRepetitions = nb; };
+  void SetNbFramesPerRepetition( int nb ) { this->NbFramesPerRepetition = nb; };
+  void SetScanner( LineScanner const& scanner ) { this->Scanner = scanner; };
+  void SetColorModels( ColorModelSet const* models ) { this->ColorModels = models; };
+
+  // Reads and reconstructs every frame, in parallel. Returns false if no line was reconstructed.
+  bool LoadFrames( QStringList const& filenames, cv::Mat const& mat_color_ref );
+  int GetNbValidFrames() const { return static_cast<int>( this->FrameIds.size() ); };
+
+  // Returns false if no repetition succeeded
+  bool Run();
+
+  std::vector<RepeatabilityResult> const& GetResults() const { return this->Results; };
+  // Statistics of the M1 (circle = false) or M2 (circle = true) corners of the valid repetitions
+  void GetStatistics( bool circle, cv::Scalar * mean, cv::Scalar * stddev ) const;
+
+  // One row per repetition, then the mean and the standard deviation
+  bool WriteCsv( QString const& filename ) const;
+
+private:
+  uint64 Seed;
+  int NbRepetitions;
+  int NbFramesPerRepetition;
+  LineScanner Scanner;
+  ColorModelSet const* ColorModels;
+
+  // Read-only once loaded : the valid lines and their index in the list of frames
+  int ImageCols;
+  std::vector<ScanLine> Lines;
+  std::vector<int> FrameIds;
+
+  std::vector<RepeatabilityResult> Results;
+};
+
+#endif //__REPEATABILITYSTUDY_HPP__
@@ -0,0 +1,160 @@
+/*=========================================================================
+
+Library:   AnatomicAugmentedRealityProjector
+
+Author: Maeliss Jallais
+
+Copyright 2010 Kitware Inc. 28 Corporate Drive,
+Clifton Park, NY, 12065, USA.
+
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+=========================================================================*/
+
+
+#ifndef __SCENERENDERER_HPP__
+#define __SCENERENDERER_HPP__
+
+#include "CalibrationRuntime.hpp"
+
+#include <opencv2/core/core.hpp>
+
+#include <memory>
+#include <vector>
+
+// Parametric scene in the camera frame, in the units of the calibration.
+// The colors are BGR reflectances.
+struct SyntheticScene
+{
+  struct Plane
+  {
+    cv::Vec3d Normal;
+    cv::Vec3d Point;
+    cv::Vec3b Color;
+  };
+  struct Sphere
+  {
+    cv::Vec3d Center;
+    double Radius;
+    cv::Vec3b Color;
+  };
+  // Cube of side Size, the columns of Rotation are its axes. Colors of the faces -x, +x,
+  // -y, +y, -z and +z of the cube frame.
+  struct Cube
+  {
+    cv::Vec3d Center;
+    cv::Matx33d Rotation;
+    double Size;
+    cv::Vec3b Colors[ 6 ];
+  };
+
+  std::vector<Plane> Planes;
+  std::vector<Sphere> Spheres;
+  std::vector<Cube> Cubes;
+
+  // First surface hit by the ray origin + t.direction with 0 < t < max_t, direction being
+  // a unit vector. Returns false if there is none.
+  bool Intersect( cv::Vec3d const& origin, cv::Vec3d const& direction, double max_t,
+    double * t, cv::Vec3d * normal, cv::Vec3b * color ) const;
+};
+
+// Ground truth of a rendered frame : for every camera column where the line is seen, the
+// pixel nearest to the center of the line and the point of the scene it sees
+struct SceneLine
+{
+  double Row;
+  std::vector<cv::Point2i> Pixels;
+  std::vector<cv::Vec3f> Points;
+};
+
+// Camera frames of a synthetic scene lit by the line of one projector row, for a given
+// calibration. What every camera pixel sees is computed once per scene : the point, its
+// reflectance, its projector row and how much light it gets from the projector, shadows
+// included. A frame is then rendered one scanline per task. The noise of a frame only
+// depends on the seed and on the projector row, not on the threads.
+class SceneRenderer
+{
+public:
+  SceneRenderer( uint64 seed = 0x2545F4914F6CDD1DULL );
+
+  // Returns false if the calibration is not valid
+  bool SetCalibration( CalibrationData const& data );
+  void SetCalibration( std::shared_ptr<const CompiledCalibration> const& calib ) { this->Calib = calib; };
+  void SetCameraSize( int width, int height ) { this->CameraWidth = width; this->CameraHeight = height; };
+  void SetProjectorSize( int width, int height ) { this->ProjectorWidth = width; this->ProjectorHeight = height; };
+
+  void SetSeed( uint64 seed ) { this->Seed = seed; };
+  // Standard deviation of the sensor noise, in gray levels
+  void SetNoise( double sigma ) { this->Noise = sigma; };
+  // Standard deviation of the blur of the optics, in pixels, 0 for none
+  void SetBlur( double sigma ) { this->Blur = sigma; };
+  // Light of the room, from 0 to 1
+  void SetAmbient( double ambient ) { this->Ambient = ambient; };
+  // Color of the projected line, and its width in projector rows
+  void SetLineColor( cv::Vec3b const& color ) { this->LineColor = color; };
+  void SetLineWidth( double width ) { this->LineWidth = width; };
+  // Trigger delay of the first projector row and duration of the sweep of all the rows,
+  // in seconds
+  void SetTriggerTiming( double first_delay, double sweep ) { this->FirstDelay = first_delay; this->Sweep = sweep; };
+
+  int GetCameraWidth() const { return this->CameraWidth; };
+  int GetCameraHeight() const { return this->CameraHeight; };
+  double GetRowFromDelay( double delay ) const;
+
+  // Computes what every camera pixel sees. Returns false without a calibration or sizes.
+  bool SetScene( SyntheticScene const& scene );
+
+  // Frame lit by the room only
+  void RenderReference( cv::Mat & frame ) const;
+  // Frame of the line centered on the projector row, which can be fractional.
+  // truth can be NULL.
+  void RenderRow( double row, cv::Mat & frame, SceneLine * truth = NULL ) const;
+  // Frame captured with the trigger delay
+  void RenderDelay( double delay, cv::Mat & frame, SceneLine * truth = NULL ) const;
+
+  // Points seen by the camera, organized like the frames, z = 0 where nothing is seen
+  cv::Mat const& GetPoints() const { return this->Points; };
+
+private:
+  void Render( double row, bool line, uint64 seed, cv::Mat & frame ) const;
+  void FindLine( double row, SceneLine * truth ) const;
+  // Projector pixel of a point of the projector frame
+  cv::Point2d ProjectToProjector( cv::Vec3d const& point ) const;
+
+  std::shared_ptr<const CompiledCalibration> Calib;
+  int CameraWidth;
+  int CameraHeight;
+  int ProjectorWidth;
+  int ProjectorHeight;
+  uint64 Seed;
+  double Noise;
+  double Blur;
+  double Ambient;
+  cv::Vec3b LineColor;
+  double LineWidth;
+  double FirstDelay;
+  double Sweep;
+
+  // What every camera pixel sees
+  cv::Mat Points;
+  // CV_32FC3 reflectance, 0 where nothing is seen
+  cv::Mat Reflectance;
+  // CV_32F cosine of the light of the projector, 0 if the projector does not light the point
+  cv::Mat Shading;
+  // CV_32F projector row of the point
+  cv::Mat ProjectorRows;
+};
+
+#endif //__SCENERENDERER_HPP__
@@ -0,0 +1,81 @@
+/*=========================================================================
+
+Library:   AnatomicAugmentedRealityProjector
+
+Author: Maeliss Jallais
+
+Copyright 2010 Kitware Inc. 28 Corporate Drive,
+Clifton Park, NY, 12065, USA.
+
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+=========================================================================*/
+
+
+#ifndef __SIGNEDDISTANCEFIELD_HPP__
+#define __SIGNEDDISTANCEFIELD_HPP__
+
+#include <QFile>
+#include <QString>
+
+#include <opencv2/core/core.hpp>
+
+#include <vector>
+
+// Signed distance to a surface sampled on a regular grid, positive on the side of the normals.
+// The field is computed once from the points and normals of a model and saved as a raw volume :
+// a small header followed by the float values, x varying fastest, in the byte order of the
+// machine. Loading maps the file in memory, so a saved field is available immediately.
+// A field that was loaded keeps its file open : the fields cannot be copied.
+class SignedDistanceField
+{
+public:
+  static const int SDF_FILE_VERSION = 1;
+
+  SignedDistanceField();
+  ~SignedDistanceField();
+
+  // Grid of the given spacing over the bounding box of the points, extended by margin.
+  // Returns false if the normals do not match the points.
+  bool Compute( std::vector<cv::Vec3f> const& points, std::vector<cv::Vec3f> const& normals, float spacing, float margin );
+
+  bool Save( QString const& filename ) const;
+  bool Load( QString const& filename );
+  void Clear();
+
+  bool IsValid() const { return this->Data != NULL; };
+  cv::Vec3i GetDimensions() const { return this->Dimensions; };
+  cv::Vec3f GetOrigin() const { return this->Origin; };
+  float GetSpacing() const { return this->Spacing; };
+
+  // Trilinear distance and its gradient at point. Returns false outside of the grid.
+  bool Sample( cv::Vec3f const& point, float * distance, cv::Vec3f * gradient ) const;
+
+private:
+  SignedDistanceField( SignedDistanceField const& );
+  SignedDistanceField & operator=( SignedDistanceField const& );
+
+  cv::Vec3i Dimensions;
+  cv::Vec3f Origin;
+  float Spacing;
+
+  // Values of a computed field, or mapping of a loaded one
+  std::vector<float> Values;
+  QFile File;
+  uchar * Mapping;
+  float const* Data;
+};
+
+#endif //__SIGNEDDISTANCEFIELD_HPP__
@@ -0,0 +1,79 @@
+/*=========================================================================
+
+Library:   AnatomicAugmentedRealityProjector
+
+Author: Maeliss Jallais
+
+Copyright 2010 Kitware Inc. 28 Corporate Drive,
+Clifton Park, NY, 12065, USA.
+
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+=========================================================================*/
+
+
+#ifndef __SURFACEEXTRACTOR_HPP__
+#define __SURFACEEXTRACTOR_HPP__
+
+#include "TriangleMesh.hpp"
+
+#include <QString>
+
+#include <opencv2/core/core.hpp>
+
+// Surface of an anatomy in a CT or MR volume, read with ITK. The voxels between two
+// thresholds, or of one label, are selected and the mask is smoothed with ITK. The surface
+// is extracted with marching cubes, the volume being split in slabs along z that are processed
+// in parallel and stitched on the shared planes. The mesh is closed : the volume is padded
+// with background. It is then decimated by vertex clustering and can be saved in the cache
+// format of MeshLoader.
+class SurfaceExtractor
+{
+public:
+  SurfaceExtractor();
+
+  // Voxels with lower <= value <= upper are inside the surface
+  void SetThresholds( float lower, float upper ) { this->Lower = lower; this->Upper = upper; };
+  void SetLabel( int label ) { this->SetThresholds( static_cast<float>( label ), static_cast<float>( label ) ); };
+  // Variance of the Gaussian applied to the mask, in squared physical units. 0 disables it.
+  void SetSmoothingVariance( double variance ) { this->SmoothingVariance = variance; };
+  // From the physical units of the volume to the units of the mesh, millimeters to meters by default
+  void SetScale( float scale ) { this->Scale = scale; };
+  void SetNbSlabs( int nb ) { this->NbSlabs = nb; };
+  // Size of the clustering cells in voxels of the smallest spacing. 0 disables the decimation.
+  void SetClusterSize( float size ) { this->ClusterSize = size; };
+
+  bool Extract( QString const& filename, TriangleMesh * mesh ) const;
+  // Same as Extract, the mesh is saved as the cache of the volume : MeshLoader::Load( filename )
+  // then returns it while the volume is unchanged.
+  bool Convert( QString const& filename ) const;
+
+  // Isosurface of the values ( x varying fastest ), the normals point to the values below iso.
+  // The point of index ( i, j, k ) is at origin + direction * ( spacing .* ( i, j, k ) ).
+  bool ExtractIsoSurface( cv::Vec3i const& dimensions, cv::Vec3d const& spacing, cv::Vec3d const& origin, cv::Matx33d const& direction,
+    float const* values, float iso, TriangleMesh * mesh ) const;
+
+private:
+  void Decimate( float cell, TriangleMesh * mesh ) const;
+
+  float Lower;
+  float Upper;
+  double SmoothingVariance;
+  float Scale;
+  int NbSlabs;
+  float ClusterSize;
+};
+
+#endif //__SURFACEEXTRACTOR_HPP__
@@ -0,0 +1,42 @@
+/*=========================================================================
+
+Library:   AnatomicAugmentedRealityProjector
+
+Author: Maeliss Jallais
+
+Copyright 2010 Kitware Inc. 28 Corporate Drive,
+Clifton Park, NY, 12065, USA.
+
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+=========================================================================*/
+
+
+#ifndef __TRIANGLEMESH_HPP__
+#define __TRIANGLEMESH_HPP__
+
+#include <opencv2/core/core.hpp>
+
+#include <vector>
+
+// Indexed triangle mesh, the normals are per vertex and may be empty
+struct TriangleMesh
+{
+  std::vector<cv::Vec3f> Vertices;
+  std::vector<cv::Vec3f> Normals;
+  std::vector<cv::Vec3i> Triangles;
+};
+
+#endif //__TRIANGLEMESH_HPP__
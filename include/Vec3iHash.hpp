@@ -0,0 +1,46 @@
+/*=========================================================================
+
+Library:   AnatomicAugmentedRealityProjector
+
+Author: Maeliss Jallais
+
+Copyright 2010 Kitware Inc. 28 Corporate Drive,
+Clifton Park, NY, 12065, USA.
+
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+=========================================================================*/
+
+#ifndef __VEC3IHASH_HPP__
+#define __VEC3IHASH_HPP__
+
+#include <opencv2/core/core.hpp>
+
+#include <cstddef>
+
+// Hash of integer 3D keys : voxels of the sparse grids, welded vertices, sorted triangles
+class Vec3iHash
+  {
+  public:
+    std::size_t operator()( const cv::Vec3i &vec ) const
+      {
+      std::size_t s = static_cast<std::size_t>( vec( 0 ) ) * 73856093u
+        ^ static_cast<std::size_t>( vec( 1 ) ) * 19349663u
+        ^ static_cast<std::size_t>( vec( 2 ) ) * 83492791u;
+      return s;
+      }
+  };
+
+#endif //__VEC3IHASH_HPP__
@@ -26,13 +26,95 @@ limitations under the License.
 #ifndef __IO_UTIL_HPP__
 #define __IO_UTIL_HPP__
 
+#include <QFile>
+
 #include <opencv2/core/core.hpp>
 
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
 namespace io_util
 {
   enum PlyFlags { PlyPoints = 0x00, PlyColors = 0x01, PlyNormals = 0x02, PlyBinary = 0x04, PlyPlane = 0x08, PlyFaces = 0x10, PlyTexture = 0x20 };
 
-  bool write_ply( const std::string & filename, cv::Mat const& pointcloud_points, cv::Mat const& pointcloud_colors );
+  // Writes the points with z > 0. The flags select the format and the optional properties :
+  // colors and normals are written if they are selected and given, the face element only
+  // with PlyFaces. Binary colors get an opaque alpha and the header is padded, so that the
+  // vertices and their floats are aligned on 4 bytes in the file. Ascii floats are written
+  // with all their significant digits.
+  bool write_ply( const std::string & filename, cv::Mat const& pointcloud_points, cv::Mat const& pointcloud_colors,
+    cv::Mat const& pointcloud_normals = cv::Mat(), unsigned int flags = PlyBinary | PlyColors | PlyNormals );
+
+  // Vertices of a ply file, as one column matrices : the cloud is not organized anymore,
+  // the analysis takes it without the borders of an organized cloud.
+  // Colors are BGR, Colors and Normals are empty if the file does not have them.
+  // In a binary file whose three float32 coordinates, or normals, are consecutive and aligned
+  // on 4 bytes, with a vertex size multiple of 4 like in the files of write_ply, Points and
+  // Normals are views on the file mapped in memory, kept mapped by Mapping as long as the cloud
+  // or a copy of it exists. Otherwise they are copied.
+  // The mapping is private : writing in the views does not change the file.
+  struct PlyCloud
+    {
+    cv::Mat Points;
+    cv::Mat Colors;
+    cv::Mat Normals;
+    std::shared_ptr<QFile> Mapping;
+    };
+
+  bool read_ply( const std::string & filename, PlyCloud * cloud );
+
+  // Compressed archive of the points with z > 0 : the coordinates are quantized to precision
+  // from the corner of the bounding box, the points are sorted in Morton order, then the codes
+  // and the colors are delta encoded and compressed in chunks of chunk_size points.
+  // The chunks are encoded and decoded in parallel. The points are read back in Morton order,
+  // in one column matrices like read_ply, within precision / 2 of their original position.
+  static const int ARCHIVE_FILE_VERSION = 1;
+  bool write_archive( const std::string & filename, cv::Mat const& pointcloud_points, cv::Mat const& pointcloud_colors,
+    float precision = 0.0001f, int chunk_size = 65536 );
+  bool read_archive( const std::string & filename, cv::Mat & pointcloud_points, cv::Mat & pointcloud_colors );
+
+  enum PlyType { PlyInvalid = 0, PlyInt8, PlyUInt8, PlyInt16, PlyUInt16, PlyInt32, PlyUInt32, PlyFloat32, PlyFloat64 };
+
+  struct PlyProperty
+    {
+    std::string Name;
+    PlyType Type;
+    // Type of the number of items for a list property, PlyInvalid otherwise
+    PlyType CountType;
+    };
+
+  struct PlyElement
+    {
+    std::string Name;
+    size_t Count;
+    std::vector<PlyProperty> Properties;
+    };
+
+  // Parses the header of a ply file in memory. The data starts at header_size.
+  // Only the ascii and binary little endian formats are accepted.
+  bool read_ply_header( const char * data, size_t size, std::vector<PlyElement> & elements, bool * binary, size_t * header_size );
+  int ply_type_size( PlyType type );
+  // Size of one element in a binary file, 0 if it has list properties
+  size_t ply_element_stride( PlyElement const& element );
+
+  // Value of the given type at data, which does not need to be aligned
+  inline double read_ply_value( const unsigned char * data, PlyType type )
+    {
+    switch( type )
+      {
+      case PlyInt8: { signed char v; memcpy( &v, data, sizeof( v ) ); return v; }
+      case PlyUInt8: { unsigned char v; memcpy( &v, data, sizeof( v ) ); return v; }
+      case PlyInt16: { short v; memcpy( &v, data, sizeof( v ) ); return v; }
+      case PlyUInt16: { unsigned short v; memcpy( &v, data, sizeof( v ) ); return v; }
+      case PlyInt32: { int v; memcpy( &v, data, sizeof( v ) ); return v; }
+      case PlyUInt32: { unsigned int v; memcpy( &v, data, sizeof( v ) ); return v; }
+      case PlyFloat32: { float v; memcpy( &v, data, sizeof( v ) ); return v; }
+      case PlyFloat64: { double v; memcpy( &v, data, sizeof( v ) ); return v; }
+      default: return 0;
+      }
+    }
 };
 
 #endif  /* __IO_UTIL_HPP__ */
\ No newline at end of file
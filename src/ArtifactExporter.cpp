@@ -0,0 +1,239 @@
+/*=========================================================================
+
+Library:   AnatomicAugmentedRealityProjector
+
+Author: Maeliss Jallais
+
+Copyright 2010 Kitware Inc. 28 Corporate Drive,
+Clifton Park, NY, 12065, USA.
+
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+=========================================================================*/
+
+
+#include "ArtifactExporter.hpp"
+#include "io_util.hpp"
+#include "Logger.hpp"
+#include "Profiler.hpp"
+
+#include <QDir>
+#include <QFileInfo>
+
+#include <opencv2/highgui/highgui.hpp>
+
+#include <fstream>
+
+namespace
+{
+  const char * ArtifactNames[ ArtifactExporter::NbArtifacts ] = { "pointcloud", "color_classes", "centers", "planes", "scan_image", "color_image", "results" };
+}
+
+ArtifactExporter::ArtifactExporter() :
+  Writing( false ),
+  Stop( false )
+{
+  // The debug images are only wanted when looking for a problem
+  for( int a = 0; a < NbArtifacts; a++ )
+    {
+    this->Directories[ a ] = ".";
+    this->Enabled[ a ] = ( a != ScanImage && a != ColorImage );
+    }
+  this->Writer = std::thread( &ArtifactExporter::Write, this );
+}
+
+ArtifactExporter::~ArtifactExporter()
+{
+    {
+    std::lock_guard<std::mutex> lock( this->Mutex );
+    this->Stop = true;
+    }
+  this->Queued.notify_one();
+  this->Writer.join();
+}
+
+void ArtifactExporter::SetDirectory( QString const& directory )
+{
+  for( int a = 0; a < NbArtifacts; a++ )
+    {
+    this->Directories[ a ] = directory;
+    }
+}
+
+bool ArtifactExporter::LoadSettings( QString const& filename )
+{
+  cv::FileStorage fs( filename.toStdString(), cv::FileStorage::READ );
+  if( !fs.isOpened() )
+    {
+    return false;
+    }
+
+  int version = 0;
+  fs[ "export_settings_version" ] >> version;
+  if( version != EXPORT_SETTINGS_VERSION )
+    {
+    LOG_ERROR( Io, "Unsupported export settings file version : " << version );
+    return false;
+    }
+  std::string directory;
+  fs[ "directory" ] >> directory;
+  if( !directory.empty() )
+    {
+    this->SetDirectory( QString::fromStdString( directory ) );
+    }
+  for( int a = 0; a < NbArtifacts; a++ )
+    {
+    std::string name = ArtifactNames[ a ];
+    directory.clear();
+    fs[ name + "_directory" ] >> directory;
+    if( !directory.empty() )
+      {
+      this->Directories[ a ] = QString::fromStdString( directory );
+      }
+    if( !fs[ name + "_enabled" ].empty() )
+      {
+      int enabled = 0;
+      fs[ name + "_enabled" ] >> enabled;
+      this->Enabled[ a ] = ( enabled != 0 );
+      }
+    }
+  return true;
+}
+
+bool ArtifactExporter::SaveSettings( QString const& filename ) const
+{
+  cv::FileStorage fs( filename.toStdString(), cv::FileStorage::WRITE );
+  if( !fs.isOpened() )
+    {
+    return false;
+    }
+
+  fs << "export_settings_version" << EXPORT_SETTINGS_VERSION;
+  for( int a = 0; a < NbArtifacts; a++ )
+    {
+    std::string name = ArtifactNames[ a ];
+    fs << name + "_directory" << this->Directories[ a ].toStdString()
+      << name + "_enabled" << ( this->Enabled[ a ] ? 1 : 0 );
+    }
+  fs.release();
+  return true;
+}
+
+QString ArtifactExporter::GetFilename( Artifact artifact, QString const& name, const char * extension ) const
+{
+  return QDir( this->Directories[ artifact ] ).filePath( name + extension );
+}
+
+void ArtifactExporter::ExportPointCloud( Artifact artifact, QString const& name, cv::Mat const& points, cv::Mat const& colors )
+{
+  if( !this->Enabled[ artifact ] )
+    {
+    return;
+    }
+  Job job;
+  job.Type = PlyJob;
+  job.Filename = this->GetFilename( artifact, name, ".ply" );
+  // The copies wait in the queue, their memory is accounted to the export
+  Profiler::Scope scope( Profiler::Export );
+  job.Points = points.clone();
+  job.Colors = colors.clone();
+  this->Queue( job );
+}
+
+void ArtifactExporter::ExportImage( Artifact artifact, QString const& name, cv::Mat const& image )
+{
+  if( !this->Enabled[ artifact ] )
+    {
+    return;
+    }
+  Job job;
+  job.Type = ImageJob;
+  job.Filename = this->GetFilename( artifact, name, ".png" );
+  Profiler::Scope scope( Profiler::Export );
+  job.Image = image.clone();
+  this->Queue( job );
+}
+
+void ArtifactExporter::ExportText( Artifact artifact, QString const& name, std::string const& text )
+{
+  if( !this->Enabled[ artifact ] )
+    {
+    return;
+    }
+  Job job;
+  job.Type = TextJob;
+  job.Filename = this->GetFilename( artifact, name, ".txt" );
+  job.Text = text;
+  this->Queue( job );
+}
+
+void ArtifactExporter::Queue( Job const& job )
+{
+    {
+    std::lock_guard<std::mutex> lock( this->Mutex );
+    this->Jobs.push_back( job );
+    }
+  this->Queued.notify_one();
+}
+
+void ArtifactExporter::Flush()
+{
+  std::unique_lock<std::mutex> lock( this->Mutex );
+  this->Done.wait( lock, [ this ]() { return this->Jobs.empty() && !this->Writing; } );
+}
+
+void ArtifactExporter::Write()
+{
+  std::unique_lock<std::mutex> lock( this->Mutex );
+  for( ;; )
+    {
+    this->Queued.wait( lock, [ this ]() { return this->Stop || !this->Jobs.empty(); } );
+    if( this->Jobs.empty() )
+      {
+      // Stopped, everything was written
+      return;
+      }
+    Job job = this->Jobs.front();
+    this->Jobs.pop_front();
+    this->Writing = true;
+    lock.unlock();
+    Profiler::Scope scope( Profiler::Export );
+
+    bool success = QDir().mkpath( QFileInfo( job.Filename ).absolutePath() );
+    std::string filename = job.Filename.toStdString();
+    if( success && job.Type == PlyJob )
+      {
+      success = io_util::write_ply( filename, job.Points, job.Colors );
+      }
+    else if( success && job.Type == ImageJob )
+      {
+      success = cv::imwrite( filename, job.Image );
+      }
+    else if( success )
+      {
+      std::ofstream file( filename.c_str() );
+      file << job.Text;
+      success = file.good();
+      }
+    if( !success )
+      {
+      LOG_ERROR( Io, "Impossible to write " << filename );
+      }
+
+    lock.lock();
+    this->Writing = false;
+    this->Done.notify_all();
+    }
+}
@@ -0,0 +1,164 @@
+/*=========================================================================
+
+Library:   AnatomicAugmentedRealityProjector
+
+Author: Maeliss Jallais
+
+Copyright 2010 Kitware Inc. 28 Corporate Drive,
+Clifton Park, NY, 12065, USA.
+
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+=========================================================================*/
+
+
+#include "CalibrationRuntime.hpp"
+#include "Logger.hpp"
+
+#include <QFileInfo>
+
+#include <algorithm>
+#include <atomic>
+#include <sstream>
+
+namespace
+{
+  std::atomic<uint64> LastVersion( 0 );
+
+  // Missing distortion coefficients are 0 : only min_size values are needed
+  bool to_matx( cv::Mat const& mat, double * values, int size, int min_size )
+    {
+    if( mat.empty() || mat.total() < static_cast<size_t>( min_size ) )
+      {
+      return false;
+      }
+    cv::Mat mat_64;
+    mat.convertTo( mat_64, CV_64F );
+    mat_64 = mat_64.reshape( 1, 1 );
+    for( int i = 0; i < size; i++ )
+      {
+      values[ i ] = ( i < mat_64.cols ? mat_64.at<double>( 0, i ) : 0 );
+      }
+    return true;
+    }
+}
+
+std::shared_ptr<const CompiledCalibration> CompiledCalibration::Compile( CalibrationData const& data )
+{
+  std::shared_ptr<CompiledCalibration> calib = std::make_shared<CompiledCalibration>();
+  if( !data.IsValid() || !to_matx( data.Cam_K, calib->CamK.val, 9, 9 ) || !to_matx( data.Cam_kc, calib->CamKc.val, 5, 1 )
+    || !to_matx( data.Proj_K, calib->ProjK.val, 9, 9 ) || !to_matx( data.Proj_kc, calib->ProjKc.val, 5, 1 )
+    || !to_matx( data.R, calib->R.val, 9, 9 ) || !to_matx( data.T, calib->T.val, 3, 3 ) )
+    {
+    return std::shared_ptr<const CompiledCalibration>();
+    }
+  calib->Rt = calib->R.t();
+  calib->ProjectorCenter = -( calib->Rt * calib->T );
+  calib->CameraToProjector = cv::Matx44d::eye();
+  calib->ProjectorToCamera = cv::Matx44d::eye();
+  for( int r = 0; r < 3; r++ )
+    {
+    for( int c = 0; c < 3; c++ )
+      {
+      calib->CameraToProjector( r, c ) = calib->R( r, c );
+      calib->ProjectorToCamera( r, c ) = calib->Rt( r, c );
+      }
+    calib->CameraToProjector( r, 3 ) = calib->T[ r ];
+    calib->ProjectorToCamera( r, 3 ) = calib->ProjectorCenter[ r ];
+    }
+  calib->CamError = data.CamError;
+  calib->ProjError = data.ProjError;
+  calib->StereoError = data.StereoError;
+  calib->Filename = data.Filename;
+  calib->Version = ++LastVersion;
+  return calib;
+}
+
+CalibrationRuntime::CalibrationRuntime( QObject * parent ) :
+  QObject( parent ),
+  Watcher(),
+  Filename(),
+  Current()
+{
+  this->connect( &this->Watcher, SIGNAL( fileChanged( QString const& ) ), SLOT( FileChanged( QString const& ) ) );
+  this->connect( &this->Watcher, SIGNAL( directoryChanged( QString const& ) ), SLOT( DirectoryChanged( QString const& ) ) );
+}
+
+bool CalibrationRuntime::Load( QString const& filename )
+{
+  QString directory = QFileInfo( filename ).absolutePath();
+  if( !this->Filename.isEmpty() && this->Filename != filename )
+    {
+    this->Watcher.removePath( this->Filename );
+    QString previous_directory = QFileInfo( this->Filename ).absolutePath();
+    if( previous_directory != directory )
+      {
+      this->Watcher.removePath( previous_directory );
+      }
+    }
+  this->Filename = filename;
+  // Editors often replace the file instead of writing it : the path is watched again
+  if( QFileInfo( filename ).exists() && !this->Watcher.files().contains( filename ) )
+    {
+    this->Watcher.addPath( filename );
+    }
+  if( !this->Watcher.directories().contains( directory ) )
+    {
+    this->Watcher.addPath( directory );
+    }
+
+  CalibrationData data;
+  std::shared_ptr<const CompiledCalibration> calib;
+  if( !data.LoadCalibration( filename ) || ( calib = CompiledCalibration::Compile( data ) ) == NULL )
+    {
+    LOG_ERROR( Calibration, "[CalibrationRuntime] Impossible to read the calibration " << qPrintable( filename ) );
+    return false;
+    }
+  std::ostringstream text;
+  data.Display( text );
+  Logger::LogLines( Logger::Calibration, Logger::Info, text.str() );
+  std::atomic_store( &this->Current, calib );
+  emit CalibrationChanged( calib->Version );
+  return true;
+}
+
+std::shared_ptr<const CompiledCalibration> CalibrationRuntime::Get() const
+{
+  return std::atomic_load( &this->Current );
+}
+
+void CalibrationRuntime::FileChanged( QString const& filename )
+{
+  // Removed while it is replaced : it is loaded when it is back in its directory
+  if( !QFileInfo( filename ).exists() )
+    {
+    LOG_INFO( Calibration, "[CalibrationRuntime] " << qPrintable( filename ) << " removed, waiting for it to be written again" );
+    return;
+    }
+  LOG_INFO( Calibration, "[CalibrationRuntime] " << qPrintable( filename ) << " changed, the calibration is loaded again" );
+  this->Load( filename );
+}
+
+void CalibrationRuntime::DirectoryChanged( QString const& directory )
+{
+  // The file is back but is not watched anymore : it was replaced
+  if( this->Filename.isEmpty() || QFileInfo( this->Filename ).absolutePath() != directory
+    || !QFileInfo( this->Filename ).exists() || this->Watcher.files().contains( this->Filename ) )
+    {
+    return;
+    }
+  LOG_INFO( Calibration, "[CalibrationRuntime] " << qPrintable( this->Filename ) << " replaced, the calibration is loaded again" );
+  this->Load( this->Filename );
+}
@@ -0,0 +1,140 @@
+/*=========================================================================
+
+Library:   AnatomicAugmentedRealityProjector
+
+Author: Maeliss Jallais
+
+Copyright 2010 Kitware Inc. 28 Corporate Drive,
+Clifton Park, NY, 12065, USA.
+
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+=========================================================================*/
+
+
+#include "CameraGrabber.hpp"
+#include "Logger.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+const int CameraGrabber::MAX_FAILURES;
+const int CameraGrabber::MIN_BACKOFF_MS;
+const int CameraGrabber::MAX_BACKOFF_MS;
+
+CameraGrabber::CameraGrabber( QObject * parent ) :
+  QObject( parent ),
+  Camera( NULL ),
+  NewFrame( false ),
+  Pending( false ),
+  Stopping( false ),
+  Failed( false )
+{
+}
+
+CameraGrabber::~CameraGrabber()
+{
+  this->Stop();
+}
+
+void CameraGrabber::Start( CameraInput * camera, FrameHandler const& handler )
+{
+  this->Stop();
+  this->Camera = camera;
+  this->Handler = handler;
+  this->Stopping = false;
+  this->Failed = false;
+  this->Pending = false;
+  this->Grabber = std::thread( &CameraGrabber::Grab, this );
+}
+
+void CameraGrabber::Stop()
+{
+  if( this->Grabber.joinable() )
+    {
+    this->Stopping = true;
+    this->Grabber.join();
+    }
+  std::lock_guard<std::mutex> lock( this->Mutex );
+  this->Frame.release();
+  this->NewFrame = false;
+}
+
+bool CameraGrabber::TakeFrame( cv::Mat & frame )
+{
+  std::lock_guard<std::mutex> lock( this->Mutex );
+  this->Pending = false;
+  if( !this->NewFrame )
+    {
+    return false;
+    }
+  cv::swap( frame, this->Frame );
+  this->NewFrame = false;
+  return true;
+}
+
+void CameraGrabber::Grab()
+{
+  cv::Mat frame;
+  int failures = 0;
+  while( !this->Stopping )
+    {
+    this->Camera->IncrementTriggerDelay();
+    frame = this->Camera->GetImageFromBuffer();
+    if( frame.data )
+      {
+      failures = 0;
+      if( this->Handler )
+        {
+        this->Handler( frame );
+        }
+      this->PostFrame( frame );
+      continue;
+      }
+
+    // The camera is given time to recover instead of being polled in a loop
+    failures++;
+    if( failures >= MAX_FAILURES )
+      {
+      LOG_ERROR( Camera, "No image after " << failures << " attempts, the preview is stopped" );
+      this->Failed = true;
+      return;
+      }
+    int backoff = std::min( MAX_BACKOFF_MS, MIN_BACKOFF_MS << std::min( failures - 1, 16 ) );
+    // Stop does not wait for the end of the backoff
+    for( int waited = 0; waited < backoff && !this->Stopping; waited += MIN_BACKOFF_MS )
+      {
+      std::this_thread::sleep_for( std::chrono::milliseconds( MIN_BACKOFF_MS ) );
+      }
+    }
+}
+
+void CameraGrabber::PostFrame( cv::Mat const& frame )
+{
+  if( !frame.data )
+    {
+    return;
+    }
+    {
+    std::lock_guard<std::mutex> lock( this->Mutex );
+    this->Frame = frame;
+    this->NewFrame = true;
+    }
+  // Queued to the thread of the receiver, once until the frame is taken
+  if( !this->Pending.exchange( true ) )
+    {
+    emit FrameReady();
+    }
+}
@@ -24,6 +24,8 @@ limitations under the License.
 =========================================================================*/
 
 #include "CameraInput.hpp"
+#include "Logger.hpp"
+#include "Profiler.hpp"
 
 #include "FlyCapture2.h"
 
@@ -76,12 +78,12 @@ bool CameraInput::Run()
   }
   if (numCameras < 1)
   {
-    std::cout << "No camera detected." << std::endl;
+    LOG_WARNING( Camera, "No camera detected." );
     return false;
   }
   else
   {
-    std::cout << "Number of cameras detected: " << numCameras << std::endl;
+    LOG_INFO( Camera, "Number of cameras detected: " << numCameras );
   }
 
   error = busMgr.GetCameraFromIndex(0, &guid);
@@ -103,12 +105,12 @@ bool CameraInput::Run()
   error = Camera.StartCapture();
   if (error == PGRERROR_ISOCH_BANDWIDTH_EXCEEDED)
   {
-    std::cout << "Bandwidth exceeded" << std::endl;
+    LOG_ERROR( Camera, "Bandwidth exceeded" );
     return false;
   }
   else if (error != PGRERROR_OK)
   {
-    std::cout << "Failed to start image capture" << std::endl;
+    LOG_ERROR( Camera, "Failed to start image capture" );
     return false;
   }
   return true;
@@ -125,7 +127,7 @@ void CameraInput::SetCameraTriggerDelay(double delay)
 	Error error;
 
 	// Check if the camera supports the FRAME_RATE property
-	std::cout << "Detecting trigger delay from camera... " << std::endl;
+	LOG_EVERY_MS( Camera, Debug, 1000, "Detecting trigger delay from camera... " );
 	PropertyInfo propInfo;
 	propInfo.type = TRIGGER_DELAY;
 	error = this->Camera.GetPropertyInfo(&propInfo);
@@ -167,7 +169,7 @@ void CameraInput::SetCameraFrameRate(double frameRate)
   Error error;
 
   // Check if the camera supports the FRAME_RATE property
-  std::cout << "Detecting frame rate from camera... " << std::endl;
+  LOG_DEBUG( Camera, "Detecting frame rate from camera... " );
   PropertyInfo propInfo;
   propInfo.type = FRAME_RATE;
   error = this->Camera.GetPropertyInfo(&propInfo);
@@ -201,7 +203,7 @@ void CameraInput::SetCameraFrameRate(double frameRate)
       }
     }
   }
-  std::cout << "Asking frame rate of " << std::fixed << std::setprecision(1) << frameRate << std::endl;
+  LOG_INFO( Camera, "Asking frame rate of " << std::fixed << std::setprecision(1) << frameRate );
   this->GetCameraFrameRate();
 }
 
@@ -234,7 +236,7 @@ double CameraInput::GetCameraFrameRate()
       // Set the frame rate.
       // Note that the actual recording frame rate may be slower,
       // depending on the bus speed and disk writing speed.
-      std::cout << "Using frame rate of " << std::fixed << std::setprecision(1) << prop.absValue << std::endl;
+      LOG_INFO( Camera, "Using frame rate of " << std::fixed << std::setprecision(1) << prop.absValue );
       return prop.absValue;
     }
   }
@@ -258,7 +260,7 @@ void CameraInput::RecordImages()
       continue;
     }
 
-    std::cout << ".";
+    LOG_DEBUG( Camera, "Image " << imageCount << " grabbed" );
 
     // Get the raw image dimensions
     PixelFormat pixFormat;
@@ -297,25 +299,28 @@ void CameraInput::RecordImages()
       return;
     }
   }
-  std::cout << std::endl;
-  std::cout << "Finished grabbing images" << std::endl;
+  LOG_INFO( Camera, "Finished grabbing images" );
 }
 // note : return a value to detect an error ?
 
 cv::Mat CameraInput::GetImageFromBuffer()
 {
   FlyCapture2::Error error;
-  static bool flag = false;
   FlyCapture2::Image rawImage;
-  error = this->Camera.RetrieveBuffer(&rawImage);
+    {
+    Profiler::Scope scope( Profiler::Acquisition );
+    scope.AddItems( 1 );
+    error = this->Camera.RetrieveBuffer(&rawImage);
+    }
   if (error != FlyCapture2::PGRERROR_OK)
     {
-    error.PrintErrorTrace();
-    //if (timer.elapsed() > warmup) { error_frame++; }
-    //return;
+    // Called for every frame : a camera that fails keeps failing
+    LOG_EVERY_MS( Camera, Warning, 1000, "Impossible to retrieve the image : " << error.GetDescription() );
+    return cv::Mat();
     }
   //error_frame = 0;
   // convert to rgb
+  Profiler::Scope scope( Profiler::Conversion );
   FlyCapture2::Image rgbImage;
   rawImage.Convert(FlyCapture2::PIXEL_FORMAT_BGR, &rgbImage);
 
@@ -333,7 +338,7 @@ void CameraInput::FindTopBottomLines(cv::Mat mat_color_ref, cv::Mat mat_color)
 {
   if( !mat_color_ref.data || mat_color_ref.type() != CV_8UC3 || !mat_color.data || mat_color.type() != CV_8UC3 )
     {
-    std::cout << "ERROR invalid cv::Mat data" << std::endl;
+    LOG_ERROR( Camera, "invalid cv::Mat data" );
     return;
     }
   cv::Mat mat_BGR;
@@ -346,10 +351,13 @@ void CameraInput::FindTopBottomLines(cv::Mat mat_color_ref, cv::Mat mat_color)
   bool first = true;
 
   // Substract 2 images to keep only the line illuminated by the projector
-  cv::subtract( mat_color, mat_color_ref, mat_BGR );
+    {
+    Profiler::Scope scope( Profiler::Subtraction );
+    cv::subtract( mat_color, mat_color_ref, mat_BGR );
+    }
   if( !mat_BGR.data || mat_BGR.type() != CV_8UC3 )
     {
-    std::cout << "ERROR invalid cv::Mat data\n" << std::endl;
+    LOG_ERROR( Camera, "invalid cv::Mat data" );
     }
 
   //morphological opening (remove small objects from the foreground)
@@ -0,0 +1,325 @@
+/*=========================================================================
+
+Library:   AnatomicAugmentedRealityProjector
+
+Author: Maeliss Jallais
+
+Copyright 2010 Kitware Inc. 28 Corporate Drive,
+Clifton Park, NY, 12065, USA.
+
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+=========================================================================*/
+
+#include "ColorModel.hpp"
+#include "Logger.hpp"
+
+#include <opencv2/highgui/highgui.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+ColorModelAccumulator::ColorModelAccumulator() :
+  Count( 0 ),
+  Mean( 0, 0, 0 ),
+  M2( cv::Matx33d::zeros() )
+{
+}
+
+void ColorModelAccumulator::Add( cv::Vec3b const& bgr )
+{
+  cv::Vec3d x( bgr[ 0 ], bgr[ 1 ], bgr[ 2 ] );
+  ++this->Count;
+  cv::Vec3d delta = x - this->Mean;
+  this->Mean += delta / static_cast<double>( this->Count );
+  cv::Vec3d delta2 = x - this->Mean;
+  for( int i = 0; i < 3; i++ )
+    {
+    for( int j = 0; j < 3; j++ )
+      {
+      this->M2( i, j ) += delta[ i ] * delta2[ j ];
+      }
+    }
+}
+
+void ColorModelAccumulator::Merge( ColorModelAccumulator const& other )
+{
+  if( other.Count == 0 )
+    {
+    return;
+    }
+  if( this->Count == 0 )
+    {
+    *this = other;
+    return;
+    }
+  double na = static_cast<double>( this->Count );
+  double nb = static_cast<double>( other.Count );
+  double n = na + nb;
+  cv::Vec3d delta = other.Mean - this->Mean;
+  this->Mean += delta * ( nb / n );
+  for( int i = 0; i < 3; i++ )
+    {
+    for( int j = 0; j < 3; j++ )
+      {
+      this->M2( i, j ) += other.M2( i, j ) + delta[ i ] * delta[ j ] * na * nb / n;
+      }
+    }
+  this->Count += other.Count;
+}
+
+ColorModel ColorModelAccumulator::GetModel() const
+{
+  ColorModel model;
+  model.Mean = this->Mean;
+  model.Covariance = ( this->Count > 0 ? this->M2 * ( 1.0 / static_cast<double>( this->Count ) ) : cv::Matx33d::zeros() );
+  return model;
+}
+
+ColorModelSet::ColorModelSet() :
+  Filename()
+{
+  this->SetDefault();
+}
+
+void ColorModelSet::SetDefault()
+{
+  // BGR - Blue - curved
+  this->Models[ Blue ].Mean = cv::Vec3d( 162.790273556231, 69.31408308004053, 59.89260385005066 );
+  this->Models[ Blue ].Covariance = cv::Matx33d(
+    247.0512529140221, 23.33132238862042, 9.271295842918425,
+    23.33132238862042, 18.81523226462756, 5.455210543550453,
+    9.271295842918425, 5.455210543550453, 26.2255481338454 );
+
+  // BGR - Green - curved
+  this->Models[ Green ].Mean = cv::Vec3d( 89.98476454293629, 113.5203139427516, 69.0803324099723 );
+  this->Models[ Green ].Covariance = cv::Matx33d(
+    159.8986598476079, 120.4950001662561, 89.770845322959,
+    120.4950001662561, 166.0926159679223, 111.4628187322072,
+    89.770845322959, 111.4628187322072, 109.2779419024306 );
+
+  // BGR - Red - curved
+  this->Models[ Red ].Mean = cv::Vec3d( 55.29753265602322, 65.80188679245283, 210.0304789550073 );
+  this->Models[ Red ].Covariance = cv::Matx33d(
+    88.49347722135754, 27.61482323301476, 44.47569203806028,
+    27.61482323301476, 41.77134622230733, 70.2651094011009,
+    44.47569203806028, 70.2651094011009, 343.3067633409943 );
+
+  for( int c = 0; c < NbClasses; c++ )
+    {
+    this->NbSamples[ c ] = 0;
+    }
+  this->Filename = QString();
+  this->UpdateDensities();
+}
+
+void ColorModelSet::UpdateDensities()
+{
+  for( int c = 0; c < NbClasses; c++ )
+    {
+    cv::Matx33d const& cov = this->Models[ c ].Covariance;
+    this->InverseCovariance[ c ] = cov.inv( cv::DECOMP_SVD );
+    double det = cv::determinant( cov );
+    this->Normalization[ c ] = ( det > 0 ? 1.0 / std::sqrt( std::pow( 2.0 * CV_PI, 3 ) * det ) : 0.0 );
+    }
+}
+
+double ColorModelSet::Evaluate( ColorClass c, cv::Vec3b const& bgr ) const
+{
+  cv::Vec3d diff = cv::Vec3d( bgr[ 0 ], bgr[ 1 ], bgr[ 2 ] ) - this->Models[ c ].Mean;
+  double mahalanobis2 = diff.dot( this->InverseCovariance[ c ] * diff );
+  return this->Normalization[ c ] * std::exp( -0.5 * mahalanobis2 );
+}
+
+int ColorModelSet::Classify( cv::Vec3b const& bgr, double threshold ) const
+{
+  double density_G = this->Evaluate( Green, bgr );
+  double density_B = this->Evaluate( Blue, bgr );
+  double density_R = this->Evaluate( Red, bgr );
+  double density = std::max( { density_G, density_B, density_R } );
+  if( density <= threshold )
+    {
+    return -1;
+    }
+  if( density == density_G )
+    {
+    return Green;
+    }
+  return ( density == density_B ? Blue : Red );
+}
+
+static const char * const ColorClassNames[ ColorModelSet::NbClasses ] = { "blue", "green", "red" };
+
+bool ColorModelSet::LoadColorModels( QString const& filename )
+{
+  cv::FileStorage fs( filename.toStdString(), cv::FileStorage::READ );
+  if( !fs.isOpened() )
+    {
+    return false;
+    }
+
+  int version = 0;
+  fs[ "color_model_version" ] >> version;
+  if( version != COLOR_MODEL_FILE_VERSION )
+    {
+    LOG_ERROR( Io, "Unsupported color model file version : " << version );
+    return false;
+    }
+
+  ColorModel models[ NbClasses ];
+  long long nb_samples[ NbClasses ];
+  for( int c = 0; c < NbClasses; c++ )
+    {
+    std::string name = ColorClassNames[ c ];
+    cv::Mat mean, cov;
+    double samples = 0;
+    fs[ name + "_mean" ] >> mean;
+    fs[ name + "_cov" ] >> cov;
+    fs[ name + "_samples" ] >> samples;
+    if( mean.total() != 3 || cov.rows != 3 || cov.cols != 3 )
+      {
+      LOG_ERROR( Io, "Invalid " << name << " color model in " << filename.toStdString() );
+      return false;
+      }
+    mean.convertTo( mean, CV_64F );
+    cov.convertTo( cov, CV_64F );
+    models[ c ].Mean = cv::Vec3d( mean.ptr<double>( 0 ) );
+    models[ c ].Covariance = cv::Matx33d( cov.ptr<double>( 0 ) );
+    nb_samples[ c ] = static_cast<long long>( samples );
+    }
+  fs.release();
+
+  for( int c = 0; c < NbClasses; c++ )
+    {
+    this->Models[ c ] = models[ c ];
+    this->NbSamples[ c ] = nb_samples[ c ];
+    }
+  this->Filename = filename;
+  this->UpdateDensities();
+
+  return true;
+}
+
+bool ColorModelSet::SaveColorModels( QString const& filename ) const
+{
+  cv::FileStorage fs( filename.toStdString(), cv::FileStorage::WRITE );
+  if( !fs.isOpened() )
+    {
+    return false;
+    }
+
+  fs << "color_model_version" << COLOR_MODEL_FILE_VERSION;
+  for( int c = 0; c < NbClasses; c++ )
+    {
+    std::string name = ColorClassNames[ c ];
+    fs << name + "_mean" << cv::Mat( this->Models[ c ].Mean )
+      << name + "_cov" << cv::Mat( this->Models[ c ].Covariance )
+      << name + "_samples" << static_cast<double>( this->NbSamples[ c ] );
+    }
+  fs.release();
+
+  return true;
+}
+
+bool ColorModelSet::Train( QStringList const& imagenames, int min_intensity )
+{
+  int nb_images = static_cast<int>( imagenames.size() );
+  if( nb_images == 0 )
+    {
+    return false;
+    }
+
+  // One set of accumulators per image, merged afterwards in a fixed order so that
+  // the result does not depend on the scheduling of the threads
+  std::vector< std::vector<ColorModelAccumulator> > accumulators( nb_images, std::vector<ColorModelAccumulator>( NbClasses ) );
+  std::vector<int> valid( nb_images, 0 );
+
+  cv::parallel_for_( cv::Range( 0, nb_images ), [ & ]( const cv::Range & range )
+    {
+    for( int k = range.start; k < range.end; k++ )
+      {
+      cv::Mat mat = cv::imread( imagenames[ k ].toStdString() );
+      if( !mat.data || mat.type() != CV_8UC3 )
+        {
+        continue;
+        }
+      std::vector<ColorModelAccumulator> & acc = accumulators[ k ];
+      for( int i = 0; i < mat.rows; i++ )
+        {
+        const cv::Vec3b * row = mat.ptr<cv::Vec3b>( i );
+        for( int j = 0; j < mat.cols; j++ )
+          {
+          const cv::Vec3b & crt = row[ j ];
+          if( crt[ 0 ] > crt[ 1 ] && crt[ 0 ] > crt[ 2 ] && crt[ 0 ] > min_intensity )
+            {
+            acc[ Blue ].Add( crt );
+            }
+          else if( crt[ 1 ] > crt[ 0 ] && crt[ 1 ] > crt[ 2 ] && crt[ 1 ] > min_intensity )
+            {
+            acc[ Green ].Add( crt );
+            }
+          else if( crt[ 2 ] > crt[ 1 ] && crt[ 2 ] > crt[ 0 ] && crt[ 2 ] > min_intensity )
+            {
+            acc[ Red ].Add( crt );
+            }
+          }
+        }
+      valid[ k ] = 1;
+      }
+    } );
+
+  std::vector<ColorModelAccumulator> total( NbClasses );
+  for( int k = 0; k < nb_images; k++ )
+    {
+    if( !valid[ k ] )
+      {
+      LOG_WARNING( Io, "Could not read the sample image " << imagenames[ k ].toStdString() );
+      continue;
+      }
+    for( int c = 0; c < NbClasses; c++ )
+      {
+      total[ c ].Merge( accumulators[ k ][ c ] );
+      }
+    }
+
+  // A class without samples keeps its previous model
+  bool trained = false;
+  for( int c = 0; c < NbClasses; c++ )
+    {
+    if( total[ c ].GetCount() < 2 )
+      {
+      LOG_WARNING( Analysis, "Not enough " << ColorClassNames[ c ] << " samples, the previous model is kept" );
+      continue;
+      }
+    this->Models[ c ] = total[ c ].GetModel();
+    this->NbSamples[ c ] = total[ c ].GetCount();
+    trained = true;
+    }
+  this->UpdateDensities();
+  return trained;
+}
+
+void ColorModelSet::Display( std::ostream & stream ) const
+{
+  for( int c = 0; c < NbClasses; c++ )
+    {
+    stream << "Color model " << ColorClassNames[ c ] << " (" << this->NbSamples[ c ] << " samples): " << std::endl
+      << " - mean: " << this->Models[ c ].Mean << std::endl
+      << " - cov:\n" << this->Models[ c ].Covariance << std::endl
+      ;
+    }
+}
@@ -0,0 +1,332 @@
+/*=========================================================================
+
+Library:   AnatomicAugmentedRealityProjector
+
+Author: Maeliss Jallais
+
+Copyright 2010 Kitware Inc. 28 Corporate Drive,
+Clifton Park, NY, 12065, USA.
+
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+=========================================================================*/
+
+#include "CubeCornerSolver.hpp"
+#include "Logger.hpp"
+#include "PlaneRansac.hpp"
+#include "Profiler.hpp"
+
+#include <opencv2/calib3d/calib3d.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+CubeCornerSolver::CubeCornerSolver( uint64 seed ) :
+  Rng( seed ),
+  MaxIterations( 100 ),
+  Threshold( 0.01f ),
+  MinInliers( 3 ),
+  Confidence( 0.999 ),
+  Corner( 0, 0, 0 ),
+  Frame( cv::Matx33f::zeros() ),
+  Covariance( cv::Matx33f::zeros() ),
+  NbIterations( 0 )
+{
+  for( int f = 0; f < NbFaces; f++ )
+    {
+    this->NbInliers[ f ] = 0;
+    }
+  for( int f = 0; f <= NbFaces; f++ )
+    {
+    this->Begin[ f ] = 0;
+    }
+}
+
+void CubeCornerSolver::SetSeed( uint64 seed )
+{
+  this->Rng = cv::RNG( seed );
+}
+
+int CubeCornerSolver::Score( cv::Matx33f const& frame, cv::Vec3f const& corner, int inliers[ NbFaces ] ) const
+{
+  int total = 0;
+  for( int f = 0; f < NbFaces; f++ )
+    {
+    cv::Vec3f normal( frame( 0, f ), frame( 1, f ), frame( 2, f ) );
+    int begin = this->Begin[ f ];
+    inliers[ f ] = PlaneRansac::CountPlaneInliers( this->X.data() + begin, this->Y.data() + begin, this->Z.data() + begin,
+      this->Begin[ f + 1 ] - begin, normal, normal.dot( corner ), this->Threshold );
+    total += inliers[ f ];
+    }
+  return total;
+}
+
+void CubeCornerSolver::Refine( cv::Matx33d & frame, cv::Vec3d & corner )
+/*  Gauss-Newton on the residuals n_f.(p - corner) of the inliers of each face.
+    The frame is updated by a rotation so that it stays orthonormal. */
+{
+  for( int iteration = 0; iteration < 5; iteration++ )
+    {
+    cv::Matx66d JtJ = cv::Matx66d::zeros();
+    cv::Matx61d Jtr = cv::Matx61d::zeros();
+    double sum_r2 = 0;
+    int nb = 0;
+    for( int f = 0; f < NbFaces; f++ )
+      {
+      cv::Vec3d normal( frame( 0, f ), frame( 1, f ), frame( 2, f ) );
+      for( int i = this->Begin[ f ]; i < this->Begin[ f + 1 ]; i++ )
+        {
+        cv::Vec3d v = cv::Vec3d( this->X[ i ], this->Y[ i ], this->Z[ i ] ) - corner;
+        double r = normal.dot( v );
+        if( std::abs( r ) >= this->Threshold )
+          {
+          continue;
+          }
+        // d r / d rotation = normal x v, d r / d corner = -normal
+        cv::Vec3d j_rot = normal.cross( v );
+        double J[ 6 ] = { j_rot[ 0 ], j_rot[ 1 ], j_rot[ 2 ], -normal[ 0 ], -normal[ 1 ], -normal[ 2 ] };
+        for( int a = 0; a < 6; a++ )
+          {
+          for( int b = 0; b < 6; b++ )
+            {
+            JtJ( a, b ) += J[ a ] * J[ b ];
+            }
+          Jtr( a ) += J[ a ] * r;
+          }
+        sum_r2 += r * r;
+        nb++;
+        }
+      }
+    if( nb <= 6 )
+      {
+      return;
+      }
+
+    cv::Matx66d JtJ_inv = JtJ.inv( cv::DECOMP_SVD );
+    cv::Matx61d delta = -( JtJ_inv * Jtr );
+
+    // Covariance of the corner from the last linearization
+    double sigma2 = sum_r2 / ( nb - 6 );
+    for( int a = 0; a < 3; a++ )
+      {
+      for( int b = 0; b < 3; b++ )
+        {
+        this->Covariance( a, b ) = static_cast<float>( sigma2 * JtJ_inv( 3 + a, 3 + b ) );
+        }
+      }
+
+    cv::Mat rotation;
+    cv::Rodrigues( cv::Mat( cv::Vec3d( delta( 0 ), delta( 1 ), delta( 2 ) ) ), rotation );
+    frame = cv::Matx33d( rotation.ptr<double>( 0 ) ) * frame;
+    corner += cv::Vec3d( delta( 3 ), delta( 4 ), delta( 5 ) );
+
+    if( cv::norm( delta ) < 1e-9 )
+      {
+      return;
+      }
+    }
+}
+
+bool CubeCornerSolver::Fit( std::vector<cv::Vec3f> const& points_B, std::vector<cv::Vec3f> const& points_R, std::vector<cv::Vec3f> const& points_G )
+{
+  Profiler::Scope scope( Profiler::Ransac );
+  scope.AddItems( points_B.size() + points_R.size() + points_G.size() );
+  this->Corner = cv::Vec3f( 0, 0, 0 );
+  this->Frame = cv::Matx33f::zeros();
+  this->Covariance = cv::Matx33f::zeros();
+  this->NbIterations = 0;
+  for( int f = 0; f < NbFaces; f++ )
+    {
+    this->NbInliers[ f ] = 0;
+    }
+
+  std::vector<cv::Vec3f> const* faces[ NbFaces ] = { &points_B, &points_R, &points_G };
+  int n = 0;
+  for( int f = 0; f < NbFaces; f++ )
+    {
+    if( faces[ f ]->size() < 3 )
+      {
+      LOG_WARNING( Analysis, "At least 3 points required on each face" );
+      return false;
+      }
+    this->Begin[ f ] = n;
+    n += static_cast<int>( faces[ f ]->size() );
+    }
+  this->Begin[ NbFaces ] = n;
+
+  this->X.resize( n );
+  this->Y.resize( n );
+  this->Z.resize( n );
+  for( int f = 0; f < NbFaces; f++ )
+    {
+    int i = this->Begin[ f ];
+    for( auto iter = faces[ f ]->cbegin(); iter != faces[ f ]->cend(); ++iter, ++i )
+      {
+      this->X[ i ] = ( *iter )[ 0 ];
+      this->Y[ i ] = ( *iter )[ 1 ];
+      this->Z[ i ] = ( *iter )[ 2 ];
+      }
+    }
+
+  cv::Matx33f best_frame;
+  cv::Vec3f best_corner;
+  int best_total = 0;
+  int inliers[ NbFaces ];
+  int needed = this->MaxIterations;
+  int it;
+  for( it = 0; it < needed; it++ )
+    {
+    // The face sampled with 3 points changes at every iteration
+    int first = it % NbFaces;
+    int second = ( it + 1 ) % NbFaces;
+    int third = ( it + 2 ) % NbFaces;
+    int size_first = this->Begin[ first + 1 ] - this->Begin[ first ];
+    int size_second = this->Begin[ second + 1 ] - this->Begin[ second ];
+    int size_third = this->Begin[ third + 1 ] - this->Begin[ third ];
+
+    int idx1, idx2, idx3;
+    idx1 = this->Rng.uniform( 0, size_first );
+    do
+      {
+      idx2 = this->Rng.uniform( 0, size_first );
+      } while( idx2 == idx1 );
+    do
+      {
+      idx3 = this->Rng.uniform( 0, size_first );
+      } while( idx3 == idx1 || idx3 == idx2 );
+    idx1 += this->Begin[ first ];
+    idx2 += this->Begin[ first ];
+    idx3 += this->Begin[ first ];
+    cv::Vec3f A( this->X[ idx1 ], this->Y[ idx1 ], this->Z[ idx1 ] );
+    cv::Vec3f B( this->X[ idx2 ], this->Y[ idx2 ], this->Z[ idx2 ] );
+    cv::Vec3f C( this->X[ idx3 ], this->Y[ idx3 ], this->Z[ idx3 ] );
+    cv::Vec3f n1 = ( B - A ).cross( C - A );
+    float norm = std::sqrt( n1.dot( n1 ) );
+    if( norm < 1e-12f )
+      {
+      continue;
+      }
+    n1 = n1 / norm;
+
+    // The second plane contains the direction PQ and is orthogonal to the first one
+    int jdx1 = this->Rng.uniform( 0, size_second );
+    int jdx2;
+    do
+      {
+      jdx2 = this->Rng.uniform( 0, size_second );
+      } while( jdx2 == jdx1 );
+    jdx1 += this->Begin[ second ];
+    jdx2 += this->Begin[ second ];
+    cv::Vec3f P( this->X[ jdx1 ], this->Y[ jdx1 ], this->Z[ jdx1 ] );
+    cv::Vec3f Q( this->X[ jdx2 ], this->Y[ jdx2 ], this->Z[ jdx2 ] );
+    cv::Vec3f n2 = n1.cross( Q - P );
+    norm = std::sqrt( n2.dot( n2 ) );
+    if( norm < 1e-12f )
+      {
+      continue;
+      }
+    n2 = n2 / norm;
+
+    // The third plane is orthogonal to both, one point fixes its position
+    int kdx = this->Rng.uniform( 0, size_third ) + this->Begin[ third ];
+    cv::Vec3f G( this->X[ kdx ], this->Y[ kdx ], this->Z[ kdx ] );
+    cv::Vec3f n3 = n1.cross( n2 );
+
+    cv::Matx33f frame;
+    cv::Vec3f normals[ NbFaces ];
+    normals[ first ] = n1;
+    normals[ second ] = n2;
+    normals[ third ] = n3;
+    for( int f = 0; f < NbFaces; f++ )
+      {
+      for( int r = 0; r < 3; r++ )
+        {
+        frame( r, f ) = normals[ f ][ r ];
+        }
+      }
+    // Orthonormal frame : the corner is the sum of the normals weighted by the plane offsets
+    cv::Vec3f corner = n1 * n1.dot( A ) + n2 * n2.dot( P ) + n3 * n3.dot( G );
+
+    int total = this->Score( frame, corner, inliers );
+    if( total > best_total && inliers[ 0 ] >= this->MinInliers && inliers[ 1 ] >= this->MinInliers && inliers[ 2 ] >= this->MinInliers )
+      {
+      best_total = total;
+      best_frame = frame;
+      best_corner = corner;
+
+      // The 6 points of a sample are all inliers with probability (w_B.w_R.w_G)^2 on average
+      double w = 1.0;
+      for( int f = 0; f < NbFaces; f++ )
+        {
+        w *= static_cast<double>( inliers[ f ] ) / ( this->Begin[ f + 1 ] - this->Begin[ f ] );
+        }
+      double p_fail = 1.0 - w * w;
+      if( p_fail <= 0 )
+        {
+        needed = it + 1;
+        }
+      else
+        {
+        double k = std::log( 1.0 - this->Confidence ) / std::log( p_fail );
+        if( k < needed )
+          {
+          needed = std::max( it + 1, static_cast<int>( std::ceil( k ) ) );
+          }
+        }
+      }
+    }
+  this->NbIterations = it;
+
+  if( best_total == 0 )
+    {
+    return false;
+    }
+
+  cv::Matx33d frame = best_frame;
+  cv::Vec3d corner = best_corner;
+  this->Refine( frame, corner );
+
+  // Normals oriented towards the camera, which is at the origin
+  for( int f = 0; f < NbFaces; f++ )
+    {
+    cv::Vec3d normal( frame( 0, f ), frame( 1, f ), frame( 2, f ) );
+    if( normal.dot( corner ) > 0 )
+      {
+      for( int r = 0; r < 3; r++ )
+        {
+        frame( r, f ) = -frame( r, f );
+        }
+      }
+    }
+  this->Frame = frame;
+  this->Corner = corner;
+  this->Score( this->Frame, this->Corner, this->NbInliers );
+
+  return this->NbInliers[ 0 ] >= this->MinInliers && this->NbInliers[ 1 ] >= this->MinInliers && this->NbInliers[ 2 ] >= this->MinInliers;
+}
+
+bool CubeCornerSolver::IntersectPlanes( cv::Vec3f const& n1, cv::Vec3f const& n2, cv::Vec3f const& n3,
+  cv::Vec3f const& x1, cv::Vec3f const& x2, cv::Vec3f const& x3, cv::Vec3f & point )
+{
+  // Determinant of the matrix [n1 n2 n3]
+  float det = n1.dot( n2.cross( n3 ) );
+  if( std::abs( det ) < 1e-20 )
+    {
+    point = cv::Vec3f( 0, 0, 0 );
+    return false;
+    }
+  point = ( x1.dot( n1 ) * n2.cross( n3 ) + x2.dot( n2 ) * n3.cross( n1 ) + x3.dot( n3 ) * n1.cross( n2 ) ) / det;
+  return true;
+}
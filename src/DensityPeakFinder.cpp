@@ -0,0 +1,174 @@
+/*=========================================================================
+
+Library:   AnatomicAugmentedRealityProjector
+
+Author: Maeliss Jallais
+
+Copyright 2010 Kitware Inc. 28 Corporate Drive,
+Clifton Park, NY, 12065, USA.
+
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+=========================================================================*/
+
+#include "DensityPeakFinder.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+  // Lexicographic order of the voxels
+  bool key_less( cv::Vec3i const& key1, cv::Vec3i const& key2 )
+    {
+    return std::lexicographical_compare( key1.val, key1.val + 3, key2.val, key2.val + 3 );
+    }
+}
+
+DensityPeakFinder::DensityPeakFinder() :
+  VoxelSize( 0.01f ),
+  Sigma( 1.732f ),
+  Bandwidth( 0.02f ),
+  MaxMeanShiftIterations( 5 )
+{
+}
+
+cv::Vec3i DensityPeakFinder::Voxel( cv::Vec3f const& point ) const
+{
+  return cv::Vec3i( static_cast<int>( std::floor( point[ 0 ] / this->VoxelSize ) ),
+    static_cast<int>( std::floor( point[ 1 ] / this->VoxelSize ) ),
+    static_cast<int>( std::floor( point[ 2 ] / this->VoxelSize ) ) );
+}
+
+void DensityPeakFinder::SetPoints( MemoryTracker::Vector<cv::Vec3f> const& points )
+{
+  this->Points = points;
+  this->Index.Build( this->Points );
+}
+
+void DensityPeakFinder::SortKeys( DensityGrid const& grid )
+{
+  this->SortedKeys.clear();
+  this->SortedKeys.reserve( grid.size() );
+  for( auto iter = grid.cbegin(); iter != grid.cend(); ++iter )
+    {
+    this->SortedKeys.push_back( iter->first );
+    }
+  std::sort( this->SortedKeys.begin(), this->SortedKeys.end(), key_less );
+}
+
+void DensityPeakFinder::Blur( DensityGrid const& input, int axis, DensityGrid & output )
+/*  The contributions to a voxel are summed in the order of the input keys. */
+{
+  int radius = static_cast<int>( this->Kernel.size() / 2 );
+  output.clear();
+  output.reserve( 2 * input.size() );
+  this->SortKeys( input );
+  for( auto iter = this->SortedKeys.cbegin(); iter != this->SortedKeys.cend(); ++iter )
+    {
+    float value = input.find( *iter )->second;
+    cv::Vec3i key = *iter;
+    key[ axis ] -= radius;
+    for( int k = 0; k <= 2 * radius; k++, key[ axis ]++ )
+      {
+      output[ key ] += value * this->Kernel[ k ];
+      }
+    }
+}
+
+bool DensityPeakFinder::FindPeak( cv::Vec3f & peak )
+{
+  if( this->Points.empty() )
+    {
+    return false;
+    }
+
+  int radius = static_cast<int>( std::ceil( 3 * this->Sigma ) );
+  this->Kernel.resize( 2 * radius + 1 );
+  float sum = 0;
+  for( int k = -radius; k <= radius; k++ )
+    {
+    float value = ( this->Sigma > 0 ? std::exp( -0.5f * k * k / ( this->Sigma * this->Sigma ) ) : 1.f );
+    this->Kernel[ k + radius ] = value;
+    sum += value;
+    }
+  for( auto iter = this->Kernel.begin(); iter != this->Kernel.end(); ++iter )
+    {
+    *iter /= sum;
+    }
+
+  // The counts are whole numbers : their sums do not depend on the order of the points
+  DensityGrid & counts = this->Density[ 0 ];
+  counts.clear();
+  for( auto iter = this->Points.cbegin(); iter != this->Points.cend(); ++iter )
+    {
+    counts[ this->Voxel( *iter ) ] += 1;
+    }
+
+  // Separable blur : x, y then z
+  this->Blur( this->Density[ 0 ], 0, this->Density[ 1 ] );
+  this->Blur( this->Density[ 1 ], 1, this->Density[ 0 ] );
+  this->Blur( this->Density[ 0 ], 2, this->Density[ 1 ] );
+
+  // Of equal densities, the smallest key wins
+  cv::Vec3i best_key;
+  float best_value = -1;
+  for( auto iter = this->Density[ 1 ].cbegin(); iter != this->Density[ 1 ].cend(); ++iter )
+    {
+    if( iter->second > best_value || ( iter->second == best_value && key_less( iter->first, best_key ) ) )
+      {
+      best_value = iter->second;
+      best_key = iter->first;
+      }
+    }
+
+  cv::Vec3f start( ( best_key[ 0 ] + 0.5f ) * this->VoxelSize, ( best_key[ 1 ] + 0.5f ) * this->VoxelSize, ( best_key[ 2 ] + 0.5f ) * this->VoxelSize );
+  peak = this->MeanShift( start, this->Bandwidth );
+  return true;
+}
+
+cv::Vec3f DensityPeakFinder::MeanShift( cv::Vec3f const& start, float bandwidth ) const
+{
+  cv::Vec3f center = start;
+  float tolerance2 = 1e-4f * this->VoxelSize * this->VoxelSize;
+  std::vector<int> neighbors;
+  for( int it = 0; it < this->MaxMeanShiftIterations; it++ )
+    {
+    this->Index.RadiusSearch( center, bandwidth, neighbors );
+    cv::Vec3d sum( 0, 0, 0 );
+    int nb = static_cast<int>( neighbors.size() );
+    for( auto iter = neighbors.cbegin(); iter != neighbors.cend(); ++iter )
+      {
+      sum += cv::Vec3d( this->Points[ *iter ][ 0 ], this->Points[ *iter ][ 1 ], this->Points[ *iter ][ 2 ] );
+      }
+    if( nb == 0 )
+      {
+      break;
+      }
+    cv::Vec3f mean( static_cast<float>( sum[ 0 ] / nb ), static_cast<float>( sum[ 1 ] / nb ), static_cast<float>( sum[ 2 ] / nb ) );
+    cv::Vec3f shift = mean - center;
+    center = mean;
+    if( shift.dot( shift ) < tolerance2 )
+      {
+      break;
+      }
+    }
+  return center;
+}
+
+void DensityPeakFinder::RadiusSearch( cv::Vec3f const& center, float radius, std::vector<int> & indices ) const
+{
+  this->Index.RadiusSearch( center, radius, indices );
+}
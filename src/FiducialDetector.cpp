@@ -0,0 +1,258 @@
+/*=========================================================================
+
+Library:   AnatomicAugmentedRealityProjector
+
+Author: Maeliss Jallais
+
+Copyright 2010 Kitware Inc. 28 Corporate Drive,
+Clifton Park, NY, 12065, USA.
+
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+=========================================================================*/
+
+#include "FiducialDetector.hpp"
+#include "Logger.hpp"
+#include "Profiler.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+FiducialDetector::FiducialDetector( uint64 seed ) :
+  ColorModels( NULL ),
+  FaceRadius( 0.03f ),
+  CircleRadius( 0.008f ),
+  Solver( seed ),
+  Corner( 0, 0, 0 ),
+  CircleCorner( 0, 0, 0 )
+{
+  for( int f = 0; f < CubeCornerSolver::NbFaces; f++ )
+    {
+    // 1 cm voxels blurred with the variance of 3 voxels of the former histograms
+    this->PeakFinders[ f ].SetVoxelSize( 0.01f );
+    this->PeakFinders[ f ].SetSigma( std::sqrt( 3.f ) );
+    this->Centers[ f ] = cv::Vec3f( 0, 0, 0 );
+    }
+}
+
+cv::Vec3f FiducialDetector::MeanNearCenters( DensityPeakFinder const& finder, cv::Vec3f const& c1, cv::Vec3f const& c2, float dist,
+  cv::Vec3f const& previous, std::vector<int> & neighbors, float min_x )
+{
+  finder.RadiusSearch( c1, dist, neighbors );
+  float dist2 = dist * dist;
+  cv::Vec3f sum( 0, 0, 0 );
+  int nb = 0;
+  for( auto iter = neighbors.cbegin(); iter != neighbors.cend(); ++iter )
+    {
+    cv::Vec3f const& point = finder.GetPoint( *iter );
+    cv::Vec3f diff = point - c2;
+    if( diff.dot( diff ) < dist2 && point[ 0 ] > min_x )
+      {
+      sum += point;
+      nb++;
+      }
+    }
+  return ( nb > 0 ? sum / nb : previous );
+}
+
+void FiducialDetector::ClassifyCloud( cv::Mat const& pointcloud, cv::Mat const& pointcloud_BGR, ColorModelSet const& models,
+  MemoryTracker::Vector<cv::Vec3f> * points_B, MemoryTracker::Vector<cv::Vec3f> * points_G, MemoryTracker::Vector<cv::Vec3f> * points_R,
+  cv::Vec3f * box_min, cv::Vec3f * box_max, cv::Mat classes )
+{
+  Profiler::Scope scope( Profiler::Classification );
+  scope.AddItems( pointcloud.total() );
+  double sum_B = 0, sum_G = 0, sum_R = 0;
+  int nb_B = 0, nb_G = 0, nb_R = 0;
+  float max_x_B = -9999, min_x_B = 9999;
+  float max_y_B = -9999, min_y_B = 9999;
+
+  const int border = ( pointcloud_BGR.rows > 1 && pointcloud_BGR.cols > 1 ? 2 : 0 );
+  for( int row = border; row < pointcloud_BGR.rows - border; row++ )
+    {
+    const cv::Vec3f * points = pointcloud.ptr<cv::Vec3f>( row );
+    const cv::Vec3b * colors = pointcloud_BGR.ptr<cv::Vec3b>( row );
+    for( int col = border; col < pointcloud_BGR.cols - border; col++ )
+      {
+      cv::Vec3f const& crt = points[ col ];
+      if( crt[ 2 ] <= 0 ) // invalid points of the cloud
+        {
+        continue;
+        }
+      for( int k = 0; k < 3; k++ )
+        {
+        ( *box_min )[ k ] = std::min( ( *box_min )[ k ], crt[ k ] );
+        ( *box_max )[ k ] = std::max( ( *box_max )[ k ], crt[ k ] );
+        }
+
+      double res_G = models.Evaluate( ColorModelSet::Green, colors[ col ] );
+      double res_B = models.Evaluate( ColorModelSet::Blue, colors[ col ] );
+      double res_R = models.Evaluate( ColorModelSet::Red, colors[ col ] );
+      double res = std::max( { res_G, res_B, res_R } );
+      cv::Vec3b shown( 255, 255, 255 );
+      if( res > 1e-9 )
+        {
+        if( res == res_G )
+          {
+          shown = cv::Vec3b( 0, 255, 0 );
+          points_G->push_back( crt );
+          sum_G += res;
+          nb_G++;
+          }
+        else if( res == res_B )
+          {
+          shown = cv::Vec3b( 255, 0, 0 );
+          points_B->push_back( crt );
+          sum_B += res;
+          nb_B++;
+          max_x_B = std::max( max_x_B, crt[ 0 ] );
+          min_x_B = std::min( min_x_B, crt[ 0 ] );
+          max_y_B = std::max( max_y_B, crt[ 1 ] );
+          min_y_B = std::min( min_y_B, crt[ 1 ] );
+          }
+        else
+          {
+          shown = cv::Vec3b( 0, 0, 255 );
+          points_R->push_back( crt );
+          sum_R += res;
+          nb_R++;
+          }
+        }
+      if( classes.data )
+        {
+        classes.at<cv::Vec3b>( row, col ) = shown;
+        }
+      }
+    }
+
+  LOG_DEBUG( Analysis, "Mean densities : blue " << sum_B / nb_B << ", green " << sum_G / nb_G << ", red " << sum_R / nb_R );
+  LOG_DEBUG( Analysis, "Blue face : x in [" << min_x_B << ", " << max_x_B << "], y in [" << min_y_B << ", " << max_y_B << "]" );
+}
+
+void FiducialDetector::ClassifyPoints( std::vector<cv::Vec3f> const& points, std::vector<cv::Vec3b> const& colors )
+{
+  Profiler::Scope scope( Profiler::Classification );
+  scope.AddItems( points.size() );
+  for( int f = 0; f < CubeCornerSolver::NbFaces; f++ )
+    {
+    this->FacePoints[ f ].clear();
+    }
+  for( size_t i = 0; i < points.size(); i++ )
+    {
+    switch( this->ColorModels->Classify( colors[ i ] ) )
+      {
+      case ColorModelSet::Blue: this->FacePoints[ CubeCornerSolver::Blue ].push_back( points[ i ] ); break;
+      case ColorModelSet::Red: this->FacePoints[ CubeCornerSolver::Red ].push_back( points[ i ] ); break;
+      case ColorModelSet::Green: this->FacePoints[ CubeCornerSolver::Green ].push_back( points[ i ] ); break;
+      default: break;
+      }
+    }
+  for( int f = 0; f < CubeCornerSolver::NbFaces; f++ )
+    {
+    this->PeakFinders[ f ].SetPoints( this->FacePoints[ f ] );
+    }
+}
+
+bool FiducialDetector::Detect( std::vector<cv::Vec3f> const& points, std::vector<cv::Vec3b> const& colors )
+{
+  this->Corner = cv::Vec3f( 0, 0, 0 );
+  this->CircleCorner = cv::Vec3f( 0, 0, 0 );
+  if( this->ColorModels == NULL || points.size() != colors.size() )
+    {
+    return false;
+    }
+
+  // Densest point of each color
+  this->ClassifyPoints( points, colors );
+  for( int f = 0; f < CubeCornerSolver::NbFaces; f++ )
+    {
+    if( !this->PeakFinders[ f ].FindPeak( this->Centers[ f ] ) )
+      {
+      return false;
+      }
+    }
+  return this->FitCorner( points, 0.08f );
+}
+
+bool FiducialDetector::Refine( std::vector<cv::Vec3f> const& points, std::vector<cv::Vec3b> const& colors )
+{
+  if( this->ColorModels == NULL || points.size() != colors.size() )
+    {
+    return false;
+    }
+
+  // The previous centers are already close to the corner : no peak search
+  this->ClassifyPoints( points, colors );
+  for( int f = 0; f < CubeCornerSolver::NbFaces; f++ )
+    {
+    if( this->PeakFinders[ f ].GetNbPoints() == 0 )
+      {
+      return false;
+      }
+    }
+  return this->FitCorner( points, 0.04f );
+}
+
+bool FiducialDetector::FitCorner( std::vector<cv::Vec3f> const& points, float start_dist )
+{
+  using Face = CubeCornerSolver::Face;
+  const Face Blue = CubeCornerSolver::Blue, Red = CubeCornerSolver::Red, Green = CubeCornerSolver::Green;
+
+  // The centers are pulled towards the corner of the cube
+  for( float dist = start_dist; dist > 0.03f; dist -= 0.01f )
+    {
+    this->Centers[ Blue ] = MeanNearCenters( this->PeakFinders[ Blue ], this->Centers[ Green ], this->Centers[ Red ], dist, this->Centers[ Blue ], this->Neighbors );
+    this->Centers[ Red ] = MeanNearCenters( this->PeakFinders[ Red ], this->Centers[ Blue ], this->Centers[ Green ], dist, this->Centers[ Red ], this->Neighbors );
+    this->Centers[ Green ] = MeanNearCenters( this->PeakFinders[ Green ], this->Centers[ Blue ], this->Centers[ Red ], dist, this->Centers[ Green ], this->Neighbors );
+    }
+  // M1 : points of each color around the centers
+  for( int f = 0; f < CubeCornerSolver::NbFaces; f++ )
+    {
+    this->Selected[ f ].clear();
+    this->PeakFinders[ f ].RadiusSearch( this->Centers[ f ], this->FaceRadius, this->Neighbors );
+    for( auto iter = this->Neighbors.cbegin(); iter != this->Neighbors.cend(); ++iter )
+      {
+      this->Selected[ f ].push_back( this->PeakFinders[ f ].GetPoint( *iter ) );
+      }
+    }
+  this->Solver.SetMaxIterations( 100 );
+  this->Solver.SetThreshold( 0.01f );
+  this->Solver.SetMinInliers( 3 );
+  if( !this->Solver.Fit( this->Selected[ Blue ], this->Selected[ Red ], this->Selected[ Green ] ) )
+    {
+    return false;
+    }
+  this->Corner = this->Solver.GetCorner();
+
+  // M2 : all the points of the circles around the centers
+  this->CloudIndex.Build( points );
+  this->CloudIndex.RadiusSearch( std::vector<cv::Vec3f>( this->Centers, this->Centers + CubeCornerSolver::NbFaces ), this->CircleRadius, this->Circles );
+  for( int f = 0; f < CubeCornerSolver::NbFaces; f++ )
+    {
+    this->Selected[ f ].clear();
+    for( auto iter = this->Circles[ f ].cbegin(); iter != this->Circles[ f ].cend(); ++iter )
+      {
+      this->Selected[ f ].push_back( points[ *iter ] );
+      }
+    }
+  size_t smallest = std::min( { this->Selected[ Blue ].size(), this->Selected[ Red ].size(), this->Selected[ Green ].size() } );
+  this->Solver.SetMinInliers( std::min( 10, int( smallest ) - 2 ) );
+  if( !this->Solver.Fit( this->Selected[ Blue ], this->Selected[ Red ], this->Selected[ Green ] ) )
+    {
+    return false;
+    }
+  this->CircleCorner = this->Solver.GetCorner();
+
+  return true;
+}
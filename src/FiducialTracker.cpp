@@ -0,0 +1,193 @@
+/*=========================================================================
+
+Library:   AnatomicAugmentedRealityProjector
+
+Author: Maeliss Jallais
+
+Copyright 2010 Kitware Inc. 28 Corporate Drive,
+Clifton Park, NY, 12065, USA.
+
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+=========================================================================*/
+
+
+#include "FiducialTracker.hpp"
+#include "Logger.hpp"
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include <cmath>
+
+FiducialTracker::FiducialTracker() :
+  Scanner(),
+  Detector(),
+  CubeSize( 0.08f ),
+  Margin( 16 ),
+  DetectionInterval( 60 ),
+  MaxMisses( 10 ),
+  Tracking( false ),
+  NbMisses( 0 ),
+  NbNewLines( 0 ),
+  Roi(),
+  Corner( 0, 0, 0 ),
+  CircleCorner( 0, 0, 0 )
+{
+}
+
+void FiducialTracker::Reset()
+{
+  this->Tracking = false;
+  this->NbMisses = 0;
+  this->NbNewLines = 0;
+  this->Roi = cv::Rect();
+  this->Lines.clear();
+}
+
+bool FiducialTracker::InBox( cv::Vec3f const& point ) const
+{
+  cv::Vec3f diff = point - this->Corner;
+  return std::abs( diff[ 0 ] ) < this->CubeSize && std::abs( diff[ 1 ] ) < this->CubeSize && std::abs( diff[ 2 ] ) < this->CubeSize;
+}
+
+void FiducialTracker::StoreLine()
+{
+  if( this->Current.Row >= static_cast<int>( this->Lines.size() ) )
+    {
+    this->Lines.resize( this->Current.Row + 1 );
+    }
+  std::swap( this->Lines[ this->Current.Row ], this->Current );
+}
+
+void FiducialTracker::GatherPoints()
+{
+  this->Points.clear();
+  this->Colors.clear();
+  for( auto line = this->Lines.cbegin(); line != this->Lines.cend(); ++line )
+    {
+    for( size_t k = 0; k < line->Points.size(); k++ )
+      {
+      if( !this->Tracking || this->InBox( line->Points[ k ] ) )
+        {
+        this->Points.push_back( line->Points[ k ] );
+        this->Colors.push_back( line->Colors[ k ] );
+        }
+      }
+    }
+}
+
+bool FiducialTracker::UpdateRoi( cv::Size const& image_size )
+{
+  this->BoxCorners.clear();
+  for( int k = 0; k < 8; k++ )
+    {
+    cv::Vec3f offset( ( k & 1 ) ? this->CubeSize : -this->CubeSize, ( k & 2 ) ? this->CubeSize : -this->CubeSize, ( k & 4 ) ? this->CubeSize : -this->CubeSize );
+    this->BoxCorners.push_back( this->Corner + offset );
+    }
+  this->Scanner.ProjectPoints( this->BoxCorners, this->BoxPixels );
+  if( this->BoxPixels.size() != this->BoxCorners.size() )
+    {
+    return false;
+    }
+
+  cv::Rect box = cv::boundingRect( this->BoxPixels );
+  box = cv::Rect( box.x - this->Margin, box.y - this->Margin, box.width + 2 * this->Margin, box.height + 2 * this->Margin );
+  this->Roi = box & cv::Rect( 0, 0, image_size.width, image_size.height );
+  return this->Roi.area() > 0;
+}
+
+bool FiducialTracker::Update( cv::Mat const& mat_color_ref, cv::Mat const& mat_color )
+{
+  if( !this->Tracking )
+    {
+    // Whole image : the lines of the sweep are accumulated until a detection succeeds
+    if( !this->Scanner.Reconstruct( mat_color_ref, mat_color, &this->Current ) )
+      {
+      return false;
+      }
+    this->StoreLine();
+    if( ++this->NbNewLines < this->DetectionInterval )
+      {
+      return false;
+      }
+    this->NbNewLines = 0;
+    this->GatherPoints();
+    if( !this->Detector.Detect( this->Points, this->Colors ) )
+      {
+      return false;
+      }
+    this->Corner = this->Detector.GetCorner();
+    this->CircleCorner = this->Detector.GetCircleCorner();
+    if( !this->UpdateRoi( mat_color.size() ) )
+      {
+      return false;
+      }
+
+    // Only the points around the corner are kept
+    this->Tracking = true;
+    this->NbMisses = 0;
+    for( auto line = this->Lines.begin(); line != this->Lines.end(); ++line )
+      {
+      size_t kept = 0;
+      for( size_t k = 0; k < line->Points.size(); k++ )
+        {
+        if( this->InBox( line->Points[ k ] ) )
+          {
+          line->Pixels[ kept ] = line->Pixels[ k ];
+          line->Points[ kept ] = line->Points[ k ];
+          line->Colors[ kept ] = line->Colors[ k ];
+          kept++;
+          }
+        }
+      line->Pixels.resize( kept );
+      line->Points.resize( kept );
+      line->Colors.resize( kept );
+      }
+    LOG_INFO( Scan, "Tracking started, corner : " << this->Corner );
+    return true;
+    }
+
+  // Tracking : the work only depends on the size of the cube in the image
+  if( !this->Scanner.Reconstruct( mat_color_ref, mat_color, this->Roi, &this->Current ) )
+    {
+    return false;
+    }
+  // A line without any point in the region is a miss : the cube moved away from where it was
+  // tracked, the full detection has to find it again
+  if( !this->Current.Points.empty() )
+    {
+    this->StoreLine();
+    this->GatherPoints();
+    if( this->Detector.Refine( this->Points, this->Colors ) )
+      {
+      this->Corner = this->Detector.GetCorner();
+      this->CircleCorner = this->Detector.GetCircleCorner();
+      this->NbMisses = 0;
+      if( !this->UpdateRoi( mat_color.size() ) )
+        {
+        LOG_INFO( Scan, "Tracking lost, the cube left the image" );
+        this->Reset();
+        }
+      return true;
+      }
+    }
+
+  if( ++this->NbMisses > this->MaxMisses )
+    {
+    LOG_INFO( Scan, "Tracking lost, back to the full detection" );
+    this->Reset();
+    }
+  return false;
+}
@@ -0,0 +1,352 @@
+/*=========================================================================
+
+Library:   AnatomicAugmentedRealityProjector
+
+Author: Maeliss Jallais
+
+Copyright 2010 Kitware Inc. 28 Corporate Drive,
+Clifton Park, NY, 12065, USA.
+
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+=========================================================================*/
+
+
+#include "IcpRegistration.hpp"
+#include "Logger.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+  // The correspondences are summed by blocks, then the blocks in order
+  const int NbBlocks = 64;
+
+  // Adds the row J = ( p x n, n ) of residual r to the normal equations
+  inline void AddRow( cv::Vec3d const& p, cv::Vec3d const& n, double r, cv::Matx66d & A, cv::Vec6d & b )
+    {
+    cv::Vec3d a = p.cross( n );
+    double J[ 6 ] = { a[ 0 ], a[ 1 ], a[ 2 ], n[ 0 ], n[ 1 ], n[ 2 ] };
+    for( int i = 0; i < 6; i++ )
+      {
+      for( int j = i; j < 6; j++ )
+        {
+        A( i, j ) += J[ i ] * J[ j ];
+        }
+      b[ i ] += J[ i ] * r;
+      }
+    }
+
+  // Rotation of angle |w| around w
+  cv::Matx33d ExpRotation( cv::Vec3d const& w )
+    {
+    double angle = cv::norm( w );
+    if( angle < 1e-12 )
+      {
+      return cv::Matx33d::eye();
+      }
+    cv::Vec3d k = w / angle;
+    cv::Matx33d K( 0, -k[ 2 ], k[ 1 ],
+      k[ 2 ], 0, -k[ 0 ],
+      -k[ 1 ], k[ 0 ], 0 );
+    return cv::Matx33d::eye() + std::sin( angle ) * K + ( 1 - std::cos( angle ) ) * K * K;
+    }
+}
+
+IcpRegistration::IcpRegistration() :
+  Method( PointToPlane ),
+  MaxIterations( 20 ),
+  NbLevels( 3 ),
+  SubsamplingFactor( 4 ),
+  MaxDistance( 0.02f ),
+  TrimRatio( 0.9f ),
+  Tolerance( 1e-6 ),
+  NbNormalNeighbors( 10 ),
+  DistanceField( NULL ),
+  RmsError( 0 ),
+  NbIterations( 0 ),
+  NbCorrespondences( 0 )
+{
+}
+
+void IcpRegistration::EstimateNormals( PointCloudIndex const& index, std::vector<cv::Vec3f> const& points, int k, std::vector<cv::Vec3f> & normals )
+{
+  normals.resize( points.size() );
+  cv::parallel_for_( cv::Range( 0, static_cast<int>( points.size() ) ), [ & ]( const cv::Range & range )
+    {
+    std::vector<int> ids;
+    std::vector<float> distances2;
+    for( int i = range.start; i < range.end; i++ )
+      {
+      index.KnnSearch( points[ i ], k, ids, distances2 );
+      cv::Vec3d mean( 0, 0, 0 );
+      for( auto iter = ids.cbegin(); iter != ids.cend(); ++iter )
+        {
+        mean += cv::Vec3d( points[ *iter ] );
+        }
+      mean /= std::max( static_cast<int>( ids.size() ), 1 );
+      cv::Matx33d covariance = cv::Matx33d::zeros();
+      for( auto iter = ids.cbegin(); iter != ids.cend(); ++iter )
+        {
+        cv::Vec3d d = cv::Vec3d( points[ *iter ] ) - mean;
+        covariance += d * d.t();
+        }
+
+      // Eigenvector of the smallest eigenvalue
+      cv::Vec3d values;
+      cv::Matx33d vectors;
+      cv::eigen( covariance, values, vectors );
+      cv::Vec3d normal( vectors( 2, 0 ), vectors( 2, 1 ), vectors( 2, 2 ) );
+      if( normal.dot( cv::Vec3d( points[ i ] ) ) > 0 )
+        {
+        normal = -normal;
+        }
+      normals[ i ] = cv::Vec3f( normal );
+      }
+    } );
+}
+
+void IcpRegistration::SetModel( std::vector<cv::Vec3f> const& points, std::vector<cv::Vec3f> const& normals )
+{
+  this->ModelPoints = points;
+  this->ModelIndex.Build( points );
+  if( normals.size() == points.size() )
+    {
+    this->ModelNormals = normals;
+    }
+  else
+    {
+    EstimateNormals( this->ModelIndex, this->ModelPoints, this->NbNormalNeighbors, this->ModelNormals );
+    }
+}
+
+float IcpRegistration::MatchPoints( cv::Matx33d const& R, cv::Vec3d const& t )
+{
+  int n = static_cast<int>( this->Source.size() );
+  this->Moved.resize( n );
+  this->Matches.resize( n );
+  this->Distances2.resize( n );
+  cv::Matx33f Rf( R );
+  cv::Vec3f tf( t );
+  float max_distance2 = this->MaxDistance * this->MaxDistance;
+  if( this->Method == SignedDistance )
+    {
+    this->FieldDistances.resize( n );
+    this->FieldGradients.resize( n );
+    }
+  cv::parallel_for_( cv::Range( 0, n ), [ & ]( const cv::Range & range )
+    {
+    for( int i = range.start; i < range.end; i++ )
+      {
+      this->Moved[ i ] = Rf * this->Source[ i ] + tf;
+      if( this->Method != SignedDistance )
+        {
+        this->Matches[ i ] = this->ModelIndex.NearestSearch( this->Moved[ i ], max_distance2, &this->Distances2[ i ] );
+        continue;
+        }
+      // The field gives the distance to the model directly, the match is only a flag
+      float & distance = this->FieldDistances[ i ];
+      bool inside = this->DistanceField->Sample( this->Moved[ i ], &distance, &this->FieldGradients[ i ] );
+      this->Distances2[ i ] = distance * distance;
+      this->Matches[ i ] = ( inside && this->Distances2[ i ] < max_distance2 ? 0 : -1 );
+      }
+    } );
+
+  // Only the closest correspondences are kept
+  this->Sorted.clear();
+  for( int i = 0; i < n; i++ )
+    {
+    if( this->Matches[ i ] >= 0 )
+      {
+      this->Sorted.push_back( this->Distances2[ i ] );
+      }
+    }
+  if( this->Sorted.empty() )
+    {
+    return -1;
+    }
+  size_t keep = static_cast<size_t>( this->TrimRatio * this->Sorted.size() );
+  if( keep >= this->Sorted.size() )
+    {
+    return max_distance2;
+    }
+  keep = std::max( keep, size_t( 1 ) );
+  std::nth_element( this->Sorted.begin(), this->Sorted.begin() + keep - 1, this->Sorted.end() );
+  return this->Sorted[ keep - 1 ];
+}
+
+bool IcpRegistration::SolveIncrement( float threshold, cv::Vec6d & x )
+{
+  int n = static_cast<int>( this->Source.size() );
+  this->Blocks.resize( NbBlocks );
+  cv::parallel_for_( cv::Range( 0, NbBlocks ), [ & ]( const cv::Range & range )
+    {
+    for( int block = range.start; block < range.end; block++ )
+      {
+      NormalEquations & sums = this->Blocks[ block ];
+      sums.A = cv::Matx66d::zeros();
+      sums.b = cv::Vec6d::all( 0 );
+      sums.Error2 = 0;
+      sums.NbPoints = 0;
+      int end = static_cast<int>( static_cast<int64>( n ) * ( block + 1 ) / NbBlocks );
+      for( int i = static_cast<int>( static_cast<int64>( n ) * block / NbBlocks ); i < end; i++ )
+        {
+        int m = this->Matches[ i ];
+        if( m < 0 || this->Distances2[ i ] > threshold )
+          {
+          continue;
+          }
+        cv::Vec3d p( this->Moved[ i ] );
+        if( this->Method == SignedDistance )
+          {
+          double r = this->FieldDistances[ i ];
+          AddRow( p, cv::Vec3d( this->FieldGradients[ i ] ), r, sums.A, sums.b );
+          sums.Error2 += r * r;
+          sums.NbPoints++;
+          continue;
+          }
+        cv::Vec3d q( this->ModelPoints[ m ] );
+        if( this->Method == PointToPlane )
+          {
+          cv::Vec3d normal( this->ModelNormals[ m ] );
+          double r = normal.dot( p - q );
+          AddRow( p, normal, r, sums.A, sums.b );
+          sums.Error2 += r * r;
+          }
+        else
+          {
+          for( int axis = 0; axis < 3; axis++ )
+            {
+            cv::Vec3d e( 0, 0, 0 );
+            e[ axis ] = 1;
+            AddRow( p, e, p[ axis ] - q[ axis ], sums.A, sums.b );
+            }
+          sums.Error2 += this->Distances2[ i ];
+          }
+        sums.NbPoints++;
+        }
+      }
+    } );
+
+  cv::Matx66d A = cv::Matx66d::zeros();
+  cv::Vec6d b = cv::Vec6d::all( 0 );
+  double error2 = 0;
+  this->NbCorrespondences = 0;
+  for( auto iter = this->Blocks.cbegin(); iter != this->Blocks.cend(); ++iter )
+    {
+    A += iter->A;
+    b += iter->b;
+    error2 += iter->Error2;
+    this->NbCorrespondences += iter->NbPoints;
+    }
+  if( this->NbCorrespondences < 6 )
+    {
+    return false;
+    }
+  this->RmsError = std::sqrt( error2 / this->NbCorrespondences );
+  for( int i = 0; i < 6; i++ )
+    {
+    for( int j = 0; j < i; j++ )
+      {
+      A( i, j ) = A( j, i );
+      }
+    }
+
+  cv::Mat solution;
+  if( !cv::solve( cv::Mat( A ), cv::Mat( -b ), solution, cv::DECOMP_CHOLESKY ) )
+    {
+    return false;
+    }
+  x = cv::Vec6d( solution.ptr<double>() );
+  return true;
+}
+
+bool IcpRegistration::Register( std::vector<cv::Vec3f> const& scan, cv::Matx44f * pose )
+{
+  this->RmsError = 0;
+  this->NbIterations = 0;
+  this->NbCorrespondences = 0;
+  bool has_model = ( this->Method == SignedDistance ? this->DistanceField != NULL && this->DistanceField->IsValid() : !this->ModelPoints.empty() );
+  if( !has_model || scan.empty() || pose == NULL )
+    {
+    LOG_ERROR( Analysis, "The model and the scan are required for the registration" );
+    return false;
+    }
+
+  cv::Matx33d R;
+  cv::Vec3d t;
+  for( int r = 0; r < 3; r++ )
+    {
+    for( int c = 0; c < 3; c++ )
+      {
+      R( r, c ) = ( *pose )( r, c );
+      }
+    t[ r ] = ( *pose )( r, 3 );
+    }
+
+  // Coarse to fine, the last level decides of the success
+  bool valid = false;
+  for( int level = std::max( this->NbLevels, 1 ) - 1; level >= 0; level-- )
+    {
+    size_t stride = 1;
+    for( int l = 0; l < level; l++ )
+      {
+      stride *= std::max( this->SubsamplingFactor, 1 );
+      }
+    this->Source.clear();
+    for( size_t i = 0; i < scan.size(); i += stride )
+      {
+      this->Source.push_back( scan[ i ] );
+      }
+
+    valid = false;
+    for( int iter = 0; iter < this->MaxIterations; iter++ )
+      {
+      float threshold = this->MatchPoints( R, t );
+      cv::Vec6d x;
+      if( threshold < 0 || !this->SolveIncrement( threshold, x ) )
+        {
+        valid = false;
+        break;
+        }
+      valid = true;
+      this->NbIterations++;
+
+      cv::Matx33d dR = ExpRotation( cv::Vec3d( x[ 0 ], x[ 1 ], x[ 2 ] ) );
+      R = dR * R;
+      t = dR * t + cv::Vec3d( x[ 3 ], x[ 4 ], x[ 5 ] );
+      if( cv::norm( x ) < this->Tolerance )
+        {
+        break;
+        }
+      }
+    }
+  if( !valid )
+    {
+    return false;
+    }
+
+  *pose = cv::Matx44f::eye();
+  for( int r = 0; r < 3; r++ )
+    {
+    for( int c = 0; c < 3; c++ )
+      {
+      ( *pose )( r, c ) = static_cast<float>( R( r, c ) );
+      }
+    ( *pose )( r, 3 ) = static_cast<float>( t[ r ] );
+    }
+  return true;
+}
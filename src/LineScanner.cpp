@@ -0,0 +1,268 @@
+/*=========================================================================
+
+Library:   AnatomicAugmentedRealityProjector
+
+Author: Maeliss Jallais
+
+Copyright 2010 Kitware Inc. 28 Corporate Drive,
+Clifton Park, NY, 12065, USA.
+
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+=========================================================================*/
+
+#include "LineScanner.hpp"
+#include "Logger.hpp"
+#include "Profiler.hpp"
+
+#include <opencv2/calib3d/calib3d.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include <algorithm>
+
+LineScanner::LineScanner() :
+  Calib(),
+  TopLine( 0 ),
+  BottomLine( 0 ),
+  ProjectorWidth( 0 ),
+  ProjectorHeight( 0 ),
+  ReferenceStep( 16 ),
+  PlanesVersion( 0 ),
+  PlanesWidth( 0 )
+{
+}
+
+void LineScanner::SetCalibration( std::shared_ptr<const CompiledCalibration> const& calib )
+{
+  this->Calib = calib;
+  this->UpdatePlanes();
+}
+
+void LineScanner::SetProjectorSize( int width, int height )
+{
+  this->ProjectorWidth = width;
+  this->ProjectorHeight = height;
+  this->UpdatePlanes();
+}
+
+void LineScanner::UpdatePlanes()
+{
+  if( !this->Calib || this->ProjectorHeight <= 0 )
+    {
+    this->Planes.clear();
+    this->PlanesVersion = 0;
+    return;
+    }
+  if( this->PlanesVersion == this->Calib->Version && this->PlanesWidth == this->ProjectorWidth
+    && static_cast<int>( this->Planes.size() ) == this->ProjectorHeight + 1 )
+    {
+    return;
+    }
+
+  // Point used to define the plane of each row, to image camera coordinates
+  Profiler::Scope scope( Profiler::Undistortion );
+  scope.AddItems( this->ProjectorHeight + 1 );
+  std::vector<cv::Point2d> proj_points( this->ProjectorHeight + 1 ), proj_undistorted;
+  for( int row = 0; row <= this->ProjectorHeight; row++ )
+    {
+    proj_points[ row ] = cv::Point2d( this->ProjectorWidth, row );
+    }
+  cv::undistortPoints( proj_points, proj_undistorted, this->Calib->ProjK, this->Calib->ProjKc );
+  this->Planes.resize( this->ProjectorHeight + 1 );
+  for( int row = 0; row <= this->ProjectorHeight; row++ )
+    {
+    cv::Vec3d u2( proj_undistorted[ row ].x, proj_undistorted[ row ].y, 500.0 );
+    //to world coordinates
+    cv::Vec3d w2 = this->Calib->Rt * ( u2 - this->Calib->T );
+    // world rays = normal vector
+    this->Planes[ row ].Normal = cv::Point3d( u2 );
+    this->Planes[ row ].Point = cv::Point3d( w2 );
+    }
+  this->PlanesVersion = this->Calib->Version;
+  this->PlanesWidth = this->ProjectorWidth;
+}
+
+cv::Point3d LineScanner::RayPlaneIntersection( cv::Point3d const& vc, cv::Point3d const& qc, cv::Point3d const& vp, cv::Point3d const& qp )
+{
+  double lambda = vp.dot( qp - qc ) / vp.dot( vc );
+  return lambda * vc + qc;
+}
+
+int LineScanner::BrightestRow( cv::Mat const& gray, int j )
+{
+  // The first maximum of the average over 3 rows, if it is above 78
+  int sat_max = 78;
+  int row = -1;
+  for( int i = 1; i < gray.rows - 1; i++ )
+    {
+    int average = ( gray.at< unsigned char >( i - 1, j ) + gray.at< unsigned char >( i, j ) + gray.at< unsigned char >( i + 1, j ) ) / 3;
+    if( average > sat_max )
+      {
+      row = i;
+      sat_max = average;
+      }
+    }
+  return row;
+}
+
+bool LineScanner::Reconstruct( cv::Mat const& mat_color_ref, cv::Mat const& mat_color, ScanLine * line ) const
+{
+  return this->Reconstruct( mat_color_ref, mat_color, cv::Rect( 0, 0, mat_color.cols, mat_color.rows ), line );
+}
+
+bool LineScanner::Reconstruct( cv::Mat const& mat_color_ref, cv::Mat const& mat_color, cv::Rect const& roi, ScanLine * line ) const
+{
+  line->Row = 0;
+  line->Pixels.clear();
+  line->Points.clear();
+  line->Colors.clear();
+
+  if( this->Planes.empty() || !mat_color_ref.data || mat_color_ref.type() != CV_8UC3 || !mat_color.data || mat_color.type() != CV_8UC3
+    || mat_color.size() != mat_color_ref.size() )
+    {
+    LOG_ERROR( Scan, "invalid cv::Mat data" );
+    return false;
+    }
+
+  // Rows where the line is searched, the average needs one more row above and below
+  int first = std::max( this->TopLine, 1 );
+  int last = std::min( this->BottomLine, mat_color.rows - 1 );
+  if( first >= last )
+    {
+    return false;
+    }
+  cv::Rect band( 0, first, mat_color.cols, last - first );
+  cv::Rect search = roi & band;
+
+  // Only the region of interest is converted
+  cv::Mat mat_BGR, mat_gray;
+  cv::Rect region( search.x, search.y - 1, search.width, search.height + 2 );
+  if( search.area() > 0 )
+    {
+    Profiler::Scope scope( Profiler::Subtraction );
+    scope.AddItems( region.area() );
+    cv::subtract( mat_color( region ), mat_color_ref( region ), mat_BGR );
+    //Convert the captured frame from BGR to gray
+    cv::cvtColor( mat_BGR, mat_gray, cv::COLOR_BGR2GRAY );
+    }
+
+  // Looking for the point with the maximum intensity for each column
+    {
+    Profiler::Scope scope( Profiler::PeakSearch );
+    scope.AddItems( search.width );
+    for( int j = 0; j < search.width; j++ )
+      {
+      int i = BrightestRow( mat_gray, j );
+      if( i >= 0 )
+        {
+        line->Pixels.push_back( cv::Point2i( region.x + j, region.y + i ) );
+        }
+      }
+    }
+
+  // The row of the projector is read on the sheet of paper, where the surface is flat,
+  // on the last column where the line is found
+  int paper = mat_color.cols - mat_color.cols / 6 + 1;
+  cv::Rect paper_band( paper, first - 1, mat_color.cols - paper, last - first + 2 );
+  int current_row = 0;
+  if( ( region & paper_band ) == paper_band )
+    {
+    for( int j = region.br().x - 1; j >= paper && current_row == 0; j-- )
+      {
+      int i = BrightestRow( mat_gray, j - region.x );
+      current_row = ( i >= 0 ? region.y + i : 0 );
+      }
+    }
+  else
+    {
+    cv::Mat column_BGR, column_gray;
+    for( int j = mat_color.cols - 1; j >= paper && current_row == 0; j -= std::max( this->ReferenceStep, 1 ) )
+      {
+      cv::Rect column( j, paper_band.y, 1, paper_band.height );
+      cv::subtract( mat_color( column ), mat_color_ref( column ), column_BGR );
+      cv::cvtColor( column_BGR, column_gray, cv::COLOR_BGR2GRAY );
+      int i = BrightestRow( column_gray, 0 );
+      current_row = ( i >= 0 ? paper_band.y + i : 0 );
+      }
+    }
+
+  if( current_row == 0 )
+    {
+    return false; // Line too short
+    }
+  int row = ( current_row - this->TopLine )*this->ProjectorHeight / ( this->BottomLine - this->TopLine );
+  if( row <= 0 || row > this->ProjectorHeight )
+    {
+    LOG_EVERY_MS( Scan, Warning, 1000, "The computed row is not valid. The line is skipped. Computed row = " << row );
+    return false;
+    }
+  line->Row = row;
+  if( line->Pixels.empty() )
+    {
+    return true;
+    }
+
+  ProjectorPlane const& plane = this->Planes[ row ];
+
+  // All the camera points of the line are undistorted at once
+  std::vector<cv::Point2d> cam_points( line->Pixels.begin(), line->Pixels.end() ), cam_undistorted;
+    {
+    Profiler::Scope scope( Profiler::Undistortion );
+    scope.AddItems( cam_points.size() );
+    cv::undistortPoints( cam_points, cam_undistorted, this->Calib->CamK, this->Calib->CamKc );
+    }
+
+  Profiler::Scope scope( Profiler::Triangulation );
+  scope.AddItems( line->Pixels.size() );
+
+  line->Points.resize( line->Pixels.size() );
+  line->Colors.resize( line->Pixels.size() );
+  for( size_t k = 0; k < line->Pixels.size(); k++ )
+    {
+    // camera rays start at the camera center
+    cv::Point3d u1( cam_undistorted[ k ].x, cam_undistorted[ k ].y, 500.0 );
+    cv::Point3d p = RayPlaneIntersection( u1, u1, plane.Normal, plane.Point );
+    line->Points[ k ] = cv::Vec3f( static_cast<float>( p.x ), static_cast<float>( p.y ), static_cast<float>( p.z ) );
+
+    int x = line->Pixels[ k ].x - region.x;
+    int y = line->Pixels[ k ].y - region.y;
+    cv::Vec3b color;
+    for( int c = 0; c < 3; c++ )
+      {
+      int sum = mat_BGR.at<cv::Vec3b>( y - 1, x )[ c ] + mat_BGR.at<cv::Vec3b>( y, x )[ c ] + mat_BGR.at<cv::Vec3b>( y + 1, x )[ c ];
+      color[ c ] = static_cast<unsigned char>( sum / 3 );
+      }
+    line->Colors[ k ] = color;
+    }
+
+  return true;
+}
+
+void LineScanner::ProjectPoints( std::vector<cv::Vec3f> const& points, std::vector<cv::Point2f> & pixels ) const
+{
+  pixels.clear();
+  if( !this->Calib || points.empty() )
+    {
+    return;
+    }
+  // A point is reconstructed on the camera ray ( x, y, 500 ) of the undistorted pixel ( x, y )
+  std::vector<cv::Point3f> rays( points.size() );
+  for( size_t k = 0; k < points.size(); k++ )
+    {
+    rays[ k ] = cv::Point3f( 500.f * points[ k ][ 0 ], 500.f * points[ k ][ 1 ], points[ k ][ 2 ] );
+    }
+  cv::Mat rvec = cv::Mat::zeros( 3, 1, CV_64F ), tvec = cv::Mat::zeros( 3, 1, CV_64F );
+  cv::projectPoints( rays, rvec, tvec, this->Calib->CamK, this->Calib->CamKc, pixels );
+}
@@ -0,0 +1,419 @@
+/*=========================================================================
+
+Library:   AnatomicAugmentedRealityProjector
+
+Author: Maeliss Jallais
+
+Copyright 2010 Kitware Inc. 28 Corporate Drive,
+Clifton Park, NY, 12065, USA.
+
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+=========================================================================*/
+
+
+#include "Logger.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <streambuf>
+#include <thread>
+#include <vector>
+
+const int Logger::MESSAGES_PER_THREAD;
+const int Logger::MESSAGE_SIZE;
+const int Logger::FLUSH_INTERVAL_MS;
+std::atomic<int> Logger::Levels[ Logger::NbCategories ] = { { Logger::Info }, { Logger::Info }, { Logger::Info }, { Logger::Info },
+  { Logger::Info }, { Logger::Info }, { Logger::Info }, { Logger::Info } };
+
+namespace
+{
+  const char * CategoryNames[ Logger::NbCategories ] = { "general", "camera", "projector", "scan", "analysis", "calibration", "io", "memory" };
+  const char * LevelNames[ Logger::NbLevels ] = { "DEBUG", "INFO", "WARNING", "ERROR" };
+
+  struct Message
+    {
+    long long Time;
+    int Thread;
+    int Size;
+    Logger::Category Category;
+    Logger::Level Level;
+    char Text[ Logger::MESSAGE_SIZE ];
+    };
+
+  // Writes into the text of a message, the end of a longer message is lost
+  class SlotBuffer : public std::streambuf
+    {
+    public:
+      void Reset( char * begin, char * end ) { this->setp( begin, end ); }
+      int GetSize() const { return static_cast<int>( this->pptr() - this->pbase() ); }
+    };
+
+  // Ring of one producer, the thread, and one consumer, the writer thread : a message is
+  // published by Head and its slot is released by Tail
+  struct ThreadBuffer
+    {
+    explicit ThreadBuffer( int id ) : Id( id ), Messages( Logger::MESSAGES_PER_THREAD ), Head( 0 ), Tail( 0 ), Dropped( 0 ),
+      Retired( false ), Reported( 0 ), Current( NULL ), Out( &this->Formatter )
+      {
+      }
+
+    int Id;
+    std::vector<Message> Messages;
+    std::atomic<long long> Head;
+    std::atomic<long long> Tail;
+    std::atomic<long long> Dropped;
+    // Set by the thread when it exits, after its last message
+    std::atomic<bool> Retired;
+    // Only used by the writer thread
+    long long Reported;
+    // Message being formatted by the thread
+    Message * Current;
+    SlotBuffer Formatter;
+    std::ostream Out;
+    };
+
+  // The buffers are only locked when a thread logs its first message and by the writer thread.
+  // The pools retire their idle threads and the grabber starts a thread per acquisition : once
+  // the writer has drained the buffer of an exited thread, the buffer goes to the free list and
+  // is reused by the next new thread. Buffers owns them all, only the active ones are written.
+  std::mutex BuffersMutex;
+  std::vector< std::unique_ptr<ThreadBuffer> > Buffers;
+  std::vector<ThreadBuffer*> ActiveBuffers;
+  std::vector<ThreadBuffer*> FreeBuffers;
+  int NextId = 1;
+  const std::chrono::steady_clock::time_point Epoch = std::chrono::steady_clock::now();
+
+  std::vector<ThreadBuffer*> active_buffers()
+    {
+    std::lock_guard<std::mutex> lock( BuffersMutex );
+    return ActiveBuffers;
+    }
+
+  // Frees the buffers of the exited threads once their last messages are written.
+  // BuffersMutex is locked by the caller.
+  void recycle_drained()
+    {
+    auto drained = std::stable_partition( ActiveBuffers.begin(), ActiveBuffers.end(), []( ThreadBuffer const* buffer )
+      {
+      return !buffer->Retired.load( std::memory_order_acquire )
+        || buffer->Tail.load( std::memory_order_relaxed ) != buffer->Head.load( std::memory_order_relaxed );
+      } );
+    FreeBuffers.insert( FreeBuffers.end(), drained, ActiveBuffers.end() );
+    ActiveBuffers.erase( drained, ActiveBuffers.end() );
+    }
+
+  // Formats the pending messages of all the threads, in the order of their time, and writes
+  // them with one call per stream before their slots are released
+  void write_pending()
+    {
+    std::vector<ThreadBuffer*> buffers = active_buffers();
+    std::vector<long long> heads( buffers.size() );
+    std::vector<Message const*> pending;
+    for( size_t b = 0; b < buffers.size(); b++ )
+      {
+      heads[ b ] = buffers[ b ]->Head.load( std::memory_order_acquire );
+      for( long long m = buffers[ b ]->Tail.load( std::memory_order_relaxed ); m < heads[ b ]; m++ )
+        {
+        pending.push_back( &buffers[ b ]->Messages[ m % Logger::MESSAGES_PER_THREAD ] );
+        }
+      }
+    std::stable_sort( pending.begin(), pending.end(), []( Message const* m1, Message const* m2 ) { return m1->Time < m2->Time; } );
+
+    std::ostringstream out, err;
+    out << std::fixed << std::setprecision( 3 );
+    err << std::fixed << std::setprecision( 3 );
+    for( auto iter = pending.cbegin(); iter != pending.cend(); ++iter )
+      {
+      Message const& message = **iter;
+      std::ostringstream & stream = ( message.Level >= Logger::Warning ? err : out );
+      stream << "[" << message.Time * 1e-9 << "] [" << CategoryNames[ message.Category ] << "] ";
+      if( message.Level != Logger::Info )
+        {
+        stream << LevelNames[ message.Level ] << " ";
+        }
+      stream.write( message.Text, message.Size );
+      stream << "\n";
+      }
+    for( size_t b = 0; b < buffers.size(); b++ )
+      {
+      long long dropped = buffers[ b ]->Dropped.load( std::memory_order_relaxed );
+      if( dropped > buffers[ b ]->Reported )
+        {
+        err << "[logger] " << dropped - buffers[ b ]->Reported << " messages of thread " << buffers[ b ]->Id << " dropped\n";
+        buffers[ b ]->Reported = dropped;
+        }
+      }
+
+    if( out.tellp() > 0 )
+      {
+      std::cout << out.str() << std::flush;
+      }
+    if( err.tellp() > 0 )
+      {
+      std::cerr << err.str() << std::flush;
+      }
+    for( size_t b = 0; b < buffers.size(); b++ )
+      {
+      buffers[ b ]->Tail.store( heads[ b ], std::memory_order_release );
+      }
+    std::lock_guard<std::mutex> lock( BuffersMutex );
+    recycle_drained();
+    }
+
+  // Background thread writing the messages, stopped and joined at the exit of the program
+  // after a last write
+  class Writer
+    {
+    public:
+      Writer() : Stopping( false ), Urgent( false ), Requested( 0 ), Written( 0 ), Thread( &Writer::Run, this )
+        {
+        }
+
+      ~Writer()
+        {
+          {
+          std::lock_guard<std::mutex> lock( this->Mutex );
+          this->Stopping = true;
+          }
+        this->Condition.notify_all();
+        this->Thread.join();
+        }
+
+      // Writes without waiting for the end of the interval
+      void Wake()
+        {
+          {
+          std::lock_guard<std::mutex> lock( this->Mutex );
+          this->Urgent = true;
+          }
+        this->Condition.notify_all();
+        }
+
+      void Flush()
+        {
+        std::unique_lock<std::mutex> lock( this->Mutex );
+        long long request = ++this->Requested;
+        this->Condition.notify_all();
+        this->Condition.wait( lock, [&]() { return this->Written >= request; } );
+        }
+
+    private:
+      void Run()
+        {
+        std::unique_lock<std::mutex> lock( this->Mutex );
+        while( true )
+          {
+          this->Condition.wait_for( lock, std::chrono::milliseconds( Logger::FLUSH_INTERVAL_MS ),
+            [&]() { return this->Stopping || this->Urgent || this->Requested > this->Written; } );
+          long long request = this->Requested;
+          bool stopping = this->Stopping;
+          this->Urgent = false;
+          lock.unlock();
+          write_pending();
+          lock.lock();
+          this->Written = request;
+          this->Condition.notify_all();
+          if( stopping )
+            {
+            return;
+            }
+          }
+        }
+
+      std::mutex Mutex;
+      std::condition_variable Condition;
+      bool Stopping;
+      bool Urgent;
+      long long Requested;
+      long long Written;
+      // Started last, once the other members are constructed
+      std::thread Thread;
+    };
+
+  // Started with the first message
+  Writer & writer()
+    {
+    static Writer instance;
+    return instance;
+    }
+
+  // Buffer of a thread, retired when the thread exits and freed at once if the writer has
+  // nothing left to write from it
+  struct BufferOwner
+    {
+    BufferOwner() : Buffer( NULL )
+      {
+      }
+
+    ~BufferOwner()
+      {
+      if( this->Buffer != NULL )
+        {
+        std::lock_guard<std::mutex> lock( BuffersMutex );
+        this->Buffer->Retired.store( true, std::memory_order_release );
+        recycle_drained();
+        }
+      }
+
+    ThreadBuffer * Buffer;
+    };
+
+  ThreadBuffer * thread_buffer()
+    {
+    static thread_local BufferOwner owner;
+    if( owner.Buffer == NULL )
+      {
+      writer();
+      std::lock_guard<std::mutex> lock( BuffersMutex );
+      if( FreeBuffers.empty() )
+        {
+        Buffers.push_back( std::unique_ptr<ThreadBuffer>( new ThreadBuffer( NextId ) ) );
+        owner.Buffer = Buffers.back().get();
+        }
+      else
+        {
+        // The dropped messages stay counted, the slots are free
+        owner.Buffer = FreeBuffers.back();
+        FreeBuffers.pop_back();
+        owner.Buffer->Id = NextId;
+        owner.Buffer->Retired.store( false, std::memory_order_relaxed );
+        }
+      NextId++;
+      ActiveBuffers.push_back( owner.Buffer );
+      }
+    return owner.Buffer;
+    }
+}
+
+void Logger::SetLevel( Level level )
+{
+  for( int c = 0; c < NbCategories; c++ )
+    {
+    Levels[ c ].store( level, std::memory_order_relaxed );
+    }
+}
+
+const char * Logger::GetCategoryName( Category category )
+{
+  return ( category >= 0 && category < NbCategories ? CategoryNames[ category ] : "unknown" );
+}
+
+const char * Logger::GetLevelName( Level level )
+{
+  return ( level >= 0 && level < NbLevels ? LevelNames[ level ] : "UNKNOWN" );
+}
+
+void Logger::LogLines( Category category, Level level, std::string const& text )
+{
+  if( !IsEnabled( category, level ) )
+    {
+    return;
+    }
+  std::istringstream lines( text );
+  std::string line;
+  while( std::getline( lines, line ) )
+    {
+    Stream stream( category, level );
+    stream.Get() << line;
+    }
+}
+
+void Logger::Flush()
+{
+  writer().Flush();
+}
+
+long long Logger::GetNbDropped()
+{
+  std::lock_guard<std::mutex> lock( BuffersMutex );
+  long long dropped = 0;
+  for( auto iter = Buffers.cbegin(); iter != Buffers.cend(); ++iter )
+    {
+    dropped += ( *iter )->Dropped.load( std::memory_order_relaxed );
+    }
+  return dropped;
+}
+
+long long Logger::Now()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now() - Epoch ).count();
+}
+
+std::ostream & Logger::Begin( Category category, Level level )
+{
+  ThreadBuffer * buffer = thread_buffer();
+  long long head = buffer->Head.load( std::memory_order_relaxed );
+  if( head - buffer->Tail.load( std::memory_order_acquire ) >= MESSAGES_PER_THREAD )
+    {
+    // Only the owner thread writes : no read-modify-write is needed
+    buffer->Dropped.store( buffer->Dropped.load( std::memory_order_relaxed ) + 1, std::memory_order_relaxed );
+    buffer->Current = NULL;
+    buffer->Formatter.Reset( NULL, NULL );
+    }
+  else
+    {
+    Message & message = buffer->Messages[ head % MESSAGES_PER_THREAD ];
+    message.Time = Now();
+    message.Thread = buffer->Id;
+    message.Category = category;
+    message.Level = level;
+    buffer->Current = &message;
+    buffer->Formatter.Reset( message.Text, message.Text + MESSAGE_SIZE );
+    }
+  // The stream is shared by the messages of the thread : the format set by one message,
+  // like std::fixed or std::setprecision, must not apply to the next ones
+  buffer->Out.clear();
+  buffer->Out.flags( std::ios_base::skipws | std::ios_base::dec );
+  buffer->Out.precision( 6 );
+  buffer->Out.width( 0 );
+  buffer->Out.fill( ' ' );
+  return buffer->Out;
+}
+
+void Logger::Commit( Level level )
+{
+  ThreadBuffer * buffer = thread_buffer();
+  if( buffer->Current == NULL )
+    {
+    return;
+    }
+  buffer->Current->Size = buffer->Formatter.GetSize();
+  buffer->Current = NULL;
+  buffer->Head.store( buffer->Head.load( std::memory_order_relaxed ) + 1, std::memory_order_release );
+  if( level >= Error )
+    {
+    writer().Wake();
+    }
+}
+
+bool Logger::RateLimit::Allow( int interval_ms, long long * skipped )
+{
+  long long now = Now();
+  long long next = this->Next.load( std::memory_order_relaxed );
+  if( now < next || !this->Next.compare_exchange_strong( next, now + interval_ms * 1000000LL, std::memory_order_relaxed ) )
+    {
+    this->Skipped.fetch_add( 1, std::memory_order_relaxed );
+    return false;
+    }
+  *skipped = this->Skipped.exchange( 0, std::memory_order_relaxed );
+  return true;
+}
@@ -25,6 +25,8 @@ limitations under the License.
 
 #include "MainWindow.hpp"
 #include "CalibrationData.hpp"
+#include "Logger.hpp"
+#include "MemoryTracker.hpp"
 
 #include <opencv2/highgui/highgui.hpp>
 
@@ -35,11 +37,21 @@ limitations under the License.
 #include <stdio.h>
 #include <string.h>
 
+static const char * MemorySettingsFile = "C:\\Camera_Projector_Calibration\\Tests_publication\\memory_settings.yml";
+
 int main(int argc, char *argv[])
 {
+  // Every Mat is accounted to the stages of the pipeline : the allocator is installed before
+  // the window starts the threads that allocate
+  if( MemoryTracker::LoadSettings( MemorySettingsFile ) == false )
+    {
+    LOG_INFO( Memory, "Impossible to read the memory settings, default settings are used" );
+    }
+  MemoryTracker::Install();
+
   QApplication app(argc, argv);
   MainWindow window;
-  std::cout<<"Draw the window"<<std::endl;
+  LOG_INFO( General, "Draw the window" );
   window.show();
 
   /*CalibrationData calib;
@@ -52,7 +64,7 @@ int main(int argc, char *argv[])
   }
   //calib.display(std::cout);
   */
-  std::cout<<"Start the main application"<<std::endl;
+  LOG_INFO( General, "Start the main application" );
   return app.exec();
 
 }
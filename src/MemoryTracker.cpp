@@ -0,0 +1,356 @@
+/*=========================================================================
+
+Library:   AnatomicAugmentedRealityProjector
+
+Author: Maeliss Jallais
+
+Copyright 2010 Kitware Inc. 28 Corporate Drive,
+Clifton Park, NY, 12065, USA.
+
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+=========================================================================*/
+
+
+#include "MemoryTracker.hpp"
+#include "Logger.hpp"
+
+#include <opencv2/core/core.hpp>
+
+#include <algorithm>
+#include <iomanip>
+#include <new>
+#include <sstream>
+
+std::atomic<bool> MemoryTracker::Enabled( true );
+std::atomic<long long> MemoryTracker::Budget( MemoryTracker::DEFAULT_BUDGET );
+
+namespace
+{
+  // Bytes written before a block of the STL allocator, the alignment of new is kept
+  const std::size_t BlockHeader = 16;
+
+  struct StageMemory
+    {
+    std::atomic<long long> Live;
+    std::atomic<long long> Peak;
+    std::atomic<long long> Total;
+    std::atomic<long long> NbAllocations;
+    };
+
+  // Zero initialized : static storage
+  StageMemory Stages[ MemoryTracker::NB_SLOTS ];
+  std::atomic<long long> LiveBytes( 0 );
+  std::atomic<long long> PeakBytes( 0 );
+  std::atomic<bool> OverBudget( false );
+
+  // Peaks of the windows, followed while Used is set
+  struct WindowPeaks
+    {
+    std::atomic<bool> Used;
+    std::atomic<long long> Peak;
+    std::atomic<long long> Stages[ MemoryTracker::NB_SLOTS ];
+    };
+  WindowPeaks Windows[ MemoryTracker::MAX_WINDOWS ];
+
+  const char * stage_name( int stage )
+    {
+    return ( stage < Profiler::NbStages ? Profiler::GetStageName( static_cast<Profiler::Stage>( stage ) ) : "other" );
+    }
+
+  double megabytes( long long bytes )
+    {
+    return bytes / ( 1024. * 1024. );
+    }
+
+  void raise_peak( std::atomic<long long> & peak, long long value )
+    {
+    long long current = peak.load( std::memory_order_relaxed );
+    while( value > current && !peak.compare_exchange_weak( current, value, std::memory_order_relaxed ) )
+      {
+      }
+    }
+
+  // Allocations, total, peak and live memory of every stage that allocated or holds memory
+  void print_report( std::ostream & stream, long long const* totals, long long const* allocations, long long const* peaks, long long peak )
+    {
+    std::ios::fmtflags format = stream.flags();
+    std::streamsize precision = stream.precision();
+    stream << std::fixed << std::setprecision( 1 );
+    stream << "memory : " << megabytes( MemoryTracker::GetLiveBytes() ) << " MB live, " << megabytes( peak ) << " MB peak, "
+      << megabytes( MemoryTracker::GetBudget() ) << " MB budget" << std::endl;
+    stream << std::left << std::setw( 16 ) << "stage" << std::right << std::setw( 12 ) << "allocations" << std::setw( 12 ) << "total (MB)"
+      << std::setw( 12 ) << "peak (MB)" << std::setw( 12 ) << "live (MB)" << std::endl;
+    for( int s = 0; s < MemoryTracker::NB_SLOTS; s++ )
+      {
+      if( allocations[ s ] == 0 && MemoryTracker::GetLiveBytes( s ) == 0 )
+        {
+        continue;
+        }
+      stream << std::left << std::setw( 16 ) << stage_name( s ) << std::right << std::setw( 12 ) << allocations[ s ]
+        << std::setw( 12 ) << megabytes( totals[ s ] ) << std::setw( 12 ) << megabytes( peaks[ s ] )
+        << std::setw( 12 ) << megabytes( MemoryTracker::GetLiveBytes( s ) ) << std::endl;
+      }
+    stream.flags( format );
+    stream.precision( precision );
+    }
+
+  // Standard allocator of OpenCV, with the stage of each Mat kept in the allocator flags of
+  // its data. -1 : not accounted.
+  class CountingMatAllocator : public cv::MatAllocator
+    {
+    public:
+      CountingMatAllocator() : Std( cv::Mat::getStdAllocator() )
+        {
+        }
+
+      cv::UMatData * allocate( int dims, const int * sizes, int type, void * data, size_t * step, int flags,
+        cv::UMatUsageFlags usage ) const
+        {
+        cv::UMatData * u = this->Std->allocate( dims, sizes, type, data, step, flags, usage );
+        if( u != NULL )
+          {
+          u->currAllocator = this;
+          u->allocatorFlags_ = ( data == NULL && MemoryTracker::IsEnabled() ? Profiler::GetCurrentStage() : -1 );
+          if( u->allocatorFlags_ >= 0 )
+            {
+            MemoryTracker::Allocated( u->allocatorFlags_, static_cast<long long>( u->size ) );
+            }
+          }
+        return u;
+        }
+
+      bool allocate( cv::UMatData * u, int access, cv::UMatUsageFlags usage ) const
+        {
+        return this->Std->allocate( u, access, usage );
+        }
+
+      void deallocate( cv::UMatData * u ) const
+        {
+        if( u != NULL && u->allocatorFlags_ >= 0 )
+          {
+          MemoryTracker::Released( u->allocatorFlags_, static_cast<long long>( u->size ) );
+          }
+        this->Std->deallocate( u );
+        }
+
+    private:
+      cv::MatAllocator * Std;
+    };
+}
+
+bool MemoryTracker::LoadSettings( std::string const& filename )
+{
+  cv::FileStorage fs( filename, cv::FileStorage::READ );
+  if( !fs.isOpened() )
+    {
+    return false;
+    }
+
+  int version = 0;
+  fs[ "memory_settings_version" ] >> version;
+  if( version != MEMORY_SETTINGS_VERSION )
+    {
+    LOG_ERROR( Memory, "Unsupported memory settings file version : " << version );
+    return false;
+    }
+  if( !fs[ "enabled" ].empty() )
+    {
+    int enabled = 1;
+    fs[ "enabled" ] >> enabled;
+    SetEnabled( enabled != 0 );
+    }
+  if( !fs[ "budget_mb" ].empty() )
+    {
+    double budget = 0;
+    fs[ "budget_mb" ] >> budget;
+    SetBudget( static_cast<long long>( budget * 1024 * 1024 ) );
+    }
+  return true;
+}
+
+void MemoryTracker::Install()
+{
+  // Never freed : the Mats may be released after the static objects
+  static CountingMatAllocator * allocator = new CountingMatAllocator();
+  cv::Mat::setDefaultAllocator( allocator );
+}
+
+long long MemoryTracker::GetLiveBytes()
+{
+  return LiveBytes.load( std::memory_order_relaxed );
+}
+
+long long MemoryTracker::GetPeakBytes()
+{
+  return PeakBytes.load( std::memory_order_relaxed );
+}
+
+long long MemoryTracker::GetLiveBytes( int stage )
+{
+  return Stages[ stage ].Live.load( std::memory_order_relaxed );
+}
+
+long long MemoryTracker::GetPeakBytes( int stage )
+{
+  return Stages[ stage ].Peak.load( std::memory_order_relaxed );
+}
+
+long long MemoryTracker::GetTotalBytes( int stage )
+{
+  return Stages[ stage ].Total.load( std::memory_order_relaxed );
+}
+
+void MemoryTracker::Allocated( int stage, long long bytes )
+{
+  StageMemory & memory = Stages[ stage ];
+  long long stage_live = memory.Live.fetch_add( bytes, std::memory_order_relaxed ) + bytes;
+  raise_peak( memory.Peak, stage_live );
+  memory.Total.fetch_add( bytes, std::memory_order_relaxed );
+  memory.NbAllocations.fetch_add( 1, std::memory_order_relaxed );
+
+  long long live = LiveBytes.fetch_add( bytes, std::memory_order_relaxed ) + bytes;
+  raise_peak( PeakBytes, live );
+  for( int w = 0; w < MAX_WINDOWS; w++ )
+    {
+    if( Windows[ w ].Used.load( std::memory_order_acquire ) )
+      {
+      raise_peak( Windows[ w ].Stages[ stage ], stage_live );
+      raise_peak( Windows[ w ].Peak, live );
+      }
+    }
+  long long budget = GetBudget();
+  if( budget > 0 && live > budget && !OverBudget.exchange( true, std::memory_order_relaxed ) )
+    {
+    LOG_WARNING( Memory, "Memory budget exceeded : " << std::fixed << std::setprecision( 1 ) << megabytes( live ) << " MB live for "
+      << megabytes( budget ) << " MB, last allocation of " << megabytes( bytes ) << " MB by " << stage_name( stage ) );
+    }
+}
+
+void MemoryTracker::Released( int stage, long long bytes )
+{
+  Stages[ stage ].Live.fetch_sub( bytes, std::memory_order_relaxed );
+  long long live = LiveBytes.fetch_sub( bytes, std::memory_order_relaxed ) - bytes;
+  if( OverBudget.load( std::memory_order_relaxed ) && live < GetBudget() / 10 * 9 )
+    {
+    OverBudget.store( false, std::memory_order_relaxed );
+    }
+}
+
+void * MemoryTracker::AllocateBlock( std::size_t bytes )
+{
+  char * block = static_cast<char*>( ::operator new( bytes + BlockHeader ) );
+  int stage = ( IsEnabled() ? Profiler::GetCurrentStage() : -1 );
+  *reinterpret_cast<int*>( block ) = stage;
+  if( stage >= 0 )
+    {
+    Allocated( stage, static_cast<long long>( bytes ) );
+    }
+  return block + BlockHeader;
+}
+
+void MemoryTracker::ReleaseBlock( void * pointer, std::size_t bytes )
+{
+  char * block = static_cast<char*>( pointer ) - BlockHeader;
+  int stage = *reinterpret_cast<int*>( block );
+  if( stage >= 0 )
+    {
+    Released( stage, static_cast<long long>( bytes ) );
+    }
+  ::operator delete( block );
+}
+
+void MemoryTracker::ResetPeaks()
+{
+  for( int s = 0; s < NB_SLOTS; s++ )
+    {
+    Stages[ s ].Peak.store( Stages[ s ].Live.load( std::memory_order_relaxed ), std::memory_order_relaxed );
+    Stages[ s ].Total.store( 0, std::memory_order_relaxed );
+    Stages[ s ].NbAllocations.store( 0, std::memory_order_relaxed );
+    }
+  PeakBytes.store( LiveBytes.load( std::memory_order_relaxed ), std::memory_order_relaxed );
+}
+
+void MemoryTracker::PrintReport( std::ostream & stream )
+{
+  long long totals[ NB_SLOTS ], allocations[ NB_SLOTS ], peaks[ NB_SLOTS ];
+  for( int s = 0; s < NB_SLOTS; s++ )
+    {
+    totals[ s ] = GetTotalBytes( s );
+    allocations[ s ] = Stages[ s ].NbAllocations.load( std::memory_order_relaxed );
+    peaks[ s ] = GetPeakBytes( s );
+    }
+  print_report( stream, totals, allocations, peaks, GetPeakBytes() );
+}
+
+void MemoryTracker::LogReport()
+{
+  std::ostringstream report;
+  PrintReport( report );
+  Logger::LogLines( Logger::Memory, Logger::Info, report.str() );
+}
+
+MemoryTracker::Window::Window() : Slot( -1 )
+{
+  for( int w = 0; w < MAX_WINDOWS && this->Slot < 0; w++ )
+    {
+    bool used = false;
+    if( Windows[ w ].Used.compare_exchange_strong( used, true, std::memory_order_acq_rel ) )
+      {
+      this->Slot = w;
+      }
+    }
+  for( int s = 0; s < NB_SLOTS; s++ )
+    {
+    this->Totals[ s ] = GetTotalBytes( s );
+    this->NbAllocations[ s ] = Stages[ s ].NbAllocations.load( std::memory_order_relaxed );
+    if( this->Slot >= 0 )
+      {
+      Windows[ this->Slot ].Stages[ s ].store( GetLiveBytes( s ), std::memory_order_relaxed );
+      }
+    }
+  if( this->Slot >= 0 )
+    {
+    Windows[ this->Slot ].Peak.store( GetLiveBytes(), std::memory_order_relaxed );
+    }
+}
+
+MemoryTracker::Window::~Window()
+{
+  if( this->Slot >= 0 )
+    {
+    Windows[ this->Slot ].Used.store( false, std::memory_order_release );
+    }
+}
+
+void MemoryTracker::Window::PrintReport( std::ostream & stream ) const
+{
+  // ResetPeaks may have cleared the totals since the snapshot
+  long long totals[ NB_SLOTS ], allocations[ NB_SLOTS ], peaks[ NB_SLOTS ];
+  for( int s = 0; s < NB_SLOTS; s++ )
+    {
+    totals[ s ] = std::max( 0LL, GetTotalBytes( s ) - this->Totals[ s ] );
+    allocations[ s ] = std::max( 0LL, Stages[ s ].NbAllocations.load( std::memory_order_relaxed ) - this->NbAllocations[ s ] );
+    peaks[ s ] = ( this->Slot >= 0 ? Windows[ this->Slot ].Stages[ s ].load( std::memory_order_relaxed ) : GetPeakBytes( s ) );
+    }
+  print_report( stream, totals, allocations, peaks, this->Slot >= 0 ? Windows[ this->Slot ].Peak.load( std::memory_order_relaxed ) : GetPeakBytes() );
+}
+
+void MemoryTracker::Window::LogReport() const
+{
+  std::ostringstream report;
+  this->PrintReport( report );
+  Logger::LogLines( Logger::Memory, Logger::Info, report.str() );
+}
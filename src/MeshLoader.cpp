@@ -0,0 +1,471 @@
+/*=========================================================================
+
+Library:   AnatomicAugmentedRealityProjector
+
+Author: Maeliss Jallais
+
+Copyright 2010 Kitware Inc. 28 Corporate Drive,
+Clifton Park, NY, 12065, USA.
+
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+=========================================================================*/
+
+
+#include "MeshLoader.hpp"
+#include "io_util.hpp"
+#include "Logger.hpp"
+#include "Vec3iHash.hpp"
+
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
+
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+namespace
+{
+  struct MeshCacheHeader
+    {
+    char Magic[ 4 ];
+    int Version;
+    int HasNormals;
+    int Reserved;
+    qint64 NbVertices;
+    qint64 NbTriangles;
+    qint64 SourceSize;
+    qint64 SourceTime;
+    };
+
+  const char MeshCacheMagic[ 4 ] = { 'M', 'E', 'S', 'H' };
+}
+
+MeshLoader::MeshLoader() :
+  WeldTolerance( 0 ),
+  UseCache( true )
+{
+}
+
+bool MeshLoader::Load( QString const& filename, TriangleMesh * mesh ) const
+{
+  QFileInfo info( filename );
+  if( !info.exists() )
+    {
+    LOG_ERROR( Io, "Impossible to find " << qPrintable( filename ) );
+    return false;
+    }
+  qint64 source_size = info.size();
+  qint64 source_time = info.lastModified().toMSecsSinceEpoch();
+  QString cache = GetCacheFilename( filename );
+  if( this->UseCache && QFileInfo( cache ).exists() && LoadCache( cache, mesh, source_size, source_time ) )
+    {
+    return true;
+    }
+
+  QFile file( filename );
+  uchar * data = NULL;
+  if( !file.open( QIODevice::ReadOnly ) || ( data = file.map( 0, source_size ) ) == NULL )
+    {
+    LOG_ERROR( Io, "Impossible to read " << qPrintable( filename ) );
+    return false;
+    }
+  QString suffix = info.suffix().toLower();
+  bool valid = false;
+  if( suffix == "stl" )
+    {
+    valid = this->ReadStl( data, source_size, mesh );
+    }
+  else if( suffix == "ply" )
+    {
+    valid = this->ReadPly( data, source_size, mesh );
+    }
+  else
+    {
+    LOG_ERROR( Io, "Only the stl and ply meshes can be loaded" );
+    }
+  file.unmap( data );
+  file.close();
+  if( !valid )
+    {
+    LOG_ERROR( Io, "Impossible to parse " << qPrintable( filename ) );
+    return false;
+    }
+
+  this->Weld( mesh );
+  ComputeNormals( mesh );
+  LOG_INFO( Io, "Mesh loaded : " << mesh->Vertices.size() << " vertices, " << mesh->Triangles.size() << " triangles" );
+  if( this->UseCache && !SaveCache( cache, *mesh, source_size, source_time ) )
+    {
+    LOG_WARNING( Io, "Impossible to write the cache of " << qPrintable( filename ) );
+    }
+  return true;
+}
+
+bool MeshLoader::ReadStl( const uchar * data, qint64 size, TriangleMesh * mesh ) const
+{
+  // 80 bytes of header, the number of triangles, then 50 bytes per triangle :
+  // normal, 3 vertices, attribute
+  unsigned int nb_triangles = 0;
+  if( size >= 84 )
+    {
+    memcpy( &nb_triangles, data + 80, sizeof( nb_triangles ) );
+    }
+  if( size < 84 || size != 84 + 50 * static_cast<qint64>( nb_triangles ) )
+    {
+    LOG_ERROR( Io, "Only the binary stl meshes can be loaded" );
+    return false;
+    }
+
+  int n = static_cast<int>( nb_triangles );
+  mesh->Vertices.resize( 3 * static_cast<size_t>( n ) );
+  mesh->Triangles.resize( n );
+  mesh->Normals.clear();
+  cv::parallel_for_( cv::Range( 0, n ), [ & ]( const cv::Range & range )
+    {
+    for( int t = range.start; t < range.end; t++ )
+      {
+      const uchar * vertices = data + 84 + 50 * static_cast<size_t>( t ) + 12;
+      for( int k = 0; k < 3; k++ )
+        {
+        memcpy( &mesh->Vertices[ 3 * t + k ][ 0 ], vertices + 12 * k, 3 * sizeof( float ) );
+        }
+      mesh->Triangles[ t ] = cv::Vec3i( 3 * t, 3 * t + 1, 3 * t + 2 );
+      }
+    } );
+  return true;
+}
+
+bool MeshLoader::ReadPly( const uchar * data, qint64 size, TriangleMesh * mesh ) const
+{
+  using namespace io_util;
+  std::vector<PlyElement> elements;
+  bool binary = false;
+  size_t offset = 0;
+  if( !read_ply_header( reinterpret_cast<const char *>( data ), static_cast<size_t>( size ), elements, &binary, &offset ) || !binary )
+    {
+    LOG_ERROR( Io, "Only the binary little endian ply meshes can be loaded" );
+    return false;
+    }
+
+  mesh->Vertices.clear();
+  mesh->Normals.clear();
+  mesh->Triangles.clear();
+  bool has_vertices = false, has_faces = false;
+  for( auto element = elements.cbegin(); element != elements.cend() && !( has_vertices && has_faces ); ++element )
+    {
+    size_t stride = ply_element_stride( *element );
+    if( element->Name == "vertex" )
+      {
+      // Offset and type of x, y and z
+      size_t coord_offset[ 3 ] = { 0, 0, 0 };
+      PlyType coord_type[ 3 ] = { PlyInvalid, PlyInvalid, PlyInvalid };
+      size_t property_offset = 0;
+      for( auto property = element->Properties.cbegin(); property != element->Properties.cend(); ++property )
+        {
+        int axis = ( property->Name == "x" ? 0 : ( property->Name == "y" ? 1 : ( property->Name == "z" ? 2 : -1 ) ) );
+        if( axis >= 0 )
+          {
+          coord_offset[ axis ] = property_offset;
+          coord_type[ axis ] = property->Type;
+          }
+        property_offset += ply_type_size( property->Type );
+        }
+      if( stride == 0 || coord_type[ 0 ] == PlyInvalid || coord_type[ 1 ] == PlyInvalid || coord_type[ 2 ] == PlyInvalid
+        || offset + element->Count * stride > static_cast<size_t>( size ) )
+        {
+        return false;
+        }
+
+      int n = static_cast<int>( element->Count );
+      const uchar * begin = data + offset;
+      mesh->Vertices.resize( n );
+      cv::parallel_for_( cv::Range( 0, n ), [ & ]( const cv::Range & range )
+        {
+        for( int i = range.start; i < range.end; i++ )
+          {
+          const uchar * vertex = begin + i * stride;
+          for( int a = 0; a < 3; a++ )
+            {
+            mesh->Vertices[ i ][ a ] = static_cast<float>( read_ply_value( vertex + coord_offset[ a ], coord_type[ a ] ) );
+            }
+          }
+        } );
+      offset += element->Count * stride;
+      has_vertices = true;
+      }
+    else if( element->Name == "face" )
+      {
+      // Usual layout first : only the list of indices, always 3 of them
+      int n = static_cast<int>( element->Count );
+      bool fixed = false;
+      if( element->Properties.size() == 1 && element->Properties[ 0 ].CountType != PlyInvalid )
+        {
+        PlyType count_type = element->Properties[ 0 ].CountType;
+        PlyType index_type = element->Properties[ 0 ].Type;
+        size_t count_size = ply_type_size( count_type ), index_size = ply_type_size( index_type );
+        size_t face_size = count_size + 3 * index_size;
+        if( offset + element->Count * face_size <= static_cast<size_t>( size ) )
+          {
+          std::atomic<bool> triangles( true );
+          const uchar * begin = data + offset;
+          mesh->Triangles.resize( n );
+          cv::parallel_for_( cv::Range( 0, n ), [ & ]( const cv::Range & range )
+            {
+            for( int t = range.start; t < range.end && triangles; t++ )
+              {
+              const uchar * face = begin + t * face_size;
+              if( read_ply_value( face, count_type ) != 3 )
+                {
+                triangles = false;
+                break;
+                }
+              for( int k = 0; k < 3; k++ )
+                {
+                mesh->Triangles[ t ][ k ] = static_cast<int>( read_ply_value( face + count_size + k * index_size, index_type ) );
+                }
+              }
+            } );
+          fixed = triangles;
+          if( fixed )
+            {
+            offset += element->Count * face_size;
+            }
+          }
+        }
+
+      // Any layout : polygons are split in fans, the other properties are skipped
+      if( !fixed )
+        {
+        mesh->Triangles.clear();
+        for( int f = 0; f < n; f++ )
+          {
+          for( auto property = element->Properties.cbegin(); property != element->Properties.cend(); ++property )
+            {
+            if( property->CountType == PlyInvalid )
+              {
+              offset += ply_type_size( property->Type );
+              continue;
+              }
+            size_t count_size = ply_type_size( property->CountType ), index_size = ply_type_size( property->Type );
+            if( offset + count_size > static_cast<size_t>( size ) )
+              {
+              return false;
+              }
+            int count = static_cast<int>( read_ply_value( data + offset, property->CountType ) );
+            offset += count_size;
+            if( count < 0 || offset + count * index_size > static_cast<size_t>( size ) )
+              {
+              return false;
+              }
+            if( property->Name == "vertex_indices" || property->Name == "vertex_index" )
+              {
+              int first = static_cast<int>( read_ply_value( data + offset, property->Type ) );
+              for( int k = 1; k + 1 < count; k++ )
+                {
+                mesh->Triangles.push_back( cv::Vec3i( first, static_cast<int>( read_ply_value( data + offset + k * index_size, property->Type ) ),
+                  static_cast<int>( read_ply_value( data + offset + ( k + 1 ) * index_size, property->Type ) ) ) );
+                }
+              }
+            offset += count * index_size;
+            }
+          }
+        }
+      has_faces = true;
+      }
+    else if( stride > 0 )
+      {
+      offset += element->Count * stride;
+      }
+    else
+      {
+      // Elements with lists can only be skipped one by one : not supported before the mesh
+      return false;
+      }
+    }
+  if( !has_vertices || !has_faces )
+    {
+    return false;
+    }
+
+  int nb_vertices = static_cast<int>( mesh->Vertices.size() );
+  for( auto iter = mesh->Triangles.cbegin(); iter != mesh->Triangles.cend(); ++iter )
+    {
+    for( int k = 0; k < 3; k++ )
+      {
+      if( ( *iter )[ k ] < 0 || ( *iter )[ k ] >= nb_vertices )
+        {
+        return false;
+        }
+      }
+    }
+  return true;
+}
+
+void MeshLoader::Weld( TriangleMesh * mesh ) const
+{
+  // Cell of size WeldTolerance, or the bits of the position ( -0 and 0 being merged )
+  int n = static_cast<int>( mesh->Vertices.size() );
+  std::vector<cv::Vec3i> keys( n );
+  cv::parallel_for_( cv::Range( 0, n ), [ & ]( const cv::Range & range )
+    {
+    for( int i = range.start; i < range.end; i++ )
+      {
+      cv::Vec3f const& v = mesh->Vertices[ i ];
+      for( int a = 0; a < 3; a++ )
+        {
+        if( this->WeldTolerance > 0 )
+          {
+          keys[ i ][ a ] = static_cast<int>( std::floor( v[ a ] / this->WeldTolerance ) );
+          }
+        else
+          {
+          float value = v[ a ] + 0.f;
+          memcpy( &keys[ i ][ a ], &value, sizeof( float ) );
+          }
+        }
+      }
+    } );
+
+  std::unordered_map<cv::Vec3i, int, Vec3iHash> ids;
+  ids.reserve( n );
+  std::vector<int> remap( n );
+  std::vector<cv::Vec3f> vertices;
+  vertices.reserve( n );
+  for( int i = 0; i < n; i++ )
+    {
+    auto inserted = ids.emplace( keys[ i ], static_cast<int>( vertices.size() ) );
+    if( inserted.second )
+      {
+      vertices.push_back( mesh->Vertices[ i ] );
+      }
+    remap[ i ] = inserted.first->second;
+    }
+
+  // Triangles that collapsed are removed
+  size_t kept = 0;
+  for( size_t t = 0; t < mesh->Triangles.size(); t++ )
+    {
+    cv::Vec3i tri( remap[ mesh->Triangles[ t ][ 0 ] ], remap[ mesh->Triangles[ t ][ 1 ] ], remap[ mesh->Triangles[ t ][ 2 ] ] );
+    if( tri[ 0 ] != tri[ 1 ] && tri[ 1 ] != tri[ 2 ] && tri[ 0 ] != tri[ 2 ] )
+      {
+      mesh->Triangles[ kept++ ] = tri;
+      }
+    }
+  mesh->Triangles.resize( kept );
+  mesh->Vertices.swap( vertices );
+  mesh->Normals.clear();
+}
+
+void MeshLoader::ComputeNormals( TriangleMesh * mesh )
+{
+  mesh->Normals.assign( mesh->Vertices.size(), cv::Vec3f( 0, 0, 0 ) );
+  for( auto iter = mesh->Triangles.cbegin(); iter != mesh->Triangles.cend(); ++iter )
+    {
+    cv::Vec3f const& a = mesh->Vertices[ ( *iter )[ 0 ] ];
+    // Twice the area times the unit normal
+    cv::Vec3f normal = ( mesh->Vertices[ ( *iter )[ 1 ] ] - a ).cross( mesh->Vertices[ ( *iter )[ 2 ] ] - a );
+    for( int k = 0; k < 3; k++ )
+      {
+      mesh->Normals[ ( *iter )[ k ] ] += normal;
+      }
+    }
+  cv::parallel_for_( cv::Range( 0, static_cast<int>( mesh->Normals.size() ) ), [ & ]( const cv::Range & range )
+    {
+    for( int i = range.start; i < range.end; i++ )
+      {
+      float norm = static_cast<float>( cv::norm( mesh->Normals[ i ] ) );
+      mesh->Normals[ i ] = ( norm > 0 ? mesh->Normals[ i ] / norm : cv::Vec3f( 0, 0, 0 ) );
+      }
+    } );
+}
+
+bool MeshLoader::SaveCache( QString const& filename, TriangleMesh const& mesh, qint64 source_size, qint64 source_time )
+{
+  QFile file( filename );
+  if( !file.open( QIODevice::WriteOnly ) )
+    {
+    return false;
+    }
+  MeshCacheHeader header;
+  memcpy( header.Magic, MeshCacheMagic, sizeof( MeshCacheMagic ) );
+  header.Version = MESH_CACHE_VERSION;
+  header.HasNormals = ( mesh.Normals.size() == mesh.Vertices.size() && !mesh.Normals.empty() ? 1 : 0 );
+  header.Reserved = 0;
+  header.NbVertices = mesh.Vertices.size();
+  header.NbTriangles = mesh.Triangles.size();
+  header.SourceSize = source_size;
+  header.SourceTime = source_time;
+
+  qint64 vertices_size = header.NbVertices * sizeof( cv::Vec3f );
+  qint64 triangles_size = header.NbTriangles * sizeof( cv::Vec3i );
+  bool valid = file.write( reinterpret_cast<const char *>( &header ), sizeof( header ) ) == sizeof( header )
+    && file.write( reinterpret_cast<const char *>( mesh.Vertices.data() ), vertices_size ) == vertices_size
+    && ( !header.HasNormals || file.write( reinterpret_cast<const char *>( mesh.Normals.data() ), vertices_size ) == vertices_size )
+    && file.write( reinterpret_cast<const char *>( mesh.Triangles.data() ), triangles_size ) == triangles_size;
+  file.close();
+  if( !valid )
+    {
+    QFile::remove( filename );
+    }
+  return valid;
+}
+
+bool MeshLoader::LoadCache( QString const& filename, TriangleMesh * mesh, qint64 source_size, qint64 source_time )
+{
+  QFile file( filename );
+  if( !file.open( QIODevice::ReadOnly ) )
+    {
+    return false;
+    }
+  qint64 size = file.size();
+  MeshCacheHeader header;
+  if( size < static_cast<qint64>( sizeof( header ) ) || file.read( reinterpret_cast<char *>( &header ), sizeof( header ) ) != sizeof( header )
+    || memcmp( header.Magic, MeshCacheMagic, sizeof( MeshCacheMagic ) ) != 0 || header.Version != MESH_CACHE_VERSION
+    || ( source_size >= 0 && header.SourceSize != source_size ) || ( source_time >= 0 && header.SourceTime != source_time ) )
+    {
+    return false;
+    }
+  qint64 vertices_size = header.NbVertices * sizeof( cv::Vec3f );
+  qint64 triangles_size = header.NbTriangles * sizeof( cv::Vec3i );
+  if( header.NbVertices < 0 || header.NbTriangles < 0
+    || size != static_cast<qint64>( sizeof( header ) ) + ( header.HasNormals ? 2 : 1 ) * vertices_size + triangles_size )
+    {
+    return false;
+    }
+
+  // The arrays are contiguous in the file
+  const uchar * data = file.map( 0, size );
+  if( data == NULL )
+    {
+    return false;
+    }
+  const uchar * crt = data + sizeof( header );
+  mesh->Vertices.resize( header.NbVertices );
+  memcpy( mesh->Vertices.data(), crt, vertices_size );
+  crt += vertices_size;
+  mesh->Normals.resize( header.HasNormals ? header.NbVertices : 0 );
+  if( header.HasNormals )
+    {
+    memcpy( mesh->Normals.data(), crt, vertices_size );
+    crt += vertices_size;
+    }
+  mesh->Triangles.resize( header.NbTriangles );
+  memcpy( mesh->Triangles.data(), crt, triangles_size );
+  file.unmap( const_cast<uchar *>( data ) );
+  return true;
+}
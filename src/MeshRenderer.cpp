@@ -0,0 +1,275 @@
+/*=========================================================================
+
+Library:   AnatomicAugmentedRealityProjector
+
+Author: Maeliss Jallais
+
+Copyright 2010 Kitware Inc. 28 Corporate Drive,
+Clifton Park, NY, 12065, USA.
+
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+=========================================================================*/
+
+
+#include "MeshRenderer.hpp"
+#include "Logger.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+  // The triangles are binned by blocks, the tiles draw the blocks in order
+  const int NbBlocks = 16;
+
+  // Twice the signed area of ( a, b, p ), positive if p is on the left of ab
+  inline float Edge( cv::Vec3f const& a, cv::Vec3f const& b, float x, float y )
+    {
+    return ( b[ 0 ] - a[ 0 ] ) * ( y - a[ 1 ] ) - ( b[ 1 ] - a[ 1 ] ) * ( x - a[ 0 ] );
+    }
+}
+
+MeshRenderer::MeshRenderer() :
+  Calib(),
+  Width( 1920 ),
+  Height( 1080 ),
+  TileSize( 64 ),
+  Color( qRgb( 255, 255, 255 ) ),
+  NbTilesX( 0 ),
+  NbTilesY( 0 ),
+  Current( 0 )
+{
+}
+
+void MeshRenderer::ProjectVertices( TriangleMesh const& mesh, cv::Matx44f const& pose )
+{
+  // Model to projector : X_proj = R * X_cam + T
+  cv::Matx44f M = cv::Matx44f( this->Calib->CameraToProjector * cv::Matx44d( pose ) );
+
+  cv::Matx33d const& K = this->Calib->ProjK;
+  double fx = K( 0, 0 ), fy = K( 1, 1 ), skew = K( 0, 1 );
+  double cx = K( 0, 2 ), cy = K( 1, 2 );
+  cv::Vec<double, 5> const& d = this->Calib->ProjKc;
+
+  int n = static_cast<int>( mesh.Vertices.size() );
+  this->Positions.resize( n );
+  this->Screen.resize( n );
+  cv::parallel_for_( cv::Range( 0, n ), [ & ]( const cv::Range & range )
+    {
+    for( int i = range.start; i < range.end; i++ )
+      {
+      cv::Vec3f const& v = mesh.Vertices[ i ];
+      cv::Vec3f X( M( 0, 0 ) * v[ 0 ] + M( 0, 1 ) * v[ 1 ] + M( 0, 2 ) * v[ 2 ] + M( 0, 3 ),
+        M( 1, 0 ) * v[ 0 ] + M( 1, 1 ) * v[ 1 ] + M( 1, 2 ) * v[ 2 ] + M( 1, 3 ),
+        M( 2, 0 ) * v[ 0 ] + M( 2, 1 ) * v[ 1 ] + M( 2, 2 ) * v[ 2 ] + M( 2, 3 ) );
+      this->Positions[ i ] = X;
+      if( X[ 2 ] <= 1e-6f )
+        {
+        this->Screen[ i ] = cv::Vec3f( 0, 0, 0 );
+        continue;
+        }
+      // Same distortion model as the calibration : k1, k2, p1, p2, k3
+      double x = X[ 0 ] / X[ 2 ], y = X[ 1 ] / X[ 2 ];
+      double r2 = x * x + y * y;
+      double radial = 1 + d[ 0 ] * r2 + d[ 1 ] * r2 * r2 + d[ 4 ] * r2 * r2 * r2;
+      double xd = x * radial + 2 * d[ 2 ] * x * y + d[ 3 ] * ( r2 + 2 * x * x );
+      double yd = y * radial + d[ 2 ] * ( r2 + 2 * y * y ) + 2 * d[ 3 ] * x * y;
+      this->Screen[ i ] = cv::Vec3f( static_cast<float>( fx * xd + skew * yd + cx ), static_cast<float>( fy * yd + cy ), 1.f / X[ 2 ] );
+      }
+    } );
+}
+
+void MeshRenderer::SetupTriangles( TriangleMesh const& mesh )
+{
+  int n = static_cast<int>( mesh.Triangles.size() );
+  int nb_vertices = static_cast<int>( mesh.Vertices.size() );
+  this->Shades.resize( n );
+  cv::parallel_for_( cv::Range( 0, n ), [ & ]( const cv::Range & range )
+    {
+    for( int t = range.start; t < range.end; t++ )
+      {
+      cv::Vec3i const& tri = mesh.Triangles[ t ];
+      this->Shades[ t ] = 0;
+      if( tri[ 0 ] < 0 || tri[ 1 ] < 0 || tri[ 2 ] < 0 || tri[ 0 ] >= nb_vertices || tri[ 1 ] >= nb_vertices || tri[ 2 ] >= nb_vertices )
+        {
+        continue;
+        }
+      cv::Vec3f const& a = this->Screen[ tri[ 0 ] ];
+      cv::Vec3f const& b = this->Screen[ tri[ 1 ] ];
+      cv::Vec3f const& c = this->Screen[ tri[ 2 ] ];
+      if( a[ 2 ] == 0 || b[ 2 ] == 0 || c[ 2 ] == 0 || std::abs( Edge( a, b, c[ 0 ], c[ 1 ] ) ) < 1e-6f )
+        {
+        continue;
+        }
+
+      // Lambert with the light at the projector
+      cv::Vec3f const& pa = this->Positions[ tri[ 0 ] ];
+      cv::Vec3f normal = ( this->Positions[ tri[ 1 ] ] - pa ).cross( this->Positions[ tri[ 2 ] ] - pa );
+      cv::Vec3f light = -( pa + this->Positions[ tri[ 1 ] ] + this->Positions[ tri[ 2 ] ] );
+      double norms = cv::norm( normal ) * cv::norm( light );
+      double intensity = 0.2 + 0.8 * ( norms > 0 ? std::abs( normal.dot( light ) ) / norms : 0 );
+      this->Shades[ t ] = qRgb( static_cast<int>( qRed( this->Color ) * intensity ), static_cast<int>( qGreen( this->Color ) * intensity ),
+        static_cast<int>( qBlue( this->Color ) * intensity ) );
+      }
+    } );
+}
+
+void MeshRenderer::BinTriangles( TriangleMesh const& mesh )
+{
+  int nb_tiles = this->NbTilesX * this->NbTilesY;
+  this->Bins.resize( NbBlocks * nb_tiles );
+  int n = static_cast<int>( mesh.Triangles.size() );
+  cv::parallel_for_( cv::Range( 0, NbBlocks ), [ & ]( const cv::Range & range )
+    {
+    for( int block = range.start; block < range.end; block++ )
+      {
+      std::vector<int> * bins = &this->Bins[ block * nb_tiles ];
+      for( int tile = 0; tile < nb_tiles; tile++ )
+        {
+        bins[ tile ].clear();
+        }
+      int end = static_cast<int>( static_cast<int64>( n ) * ( block + 1 ) / NbBlocks );
+      for( int t = static_cast<int>( static_cast<int64>( n ) * block / NbBlocks ); t < end; t++ )
+        {
+        if( this->Shades[ t ] == 0 )
+          {
+          continue;
+          }
+        cv::Vec3i const& tri = mesh.Triangles[ t ];
+        cv::Vec3f const& a = this->Screen[ tri[ 0 ] ];
+        cv::Vec3f const& b = this->Screen[ tri[ 1 ] ];
+        cv::Vec3f const& c = this->Screen[ tri[ 2 ] ];
+        float x0 = std::max( std::min( { a[ 0 ], b[ 0 ], c[ 0 ] } ), 0.f );
+        float x1 = std::min( std::max( { a[ 0 ], b[ 0 ], c[ 0 ] } ), this->Width - 1.f );
+        float y0 = std::max( std::min( { a[ 1 ], b[ 1 ], c[ 1 ] } ), 0.f );
+        float y1 = std::min( std::max( { a[ 1 ], b[ 1 ], c[ 1 ] } ), this->Height - 1.f );
+        if( x0 > x1 || y0 > y1 )
+          {
+          continue;
+          }
+        for( int ty = static_cast<int>( y0 ) / this->TileSize; ty <= static_cast<int>( y1 ) / this->TileSize; ty++ )
+          {
+          for( int tx = static_cast<int>( x0 ) / this->TileSize; tx <= static_cast<int>( x1 ) / this->TileSize; tx++ )
+            {
+            bins[ ty * this->NbTilesX + tx ].push_back( t );
+            }
+          }
+        }
+      }
+    } );
+}
+
+void MeshRenderer::RasterizeTile( TriangleMesh const& mesh, int tile, uchar * bits, int bytes_per_line, std::vector<float> & depth ) const
+{
+  int tile_x0 = ( tile % this->NbTilesX ) * this->TileSize;
+  int tile_y0 = ( tile / this->NbTilesX ) * this->TileSize;
+  int tile_x1 = std::min( tile_x0 + this->TileSize, this->Width );
+  int tile_y1 = std::min( tile_y0 + this->TileSize, this->Height );
+
+  // Black where nothing is drawn, the inverse depth 0 is infinitely far
+  std::fill( depth.begin(), depth.end(), 0.f );
+  for( int y = tile_y0; y < tile_y1; y++ )
+    {
+    QRgb * row = reinterpret_cast<QRgb *>( bits + y * bytes_per_line );
+    std::fill( row + tile_x0, row + tile_x1, qRgb( 0, 0, 0 ) );
+    }
+
+  int nb_tiles = this->NbTilesX * this->NbTilesY;
+  for( int block = 0; block < NbBlocks; block++ )
+    {
+    std::vector<int> const& bin = this->Bins[ block * nb_tiles + tile ];
+    for( auto iter = bin.cbegin(); iter != bin.cend(); ++iter )
+      {
+      cv::Vec3i const& tri = mesh.Triangles[ *iter ];
+      cv::Vec3f a = this->Screen[ tri[ 0 ] ];
+      cv::Vec3f b = this->Screen[ tri[ 1 ] ];
+      cv::Vec3f c = this->Screen[ tri[ 2 ] ];
+      float area = Edge( a, b, c[ 0 ], c[ 1 ] );
+      if( area < 0 )
+        {
+        std::swap( b, c );
+        area = -area;
+        }
+      int x0 = std::max( tile_x0, static_cast<int>( std::floor( std::min( { a[ 0 ], b[ 0 ], c[ 0 ] } ) ) ) );
+      int x1 = std::min( tile_x1 - 1, static_cast<int>( std::ceil( std::max( { a[ 0 ], b[ 0 ], c[ 0 ] } ) ) ) );
+      int y0 = std::max( tile_y0, static_cast<int>( std::floor( std::min( { a[ 1 ], b[ 1 ], c[ 1 ] } ) ) ) );
+      int y1 = std::min( tile_y1 - 1, static_cast<int>( std::ceil( std::max( { a[ 1 ], b[ 1 ], c[ 1 ] } ) ) ) );
+
+      // Barycentric weights of a, b and c, stepped along the rows. The inverse depth is
+      // linear in the image.
+      float inv_area = 1.f / area;
+      float dx0 = -( c[ 1 ] - b[ 1 ] ), dx1 = -( a[ 1 ] - c[ 1 ] ), dx2 = -( b[ 1 ] - a[ 1 ] );
+      QRgb shade = this->Shades[ *iter ];
+      for( int y = y0; y <= y1; y++ )
+        {
+        float px = x0 + 0.5f, py = y + 0.5f;
+        float w0 = Edge( b, c, px, py ), w1 = Edge( c, a, px, py ), w2 = Edge( a, b, px, py );
+        QRgb * row = reinterpret_cast<QRgb *>( bits + y * bytes_per_line );
+        float * depth_row = depth.data() + ( y - tile_y0 ) * this->TileSize;
+        for( int x = x0; x <= x1; x++, w0 += dx0, w1 += dx1, w2 += dx2 )
+          {
+          if( w0 < 0 || w1 < 0 || w2 < 0 )
+            {
+            continue;
+            }
+          float z = ( w0 * a[ 2 ] + w1 * b[ 2 ] + w2 * c[ 2 ] ) * inv_area;
+          if( z > depth_row[ x - tile_x0 ] )
+            {
+            depth_row[ x - tile_x0 ] = z;
+            row[ x ] = shade;
+            }
+          }
+        }
+      }
+    }
+}
+
+bool MeshRenderer::Render( TriangleMesh const& mesh, cv::Matx44f const& pose )
+{
+  if( !this->Calib || this->Width <= 0 || this->Height <= 0 || this->TileSize <= 0 )
+    {
+    LOG_ERROR( Projector, "The projector calibration and size are required to render" );
+    return false;
+    }
+
+  // The other image may still be displayed
+  int next = 1 - this->Current;
+  QImage & image = this->Images[ next ];
+  if( image.width() != this->Width || image.height() != this->Height || image.format() != QImage::Format_RGB32 )
+    {
+    image = QImage( this->Width, this->Height, QImage::Format_RGB32 );
+    }
+  uchar * bits = image.bits();
+  int bytes_per_line = image.bytesPerLine();
+
+  this->NbTilesX = ( this->Width + this->TileSize - 1 ) / this->TileSize;
+  this->NbTilesY = ( this->Height + this->TileSize - 1 ) / this->TileSize;
+  this->ProjectVertices( mesh, pose );
+  this->SetupTriangles( mesh );
+  this->BinTriangles( mesh );
+
+  cv::parallel_for_( cv::Range( 0, this->NbTilesX * this->NbTilesY ), [ & ]( const cv::Range & range )
+    {
+    std::vector<float> depth( this->TileSize * this->TileSize );
+    for( int tile = range.start; tile < range.end; tile++ )
+      {
+      this->RasterizeTile( mesh, tile, bits, bytes_per_line, depth );
+      }
+    } );
+
+  this->Current = next;
+  return true;
+}
@@ -0,0 +1,339 @@
+/*=========================================================================
+
+Library:   AnatomicAugmentedRealityProjector
+
+Author: Maeliss Jallais
+
+Copyright 2010 Kitware Inc. 28 Corporate Drive,
+Clifton Park, NY, 12065, USA.
+
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+=========================================================================*/
+
+#include "PlaneRansac.hpp"
+#include "Logger.hpp"
+#include "Profiler.hpp"
+
+#include <opencv2/core/hal/intrin.hpp>
+#include <opencv2/core/version.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+// OpenCV 5 removed the operators of the universal intrinsics for the named functions, which
+// OpenCV 4.9 introduced : the two used here are defined for the older versions
+#if CV_SIMD128 && ( CV_VERSION_MAJOR < 4 || ( CV_VERSION_MAJOR == 4 && CV_VERSION_MINOR < 9 ) )
+namespace cv
+{
+  inline v_int32x4 v_sub( v_int32x4 const& a, v_int32x4 const& b ) { return a - b; }
+  inline v_float32x4 v_lt( v_float32x4 const& a, v_float32x4 const& b ) { return a < b; }
+}
+#endif
+
+PlaneRansac::PlaneRansac( uint64 seed ) :
+  Rng( seed ),
+  MaxIterations( 100 ),
+  Threshold( 0.01f ),
+  MinInliers( 3 ),
+  Confidence( 0.999 ),
+  PreemptiveSubsetSize( 64 ),
+  OrthogonalTolerance( 0.1f ),
+  Normal( 0, 0, 0 ),
+  Point( 0, 0, 0 ),
+  NbInliers( 0 ),
+  NbIterations( 0 )
+{
+  this->Orthogonal[ 0 ] = cv::Vec3f( 0, 0, 0 );
+  this->Orthogonal[ 1 ] = cv::Vec3f( 0, 0, 0 );
+}
+
+void PlaneRansac::SetSeed( uint64 seed )
+{
+  this->Rng = cv::RNG( seed );
+}
+
+void PlaneRansac::SetOrthogonalTo( cv::Vec3f const& normal_1, cv::Vec3f const& normal_2 )
+{
+  cv::Vec3f normals[ 2 ] = { normal_1, normal_2 };
+  for( int k = 0; k < 2; k++ )
+    {
+    float norm = std::sqrt( normals[ k ].dot( normals[ k ] ) );
+    this->Orthogonal[ k ] = ( norm > 0 ? normals[ k ] / norm : cv::Vec3f( 0, 0, 0 ) );
+    }
+}
+
+bool PlaneRansac::IsOrthogonal( cv::Vec3f const& normal ) const
+{
+  for( int k = 0; k < 2; k++ )
+    {
+    if( std::abs( normal.dot( this->Orthogonal[ k ] ) ) > this->OrthogonalTolerance )
+      {
+      return false;
+      }
+    }
+  return true;
+}
+
+int PlaneRansac::CountPlaneInliers( const float * x, const float * y, const float * z, int n, cv::Vec3f const& normal, float d, float thres )
+{
+  int inliers = 0;
+  int i = 0;
+#if CV_SIMD128
+  cv::v_float32x4 v_nx = cv::v_setall_f32( normal[ 0 ] );
+  cv::v_float32x4 v_ny = cv::v_setall_f32( normal[ 1 ] );
+  cv::v_float32x4 v_nz = cv::v_setall_f32( normal[ 2 ] );
+  cv::v_float32x4 v_minus_d = cv::v_setall_f32( -d );
+  cv::v_float32x4 v_thres = cv::v_setall_f32( thres );
+  cv::v_int32x4 v_count = cv::v_setzero_s32();
+  for( ; i <= n - 4; i += 4 )
+    {
+    cv::v_float32x4 v_dist = cv::v_fma( v_nx, cv::v_load( x + i ), cv::v_fma( v_ny, cv::v_load( y + i ), cv::v_fma( v_nz, cv::v_load( z + i ), v_minus_d ) ) );
+    // the comparison mask is -1 for the inliers
+    v_count = cv::v_sub( v_count, cv::v_reinterpret_as_s32( cv::v_lt( cv::v_abs( v_dist ), v_thres ) ) );
+    }
+  inliers += cv::v_reduce_sum( v_count );
+#endif
+  for( ; i < n; i++ )
+    {
+    if( std::abs( normal[ 0 ] * x[ i ] + normal[ 1 ] * y[ i ] + normal[ 2 ] * z[ i ] - d ) < thres )
+      {
+      inliers++;
+      }
+    }
+  return inliers;
+}
+
+int PlaneRansac::CountInliers( cv::Vec3f const& normal, float d, int begin, int end, int stop_below ) const
+/*  Counts the points of [begin, end) closer than Threshold to the plane normal.x = d (unit normal).
+    If stop_below > 0, the count stops as soon as it can no longer reach stop_below. */
+{
+  const int block_size = 1024;
+  int inliers = 0;
+
+  for( int block = begin; block < end; block += block_size )
+    {
+    int block_end = std::min( block + block_size, end );
+    inliers += CountPlaneInliers( this->X.data() + block, this->Y.data() + block, this->Z.data() + block, block_end - block, normal, d, this->Threshold );
+    if( stop_below > 0 && inliers + ( end - block_end ) < stop_below )
+      {
+      break;
+      }
+    }
+  return inliers;
+}
+
+bool PlaneRansac::Refine( cv::Vec3f & normal, float & d ) const
+/*  Least squares plane through the inliers : the normal is the eigenvector of the
+    covariance matrix with the smallest eigenvalue. Two rounds, the second one on the
+    inliers of the refined plane. */
+{
+  int n = static_cast<int>( this->X.size() );
+  for( int round = 0; round < 2; round++ )
+    {
+    cv::Vec3d sum( 0, 0, 0 );
+    cv::Matx33d sum2 = cv::Matx33d::zeros();
+    int nb = 0;
+    for( int i = 0; i < n; i++ )
+      {
+      if( std::abs( normal[ 0 ] * this->X[ i ] + normal[ 1 ] * this->Y[ i ] + normal[ 2 ] * this->Z[ i ] - d ) < this->Threshold )
+        {
+        cv::Vec3d p( this->X[ i ], this->Y[ i ], this->Z[ i ] );
+        sum += p;
+        for( int r = 0; r < 3; r++ )
+          {
+          for( int c = 0; c < 3; c++ )
+            {
+            sum2( r, c ) += p[ r ] * p[ c ];
+            }
+          }
+        nb++;
+        }
+      }
+    if( nb < 3 )
+      {
+      return false;
+      }
+    cv::Vec3d centroid = sum / static_cast<double>( nb );
+    cv::Matx33d cov;
+    for( int r = 0; r < 3; r++ )
+      {
+      for( int c = 0; c < 3; c++ )
+        {
+        cov( r, c ) = sum2( r, c ) / nb - centroid[ r ] * centroid[ c ];
+        }
+      }
+    cv::Mat eigenvalues, eigenvectors;
+    if( !cv::eigen( cv::Mat( cov ), eigenvalues, eigenvectors ) )
+      {
+      return false;
+      }
+    // eigenvalues are sorted in descending order
+    cv::Vec3f refined( static_cast<float>( eigenvectors.at<double>( 2, 0 ) ),
+      static_cast<float>( eigenvectors.at<double>( 2, 1 ) ),
+      static_cast<float>( eigenvectors.at<double>( 2, 2 ) ) );
+    if( refined.dot( normal ) < 0 )
+      {
+      refined = -refined;
+      }
+    cv::Vec3f point( static_cast<float>( centroid[ 0 ] ), static_cast<float>( centroid[ 1 ] ), static_cast<float>( centroid[ 2 ] ) );
+    // The refined plane must still respect the orthogonality constraints
+    if( !this->IsOrthogonal( refined ) )
+      {
+      return round > 0;
+      }
+    normal = refined;
+    d = refined.dot( point );
+    }
+  return true;
+}
+
+bool PlaneRansac::Fit( std::vector<cv::Vec3f> const& points )
+{
+  Profiler::Scope scope( Profiler::Ransac );
+  scope.AddItems( points.size() );
+  this->Normal = cv::Vec3f( 0, 0, 0 );
+  this->Point = cv::Vec3f( 0, 0, 0 );
+  this->NbInliers = 0;
+  this->NbIterations = 0;
+
+  int n = static_cast<int>( points.size() );
+  if( n < 3 )
+    {
+    LOG_WARNING( Analysis, "At least 3 points required" );
+    return false;
+    }
+
+  // Structure of arrays, in random order so that the first points are a random subset
+  this->X.resize( n );
+  this->Y.resize( n );
+  this->Z.resize( n );
+  for( int i = 0; i < n; i++ )
+    {
+    this->X[ i ] = points[ i ][ 0 ];
+    this->Y[ i ] = points[ i ][ 1 ];
+    this->Z[ i ] = points[ i ][ 2 ];
+    }
+  for( int i = n - 1; i > 0; i-- )
+    {
+    int j = this->Rng.uniform( 0, i + 1 );
+    std::swap( this->X[ i ], this->X[ j ] );
+    std::swap( this->Y[ i ], this->Y[ j ] );
+    std::swap( this->Z[ i ], this->Z[ j ] );
+    }
+  int subset = ( this->PreemptiveSubsetSize > 0 && n >= 4 * this->PreemptiveSubsetSize ? this->PreemptiveSubsetSize : 0 );
+
+  int idx1, idx2, idx3;
+  cv::Vec3f A, B, C;
+  cv::Vec3f best_normal( 0, 0, 0 );
+  float best_d = 0;
+  int best_inliers = 0;
+  int needed = this->MaxIterations;
+  int it;
+  for( it = 0; it < needed; it++ )
+    {
+    // Select 3 points randomly
+    idx1 = this->Rng.uniform( 0, n );
+    do
+      {
+      idx2 = this->Rng.uniform( 0, n );
+      } while( idx2 == idx1 );
+    do
+      {
+      idx3 = this->Rng.uniform( 0, n );
+      } while( idx3 == idx1 || idx3 == idx2 );
+    A = cv::Vec3f( this->X[ idx1 ], this->Y[ idx1 ], this->Z[ idx1 ] );
+    B = cv::Vec3f( this->X[ idx2 ], this->Y[ idx2 ], this->Z[ idx2 ] );
+    C = cv::Vec3f( this->X[ idx3 ], this->Y[ idx3 ], this->Z[ idx3 ] );
+
+    cv::Vec3f normal = ( B - A ).cross( C - A );
+    float norm = std::sqrt( normal.dot( normal ) );
+    if( norm < 1e-12f )
+      {
+      continue; // collinear sample
+      }
+    normal = normal / norm;
+    if( !this->IsOrthogonal( normal ) )
+      {
+      continue;
+      }
+    float d = normal.dot( A );
+
+    // Preemptive test : the model is dropped if its subset score is less than half of
+    // what the best model would be expected to score on the subset
+    if( subset > 0 && best_inliers > 0 )
+      {
+      int subset_inliers = this->CountInliers( normal, d, 0, subset );
+      if( 2.0 * subset_inliers * n < static_cast<double>( best_inliers ) * subset )
+        {
+        continue;
+        }
+      }
+
+    int inliers = this->CountInliers( normal, d, 0, n, best_inliers + 1 );
+    if( inliers > best_inliers && inliers >= this->MinInliers ) //We may have found a good model
+      {
+      best_inliers = inliers;
+      best_normal = normal;
+      best_d = d;
+
+      // Number of iterations to draw an all-inlier sample with the requested confidence
+      double w = static_cast<double>( inliers ) / n;
+      double p_fail = 1.0 - w * w * w;
+      if( p_fail <= 0 )
+        {
+        needed = it + 1;
+        }
+      else
+        {
+        double k = std::log( 1.0 - this->Confidence ) / std::log( p_fail );
+        if( k < needed )
+          {
+          needed = std::max( it + 1, static_cast<int>( std::ceil( k ) ) );
+          }
+        }
+      }
+    }
+  this->NbIterations = it;
+
+  if( best_inliers == 0 )
+    {
+    return false;
+    }
+
+  this->Refine( best_normal, best_d );
+  this->Normal = best_normal;
+  this->NbInliers = this->CountInliers( best_normal, best_d, 0, n );
+
+  // Centroid of the inliers of the final plane
+  cv::Vec3d centroid( 0, 0, 0 );
+  int nb = 0;
+  for( int i = 0; i < n; i++ )
+    {
+    if( std::abs( best_normal[ 0 ] * this->X[ i ] + best_normal[ 1 ] * this->Y[ i ] + best_normal[ 2 ] * this->Z[ i ] - best_d ) < this->Threshold )
+      {
+      centroid += cv::Vec3d( this->X[ i ], this->Y[ i ], this->Z[ i ] );
+      nb++;
+      }
+    }
+  if( nb == 0 )
+    {
+    return false;
+    }
+  centroid = centroid / static_cast<double>( nb );
+  this->Point = cv::Vec3f( static_cast<float>( centroid[ 0 ] ), static_cast<float>( centroid[ 1 ] ), static_cast<float>( centroid[ 2 ] ) );
+
+  return this->NbInliers >= this->MinInliers;
+}
@@ -0,0 +1,371 @@
+/*=========================================================================
+
+Library:   AnatomicAugmentedRealityProjector
+
+Author: Maeliss Jallais
+
+Copyright 2010 Kitware Inc. 28 Corporate Drive,
+Clifton Park, NY, 12065, USA.
+
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+=========================================================================*/
+
+#include "PointCloudIndex.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <queue>
+
+namespace
+{
+  struct TreeRange
+    {
+    int Begin;
+    int End;
+    float Distance2; // lower bound of the squared distance to the range, for the kNN pruning
+    };
+
+  const int MaxTreeDepth = 64;
+}
+
+PointCloudIndex::PointCloudIndex() :
+  LeafSize( 16 )
+{
+}
+
+void PointCloudIndex::Clear()
+{
+  this->Points.clear();
+  this->Ids.clear();
+  this->SplitAxis.clear();
+}
+
+void PointCloudIndex::Build( std::vector<cv::Vec3f> const& points )
+{
+  this->Build( points.data(), static_cast<int>( points.size() ) );
+}
+
+void PointCloudIndex::Build( MemoryTracker::Vector<cv::Vec3f> const& points )
+{
+  this->Build( points.data(), static_cast<int>( points.size() ) );
+}
+
+void PointCloudIndex::Build( cv::Vec3f const* points, int nb_points )
+{
+  this->Points.assign( points, points + nb_points );
+  this->Ids.resize( nb_points );
+  for( int i = 0; i < nb_points; i++ )
+    {
+    this->Ids[ i ] = i;
+    }
+  this->BuildTree();
+}
+
+void PointCloudIndex::Build( cv::Mat const& pointcloud )
+{
+  this->Points.clear();
+  this->Ids.clear();
+  for( int row = 0; row < pointcloud.rows; row++ )
+    {
+    const cv::Vec3f * crt = pointcloud.ptr<cv::Vec3f>( row );
+    for( int col = 0; col < pointcloud.cols; col++ )
+      {
+      if( crt[ col ][ 2 ] > 0 )
+        {
+        this->Points.push_back( crt[ col ] );
+        this->Ids.push_back( row * pointcloud.cols + col );
+        }
+      }
+    }
+  this->BuildTree();
+}
+
+void PointCloudIndex::BuildTree()
+/*  Level by level : all the ranges of a level are independent and partitioned in parallel.
+    The split axis of a range is the one of largest extent. */
+{
+  int n = static_cast<int>( this->Points.size() );
+  this->SplitAxis.assign( n, 0 );
+  std::vector<int> order( n );
+  for( int i = 0; i < n; i++ )
+    {
+    order[ i ] = i;
+    }
+
+  std::vector<TreeRange> level, next;
+  if( n > this->LeafSize )
+    {
+    level.push_back( TreeRange{ 0, n, 0 } );
+    }
+  while( !level.empty() )
+    {
+    cv::parallel_for_( cv::Range( 0, static_cast<int>( level.size() ) ), [ & ]( const cv::Range & range )
+      {
+      for( int r = range.start; r < range.end; r++ )
+        {
+        int begin = level[ r ].Begin;
+        int end = level[ r ].End;
+        cv::Vec3f low = this->Points[ order[ begin ] ];
+        cv::Vec3f high = low;
+        for( int i = begin + 1; i < end; i++ )
+          {
+          cv::Vec3f const& p = this->Points[ order[ i ] ];
+          for( int a = 0; a < 3; a++ )
+            {
+            low[ a ] = std::min( low[ a ], p[ a ] );
+            high[ a ] = std::max( high[ a ], p[ a ] );
+            }
+          }
+        cv::Vec3f extent = high - low;
+        int axis = ( extent[ 0 ] >= extent[ 1 ] ? ( extent[ 0 ] >= extent[ 2 ] ? 0 : 2 ) : ( extent[ 1 ] >= extent[ 2 ] ? 1 : 2 ) );
+
+        int mid = ( begin + end ) / 2;
+        std::nth_element( order.begin() + begin, order.begin() + mid, order.begin() + end, [ & ]( int i, int j )
+          {
+          return this->Points[ i ][ axis ] < this->Points[ j ][ axis ];
+          } );
+        this->SplitAxis[ mid ] = static_cast<unsigned char>( axis );
+        }
+      } );
+
+    next.clear();
+    for( auto iter = level.cbegin(); iter != level.cend(); ++iter )
+      {
+      int mid = ( iter->Begin + iter->End ) / 2;
+      if( mid - iter->Begin > this->LeafSize )
+        {
+        next.push_back( TreeRange{ iter->Begin, mid, 0 } );
+        }
+      if( iter->End - mid - 1 > this->LeafSize )
+        {
+        next.push_back( TreeRange{ mid + 1, iter->End, 0 } );
+        }
+      }
+    level.swap( next );
+    }
+
+  // Points and ids in tree order
+  MemoryTracker::Vector<cv::Vec3f> points( n );
+  MemoryTracker::Vector<int> ids( n );
+  for( int i = 0; i < n; i++ )
+    {
+    points[ i ] = this->Points[ order[ i ] ];
+    ids[ i ] = this->Ids[ order[ i ] ];
+    }
+  this->Points.swap( points );
+  this->Ids.swap( ids );
+}
+
+void PointCloudIndex::RadiusSearch( cv::Vec3f const& center, float radius, std::vector<int> & ids ) const
+{
+  ids.clear();
+  if( this->Points.empty() )
+    {
+    return;
+    }
+  float radius2 = radius * radius;
+  TreeRange stack[ MaxTreeDepth ];
+  int top = 0;
+  stack[ top++ ] = TreeRange{ 0, static_cast<int>( this->Points.size() ), 0 };
+  while( top > 0 )
+    {
+    TreeRange crt = stack[ --top ];
+    if( crt.End - crt.Begin <= this->LeafSize )
+      {
+      for( int i = crt.Begin; i < crt.End; i++ )
+        {
+        cv::Vec3f diff = this->Points[ i ] - center;
+        if( diff.dot( diff ) < radius2 )
+          {
+          ids.push_back( this->Ids[ i ] );
+          }
+        }
+      continue;
+      }
+
+    int mid = ( crt.Begin + crt.End ) / 2;
+    cv::Vec3f diff = this->Points[ mid ] - center;
+    if( diff.dot( diff ) < radius2 )
+      {
+      ids.push_back( this->Ids[ mid ] );
+      }
+    int axis = this->SplitAxis[ mid ];
+    float split_diff = center[ axis ] - this->Points[ mid ][ axis ];
+    TreeRange left = TreeRange{ crt.Begin, mid, 0 };
+    TreeRange right = TreeRange{ mid + 1, crt.End, 0 };
+    if( split_diff * split_diff < radius2 )
+      {
+      stack[ top++ ] = ( split_diff <= 0 ? right : left );
+      }
+    stack[ top++ ] = ( split_diff <= 0 ? left : right );
+    }
+}
+
+void PointCloudIndex::KnnSearch( cv::Vec3f const& center, int k, std::vector<int> & ids, std::vector<float> & distances2 ) const
+{
+  ids.clear();
+  distances2.clear();
+  if( this->Points.empty() || k <= 0 )
+    {
+    return;
+    }
+
+  // Max-heap of the best candidates, the worst one on top
+  std::priority_queue< std::pair<float, int> > best;
+  auto bound = [ & ]()
+    {
+    return ( static_cast<int>( best.size() ) < k ? std::numeric_limits<float>::max() : best.top().first );
+    };
+  auto consider = [ & ]( int i )
+    {
+    cv::Vec3f diff = this->Points[ i ] - center;
+    float d2 = diff.dot( diff );
+    if( d2 < bound() )
+      {
+      best.push( std::make_pair( d2, i ) );
+      if( static_cast<int>( best.size() ) > k )
+        {
+        best.pop();
+        }
+      }
+    };
+
+  TreeRange stack[ MaxTreeDepth ];
+  int top = 0;
+  stack[ top++ ] = TreeRange{ 0, static_cast<int>( this->Points.size() ), 0 };
+  while( top > 0 )
+    {
+    TreeRange crt = stack[ --top ];
+    if( crt.Distance2 >= bound() )
+      {
+      continue;
+      }
+    if( crt.End - crt.Begin <= this->LeafSize )
+      {
+      for( int i = crt.Begin; i < crt.End; i++ )
+        {
+        consider( i );
+        }
+      continue;
+      }
+
+    int mid = ( crt.Begin + crt.End ) / 2;
+    consider( mid );
+    int axis = this->SplitAxis[ mid ];
+    float split_diff = center[ axis ] - this->Points[ mid ][ axis ];
+    TreeRange left = TreeRange{ crt.Begin, mid, 0 };
+    TreeRange right = TreeRange{ mid + 1, crt.End, 0 };
+    TreeRange far_side = ( split_diff <= 0 ? right : left );
+    far_side.Distance2 = std::max( crt.Distance2, split_diff * split_diff );
+    TreeRange near_side = ( split_diff <= 0 ? left : right );
+    near_side.Distance2 = crt.Distance2;
+    stack[ top++ ] = far_side;
+    stack[ top++ ] = near_side;
+    }
+
+  ids.resize( best.size() );
+  distances2.resize( best.size() );
+  for( int i = static_cast<int>( best.size() ) - 1; i >= 0; i-- )
+    {
+    distances2[ i ] = best.top().first;
+    ids[ i ] = this->Ids[ best.top().second ];
+    best.pop();
+    }
+}
+
+int PointCloudIndex::NearestSearch( cv::Vec3f const& center, float max_distance2, float * distance2 ) const
+{
+  // Same traversal as KnnSearch with k = 1, the bound starting at max_distance2
+  int best = -1;
+  float bound = max_distance2;
+  auto consider = [ & ]( int i )
+    {
+    cv::Vec3f diff = this->Points[ i ] - center;
+    float d2 = diff.dot( diff );
+    if( d2 < bound )
+      {
+      bound = d2;
+      best = i;
+      }
+    };
+
+  TreeRange stack[ MaxTreeDepth ];
+  int top = 0;
+  if( !this->Points.empty() )
+    {
+    stack[ top++ ] = TreeRange{ 0, static_cast<int>( this->Points.size() ), 0 };
+    }
+  while( top > 0 )
+    {
+    TreeRange crt = stack[ --top ];
+    if( crt.Distance2 >= bound )
+      {
+      continue;
+      }
+    if( crt.End - crt.Begin <= this->LeafSize )
+      {
+      for( int i = crt.Begin; i < crt.End; i++ )
+        {
+        consider( i );
+        }
+      continue;
+      }
+
+    int mid = ( crt.Begin + crt.End ) / 2;
+    consider( mid );
+    int axis = this->SplitAxis[ mid ];
+    float split_diff = center[ axis ] - this->Points[ mid ][ axis ];
+    TreeRange left = TreeRange{ crt.Begin, mid, 0 };
+    TreeRange right = TreeRange{ mid + 1, crt.End, 0 };
+    TreeRange far_side = ( split_diff <= 0 ? right : left );
+    far_side.Distance2 = std::max( crt.Distance2, split_diff * split_diff );
+    TreeRange near_side = ( split_diff <= 0 ? left : right );
+    near_side.Distance2 = crt.Distance2;
+    stack[ top++ ] = far_side;
+    stack[ top++ ] = near_side;
+    }
+
+  if( distance2 != NULL )
+    {
+    *distance2 = bound;
+    }
+  return ( best >= 0 ? this->Ids[ best ] : -1 );
+}
+
+void PointCloudIndex::RadiusSearch( std::vector<cv::Vec3f> const& centers, float radius, std::vector< std::vector<int> > & ids ) const
+{
+  ids.resize( centers.size() );
+  cv::parallel_for_( cv::Range( 0, static_cast<int>( centers.size() ) ), [ & ]( const cv::Range & range )
+    {
+    for( int c = range.start; c < range.end; c++ )
+      {
+      this->RadiusSearch( centers[ c ], radius, ids[ c ] );
+      }
+    } );
+}
+
+void PointCloudIndex::KnnSearch( std::vector<cv::Vec3f> const& centers, int k, std::vector< std::vector<int> > & ids, std::vector< std::vector<float> > & distances2 ) const
+{
+  ids.resize( centers.size() );
+  distances2.resize( centers.size() );
+  cv::parallel_for_( cv::Range( 0, static_cast<int>( centers.size() ) ), [ & ]( const cv::Range & range )
+    {
+    for( int c = range.start; c < range.end; c++ )
+      {
+      this->KnnSearch( centers[ c ], k, ids[ c ], distances2[ c ] );
+      }
+    } );
+}
@@ -0,0 +1,292 @@
+/*=========================================================================
+
+Library:   AnatomicAugmentedRealityProjector
+
+Author: Maeliss Jallais
+
+Copyright 2010 Kitware Inc. 28 Corporate Drive,
+Clifton Park, NY, 12065, USA.
+
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+=========================================================================*/
+
+
+#include "Profiler.hpp"
+#include "Logger.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+std::atomic<bool> Profiler::Enabled( false );
+thread_local int Profiler::CurrentStage = Profiler::NbStages;
+
+namespace
+{
+  const char * StageNames[ Profiler::NbStages ] = { "acquisition", "conversion", "subtraction", "peak_search", "undistortion",
+    "triangulation", "classification", "ransac", "compute_maximum", "export" };
+
+  // Written by one thread, read by the reports : the fields are atomic so that a report
+  // never reads a half written value
+  struct Event
+    {
+    std::atomic<long long> Start;
+    std::atomic<long long> Duration;
+    std::atomic<long long> Items;
+    std::atomic<int> Stage;
+    };
+
+  struct ThreadBuffer
+    {
+    explicit ThreadBuffer( int id ) : Id( id ), Events( Profiler::EVENTS_PER_THREAD ), Written( 0 )
+      {
+      for( int s = 0; s < Profiler::NbStages; s++ )
+        {
+        Items[ s ] = 0;
+        for( int b = 0; b < Profiler::NB_BINS; b++ )
+          {
+          Bins[ s ][ b ] = 0;
+          }
+        }
+      }
+
+    int Id;
+    std::vector<Event> Events;
+    std::atomic<long long> Written;
+    std::atomic<long long> Bins[ Profiler::NbStages ][ Profiler::NB_BINS ];
+    std::atomic<long long> Items[ Profiler::NbStages ];
+    };
+
+  // The buffers are only locked when a thread records its first event and by the reports.
+  // The pools retire their idle threads and the grabber starts a thread per acquisition : the
+  // buffer of an exited thread goes to the free list and the next new thread records after its
+  // events, which stay in the reports. A trace thread is then a sequence of threads.
+  std::mutex BuffersMutex;
+  std::vector< std::unique_ptr<ThreadBuffer> > Buffers;
+  std::vector<ThreadBuffer*> FreeBuffers;
+  const std::chrono::steady_clock::time_point Epoch = std::chrono::steady_clock::now();
+
+  // Buffer of a thread, freed when the thread exits
+  struct BufferOwner
+    {
+    BufferOwner() : Buffer( NULL )
+      {
+      }
+
+    ~BufferOwner()
+      {
+      if( this->Buffer != NULL )
+        {
+        std::lock_guard<std::mutex> lock( BuffersMutex );
+        FreeBuffers.push_back( this->Buffer );
+        }
+      }
+
+    ThreadBuffer * Buffer;
+    };
+
+  ThreadBuffer * thread_buffer()
+    {
+    static thread_local BufferOwner owner;
+    if( owner.Buffer == NULL )
+      {
+      std::lock_guard<std::mutex> lock( BuffersMutex );
+      if( FreeBuffers.empty() )
+        {
+        Buffers.push_back( std::unique_ptr<ThreadBuffer>( new ThreadBuffer( static_cast<int>( Buffers.size() ) + 1 ) ) );
+        owner.Buffer = Buffers.back().get();
+        }
+      else
+        {
+        owner.Buffer = FreeBuffers.back();
+        FreeBuffers.pop_back();
+        }
+      }
+    return owner.Buffer;
+    }
+
+  // Only the owner thread writes : no read-modify-write is needed
+  void increment( std::atomic<long long> & value, long long delta )
+    {
+    value.store( value.load( std::memory_order_relaxed ) + delta, std::memory_order_relaxed );
+    }
+
+  int bin( long long duration )
+    {
+    int b = 0;
+    while( duration > 1 && b < Profiler::NB_BINS - 1 )
+      {
+      duration >>= 1;
+      b++;
+      }
+    return b;
+    }
+
+  // Upper bound of the bin holding the given fraction of the events
+  long long percentile( std::vector<long long> const& bins, long long count, double fraction )
+    {
+    long long rank = static_cast<long long>( fraction * ( count - 1 ) ), seen = 0;
+    for( size_t b = 0; b < bins.size(); b++ )
+      {
+      seen += bins[ b ];
+      if( seen > rank )
+        {
+        return 2LL << b;
+        }
+      }
+    return 0;
+    }
+}
+
+const char * Profiler::GetStageName( Stage stage )
+{
+  return StageNames[ stage ];
+}
+
+long long Profiler::Now()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now() - Epoch ).count();
+}
+
+void Profiler::Record( Stage stage, long long start, long long duration, long long items )
+{
+  ThreadBuffer * buffer = thread_buffer();
+  long long written = buffer->Written.load( std::memory_order_relaxed );
+  Event & event = buffer->Events[ written % EVENTS_PER_THREAD ];
+  event.Start.store( start, std::memory_order_relaxed );
+  event.Duration.store( duration, std::memory_order_relaxed );
+  event.Items.store( items, std::memory_order_relaxed );
+  event.Stage.store( stage, std::memory_order_relaxed );
+  // The event is complete before it is counted
+  buffer->Written.store( written + 1, std::memory_order_release );
+  increment( buffer->Bins[ stage ][ bin( duration ) ], 1 );
+  increment( buffer->Items[ stage ], items );
+}
+
+void Profiler::Reset()
+{
+  std::lock_guard<std::mutex> lock( BuffersMutex );
+  for( auto iter = Buffers.begin(); iter != Buffers.end(); ++iter )
+    {
+    ThreadBuffer & buffer = **iter;
+    buffer.Written.store( 0, std::memory_order_relaxed );
+    for( int s = 0; s < NbStages; s++ )
+      {
+      buffer.Items[ s ].store( 0, std::memory_order_relaxed );
+      for( int b = 0; b < NB_BINS; b++ )
+        {
+        buffer.Bins[ s ][ b ].store( 0, std::memory_order_relaxed );
+        }
+      }
+    }
+}
+
+void Profiler::PrintHistograms( std::ostream & stream )
+{
+  std::vector<long long> bins[ NbStages ];
+  long long items[ NbStages ] = {};
+    {
+    std::lock_guard<std::mutex> lock( BuffersMutex );
+    for( int s = 0; s < NbStages; s++ )
+      {
+      bins[ s ].assign( NB_BINS, 0 );
+      for( auto iter = Buffers.cbegin(); iter != Buffers.cend(); ++iter )
+        {
+        for( int b = 0; b < NB_BINS; b++ )
+          {
+          bins[ s ][ b ] += ( *iter )->Bins[ s ][ b ].load( std::memory_order_relaxed );
+          }
+        items[ s ] += ( *iter )->Items[ s ].load( std::memory_order_relaxed );
+        }
+      }
+    }
+
+  stream << std::left << std::setw( 16 ) << "stage" << std::right << std::setw( 10 ) << "count" << std::setw( 12 ) << "p50 (us)"
+    << std::setw( 12 ) << "p90 (us)" << std::setw( 12 ) << "p99 (us)" << std::setw( 14 ) << "items" << std::endl;
+  for( int s = 0; s < NbStages; s++ )
+    {
+    long long count = 0;
+    for( int b = 0; b < NB_BINS; b++ )
+      {
+      count += bins[ s ][ b ];
+      }
+    if( count == 0 )
+      {
+      continue;
+      }
+    stream << std::left << std::setw( 16 ) << StageNames[ s ] << std::right << std::setw( 10 ) << count
+      << std::setw( 12 ) << percentile( bins[ s ], count, 0.5 ) / 1000.
+      << std::setw( 12 ) << percentile( bins[ s ], count, 0.9 ) / 1000.
+      << std::setw( 12 ) << percentile( bins[ s ], count, 0.99 ) / 1000.
+      << std::setw( 14 ) << items[ s ] << std::endl;
+    // One star per percent of the events, from 1 us
+    for( int b = 10; b < NB_BINS; b++ )
+      {
+      if( bins[ s ][ b ] > 0 )
+        {
+        stream << "  < " << std::setw( 10 ) << ( 2LL << b ) / 1000 << " us " << std::string( static_cast<size_t>( 1 + 100 * bins[ s ][ b ] / count ), '*' ) << std::endl;
+        }
+      }
+    }
+}
+
+bool Profiler::WriteTrace( std::string const& filename )
+{
+  std::ofstream file( filename.c_str(), std::ios::out | std::ios::trunc );
+  if( !file.is_open() )
+    {
+    LOG_ERROR( General, "[Profiler] Impossible to write " << filename );
+    return false;
+    }
+  file << "{\"traceEvents\":[" << std::endl;
+  bool first = true;
+  std::lock_guard<std::mutex> lock( BuffersMutex );
+  for( auto iter = Buffers.cbegin(); iter != Buffers.cend(); ++iter )
+    {
+    ThreadBuffer const& buffer = **iter;
+    long long written = buffer.Written.load( std::memory_order_acquire );
+    long long oldest = std::max( 0LL, written - EVENTS_PER_THREAD );
+    for( long long e = oldest; e < written; e++ )
+      {
+      Event const& event = buffer.Events[ e % EVENTS_PER_THREAD ];
+      long long start = event.Start.load( std::memory_order_relaxed );
+      long long duration = event.Duration.load( std::memory_order_relaxed );
+      long long items = event.Items.load( std::memory_order_relaxed );
+      int stage = event.Stage.load( std::memory_order_relaxed );
+      // Overwritten by the thread during the export
+      if( e < buffer.Written.load( std::memory_order_acquire ) - EVENTS_PER_THREAD || stage < 0 || stage >= NbStages )
+        {
+        continue;
+        }
+      file << ( first ? "" : ",\n" ) << "{\"name\":\"" << StageNames[ stage ] << "\",\"cat\":\"pipeline\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer.Id
+        << std::fixed << std::setprecision( 3 ) << ",\"ts\":" << start / 1000. << ",\"dur\":" << duration / 1000.
+        << ",\"args\":{\"items\":" << items << "}}";
+      first = false;
+      }
+    }
+  file << std::endl << "],\"displayTimeUnit\":\"ms\"}" << std::endl;
+  file.close();
+  if( !file )
+    {
+    LOG_ERROR( General, "[Profiler] Impossible to write " << filename );
+    return false;
+    }
+  return true;
+}
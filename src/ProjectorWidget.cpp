@@ -24,6 +24,7 @@ limitations under the License.
 =========================================================================*/
 
 #include "ProjectorWidget.hpp"
+#include "Logger.hpp"
 
 #include <opencv2/imgproc/imgproc.hpp>
 #include <opencv2/highgui/highgui.hpp>
@@ -79,7 +80,7 @@ cv::Mat ProjectorWidget::CreatePattern()
     {
     float color = (j+1) * 180 / this->GetHeight();
     float row = color*this->GetHeight() / 180;
-    std::cout << "color : " << color << " row : " << row << std::endl;
+    LOG_DEBUG( Projector, "color : " << color << " row : " << row );
     for( int i = 0; i < image.cols; i++ )
       {
       image.at<cv::Vec3b>( j, i ) = { unsigned char(j*180/this->GetHeight()), 255, 255 };
@@ -120,7 +121,12 @@ void ProjectorWidget::paintEvent(QPaintEvent *)
 {
   QPainter painter(this);
 
-  if (!this->Pixmap.isNull())
+  if (!this->Image.isNull())
+  {
+    QRectF rect = QRectF(QPointF(0, 0), QPointF(width(), height()));
+    painter.drawImage(rect, this->Image, rect);
+  }
+  else if (!this->Pixmap.isNull())
   {
     //QPixmap scale_pixmap = Pixmap.scaled(size(), Qt::KeepAspectRatio, Qt::SmoothTransformation);
     //QRectF rect = QRectF(QPointF(0, 0), QPointF(scale_pixmap.width(), scale_pixmap.height()));
@@ -150,7 +156,7 @@ void ProjectorWidget::start()
     msgBox.setDefaultButton( QMessageBox::No );
     if( msgBox.exec() == QMessageBox::No )
       {
-      std::cout << "Pattern not displayed. Connect a projector and try again." << std::endl;
+      LOG_WARNING( Projector, "Pattern not displayed. Connect a projector and try again." );
       return;
       }
     }
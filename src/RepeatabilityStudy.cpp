@@ -0,0 +1,219 @@
+/*=========================================================================
+
+Library:   AnatomicAugmentedRealityProjector
+
+Author: Maeliss Jallais
+
+Copyright 2010 Kitware Inc. 28 Corporate Drive,
+Clifton Park, NY, 12065, USA.
+
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+=========================================================================*/
+
+#include "RepeatabilityStudy.hpp"
+#include "FiducialDetector.hpp"
+#include "Logger.hpp"
+
+#include <opencv2/highgui/highgui.hpp>
+
+#include <algorithm>
+#include <fstream>
+
+namespace
+{
+  // Point k of line Line, seen by the camera pixel Id
+  struct MergeEntry
+    {
+    int Id;
+    int Line;
+    int Point;
+    };
+
+  // Streams of different repetitions are decorrelated by large odd multipliers
+  uint64 RepetitionSeed( uint64 seed, int repetition, uint64 multiplier )
+    {
+    uint64 s = seed + multiplier * static_cast<uint64>( repetition + 1 );
+    return ( s != 0 ? s : multiplier );
+    }
+}
+
+RepeatabilityStudy::RepeatabilityStudy() :
+  Seed( 0x9E3779B97F4A7C15ULL ),
+  NbRepetitions( 100 ),
+  NbFramesPerRepetition( 7 ),
+  Scanner(),
+  ColorModels( NULL ),
+  ImageCols( 0 )
+{
+}
+
+bool RepeatabilityStudy::LoadFrames( QStringList const& filenames, cv::Mat const& mat_color_ref )
+{
+  this->Lines.clear();
+  this->FrameIds.clear();
+  this->ImageCols = mat_color_ref.cols;
+
+  int n = filenames.size();
+  std::vector<ScanLine> lines( n );
+  std::vector<char> valid( n, 0 );
+  cv::parallel_for_( cv::Range( 0, n ), [ & ]( const cv::Range & range )
+    {
+    for( int i = range.start; i < range.end; i++ )
+      {
+      cv::Mat frame = cv::imread( qPrintable( filenames[ i ] ) );
+      if( !frame.data || frame.type() != CV_8UC3 )
+        {
+        LOG_ERROR( Io, "Impossible to read " << qPrintable( filenames[ i ] ) );
+        continue;
+        }
+      valid[ i ] = this->Scanner.Reconstruct( mat_color_ref, frame, &lines[ i ] );
+      }
+    } );
+
+  for( int i = 0; i < n; i++ )
+    {
+    if( valid[ i ] )
+      {
+      this->Lines.push_back( std::move( lines[ i ] ) );
+      this->FrameIds.push_back( i );
+      }
+    }
+  LOG_INFO( Analysis, this->FrameIds.size() << " valid lines in " << n << " frames" );
+  return !this->FrameIds.empty();
+}
+
+bool RepeatabilityStudy::Run()
+{
+  this->Results.assign( this->NbRepetitions, RepeatabilityResult() );
+  if( this->Lines.empty() || this->ColorModels == NULL )
+    {
+    LOG_ERROR( Analysis, "The frames and the color models are required" );
+    return false;
+    }
+
+  int nb_lines = static_cast<int>( this->Lines.size() );
+  cv::parallel_for_( cv::Range( 0, this->NbRepetitions ), [ & ]( const cv::Range & range )
+    {
+    FiducialDetector detector;
+    detector.SetColorModels( this->ColorModels );
+    std::vector<int> picks( this->NbFramesPerRepetition );
+    std::vector<MergeEntry> entries;
+    std::vector<cv::Vec3f> points;
+    std::vector<cv::Vec3b> colors;
+
+    for( int r = range.start; r < range.end; r++ )
+      {
+      RepeatabilityResult & result = this->Results[ r ];
+      cv::RNG rng( RepetitionSeed( this->Seed, r, 0x9E3779B97F4A7C15ULL ) );
+      detector.SetSeed( RepetitionSeed( this->Seed, r, 0xD1B54A32D192ED03ULL ) );
+
+      entries.clear();
+      result.Frames.clear();
+      for( int k = 0; k < this->NbFramesPerRepetition; k++ )
+        {
+        int line = rng.uniform( 0, nb_lines );
+        result.Frames.push_back( this->FrameIds[ line ] );
+        ScanLine const& scan = this->Lines[ line ];
+        for( int p = 0; p < static_cast<int>( scan.Pixels.size() ); p++ )
+          {
+          entries.push_back( MergeEntry{ scan.Pixels[ p ].y * this->ImageCols + scan.Pixels[ p ].x, line, p } );
+          }
+        }
+
+      // Same as writing the lines one after the other in an organized cloud :
+      // the last frame wins and the points are in row major order
+      std::stable_sort( entries.begin(), entries.end(), []( MergeEntry const& a, MergeEntry const& b )
+        {
+        return a.Id < b.Id;
+        } );
+      points.clear();
+      colors.clear();
+      for( size_t e = 0; e < entries.size(); e++ )
+        {
+        if( e + 1 < entries.size() && entries[ e + 1 ].Id == entries[ e ].Id )
+          {
+          continue;
+          }
+        points.push_back( this->Lines[ entries[ e ].Line ].Points[ entries[ e ].Point ] );
+        colors.push_back( this->Lines[ entries[ e ].Line ].Colors[ entries[ e ].Point ] );
+        }
+
+      result.Valid = detector.Detect( points, colors );
+      result.Corner = detector.GetCorner();
+      result.CircleCorner = detector.GetCircleCorner();
+      }
+    } );
+
+  int nb_valid = 0;
+  for( auto iter = this->Results.cbegin(); iter != this->Results.cend(); ++iter )
+    {
+    nb_valid += ( iter->Valid ? 1 : 0 );
+    }
+  LOG_INFO( Analysis, nb_valid << " / " << this->NbRepetitions << " repetitions succeeded" );
+  return nb_valid > 0;
+}
+
+void RepeatabilityStudy::GetStatistics( bool circle, cv::Scalar * mean, cv::Scalar * stddev ) const
+{
+  std::vector<cv::Vec3f> corners;
+  for( auto iter = this->Results.cbegin(); iter != this->Results.cend(); ++iter )
+    {
+    if( iter->Valid )
+      {
+      corners.push_back( circle ? iter->CircleCorner : iter->Corner );
+      }
+    }
+  *mean = cv::Scalar::all( 0 );
+  *stddev = cv::Scalar::all( 0 );
+  if( !corners.empty() )
+    {
+    cv::meanStdDev( corners, *mean, *stddev );
+    }
+}
+
+bool RepeatabilityStudy::WriteCsv( QString const& filename ) const
+{
+  std::ofstream file( qPrintable( filename ) );
+  if( !file.is_open() )
+    {
+    LOG_ERROR( Io, "Impossible to open " << qPrintable( filename ) );
+    return false;
+    }
+  file.precision( 9 );
+
+  file << "repetition,valid,frames,m1_x,m1_y,m1_z,m2_x,m2_y,m2_z\n";
+  for( size_t r = 0; r < this->Results.size(); r++ )
+    {
+    RepeatabilityResult const& result = this->Results[ r ];
+    file << r << ',' << ( result.Valid ? 1 : 0 ) << ',';
+    for( size_t k = 0; k < result.Frames.size(); k++ )
+      {
+      file << ( k > 0 ? ";" : "" ) << result.Frames[ k ];
+      }
+    file << ',' << result.Corner[ 0 ] << ',' << result.Corner[ 1 ] << ',' << result.Corner[ 2 ]
+      << ',' << result.CircleCorner[ 0 ] << ',' << result.CircleCorner[ 1 ] << ',' << result.CircleCorner[ 2 ] << '\n';
+    }
+
+  cv::Scalar mean, stddev, mean_circle, stddev_circle;
+  this->GetStatistics( false, &mean, &stddev );
+  this->GetStatistics( true, &mean_circle, &stddev_circle );
+  file << "mean,,," << mean[ 0 ] << ',' << mean[ 1 ] << ',' << mean[ 2 ]
+    << ',' << mean_circle[ 0 ] << ',' << mean_circle[ 1 ] << ',' << mean_circle[ 2 ] << '\n';
+  file << "stddev,,," << stddev[ 0 ] << ',' << stddev[ 1 ] << ',' << stddev[ 2 ]
+    << ',' << stddev_circle[ 0 ] << ',' << stddev_circle[ 1 ] << ',' << stddev_circle[ 2 ] << '\n';
+
+  return file.good();
+}
@@ -0,0 +1,389 @@
+/*=========================================================================
+
+Library:   AnatomicAugmentedRealityProjector
+
+Author: Maeliss Jallais
+
+Copyright 2010 Kitware Inc. 28 Corporate Drive,
+Clifton Park, NY, 12065, USA.
+
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+=========================================================================*/
+
+
+#include "SceneRenderer.hpp"
+#include "Logger.hpp"
+
+#include <opencv2/calib3d/calib3d.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+bool SyntheticScene::Intersect( cv::Vec3d const& origin, cv::Vec3d const& direction, double max_t,
+  double * t, cv::Vec3d * normal, cv::Vec3b * color ) const
+{
+  *t = max_t;
+  for( auto iter = this->Planes.cbegin(); iter != this->Planes.cend(); ++iter )
+    {
+    double denominator = iter->Normal.dot( direction );
+    if( std::abs( denominator ) < 1e-12 )
+      {
+      continue;
+      }
+    double hit = iter->Normal.dot( iter->Point - origin ) / denominator;
+    if( hit > 0 && hit < *t )
+      {
+      *t = hit;
+      *normal = iter->Normal;
+      *color = iter->Color;
+      }
+    }
+  for( auto iter = this->Spheres.cbegin(); iter != this->Spheres.cend(); ++iter )
+    {
+    cv::Vec3d oc = origin - iter->Center;
+    double b = oc.dot( direction );
+    double discriminant = b * b - oc.dot( oc ) + iter->Radius * iter->Radius;
+    if( discriminant < 0 )
+      {
+      continue;
+      }
+    double root = std::sqrt( discriminant );
+    double hit = ( -b - root > 0 ? -b - root : -b + root );
+    if( hit > 0 && hit < *t )
+      {
+      *t = hit;
+      *normal = ( origin + hit * direction - iter->Center ) / iter->Radius;
+      *color = iter->Color;
+      }
+    }
+  for( auto iter = this->Cubes.cbegin(); iter != this->Cubes.cend(); ++iter )
+    {
+    // Slabs of the three axes, in the frame of the cube
+    cv::Vec3d o = iter->Rotation.t() * ( origin - iter->Center );
+    cv::Vec3d d = iter->Rotation.t() * direction;
+    double half = iter->Size / 2;
+    double t_near = -DBL_MAX, t_far = DBL_MAX;
+    int face_near = 0, face_far = 0;
+    bool missed = false;
+    for( int axis = 0; axis < 3 && !missed; axis++ )
+      {
+      if( std::abs( d[ axis ] ) < 1e-12 )
+        {
+        missed = ( std::abs( o[ axis ] ) > half );
+        continue;
+        }
+      double t1 = ( -half - o[ axis ] ) / d[ axis ];
+      double t2 = ( half - o[ axis ] ) / d[ axis ];
+      // The ray enters through the -axis face when it goes towards +axis
+      int face1 = 2 * axis, face2 = 2 * axis + 1;
+      if( t1 > t2 )
+        {
+        std::swap( t1, t2 );
+        std::swap( face1, face2 );
+        }
+      if( t1 > t_near )
+        {
+        t_near = t1;
+        face_near = face1;
+        }
+      if( t2 < t_far )
+        {
+        t_far = t2;
+        face_far = face2;
+        }
+      missed = ( t_near > t_far );
+      }
+    if( missed )
+      {
+      continue;
+      }
+    double hit = ( t_near > 0 ? t_near : t_far );
+    int face = ( t_near > 0 ? face_near : face_far );
+    if( hit > 0 && hit < *t )
+      {
+      *t = hit;
+      cv::Vec3d axis( 0, 0, 0 );
+      axis[ face / 2 ] = ( face % 2 == 0 ? -1 : 1 );
+      *normal = iter->Rotation * axis;
+      *color = iter->Colors[ face ];
+      }
+    }
+  return *t < max_t;
+}
+
+SceneRenderer::SceneRenderer( uint64 seed ) :
+  Calib(),
+  CameraWidth( 0 ),
+  CameraHeight( 0 ),
+  ProjectorWidth( 0 ),
+  ProjectorHeight( 0 ),
+  Seed( seed ),
+  Noise( 2 ),
+  Blur( 0.5 ),
+  Ambient( 0.1 ),
+  LineColor( 255, 255, 255 ),
+  LineWidth( 4 ),
+  FirstDelay( 0 ),
+  Sweep( 0.011 )
+{
+}
+
+bool SceneRenderer::SetCalibration( CalibrationData const& data )
+{
+  this->Calib = CompiledCalibration::Compile( data );
+  if( !this->Calib )
+    {
+    LOG_ERROR( Scan, "[SceneRenderer] Invalid calibration" );
+    return false;
+    }
+  return true;
+}
+
+double SceneRenderer::GetRowFromDelay( double delay ) const
+{
+  return ( this->Sweep > 0 ? ( delay - this->FirstDelay ) / this->Sweep * this->ProjectorHeight : 0 );
+}
+
+cv::Point2d SceneRenderer::ProjectToProjector( cv::Vec3d const& point ) const
+{
+  // Same distortion model as cv::projectPoints : k1, k2, p1, p2, k3
+  cv::Vec<double, 5> const& kc = this->Calib->ProjKc;
+  cv::Matx33d const& K = this->Calib->ProjK;
+  double x = point[ 0 ] / point[ 2 ];
+  double y = point[ 1 ] / point[ 2 ];
+  double r2 = x * x + y * y;
+  double radial = 1 + r2 * ( kc[ 0 ] + r2 * ( kc[ 1 ] + r2 * kc[ 4 ] ) );
+  double xd = x * radial + 2 * kc[ 2 ] * x * y + kc[ 3 ] * ( r2 + 2 * x * x );
+  double yd = y * radial + kc[ 2 ] * ( r2 + 2 * y * y ) + 2 * kc[ 3 ] * x * y;
+  return cv::Point2d( K( 0, 0 ) * xd + K( 0, 1 ) * yd + K( 0, 2 ), K( 1, 1 ) * yd + K( 1, 2 ) );
+}
+
+bool SceneRenderer::SetScene( SyntheticScene const& scene )
+{
+  if( !this->Calib || this->CameraWidth <= 0 || this->CameraHeight <= 0 || this->ProjectorWidth <= 0 || this->ProjectorHeight <= 0 )
+    {
+    LOG_ERROR( Scan, "[SceneRenderer] The calibration and the sizes are needed to render a scene" );
+    return false;
+    }
+  int width = this->CameraWidth;
+  int height = this->CameraHeight;
+
+  // Camera rays of all the pixels, undistorted at once
+  std::vector<cv::Point2d> pixels( static_cast<size_t>( width ) * height ), rays;
+  for( int y = 0; y < height; y++ )
+    {
+    for( int x = 0; x < width; x++ )
+      {
+      pixels[ static_cast<size_t>( y ) * width + x ] = cv::Point2d( x, y );
+      }
+    }
+  cv::undistortPoints( pixels, rays, this->Calib->CamK, this->Calib->CamKc );
+
+  this->Points.create( height, width, CV_32FC3 );
+  this->Reflectance.create( height, width, CV_32FC3 );
+  this->Shading.create( height, width, CV_32F );
+  this->ProjectorRows.create( height, width, CV_32F );
+  cv::Vec3d projector = this->Calib->ProjectorCenter;
+
+  cv::parallel_for_( cv::Range( 0, height ), [ & ]( const cv::Range & range )
+    {
+    for( int y = range.start; y < range.end; y++ )
+      {
+      for( int x = 0; x < width; x++ )
+        {
+        cv::Vec3f & point_out = this->Points.at<cv::Vec3f>( y, x );
+        cv::Vec3f & reflectance = this->Reflectance.at<cv::Vec3f>( y, x );
+        float & shading = this->Shading.at<float>( y, x );
+        float & projector_row = this->ProjectorRows.at<float>( y, x );
+        point_out = cv::Vec3f( 0, 0, 0 );
+        reflectance = cv::Vec3f( 0, 0, 0 );
+        shading = 0;
+        projector_row = -1;
+
+        cv::Point2d const& ray = rays[ static_cast<size_t>( y ) * width + x ];
+        cv::Vec3d direction( ray.x, ray.y, 1 );
+        direction /= cv::norm( direction );
+        double t;
+        cv::Vec3d normal;
+        cv::Vec3b color;
+        if( !scene.Intersect( cv::Vec3d( 0, 0, 0 ), direction, DBL_MAX, &t, &normal, &color ) )
+          {
+          continue;
+          }
+        cv::Vec3d point = t * direction;
+        point_out = cv::Vec3f( point );
+        reflectance = cv::Vec3f( color[ 0 ] / 255.f, color[ 1 ] / 255.f, color[ 2 ] / 255.f );
+
+        // The projector lights the point if the point is in its image, on the side of the
+        // surface facing it and not hidden by another surface
+        cv::Vec3d in_projector = this->Calib->R * point + this->Calib->T;
+        if( in_projector[ 2 ] <= 0 )
+          {
+          continue;
+          }
+        cv::Point2d pixel = this->ProjectToProjector( in_projector );
+        projector_row = static_cast<float>( pixel.y );
+        if( pixel.x < 0 || pixel.x >= this->ProjectorWidth )
+          {
+          continue;
+          }
+        if( normal.dot( direction ) > 0 )
+          {
+          normal = -normal;
+          }
+        cv::Vec3d to_projector = projector - point;
+        double distance = cv::norm( to_projector );
+        to_projector /= distance;
+        double cosine = normal.dot( to_projector );
+        double shadow_t;
+        cv::Vec3d shadow_normal;
+        cv::Vec3b shadow_color;
+        if( cosine <= 0 || scene.Intersect( point + 1e-6 * to_projector, to_projector, distance, &shadow_t, &shadow_normal, &shadow_color ) )
+          {
+          continue;
+          }
+        shading = static_cast<float>( cosine );
+        }
+      }
+    } );
+  return true;
+}
+
+void SceneRenderer::Render( double row, bool line, uint64 seed, cv::Mat & frame ) const
+{
+  if( this->Reflectance.empty() )
+    {
+    LOG_ERROR( Scan, "[SceneRenderer] No scene" );
+    frame = cv::Mat::zeros( this->CameraHeight, this->CameraWidth, CV_8UC3 );
+    return;
+    }
+  int width = this->Reflectance.cols;
+  int height = this->Reflectance.rows;
+  cv::Mat radiance( height, width, CV_32FC3 );
+  // Gaussian profile across the projector rows, LineWidth wide at half maximum
+  float falloff = static_cast<float>( 4 * std::log( 2. ) / std::max( this->LineWidth * this->LineWidth, 1e-6 ) );
+  float ambient = static_cast<float>( 255 * this->Ambient );
+  cv::Vec3f line_color( this->LineColor[ 0 ], this->LineColor[ 1 ], this->LineColor[ 2 ] );
+
+  cv::parallel_for_( cv::Range( 0, height ), [ & ]( const cv::Range & range )
+    {
+    for( int y = range.start; y < range.end; y++ )
+      {
+      const cv::Vec3f * reflectance = this->Reflectance.ptr<cv::Vec3f>( y );
+      const float * shading = this->Shading.ptr<float>( y );
+      const float * rows = this->ProjectorRows.ptr<float>( y );
+      cv::Vec3f * out = radiance.ptr<cv::Vec3f>( y );
+      for( int x = 0; x < width; x++ )
+        {
+        float light = 0;
+        if( line && shading[ x ] > 0 )
+          {
+          float d = rows[ x ] - static_cast<float>( row );
+          float exponent = d * d * falloff;
+          light = ( exponent < 20 ? shading[ x ] * std::exp( -exponent ) : 0 );
+          }
+        for( int c = 0; c < 3; c++ )
+          {
+          out[ x ][ c ] = reflectance[ x ][ c ] * ( ambient + line_color[ c ] * light );
+          }
+        }
+      }
+    } );
+
+  if( this->Blur > 0 )
+    {
+    cv::GaussianBlur( radiance, radiance, cv::Size( 0, 0 ), this->Blur );
+    }
+
+  // One random stream per scanline
+  frame.create( height, width, CV_8UC3 );
+  cv::parallel_for_( cv::Range( 0, height ), [ & ]( const cv::Range & range )
+    {
+    for( int y = range.start; y < range.end; y++ )
+      {
+      cv::RNG rng( seed ^ ( static_cast<uint64>( y + 1 ) * 0xBF58476D1CE4E5B9ULL ) );
+      const cv::Vec3f * in = radiance.ptr<cv::Vec3f>( y );
+      cv::Vec3b * out = frame.ptr<cv::Vec3b>( y );
+      for( int x = 0; x < width; x++ )
+        {
+        for( int c = 0; c < 3; c++ )
+          {
+          out[ x ][ c ] = cv::saturate_cast<uchar>( in[ x ][ c ] + ( this->Noise > 0 ? rng.gaussian( this->Noise ) : 0 ) );
+          }
+        }
+      }
+    } );
+}
+
+void SceneRenderer::FindLine( double row, SceneLine * truth ) const
+{
+  truth->Row = row;
+  truth->Pixels.clear();
+  truth->Points.clear();
+  if( this->Shading.empty() )
+    {
+    return;
+    }
+  int width = this->Shading.cols;
+  std::vector<int> best( width, -1 );
+  cv::parallel_for_( cv::Range( 0, width ), [ & ]( const cv::Range & range )
+    {
+    for( int x = range.start; x < range.end; x++ )
+      {
+      double best_distance = this->LineWidth;
+      for( int y = 0; y < this->Shading.rows; y++ )
+        {
+        double distance = std::abs( this->ProjectorRows.at<float>( y, x ) - row );
+        if( this->Shading.at<float>( y, x ) > 0 && distance <= best_distance )
+          {
+          best_distance = distance;
+          best[ x ] = y;
+          }
+        }
+      }
+    } );
+  for( int x = 0; x < width; x++ )
+    {
+    if( best[ x ] >= 0 )
+      {
+      truth->Pixels.push_back( cv::Point2i( x, best[ x ] ) );
+      truth->Points.push_back( this->Points.at<cv::Vec3f>( best[ x ], x ) );
+      }
+    }
+}
+
+void SceneRenderer::RenderReference( cv::Mat & frame ) const
+{
+  this->Render( 0, false, this->Seed, frame );
+}
+
+void SceneRenderer::RenderRow( double row, cv::Mat & frame, SceneLine * truth ) const
+{
+  // The noise changes with the row
+  uint64 seed = this->Seed + static_cast<uint64>( std::llround( ( row + 1 ) * 256 ) ) * 0x9E3779B97F4A7C15ULL;
+  this->Render( row, true, seed, frame );
+  if( truth != NULL )
+    {
+    this->FindLine( row, truth );
+    }
+}
+
+void SceneRenderer::RenderDelay( double delay, cv::Mat & frame, SceneLine * truth ) const
+{
+  this->RenderRow( this->GetRowFromDelay( delay ), frame, truth );
+}
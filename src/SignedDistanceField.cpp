@@ -0,0 +1,257 @@
+/*=========================================================================
+
+Library:   AnatomicAugmentedRealityProjector
+
+Author: Maeliss Jallais
+
+Copyright 2010 Kitware Inc. 28 Corporate Drive,
+Clifton Park, NY, 12065, USA.
+
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+=========================================================================*/
+
+
+#include "SignedDistanceField.hpp"
+#include "Logger.hpp"
+#include "PointCloudIndex.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace
+{
+  struct SdfHeader
+    {
+    char Magic[ 4 ];
+    int Version;
+    int Dimensions[ 3 ];
+    float Origin[ 3 ];
+    float Spacing;
+    };
+
+  const char SdfMagic[ 4 ] = { 'S', 'D', 'F', 'V' };
+}
+
+SignedDistanceField::SignedDistanceField() :
+  Dimensions( 0, 0, 0 ),
+  Origin( 0, 0, 0 ),
+  Spacing( 0 ),
+  Mapping( NULL ),
+  Data( NULL )
+{
+}
+
+SignedDistanceField::~SignedDistanceField()
+{
+  this->Clear();
+}
+
+void SignedDistanceField::Clear()
+{
+  if( this->Mapping != NULL )
+    {
+    this->File.unmap( this->Mapping );
+    this->Mapping = NULL;
+    }
+  if( this->File.isOpen() )
+    {
+    this->File.close();
+    }
+  this->Values.clear();
+  this->Data = NULL;
+  this->Dimensions = cv::Vec3i( 0, 0, 0 );
+}
+
+bool SignedDistanceField::Compute( std::vector<cv::Vec3f> const& points, std::vector<cv::Vec3f> const& normals, float spacing, float margin )
+{
+  this->Clear();
+  if( points.empty() || normals.size() != points.size() || spacing <= 0 )
+    {
+    LOG_ERROR( Analysis, "The signed distance field needs points, their normals and a positive spacing" );
+    return false;
+    }
+
+  cv::Vec3f low = points[ 0 ], high = points[ 0 ];
+  for( auto iter = points.cbegin(); iter != points.cend(); ++iter )
+    {
+    for( int a = 0; a < 3; a++ )
+      {
+      low[ a ] = std::min( low[ a ], ( *iter )[ a ] );
+      high[ a ] = std::max( high[ a ], ( *iter )[ a ] );
+      }
+    }
+  this->Spacing = spacing;
+  for( int a = 0; a < 3; a++ )
+    {
+    this->Origin[ a ] = low[ a ] - margin;
+    this->Dimensions[ a ] = static_cast<int>( std::ceil( ( high[ a ] - low[ a ] + 2 * margin ) / spacing ) ) + 1;
+    }
+
+  PointCloudIndex index;
+  index.Build( points );
+  int nx = this->Dimensions[ 0 ], ny = this->Dimensions[ 1 ], nz = this->Dimensions[ 2 ];
+  this->Values.resize( static_cast<size_t>( nx ) * ny * nz );
+  cv::parallel_for_( cv::Range( 0, nz ), [ & ]( const cv::Range & range )
+    {
+    for( int k = range.start; k < range.end; k++ )
+      {
+      for( int j = 0; j < ny; j++ )
+        {
+        float * row = &this->Values[ ( static_cast<size_t>( k ) * ny + j ) * nx ];
+        for( int i = 0; i < nx; i++ )
+          {
+          cv::Vec3f voxel = this->Origin + spacing * cv::Vec3f( float( i ), float( j ), float( k ) );
+          float d2;
+          int id = index.NearestSearch( voxel, std::numeric_limits<float>::max(), &d2 );
+          cv::Vec3f diff = voxel - points[ id ];
+          float plane = normals[ id ].dot( diff );
+          float dist = std::sqrt( d2 );
+          // Close to the surface the distance to the tangent plane does not depend on the
+          // sampling of the surface, far from it the euclidean distance is signed by the normal
+          float t = std::min( dist / ( 4 * spacing ), 1.f );
+          row[ i ] = ( 1 - t ) * plane + t * ( plane < 0 ? -dist : dist );
+          }
+        }
+      }
+    } );
+
+  this->Data = this->Values.data();
+  return true;
+}
+
+bool SignedDistanceField::Save( QString const& filename ) const
+{
+  if( !this->IsValid() )
+    {
+    LOG_ERROR( Io, "No signed distance field to save" );
+    return false;
+    }
+  QFile file( filename );
+  if( !file.open( QIODevice::WriteOnly ) )
+    {
+    LOG_ERROR( Io, "Impossible to open " << qPrintable( filename ) );
+    return false;
+    }
+
+  SdfHeader header;
+  std::memcpy( header.Magic, SdfMagic, sizeof( SdfMagic ) );
+  header.Version = SDF_FILE_VERSION;
+  for( int a = 0; a < 3; a++ )
+    {
+    header.Dimensions[ a ] = this->Dimensions[ a ];
+    header.Origin[ a ] = this->Origin[ a ];
+    }
+  header.Spacing = this->Spacing;
+
+  qint64 size = static_cast<qint64>( this->Dimensions[ 0 ] ) * this->Dimensions[ 1 ] * this->Dimensions[ 2 ] * sizeof( float );
+  if( file.write( reinterpret_cast<const char *>( &header ), sizeof( header ) ) != sizeof( header )
+    || file.write( reinterpret_cast<const char *>( this->Data ), size ) != size )
+    {
+    LOG_ERROR( Io, "Impossible to write " << qPrintable( filename ) );
+    return false;
+    }
+  return true;
+}
+
+bool SignedDistanceField::Load( QString const& filename )
+{
+  this->Clear();
+  this->File.setFileName( filename );
+  if( !this->File.open( QIODevice::ReadOnly ) )
+    {
+    LOG_ERROR( Io, "Impossible to open " << qPrintable( filename ) );
+    return false;
+    }
+
+  SdfHeader header;
+  qint64 file_size = this->File.size();
+  if( file_size < static_cast<qint64>( sizeof( header ) )
+    || this->File.read( reinterpret_cast<char *>( &header ), sizeof( header ) ) != sizeof( header )
+    || std::memcmp( header.Magic, SdfMagic, sizeof( SdfMagic ) ) != 0 || header.Version != SDF_FILE_VERSION )
+    {
+    LOG_ERROR( Io, qPrintable( filename ) << " is not a signed distance field" );
+    this->Clear();
+    return false;
+    }
+  qint64 size = static_cast<qint64>( header.Dimensions[ 0 ] ) * header.Dimensions[ 1 ] * header.Dimensions[ 2 ] * sizeof( float );
+  if( header.Dimensions[ 0 ] < 2 || header.Dimensions[ 1 ] < 2 || header.Dimensions[ 2 ] < 2 || file_size != static_cast<qint64>( sizeof( header ) ) + size )
+    {
+    LOG_ERROR( Io, "The size of " << qPrintable( filename ) << " does not match its header" );
+    this->Clear();
+    return false;
+    }
+
+  this->Mapping = this->File.map( 0, file_size );
+  if( this->Mapping == NULL )
+    {
+    LOG_ERROR( Io, "Impossible to map " << qPrintable( filename ) );
+    this->Clear();
+    return false;
+    }
+  for( int a = 0; a < 3; a++ )
+    {
+    this->Dimensions[ a ] = header.Dimensions[ a ];
+    this->Origin[ a ] = header.Origin[ a ];
+    }
+  this->Spacing = header.Spacing;
+  this->Data = reinterpret_cast<float const*>( this->Mapping + sizeof( header ) );
+  return true;
+}
+
+bool SignedDistanceField::Sample( cv::Vec3f const& point, float * distance, cv::Vec3f * gradient ) const
+{
+  if( this->Data == NULL )
+    {
+    return false;
+    }
+  int cell[ 3 ];
+  float f[ 3 ];
+  for( int a = 0; a < 3; a++ )
+    {
+    float u = ( point[ a ] - this->Origin[ a ] ) / this->Spacing;
+    if( !( u >= 0 ) || u >= this->Dimensions[ a ] - 1 )
+      {
+      return false;
+      }
+    cell[ a ] = static_cast<int>( u );
+    f[ a ] = u - cell[ a ];
+    }
+
+  size_t nx = this->Dimensions[ 0 ];
+  size_t slice = nx * this->Dimensions[ 1 ];
+  float const* c = this->Data + cell[ 2 ] * slice + cell[ 1 ] * nx + cell[ 0 ];
+  float c000 = c[ 0 ], c100 = c[ 1 ], c010 = c[ nx ], c110 = c[ nx + 1 ];
+  float c001 = c[ slice ], c101 = c[ slice + 1 ], c011 = c[ slice + nx ], c111 = c[ slice + nx + 1 ];
+
+  // Interpolation along x, then y, then z
+  float c00 = c000 + f[ 0 ] * ( c100 - c000 ), c10 = c010 + f[ 0 ] * ( c110 - c010 );
+  float c01 = c001 + f[ 0 ] * ( c101 - c001 ), c11 = c011 + f[ 0 ] * ( c111 - c011 );
+  float c0 = c00 + f[ 1 ] * ( c10 - c00 ), c1 = c01 + f[ 1 ] * ( c11 - c01 );
+  *distance = c0 + f[ 2 ] * ( c1 - c0 );
+
+  if( gradient != NULL )
+    {
+    // Exact derivatives of the trilinear interpolation
+    float dx0 = ( 1 - f[ 1 ] ) * ( c100 - c000 ) + f[ 1 ] * ( c110 - c010 );
+    float dx1 = ( 1 - f[ 1 ] ) * ( c101 - c001 ) + f[ 1 ] * ( c111 - c011 );
+    ( *gradient )[ 0 ] = ( dx0 + f[ 2 ] * ( dx1 - dx0 ) ) / this->Spacing;
+    ( *gradient )[ 1 ] = ( ( 1 - f[ 2 ] ) * ( c10 - c00 ) + f[ 2 ] * ( c11 - c01 ) ) / this->Spacing;
+    ( *gradient )[ 2 ] = ( c1 - c0 ) / this->Spacing;
+    }
+  return true;
+}
@@ -0,0 +1,668 @@
+/*=========================================================================
+
+Library:   AnatomicAugmentedRealityProjector
+
+Author: Maeliss Jallais
+
+Copyright 2010 Kitware Inc. 28 Corporate Drive,
+Clifton Park, NY, 12065, USA.
+
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+=========================================================================*/
+
+
+#include "SurfaceExtractor.hpp"
+#include "Logger.hpp"
+#include "MeshLoader.hpp"
+#include "Vec3iHash.hpp"
+
+#include "itkBinaryThresholdImageFilter.h"
+#include "itkDiscreteGaussianImageFilter.h"
+#include "itkImage.h"
+#include "itkImageFileReader.h"
+
+#include <QDateTime>
+#include <QFileInfo>
+
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace
+{
+  typedef itk::Image< float, 3 > VolumeType;
+
+  // Corners of a cell : the bit c of the case of a cell is set when the corner c is inside
+  const int CellCorners[ 8 ][ 3 ] = { { 0, 0, 0 }, { 1, 0, 0 }, { 1, 1, 0 }, { 0, 1, 0 }, { 0, 0, 1 }, { 1, 0, 1 }, { 1, 1, 1 }, { 0, 1, 1 } };
+  const int CellEdges[ 12 ][ 2 ] = { { 0, 1 }, { 1, 2 }, { 2, 3 }, { 3, 0 }, { 4, 5 }, { 5, 6 }, { 6, 7 }, { 7, 4 }, { 0, 4 }, { 1, 5 }, { 2, 6 }, { 3, 7 } };
+
+  // Triangles of each case as edges of the cell, -1 terminated. On the faces with 4 crossings
+  // the inside corners are separated from each other : two cells sharing a face always agree,
+  // so the surface has no hole. The triangles are not along the faces, so it is also manifold.
+  const int CaseTriangles[ 256 ][ 16 ] =
+    {
+      { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+      {  0,  3,  8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+      {  0,  9,  1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+      {  9,  3,  8,  1,  3,  9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+      {  1, 10,  2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+      {  0,  3,  8,  1, 10,  2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+      {  2,  9, 10,  0,  9,  2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+      {  9,  3,  8, 10,  3,  9,  2,  3, 10, -1, -1, -1, -1, -1, -1, -1 },
+      {  2, 11,  3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+      {  8,  2, 11,  0,  2,  8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+      {  0,  9,  1,  2, 11,  3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+      {  8,  2, 11,  9,  2,  8,  1,  2,  9, -1, -1, -1, -1, -1, -1, -1 },
+      {  3, 10, 11,  1, 10,  3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+      { 11,  1, 10,  8,  1, 11,  0,  1,  8, -1, -1, -1, -1, -1, -1, -1 },
+      { 11,  9, 10,  3,  9, 11,  0,  9,  3, -1, -1, -1, -1, -1, -1, -1 },
+      { 11,  9, 10,  8,  9, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+      {  4,  8,  7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+      {  4,  3,  7,  0,  3,  4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+      {  0,  9,  1,  4,  8,  7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+      {  4,  3,  7,  9,  3,  4,  1,  3,  9, -1, -1, -1, -1, -1, -1, -1 },
+      {  1, 10,  2,  4,  8,  7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+      {  4,  3,  7,  0,  3,  4,  1, 10,  2, -1, -1, -1, -1, -1, -1, -1 },
+      {  2,  9, 10,  0,  9,  2,  4,  8,  7, -1, -1, -1, -1, -1, -1, -1 },
+      {  4,  3,  7,  9,  3,  4, 10,  3,  9,  2,  3, 10, -1, -1, -1, -1 },
+      {  2, 11,  3,  4,  8,  7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+      {  7,  2, 11,  4,  2,  7,  0,  2,  4, -1, -1, -1, -1, -1, -1, -1 },
+      {  0,  9,  1,  2, 11,  3,  4,  8,  7, -1, -1, -1, -1, -1, -1, -1 },
+      {  7,  2, 11,  4,  2,  7,  9,  2,  4,  1,  2,  9, -1, -1, -1, -1 },
+      {  3, 10, 11,  1, 10,  3,  4,  8,  7, -1, -1, -1, -1, -1, -1, -1 },
+      { 11,  1, 10,  7,  1, 11,  4,  1,  7,  0,  1,  4, -1, -1, -1, -1 },
+      { 11,  9, 10,  3,  9, 11,  0,  9,  3,  4,  8,  7, -1, -1, -1, -1 },
+      { 11,  9, 10,  7,  9, 11,  4,  9,  7, -1, -1, -1, -1, -1, -1, -1 },
+      {  4,  5,  9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+      {  0,  3,  8,  4,  5,  9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+      {  1,  4,  5,  0,  4,  1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+      {  4,  3,  8,  5,  3,  4,  1,  3,  5, -1, -1, -1, -1, -1, -1, -1 },
+      {  1, 10,  2,  4,  5,  9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+      {  0,  3,  8,  1, 10,  2,  4,  5,  9, -1, -1, -1, -1, -1, -1, -1 },
+      { 10,  4,  5,  2,  4, 10,  0,  4,  2, -1, -1, -1, -1, -1, -1, -1 },
+      {  4,  3,  8,  5,  3,  4, 10,  3,  5,  2,  3, 10, -1, -1, -1, -1 },
+      {  2, 11,  3,  4,  5,  9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+      {  8,  2, 11,  0,  2,  8,  4,  5,  9, -1, -1, -1, -1, -1, -1, -1 },
+      {  1,  4,  5,  0,  4,  1,  2, 11,  3, -1, -1, -1, -1, -1, -1, -1 },
+      {  8,  2, 11,  4,  2,  8,  5,  2,  4,  1,  2,  5, -1, -1, -1, -1 },
+      {  3, 10, 11,  1, 10,  3,  4,  5,  9, -1, -1, -1, -1, -1, -1, -1 },
+      { 11,  1, 10,  8,  1, 11,  0,  1,  8,  4,  5,  9, -1, -1, -1, -1 },
+      { 10,  4,  5, 11,  4, 10,  3,  4, 11,  0,  4,  3, -1, -1, -1, -1 },
+      { 11,  5, 10,  8,  5, 11,  4,  5,  8, -1, -1, -1, -1, -1, -1, -1 },
+      {  7,  9,  8,  5,  9,  7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+      {  5,  3,  7,  9,  3,  5,  0,  3,  9, -1, -1, -1, -1, -1, -1, -1 },
+      {  5,  8,  7,  1,  8,  5,  0,  8,  1, -1, -1, -1, -1, -1, -1, -1 },
+      {  5,  3,  7,  1,  3,  5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+      {  1, 10,  2,  7,  9,  8,  5,  9,  7, -1, -1, -1, -1, -1, -1, -1 },
+      {  5,  3,  7,  9,  3,  5,  0,  3,  9,  1, 10,  2, -1, -1, -1, -1 },
+      {  5,  8,  7, 10,  8,  5,  2,  8, 10,  0,  8,  2, -1, -1, -1, -1 },
+      {  5,  3,  7, 10,  3,  5,  2,  3, 10, -1, -1, -1, -1, -1, -1, -1 },
+      {  2, 11,  3,  7,  9,  8,  5,  9,  7, -1, -1, -1, -1, -1, -1, -1 },
+      {  7,  2, 11,  5,  2,  7,  9,  2,  5,  0,  2,  9, -1, -1, -1, -1 },
+      {  5,  8,  7,  1,  8,  5,  0,  8,  1,  2, 11,  3, -1, -1, -1, -1 },
+      {  7,  2, 11,  5,  2,  7,  1,  2,  5, -1, -1, -1, -1, -1, -1, -1 },
+      {  3, 10, 11,  1, 10,  3,  7,  9,  8,  5,  9,  7, -1, -1, -1, -1 },
+      {  9,  7,  5,  0,  7,  9, 11,  1, 10,  7,  1, 11,  0,  1,  7, -1 },
+      {  3, 10, 11,  0, 10,  3,  5,  8,  7, 10,  8,  5,  0,  8, 10, -1 },
+      {  7, 10, 11,  5, 10,  7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+      {  5,  6, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+      {  0,  3,  8,  5,  6, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+      {  0,  9,  1,  5,  6, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+      {  9,  3,  8,  1,  3,  9,  5,  6, 10, -1, -1, -1, -1, -1, -1, -1 },
+      {  2,  5,  6,  1,  5,  2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+      {  0,  3,  8,  2,  5,  6,  1,  5,  2, -1, -1, -1, -1, -1, -1, -1 },
+      {  6,  9,  5,  2,  9,  6,  0,  9,  2, -1, -1, -1, -1, -1, -1, -1 },
+      {  9,  3,  8,  5,  3,  9,  6,  3,  5,  2,  3,  6, -1, -1, -1, -1 },
+      {  2, 11,  3,  5,  6, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+      {  8,  2, 11,  0,  2,  8,  5,  6, 10, -1, -1, -1, -1, -1, -1, -1 },
+      {  0,  9,  1,  2, 11,  3,  5,  6, 10, -1, -1, -1, -1, -1, -1, -1 },
+      {  8,  2, 11,  9,  2,  8,  1,  2,  9,  5,  6, 10, -1, -1, -1, -1 },
+      { 11,  5,  6,  3,  5, 11,  1,  5,  3, -1, -1, -1, -1, -1, -1, -1 },
+      {  6,  1,  5, 11,  1,  6,  8,  1, 11,  0,  1,  8, -1, -1, -1, -1 },
+      {  6,  9,  5, 11,  9,  6,  3,  9, 11,  0,  9,  3, -1, -1, -1, -1 },
+      {  8,  6, 11,  9,  6,  8,  5,  6,  9, -1, -1, -1, -1, -1, -1, -1 },
+      {  4,  8,  7,  5,  6, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+      {  4,  3,  7,  0,  3,  4,  5,  6, 10, -1, -1, -1, -1, -1, -1, -1 },
+      {  0,  9,  1,  4,  8,  7,  5,  6, 10, -1, -1, -1, -1, -1, -1, -1 },
+      {  4,  3,  7,  9,  3,  4,  1,  3,  9,  5,  6, 10, -1, -1, -1, -1 },
+      {  2,  5,  6,  1,  5,  2,  4,  8,  7, -1, -1, -1, -1, -1, -1, -1 },
+      {  4,  3,  7,  0,  3,  4,  2,  5,  6,  1,  5,  2, -1, -1, -1, -1 },
+      {  6,  9,  5,  2,  9,  6,  0,  9,  2,  4,  8,  7, -1, -1, -1, -1 },
+      {  4,  3,  7,  9,  3,  4,  5,  3,  9,  6,  3,  5,  2,  3,  6, -1 },
+      {  2, 11,  3,  4,  8,  7,  5,  6, 10, -1, -1, -1, -1, -1, -1, -1 },
+      {  7,  2, 11,  4,  2,  7,  0,  2,  4,  5,  6, 10, -1, -1, -1, -1 },
+      {  0,  9,  1,  2, 11,  3,  4,  8,  7,  5,  6, 10, -1, -1, -1, -1 },
+      {  7,  2, 11,  4,  2,  7,  9,  2,  4,  1,  2,  9,  5,  6, 10, -1 },
+      { 11,  5,  6,  3,  5, 11,  1,  5,  3,  4,  8,  7, -1, -1, -1, -1 },
+      {  6,  1,  5, 11,  1,  6,  7,  1, 11,  4,  1,  7,  0,  1,  4, -1 },
+      {  6,  9,  5, 11,  9,  6,  3,  9, 11,  0,  9,  3,  4,  8,  7, -1 },
+      {  6,  9,  5, 11,  9,  6,  7,  9, 11,  4,  9,  7, -1, -1, -1, -1 },
+      {  9,  6, 10,  4,  6,  9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+      {  0,  3,  8,  9,  6, 10,  4,  6,  9, -1, -1, -1, -1, -1, -1, -1 },
+      { 10,  4,  6,  1,  4, 10,  0,  4,  1, -1, -1, -1, -1, -1, -1, -1 },
+      {  4,  3,  8,  6,  3,  4, 10,  3,  6,  1,  3, 10, -1, -1, -1, -1 },
+      {  6,  9,  4,  2,  9,  6,  1,  9,  2, -1, -1, -1, -1, -1, -1, -1 },
+      {  0,  3,  8,  6,  9,  4,  2,  9,  6,  1,  9,  2, -1, -1, -1, -1 },
+      {  2,  4,  6,  0,  4,  2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+      {  4,  3,  8,  6,  3,  4,  2,  3,  6, -1, -1, -1, -1, -1, -1, -1 },
+      {  2, 11,  3,  9,  6, 10,  4,  6,  9, -1, -1, -1, -1, -1, -1, -1 },
+      {  8,  2, 11,  0,  2,  8,  9,  6, 10,  4,  6,  9, -1, -1, -1, -1 },
+      { 10,  4,  6,  1,  4, 10,  0,  4,  1,  2, 11,  3, -1, -1, -1, -1 },
+      { 10,  4,  6,  1,  4, 10,  8,  2, 11,  4,  2,  8,  1,  2,  4, -1 },
+      {  6,  9,  4, 11,  9,  6,  3,  9, 11,  1,  9,  3, -1, -1, -1, -1 },
+      {  4,  1,  9,  6,  1,  4, 11,  1,  6,  8,  1, 11,  0,  1,  8, -1 },
+      { 11,  4,  6,  3,  4, 11,  0,  4,  3, -1, -1, -1, -1, -1, -1, -1 },
+      {  8,  6, 11,  4,  6,  8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+      {  8, 10,  9,  7, 10,  8,  6, 10,  7, -1, -1, -1, -1, -1, -1, -1 },
+      {  6,  3,  7, 10,  3,  6,  9,  3, 10,  0,  3,  9, -1, -1, -1, -1 },
+      {  6,  8,  7, 10,  8,  6,  1,  8, 10,  0,  8,  1, -1, -1, -1, -1 },
+      {  6,  3,  7, 10,  3,  6,  1,  3, 10, -1, -1, -1, -1, -1, -1, -1 },
+      {  7,  9,  8,  6,  9,  7,  2,  9,  6,  1,  9,  2, -1, -1, -1, -1 },
+      {  1,  6,  2,  9,  6,  1,  6,  3,  7,  9,  3,  6,  0,  3,  9, -1 },
+      {  6,  8,  7,  2,  8,  6,  0,  8,  2, -1, -1, -1, -1, -1, -1, -1 },
+      {  6,  3,  7,  2,  3,  6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+      {  2, 11,  3,  8, 10,  9,  7, 10,  8,  6, 10,  7, -1, -1, -1, -1 },
+      { 10,  7,  6,  9,  7, 10,  7,  2, 11,  9,  2,  7,  0,  2,  9, -1 },
+      {  6,  8,  7, 10,  8,  6,  1,  8, 10,  0,  8,  1,  2, 11,  3, -1 },
+      { 10,  7,  6,  1,  7, 10,  7,  2, 11,  1,  2,  7, -1, -1, -1, -1 },
+      {  7,  9,  8,  6,  9,  7, 11,  9,  6,  3,  9, 11,  1,  9,  3, -1 },
+      {  0,  1,  9,  6, 11,  7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+      {  3,  6, 11,  0,  6,  3,  6,  8,  7,  0,  8,  6, -1, -1, -1, -1 },
+      {  6, 11,  7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+      {  6,  7, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+      {  0,  3,  8,  6,  7, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+      {  0,  9,  1,  6,  7, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+      {  9,  3,  8,  1,  3,  9,  6,  7, 11, -1, -1, -1, -1, -1, -1, -1 },
+      {  1, 10,  2,  6,  7, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+      {  0,  3,  8,  1, 10,  2,  6,  7, 11, -1, -1, -1, -1, -1, -1, -1 },
+      {  2,  9, 10,  0,  9,  2,  6,  7, 11, -1, -1, -1, -1, -1, -1, -1 },
+      {  9,  3,  8, 10,  3,  9,  2,  3, 10,  6,  7, 11, -1, -1, -1, -1 },
+      {  3,  6,  7,  2,  6,  3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+      {  7,  2,  6,  8,  2,  7,  0,  2,  8, -1, -1, -1, -1, -1, -1, -1 },
+      {  0,  9,  1,  3,  6,  7,  2,  6,  3, -1, -1, -1, -1, -1, -1, -1 },
+      {  7,  2,  6,  8,  2,  7,  9,  2,  8,  1,  2,  9, -1, -1, -1, -1 },
+      {  7, 10,  6,  3, 10,  7,  1, 10,  3, -1, -1, -1, -1, -1, -1, -1 },
+      {  6,  1, 10,  7,  1,  6,  8,  1,  7,  0,  1,  8, -1, -1, -1, -1 },
+      {  6,  9, 10,  7,  9,  6,  3,  9,  7,  0,  9,  3, -1, -1, -1, -1 },
+      {  9,  7,  8, 10,  7,  9,  6,  7, 10, -1, -1, -1, -1, -1, -1, -1 },
+      {  6,  8, 11,  4,  8,  6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+      {  6,  3, 11,  4,  3,  6,  0,  3,  4, -1, -1, -1, -1, -1, -1, -1 },
+      {  0,  9,  1,  6,  8, 11,  4,  8,  6, -1, -1, -1, -1, -1, -1, -1 },
+      {  6,  3, 11,  4,  3,  6,  9,  3,  4,  1,  3,  9, -1, -1, -1, -1 },
+      {  1, 10,  2,  6,  8, 11,  4,  8,  6, -1, -1, -1, -1, -1, -1, -1 },
+      {  6,  3, 11,  4,  3,  6,  0,  3,  4,  1, 10,  2, -1, -1, -1, -1 },
+      {  2,  9, 10,  0,  9,  2,  6,  8, 11,  4,  8,  6, -1, -1, -1, -1 },
+      {  6,  3, 11,  4,  3,  6,  9,  3,  4, 10,  3,  9,  2,  3, 10, -1 },
+      {  8,  6,  4,  3,  6,  8,  2,  6,  3, -1, -1, -1, -1, -1, -1, -1 },
+      {  4,  2,  6,  0,  2,  4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+      {  0,  9,  1,  8,  6,  4,  3,  6,  8,  2,  6,  3, -1, -1, -1, -1 },
+      {  4,  2,  6,  9,  2,  4,  1,  2,  9, -1, -1, -1, -1, -1, -1, -1 },
+      {  4, 10,  6,  8, 10,  4,  3, 10,  8,  1, 10,  3, -1, -1, -1, -1 },
+      {  6,  1, 10,  4,  1,  6,  0,  1,  4, -1, -1, -1, -1, -1, -1, -1 },
+      {  8,  6,  4,  3,  6,  8,  6,  9, 10,  3,  9,  6,  0,  9,  3, -1 },
+      {  6,  9, 10,  4,  9,  6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+      {  4,  5,  9,  6,  7, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+      {  0,  3,  8,  4,  5,  9,  6,  7, 11, -1, -1, -1, -1, -1, -1, -1 },
+      {  1,  4,  5,  0,  4,  1,  6,  7, 11, -1, -1, -1, -1, -1, -1, -1 },
+      {  4,  3,  8,  5,  3,  4,  1,  3,  5,  6,  7, 11, -1, -1, -1, -1 },
+      {  1, 10,  2,  4,  5,  9,  6,  7, 11, -1, -1, -1, -1, -1, -1, -1 },
+      {  0,  3,  8,  1, 10,  2,  4,  5,  9,  6,  7, 11, -1, -1, -1, -1 },
+      { 10,  4,  5,  2,  4, 10,  0,  4,  2,  6,  7, 11, -1, -1, -1, -1 },
+      {  4,  3,  8,  5,  3,  4, 10,  3,  5,  2,  3, 10,  6,  7, 11, -1 },
+      {  3,  6,  7,  2,  6,  3,  4,  5,  9, -1, -1, -1, -1, -1, -1, -1 },
+      {  7,  2,  6,  8,  2,  7,  0,  2,  8,  4,  5,  9, -1, -1, -1, -1 },
+      {  1,  4,  5,  0,  4,  1,  3,  6,  7,  2,  6,  3, -1, -1, -1, -1 },
+      {  7,  2,  6,  8,  2,  7,  4,  2,  8,  5,  2,  4,  1,  2,  5, -1 },
+      {  7, 10,  6,  3, 10,  7,  1, 10,  3,  4,  5,  9, -1, -1, -1, -1 },
+      {  6,  1, 10,  7,  1,  6,  8,  1,  7,  0,  1,  8,  4,  5,  9, -1 },
+      {  7, 10,  6,  3, 10,  7, 10,  4,  5,  3,  4, 10,  0,  4,  3, -1 },
+      {  7, 10,  6,  8, 10,  7,  8,  5, 10,  4,  5,  8, -1, -1, -1, -1 },
+      { 11,  9,  8,  6,  9, 11,  5,  9,  6, -1, -1, -1, -1, -1, -1, -1 },
+      {  6,  3, 11,  5,  3,  6,  9,  3,  5,  0,  3,  9, -1, -1, -1, -1 },
+      {  6,  8, 11,  5,  8,  6,  1,  8,  5,  0,  8,  1, -1, -1, -1, -1 },
+      {  6,  3, 11,  5,  3,  6,  1,  3,  5, -1, -1, -1, -1, -1, -1, -1 },
+      {  1, 10,  2, 11,  9,  8,  6,  9, 11,  5,  9,  6, -1, -1, -1, -1 },
+      {  6,  3, 11,  5,  3,  6,  9,  3,  5,  0,  3,  9,  1, 10,  2, -1 },
+      {  6,  8, 11,  5,  8,  6, 10,  8,  5,  2,  8, 10,  0,  8,  2, -1 },
+      {  6,  3, 11,  5,  3,  6, 10,  3,  5,  2,  3, 10, -1, -1, -1, -1 },
+      {  9,  6,  5,  8,  6,  9,  3,  6,  8,  2,  6,  3, -1, -1, -1, -1 },
+      {  5,  2,  6,  9,  2,  5,  0,  2,  9, -1, -1, -1, -1, -1, -1, -1 },
+      {  2,  8,  3,  6,  8,  2,  5,  8,  6,  1,  8,  5,  0,  8,  1, -1 },
+      {  5,  2,  6,  1,  2,  5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+      {  9,  6,  5,  8,  6,  9,  8, 10,  6,  3, 10,  8,  1, 10,  3, -1 },
+      {  9,  6,  5,  0,  6,  9,  6,  1, 10,  0,  1,  6, -1, -1, -1, -1 },
+      {  0,  8,  3,  5, 10,  6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+      {  5, 10,  6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+      { 10,  7, 11,  5,  7, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+      {  0,  3,  8, 10,  7, 11,  5,  7, 10, -1, -1, -1, -1, -1, -1, -1 },
+      {  0,  9,  1, 10,  7, 11,  5,  7, 10, -1, -1, -1, -1, -1, -1, -1 },
+      {  9,  3,  8,  1,  3,  9, 10,  7, 11,  5,  7, 10, -1, -1, -1, -1 },
+      { 11,  5,  7,  2,  5, 11,  1,  5,  2, -1, -1, -1, -1, -1, -1, -1 },
+      {  0,  3,  8, 11,  5,  7,  2,  5, 11,  1,  5,  2, -1, -1, -1, -1 },
+      {  7,  9,  5, 11,  9,  7,  2,  9, 11,  0,  9,  2, -1, -1, -1, -1 },
+      { 11,  5,  7,  2,  5, 11,  9,  3,  8,  5,  3,  9,  2,  3,  5, -1 },
+      {  7, 10,  5,  3, 10,  7,  2, 10,  3, -1, -1, -1, -1, -1, -1, -1 },
+      {  5,  2, 10,  7,  2,  5,  8,  2,  7,  0,  2,  8, -1, -1, -1, -1 },
+      {  0,  9,  1,  7, 10,  5,  3, 10,  7,  2, 10,  3, -1, -1, -1, -1 },
+      {  5,  2, 10,  7,  2,  5,  8,  2,  7,  9,  2,  8,  1,  2,  9, -1 },
+      {  3,  5,  7,  1,  5,  3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+      {  7,  1,  5,  8,  1,  7,  0,  1,  8, -1, -1, -1, -1, -1, -1, -1 },
+      {  7,  9,  5,  3,  9,  7,  0,  9,  3, -1, -1, -1, -1, -1, -1, -1 },
+      {  9,  7,  8,  5,  7,  9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+      { 10,  8, 11,  5,  8, 10,  4,  8,  5, -1, -1, -1, -1, -1, -1, -1 },
+      { 10,  3, 11,  5,  3, 10,  4,  3,  5,  0,  3,  4, -1, -1, -1, -1 },
+      {  0,  9,  1, 10,  8, 11,  5,  8, 10,  4,  8,  5, -1, -1, -1, -1 },
+      { 10,  3, 11,  5,  3, 10,  4,  3,  5,  9,  3,  4,  1,  3,  9, -1 },
+      {  8,  5,  4, 11,  5,  8,  2,  5, 11,  1,  5,  2, -1, -1, -1, -1 },
+      {  1, 11,  2,  5, 11,  1,  5,  3, 11,  4,  3,  5,  0,  3,  4, -1 },
+      {  8,  5,  4, 11,  5,  8, 11,  9,  5,  2,  9, 11,  0,  9,  2, -1 },
+      {  2,  3, 11,  4,  9,  5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+      {  4, 10,  5,  8, 10,  4,  3, 10,  8,  2, 10,  3, -1, -1, -1, -1 },
+      {  5,  2, 10,  4,  2,  5,  0,  2,  4, -1, -1, -1, -1, -1, -1, -1 },
+      {  0,  9,  1,  4, 10,  5,  8, 10,  4,  3, 10,  8,  2, 10,  3, -1 },
+      {  5,  2, 10,  4,  2,  5,  9,  2,  4,  1,  2,  9, -1, -1, -1, -1 },
+      {  8,  5,  4,  3,  5,  8,  1,  5,  3, -1, -1, -1, -1, -1, -1, -1 },
+      {  4,  1,  5,  0,  1,  4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+      {  8,  5,  4,  3,  5,  8,  3,  9,  5,  0,  9,  3, -1, -1, -1, -1 },
+      {  4,  9,  5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+      { 10,  7, 11,  9,  7, 10,  4,  7,  9, -1, -1, -1, -1, -1, -1, -1 },
+      {  0,  3,  8, 10,  7, 11,  9,  7, 10,  4,  7,  9, -1, -1, -1, -1 },
+      { 11,  4,  7, 10,  4, 11,  1,  4, 10,  0,  4,  1, -1, -1, -1, -1 },
+      { 11,  4,  7, 10,  4, 11,  4,  3,  8, 10,  3,  4,  1,  3, 10, -1 },
+      {  7,  9,  4, 11,  9,  7,  2,  9, 11,  1,  9,  2, -1, -1, -1, -1 },
+      {  0,  3,  8,  7,  9,  4, 11,  9,  7,  2,  9, 11,  1,  9,  2, -1 },
+      { 11,  4,  7,  2,  4, 11,  0,  4,  2, -1, -1, -1, -1, -1, -1, -1 },
+      { 11,  4,  7,  2,  4, 11,  4,  3,  8,  2,  3,  4, -1, -1, -1, -1 },
+      {  4, 10,  9,  7, 10,  4,  3, 10,  7,  2, 10,  3, -1, -1, -1, -1 },
+      {  9,  2, 10,  4,  2,  9,  7,  2,  4,  8,  2,  7,  0,  2,  8, -1 },
+      {  3,  4,  7,  2,  4,  3, 10,  4,  2,  1,  4, 10,  0,  4,  1, -1 },
+      {  1,  2, 10,  4,  7,  8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+      {  7,  9,  4,  3,  9,  7,  1,  9,  3, -1, -1, -1, -1, -1, -1, -1 },
+      {  4,  1,  9,  7,  1,  4,  8,  1,  7,  0,  1,  8, -1, -1, -1, -1 },
+      {  3,  4,  7,  0,  4,  3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+      {  4,  7,  8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+      {  9, 11, 10,  8, 11,  9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+      { 10,  3, 11,  9,  3, 10,  0,  3,  9, -1, -1, -1, -1, -1, -1, -1 },
+      { 10,  8, 11,  1,  8, 10,  0,  8,  1, -1, -1, -1, -1, -1, -1, -1 },
+      { 10,  3, 11,  1,  3, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+      { 11,  9,  8,  2,  9, 11,  1,  9,  2, -1, -1, -1, -1, -1, -1, -1 },
+      {  1, 11,  2,  9, 11,  1,  9,  3, 11,  0,  3,  9, -1, -1, -1, -1 },
+      {  2,  8, 11,  0,  8,  2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+      {  2,  3, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+      {  8, 10,  9,  3, 10,  8,  2, 10,  3, -1, -1, -1, -1, -1, -1, -1 },
+      {  9,  2, 10,  0,  2,  9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+      {  2,  8,  3, 10,  8,  2,  1,  8, 10,  0,  8,  1, -1, -1, -1, -1 },
+      {  1,  2, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+      {  3,  9,  8,  1,  9,  3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+      {  0,  1,  9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+      {  0,  8,  3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+      { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 }
+    };
+
+  // Part of the surface in the cells z0 <= z < z1
+  struct SurfaceSlab
+    {
+    int Z0;
+    // Vertices by key of their edge in the grid
+    std::unordered_map<int64, int> Ids;
+    std::vector<int64> Keys;
+    std::vector<cv::Vec3f> Vertices;
+    std::vector<cv::Vec3i> Triangles;
+    // Rank among the new vertices, or -1 - vertex of the previous slab on the shared plane
+    std::vector<int> Ranks;
+    int NbNew;
+    };
+}
+
+SurfaceExtractor::SurfaceExtractor() :
+  Lower( 1 ),
+  Upper( 1 ),
+  SmoothingVariance( 1.0 ),
+  Scale( 0.001f ),
+  NbSlabs( 32 ),
+  ClusterSize( 1.5f )
+{
+}
+
+bool SurfaceExtractor::Extract( QString const& filename, TriangleMesh * mesh ) const
+{
+  typedef itk::ImageFileReader< VolumeType > ReaderType;
+  typedef itk::BinaryThresholdImageFilter< VolumeType, VolumeType > ThresholdType;
+  typedef itk::DiscreteGaussianImageFilter< VolumeType, VolumeType > GaussianType;
+
+  mesh->Vertices.clear();
+  mesh->Normals.clear();
+  mesh->Triangles.clear();
+
+  ReaderType::Pointer reader = ReaderType::New();
+  reader->SetFileName( filename.toLocal8Bit().constData() );
+  ThresholdType::Pointer threshold = ThresholdType::New();
+  threshold->SetInput( reader->GetOutput() );
+  threshold->SetLowerThreshold( this->Lower );
+  threshold->SetUpperThreshold( this->Upper );
+  threshold->SetInsideValue( 1.f );
+  threshold->SetOutsideValue( 0.f );
+  GaussianType::Pointer gaussian = GaussianType::New();
+  VolumeType::Pointer mask;
+  try
+    {
+    if( this->SmoothingVariance > 0 )
+      {
+      gaussian->SetInput( threshold->GetOutput() );
+      gaussian->SetVariance( this->SmoothingVariance );
+      gaussian->Update();
+      mask = gaussian->GetOutput();
+      }
+    else
+      {
+      threshold->Update();
+      mask = threshold->GetOutput();
+      }
+    }
+  catch( itk::ExceptionObject & error )
+    {
+    LOG_ERROR( Io, "Impossible to read " << qPrintable( filename ) << " : " << error.GetDescription() );
+    return false;
+    }
+
+  VolumeType::SizeType size = mask->GetBufferedRegion().GetSize();
+  VolumeType::SpacingType spacing = mask->GetSpacing();
+  VolumeType::PointType origin = mask->GetOrigin();
+  VolumeType::DirectionType direction = mask->GetDirection();
+  cv::Vec3i dimensions;
+  cv::Vec3d volume_spacing, volume_origin;
+  cv::Matx33d volume_direction;
+  for( int a = 0; a < 3; a++ )
+    {
+    dimensions[ a ] = static_cast<int>( size[ a ] );
+    volume_spacing[ a ] = spacing[ a ];
+    volume_origin[ a ] = origin[ a ];
+    for( int b = 0; b < 3; b++ )
+      {
+      volume_direction( a, b ) = direction[ a ][ b ];
+      }
+    }
+  return this->ExtractIsoSurface( dimensions, volume_spacing, volume_origin, volume_direction, mask->GetBufferPointer(), 0.5f, mesh );
+}
+
+bool SurfaceExtractor::Convert( QString const& filename ) const
+{
+  QFileInfo info( filename );
+  TriangleMesh mesh;
+  if( !info.exists() || !this->Extract( filename, &mesh ) )
+    {
+    return false;
+    }
+  QString cache = MeshLoader::GetCacheFilename( filename );
+  if( !MeshLoader::SaveCache( cache, mesh, info.size(), info.lastModified().toMSecsSinceEpoch() ) )
+    {
+    LOG_ERROR( Io, "Impossible to write " << qPrintable( cache ) );
+    return false;
+    }
+  return true;
+}
+
+bool SurfaceExtractor::ExtractIsoSurface( cv::Vec3i const& dimensions, cv::Vec3d const& spacing, cv::Vec3d const& origin, cv::Matx33d const& direction,
+  float const* values, float iso, TriangleMesh * mesh ) const
+{
+  mesh->Vertices.clear();
+  mesh->Normals.clear();
+  mesh->Triangles.clear();
+  if( values == NULL || dimensions[ 0 ] <= 0 || dimensions[ 1 ] <= 0 || dimensions[ 2 ] <= 0 )
+    {
+    LOG_ERROR( Analysis, "The volume is empty" );
+    return false;
+    }
+
+  // The grid is padded with one point of background on each side : lattice point ( i, j, k )
+  // is the voxel ( i - 1, j - 1, k - 1 )
+  const int nx = dimensions[ 0 ], ny = dimensions[ 1 ], nz = dimensions[ 2 ];
+  const int64 px = nx + 2, py = ny + 2;
+  const float background = iso - 1.f;
+  auto sample = [ & ]( int i, int j, int k ) -> float
+    {
+    if( i < 1 || j < 1 || k < 1 || i > nx || j > ny || k > nz )
+      {
+      return background;
+      }
+    return values[ ( static_cast<int64>( k - 1 )*ny + ( j - 1 ) )*nx + ( i - 1 ) ];
+    };
+  cv::Matx33d to_physical = direction * cv::Matx33d::diag( spacing ) * this->Scale;
+  cv::Vec3d physical_origin = origin * this->Scale - to_physical * cv::Vec3d( 1, 1, 1 );
+
+  int nb_cells_z = nz + 1;
+  int nb_slabs = std::max( 1, std::min( this->NbSlabs, nb_cells_z ) );
+  std::vector<SurfaceSlab> slabs( nb_slabs );
+  cv::parallel_for_( cv::Range( 0, nb_slabs ), [ & ]( const cv::Range & range )
+    {
+    for( int s = range.start; s < range.end; s++ )
+      {
+      SurfaceSlab & slab = slabs[ s ];
+      slab.Z0 = s * nb_cells_z / nb_slabs;
+      int z1 = ( s + 1 ) * nb_cells_z / nb_slabs;
+      float corner_values[ 8 ];
+      int edge_vertices[ 12 ];
+      for( int z = slab.Z0; z < z1; z++ )
+        {
+        for( int y = 0; y <= ny; y++ )
+          {
+          for( int x = 0; x <= nx; x++ )
+            {
+            int cell_case = 0;
+            for( int c = 0; c < 8; c++ )
+              {
+              corner_values[ c ] = sample( x + CellCorners[ c ][ 0 ], y + CellCorners[ c ][ 1 ], z + CellCorners[ c ][ 2 ] );
+              cell_case |= ( corner_values[ c ] >= iso ? 1 << c : 0 );
+              }
+            if( cell_case == 0 || cell_case == 255 )
+              {
+              continue;
+              }
+
+            std::fill( edge_vertices, edge_vertices + 12, -1 );
+            for( const int * edges = CaseTriangles[ cell_case ]; *edges >= 0; edges += 3 )
+              {
+              cv::Vec3i triangle;
+              for( int k = 0; k < 3; k++ )
+                {
+                int e = edges[ k ];
+                if( edge_vertices[ e ] < 0 )
+                  {
+                  // Edges are keyed by their first lattice point and their axis
+                  const int * a = CellCorners[ CellEdges[ e ][ 0 ] ];
+                  const int * b = CellCorners[ CellEdges[ e ][ 1 ] ];
+                  int axis = ( a[ 0 ] != b[ 0 ] ? 0 : ( a[ 1 ] != b[ 1 ] ? 1 : 2 ) );
+                  int64 key = ( ( ( z + std::min( a[ 2 ], b[ 2 ] ) )*py + y + std::min( a[ 1 ], b[ 1 ] ) )*px + x + std::min( a[ 0 ], b[ 0 ] ) ) * 3 + axis;
+                  auto inserted = slab.Ids.emplace( key, static_cast<int>( slab.Vertices.size() ) );
+                  if( inserted.second )
+                    {
+                    float va = corner_values[ CellEdges[ e ][ 0 ] ], vb = corner_values[ CellEdges[ e ][ 1 ] ];
+                    double t = ( iso - va ) / ( vb - va );
+                    cv::Vec3d lattice( x + a[ 0 ] + t * ( b[ 0 ] - a[ 0 ] ), y + a[ 1 ] + t * ( b[ 1 ] - a[ 1 ] ), z + a[ 2 ] + t * ( b[ 2 ] - a[ 2 ] ) );
+                    slab.Vertices.push_back( cv::Vec3f( physical_origin + to_physical * lattice ) );
+                    slab.Keys.push_back( key );
+                    }
+                  edge_vertices[ e ] = inserted.first->second;
+                  }
+                triangle[ k ] = edge_vertices[ e ];
+                }
+              slab.Triangles.push_back( triangle );
+              }
+            }
+          }
+        }
+      }
+    } );
+
+  // Stitching : the vertices on the bottom plane of a slab, on the x and y edges, were also
+  // created by the previous slab
+  cv::parallel_for_( cv::Range( 0, nb_slabs ), [ & ]( const cv::Range & range )
+    {
+    for( int s = range.start; s < range.end; s++ )
+      {
+      SurfaceSlab & slab = slabs[ s ];
+      slab.Ranks.resize( slab.Vertices.size() );
+      slab.NbNew = 0;
+      for( size_t v = 0; v < slab.Vertices.size(); v++ )
+        {
+        int64 key = slab.Keys[ v ];
+        int previous = -1;
+        if( s > 0 && key % 3 != 2 && key / 3 / ( px * py ) == slab.Z0 )
+          {
+          auto iter = slabs[ s - 1 ].Ids.find( key );
+          previous = ( iter != slabs[ s - 1 ].Ids.end() ? iter->second : -1 );
+          }
+        slab.Ranks[ v ] = ( previous >= 0 ? -1 - previous : slab.NbNew++ );
+        }
+      }
+    } );
+
+  std::vector<int> vertex_offsets( nb_slabs + 1, 0 ), triangle_offsets( nb_slabs + 1, 0 );
+  for( int s = 0; s < nb_slabs; s++ )
+    {
+    vertex_offsets[ s + 1 ] = vertex_offsets[ s ] + slabs[ s ].NbNew;
+    triangle_offsets[ s + 1 ] = triangle_offsets[ s ] + static_cast<int>( slabs[ s ].Triangles.size() );
+    }
+  mesh->Vertices.resize( vertex_offsets[ nb_slabs ] );
+  mesh->Triangles.resize( triangle_offsets[ nb_slabs ] );
+  cv::parallel_for_( cv::Range( 0, nb_slabs ), [ & ]( const cv::Range & range )
+    {
+    std::vector<int> ids;
+    for( int s = range.start; s < range.end; s++ )
+      {
+      SurfaceSlab const& slab = slabs[ s ];
+      ids.resize( slab.Vertices.size() );
+      for( size_t v = 0; v < slab.Vertices.size(); v++ )
+        {
+        int rank = slab.Ranks[ v ];
+        if( rank >= 0 )
+          {
+          ids[ v ] = vertex_offsets[ s ] + rank;
+          mesh->Vertices[ ids[ v ] ] = slab.Vertices[ v ];
+          }
+        else
+          {
+          // Top plane of the previous slab, always new there
+          ids[ v ] = vertex_offsets[ s - 1 ] + slabs[ s - 1 ].Ranks[ -1 - rank ];
+          }
+        }
+      for( size_t t = 0; t < slab.Triangles.size(); t++ )
+        {
+        cv::Vec3i const& triangle = slab.Triangles[ t ];
+        mesh->Triangles[ triangle_offsets[ s ] + t ] = cv::Vec3i( ids[ triangle[ 0 ] ], ids[ triangle[ 1 ] ], ids[ triangle[ 2 ] ] );
+        }
+      }
+    } );
+  slabs.clear();
+
+  if( mesh->Triangles.empty() )
+    {
+    LOG_WARNING( Analysis, "No surface at the iso value " << iso );
+    return false;
+    }
+  LOG_INFO( Analysis, "Surface extracted : " << mesh->Vertices.size() << " vertices, " << mesh->Triangles.size() << " triangles" );
+
+  if( this->ClusterSize > 0 )
+    {
+    double smallest = std::min( { spacing[ 0 ], spacing[ 1 ], spacing[ 2 ] } );
+    this->Decimate( static_cast<float>( this->ClusterSize * smallest * this->Scale ), mesh );
+    LOG_INFO( Analysis, "Surface decimated : " << mesh->Vertices.size() << " vertices, " << mesh->Triangles.size() << " triangles" );
+    }
+  MeshLoader::ComputeNormals( mesh );
+  return true;
+}
+
+void SurfaceExtractor::Decimate( float cell, TriangleMesh * mesh ) const
+{
+  // Vertex clustering : the vertices of a cell are replaced by their mean
+  int n = static_cast<int>( mesh->Vertices.size() );
+  std::vector<cv::Vec3i> keys( n );
+  cv::parallel_for_( cv::Range( 0, n ), [ & ]( const cv::Range & range )
+    {
+    for( int i = range.start; i < range.end; i++ )
+      {
+      for( int a = 0; a < 3; a++ )
+        {
+        keys[ i ][ a ] = static_cast<int>( std::floor( mesh->Vertices[ i ][ a ] / cell ) );
+        }
+      }
+    } );
+
+  std::unordered_map<cv::Vec3i, int, Vec3iHash> ids;
+  ids.reserve( n );
+  std::vector<int> remap( n );
+  std::vector<cv::Vec3d> sums;
+  std::vector<int> counts;
+  for( int i = 0; i < n; i++ )
+    {
+    auto inserted = ids.emplace( keys[ i ], static_cast<int>( sums.size() ) );
+    if( inserted.second )
+      {
+      sums.push_back( cv::Vec3d( 0, 0, 0 ) );
+      counts.push_back( 0 );
+      }
+    remap[ i ] = inserted.first->second;
+    sums[ remap[ i ] ] += cv::Vec3d( mesh->Vertices[ i ] );
+    counts[ remap[ i ] ]++;
+    }
+
+  // Collapsed and duplicate triangles are removed, then the clusters left without triangle
+  std::unordered_set<cv::Vec3i, Vec3iHash> kept_triangles;
+  kept_triangles.reserve( mesh->Triangles.size() );
+  std::vector<char> used( sums.size(), 0 );
+  size_t kept = 0;
+  for( size_t t = 0; t < mesh->Triangles.size(); t++ )
+    {
+    cv::Vec3i tri( remap[ mesh->Triangles[ t ][ 0 ] ], remap[ mesh->Triangles[ t ][ 1 ] ], remap[ mesh->Triangles[ t ][ 2 ] ] );
+    if( tri[ 0 ] == tri[ 1 ] || tri[ 1 ] == tri[ 2 ] || tri[ 0 ] == tri[ 2 ] )
+      {
+      continue;
+      }
+    // Same rotation for the duplicates
+    int first = static_cast<int>( std::min_element( tri.val, tri.val + 3 ) - tri.val );
+    cv::Vec3i canonical( tri[ first ], tri[ ( first + 1 ) % 3 ], tri[ ( first + 2 ) % 3 ] );
+    if( kept_triangles.insert( canonical ).second )
+      {
+      mesh->Triangles[ kept++ ] = tri;
+      used[ tri[ 0 ] ] = used[ tri[ 1 ] ] = used[ tri[ 2 ] ] = 1;
+      }
+    }
+  mesh->Triangles.resize( kept );
+
+  std::vector<int> compact( sums.size(), -1 );
+  std::vector<cv::Vec3f> vertices;
+  for( size_t c = 0; c < sums.size(); c++ )
+    {
+    if( used[ c ] )
+      {
+      compact[ c ] = static_cast<int>( vertices.size() );
+      vertices.push_back( cv::Vec3f( sums[ c ] / counts[ c ] ) );
+      }
+    }
+  cv::parallel_for_( cv::Range( 0, static_cast<int>( kept ) ), [ & ]( const cv::Range & range )
+    {
+    for( int t = range.start; t < range.end; t++ )
+      {
+      for( int k = 0; k < 3; k++ )
+        {
+        mesh->Triangles[ t ][ k ] = compact[ mesh->Triangles[ t ][ k ] ];
+        }
+      }
+    } );
+  mesh->Vertices.swap( vertices );
+  mesh->Normals.clear();
+}
@@ -24,114 +24,896 @@ limitations under the License.
 =========================================================================*/
 
 #include "io_util.hpp"
+#include "Logger.hpp"
 
-#include <iostream>
+#include <QByteArray>
+
+#include <algorithm>
+#include <cfloat>
+#include <climits>
+#include <cmath>
+#include <cstdint>
 #include <fstream>
+#include <iomanip>
+#include <limits>
+#include <sstream>
 
-bool io_util::write_ply(const std::string & filename, cv::Mat const& pointcloud_points, cv::Mat const& pointcloud_colors)
+bool io_util::write_ply( const std::string & filename, cv::Mat const& pointcloud_points, cv::Mat const& pointcloud_colors,
+  cv::Mat const& pointcloud_normals, unsigned int flags )
 {
-  if (!pointcloud_points.data
-    || ( pointcloud_colors.data && pointcloud_colors.rows != pointcloud_points.rows && pointcloud_colors.cols != pointcloud_points.cols ))
-  {
+  if( !pointcloud_points.data || pointcloud_points.type() != CV_32FC3
+    || ( pointcloud_colors.data && ( pointcloud_colors.size() != pointcloud_points.size() || pointcloud_colors.type() != CV_8UC3 ) )
+    || ( pointcloud_normals.data && ( pointcloud_normals.size() != pointcloud_points.size() || pointcloud_normals.type() != CV_32FC3 ) ) )
+    {
+    LOG_ERROR( Io, "[write_ply] Invalid pointcloud" );
     return false;
-  }
+    }
 
-  bool binary = false;
-  bool colors = false;
-  if( pointcloud_colors.data )
+  bool binary = ( flags & PlyBinary ) != 0;
+  bool colors = ( flags & PlyColors ) && pointcloud_colors.data;
+  bool normals = ( flags & PlyNormals ) && pointcloud_normals.data;
+
+  // Only the points in front of the camera are kept : they are compacted in one pass into a
+  // buffer written at once. Binary records are x y z [nx ny nz] [red green blue alpha] : the
+  // opaque alpha pads the colors to a whole float, so that read_ply can see the floats in place.
+  // It costs one byte per point, 16 bytes instead of 15 for x y z and the colors, and the
+  // other readers get an alpha channel always at 255 ; without it every load of a colored
+  // cloud would copy all the points.
+  size_t record_size = 3 * sizeof( float ) + ( normals ? 3 * sizeof( float ) : 0 ) + ( colors ? 4 : 0 );
+  std::vector<char> buffer;
+  std::ostringstream text;
+  // Enough digits for the ascii floats to be read back exactly
+  text << std::setprecision( std::numeric_limits<float>::max_digits10 );
+  if( binary )
     {
-    colors = true;
+    buffer.resize( pointcloud_points.total() * record_size );
+    }
+  char * record = buffer.data();
+  size_t nb_points = 0;
+  for( int row = 0; row < pointcloud_points.rows; row++ )
+    {
+    const cv::Vec3f * points_row = pointcloud_points.ptr<cv::Vec3f>( row );
+    const cv::Vec3b * colors_row = ( colors ? pointcloud_colors.ptr<cv::Vec3b>( row ) : NULL );
+    const cv::Vec3f * normals_row = ( normals ? pointcloud_normals.ptr<cv::Vec3f>( row ) : NULL );
+    for( int col = 0; col < pointcloud_points.cols; col++ )
+      {
+      cv::Vec3f const& p = points_row[ col ];
+      if( p[ 2 ] <= 0 )
+        {
+        continue;
+        }
+      nb_points++;
+      if( binary )
+        {
+        // The records are written in the byte order of the machine, little endian on x86
+        memcpy( record, p.val, 3 * sizeof( float ) );
+        record += 3 * sizeof( float );
+        if( normals )
+          {
+          memcpy( record, normals_row[ col ].val, 3 * sizeof( float ) );
+          record += 3 * sizeof( float );
+          }
+        if( colors )
+          {
+          cv::Vec3b const& c = colors_row[ col ];
+          *record++ = static_cast<char>( c[ 2 ] );
+          *record++ = static_cast<char>( c[ 1 ] );
+          *record++ = static_cast<char>( c[ 0 ] );
+          *record++ = static_cast<char>( 255 );
+          }
+        }
+      else
+        {
+        text << p[ 0 ] << ' ' << p[ 1 ] << ' ' << p[ 2 ];
+        if( normals )
+          {
+          cv::Vec3f const& n = normals_row[ col ];
+          text << ' ' << n[ 0 ] << ' ' << n[ 1 ] << ' ' << n[ 2 ];
+          }
+        if( colors )
+          {
+          cv::Vec3b const& c = colors_row[ col ];
+          text << ' ' << static_cast<int>( c[ 2 ] ) << ' ' << static_cast<int>( c[ 1 ] ) << ' ' << static_cast<int>( c[ 0 ] );
+          }
+        text << '\n';
+        }
+      }
     }
 
-  std::vector<int> points_index;
-  points_index.reserve( pointcloud_points.total());
-  std::cout << "nb_points total : " << pointcloud_points.total() << std::endl;
+  std::ostringstream header;
+  header << "ply\n"
+    << "format " << ( binary ? "binary_little_endian 1.0" : "ascii 1.0" ) << '\n'
+    << "comment scan3d-capture generated\n"
+    << "element vertex " << nb_points << '\n'
+    << "property float x\nproperty float y\nproperty float z\n";
+  if( normals )
+    {
+    header << "property float nx\nproperty float ny\nproperty float nz\n";
+    }
+  if( colors )
+    {
+    header << "property uchar red\nproperty uchar green\nproperty uchar blue\n";
+    if( binary )
+      {
+      header << "property uchar alpha\n";
+      }
+    }
+  if( flags & PlyFaces )
+    {
+    header << "element face 0\nproperty list uchar int vertex_indices\n";
+    }
+  header << "end_header\n";
+  std::string header_text = header.str();
+  if( binary )
+    {
+    // The comment is padded with spaces so that the vertices start on a whole float
+    // from the beginning of the file, which is mapped on a page boundary by read_ply
+    size_t padding = ( sizeof( float ) - header_text.size() % sizeof( float ) ) % sizeof( float );
+    header_text.insert( header_text.find( " generated\n" ) + 10, padding, ' ' );
+    }
 
-  const cv::Vec3f * points_data = pointcloud_points.ptr<cv::Vec3f>(0);
-  const cv::Vec3b * colors_data = ( colors ? pointcloud_colors.ptr<cv::Vec3b>( 0 ) : NULL );
+  std::ofstream outfile( filename.c_str(), std::ios::out | std::ios::trunc | std::ios::binary );
+  if( !outfile.is_open() )
+    {
+    LOG_ERROR( Io, "[write_ply] Impossible to open " << filename );
+    return false;
+    }
+  outfile.write( header_text.data(), header_text.size() );
+  if( binary )
+    {
+    outfile.write( buffer.data(), nb_points * record_size );
+    }
+  else
+    {
+    std::string points_text = text.str();
+    outfile.write( points_text.data(), points_text.size() );
+    }
+  outfile.close();
+  if( !outfile )
+    {
+    LOG_ERROR( Io, "[write_ply] Impossible to write " << filename );
+    return false;
+    }
+  LOG_DEBUG( Io, "[write_ply] Saved " << nb_points << " points (" << filename << ")" );
+  return true;
+}
+
+int io_util::ply_type_size( PlyType type )
+{
+  switch( type )
+    {
+    case PlyInt8: case PlyUInt8: return 1;
+    case PlyInt16: case PlyUInt16: return 2;
+    case PlyInt32: case PlyUInt32: case PlyFloat32: return 4;
+    case PlyFloat64: return 8;
+    default: return 0;
+    }
+}
 
-  int total = static_cast<int>( pointcloud_points.total());
-  for (int i = 0; i<total; i++)
-  {
-    //if (!sl::INVALID(points_data[i]) && (!normals_data || !sl::INVALID(normals_data[i])))
+size_t io_util::ply_element_stride( PlyElement const& element )
+{
+  size_t stride = 0;
+  for( auto iter = element.Properties.cbegin(); iter != element.Properties.cend(); ++iter )
     {
-      points_index.push_back(i);
+    if( iter->CountType != PlyInvalid )
+      {
+      return 0;
+      }
+    stride += ply_type_size( iter->Type );
+    }
+  return stride;
+}
+
+static io_util::PlyType ply_type( std::string const& name )
+{
+  if( name == "char" || name == "int8" ) return io_util::PlyInt8;
+  if( name == "uchar" || name == "uint8" ) return io_util::PlyUInt8;
+  if( name == "short" || name == "int16" ) return io_util::PlyInt16;
+  if( name == "ushort" || name == "uint16" ) return io_util::PlyUInt16;
+  if( name == "int" || name == "int32" ) return io_util::PlyInt32;
+  if( name == "uint" || name == "uint32" ) return io_util::PlyUInt32;
+  if( name == "float" || name == "float32" ) return io_util::PlyFloat32;
+  if( name == "double" || name == "float64" ) return io_util::PlyFloat64;
+  return io_util::PlyInvalid;
+}
+
+bool io_util::read_ply_header( const char * data, size_t size, std::vector<PlyElement> & elements, bool * binary, size_t * header_size )
+{
+  elements.clear();
+  const char end_header[] = "end_header";
+  if( size < 4 || strncmp( data, "ply", 3 ) != 0 )
+    {
+    return false;
+    }
+
+  // The header is text up to the end_header line
+  size_t pos = 0;
+  bool format = false;
+  while( pos < size )
+    {
+    size_t end = pos;
+    while( end < size && data[ end ] != '\n' )
+      {
+      end++;
+      }
+    std::string line( data + pos, end - pos );
+    if( !line.empty() && line.back() == '\r' )
+      {
+      line.pop_back();
+      }
+    pos = end + 1;
+
+    std::istringstream stream( line );
+    std::string keyword;
+    stream >> keyword;
+    if( keyword == "format" )
+      {
+      std::string type;
+      stream >> type;
+      if( type != "ascii" && type != "binary_little_endian" )
+        {
+        LOG_ERROR( Io, "[read_ply_header] Unsupported format " << type );
+        return false;
+        }
+      *binary = ( type == "binary_little_endian" );
+      format = true;
+      }
+    else if( keyword == "element" )
+      {
+      PlyElement element;
+      stream >> element.Name >> element.Count;
+      elements.push_back( element );
+      }
+    else if( keyword == "property" )
+      {
+      if( elements.empty() )
+        {
+        return false;
+        }
+      PlyProperty property;
+      std::string type;
+      stream >> type;
+      property.CountType = PlyInvalid;
+      if( type == "list" )
+        {
+        std::string count_type, item_type;
+        stream >> count_type >> item_type;
+        property.CountType = ply_type( count_type );
+        property.Type = ply_type( item_type );
+        if( property.CountType == PlyInvalid )
+          {
+          return false;
+          }
+        }
+      else
+        {
+        property.Type = ply_type( type );
+        }
+      stream >> property.Name;
+      if( property.Type == PlyInvalid )
+        {
+        return false;
+        }
+      elements.back().Properties.push_back( property );
+      }
+    else if( line.compare( 0, sizeof( end_header ) - 1, end_header ) == 0 )
+      {
+      *header_size = pos;
+      return format;
+      }
     }
-  }
+  return false;
+}
 
-  std::ofstream outfile;
-  std::ios::openmode mode = std::ios::out | std::ios::trunc | (binary ? std::ios::binary : static_cast<std::ios::openmode>(0));
-  outfile.open(filename.c_str(), mode);
-  if (!outfile.is_open())
-  {
+// Number in ascii at text, the C locale is used whatever the locale of the application.
+// Returns false if there is no number before end.
+static bool read_ascii_value( const char * & text, const char * end, double * value )
+{
+  while( text < end && ( *text == ' ' || *text == '\t' || *text == '\r' ) )
+    {
+    text++;
+    }
+  const char * start = text;
+  double sign = 1;
+  if( text < end && ( *text == '-' || *text == '+' ) )
+    {
+    sign = ( *text == '-' ? -1 : 1 );
+    text++;
+    }
+  double mantissa = 0;
+  int exponent = 0;
+  bool digits = false;
+  for( ; text < end && *text >= '0' && *text <= '9'; text++, digits = true )
+    {
+    mantissa = mantissa * 10 + ( *text - '0' );
+    }
+  if( text < end && *text == '.' )
+    {
+    for( text++; text < end && *text >= '0' && *text <= '9'; text++, digits = true )
+      {
+      mantissa = mantissa * 10 + ( *text - '0' );
+      exponent--;
+      }
+    }
+  if( !digits )
+    {
+    text = start;
     return false;
-  }
+    }
+  if( text < end && ( *text == 'e' || *text == 'E' ) )
+    {
+    const char * e = text + 1;
+    int e_sign = 1, e_value = 0;
+    if( e < end && ( *e == '-' || *e == '+' ) )
+      {
+      e_sign = ( *e == '-' ? -1 : 1 );
+      e++;
+      }
+    if( e < end && *e >= '0' && *e <= '9' )
+      {
+      for( ; e < end && *e >= '0' && *e <= '9'; e++ )
+        {
+        e_value = std::min( e_value * 10 + ( *e - '0' ), 9999 );
+        }
+      exponent += e_sign * e_value;
+      text = e;
+      }
+    }
+  *value = sign * mantissa * std::pow( 10.0, exponent );
+  return true;
+}
 
-  int j = 0;
-  for (std::vector<int>::const_iterator iter = points_index.begin(); iter != points_index.end(); iter++)
-  {
-    cv::Vec3f const& p = points_data[*iter];
-    if (p[2] > 0)
+bool io_util::read_ply( const std::string & filename, PlyCloud * cloud )
+{
+  cloud->Points.release();
+  cloud->Colors.release();
+  cloud->Normals.release();
+  cloud->Mapping.reset();
+
+  std::shared_ptr<QFile> file = std::make_shared<QFile>( QString::fromStdString( filename ) );
+  qint64 size = file->size();
+  uchar * data = NULL;
+  if( !file->open( QIODevice::ReadOnly ) || size <= 0 || ( data = file->map( 0, size, QFileDevice::MapPrivateOption ) ) == NULL )
     {
-      j++;
+    LOG_ERROR( Io, "[read_ply] Impossible to read " << filename );
+    return false;
     }
-  }
-  const char * format_header = (binary ? "binary_little_endian 1.0" : "ascii 1.0");
-  outfile << "ply" << std::endl
-          << "format " << format_header << std::endl
-          << "comment scan3d-capture generated" << std::endl
-          << "element vertex " << j << std::endl
-          << "property float x" << std::endl
-          << "property float y" << std::endl
-          << "property float z" << std::endl;
-  if( colors )
+  std::vector<PlyElement> elements;
+  bool binary = false;
+  size_t offset = 0;
+  if( !read_ply_header( reinterpret_cast<const char *>( data ), static_cast<size_t>( size ), elements, &binary, &offset ) )
     {
-    outfile << "property uchar red" << std::endl
-            << "property uchar green" << std::endl
-            << "property uchar blue" << std::endl
-            << "property uchar alpha" << std::endl;
+    LOG_ERROR( Io, "[read_ply] Invalid header in " << filename );
+    return false;
     }
 
-  outfile << "element face 0" << std::endl
-          << "property list uchar int vertex_indices" << std::endl
-          << "end_header" << std::endl;
+  // The vertices are after the other elements in binary, after their lines in ascii
+  const PlyElement * vertex = NULL;
+  size_t first_line = 0;
+  for( auto element = elements.cbegin(); element != elements.cend() && vertex == NULL; ++element )
+    {
+    if( element->Name == "vertex" )
+      {
+      vertex = &( *element );
+      }
+    else if( !binary )
+      {
+      first_line += element->Count;
+      }
+    else if( ply_element_stride( *element ) > 0 )
+      {
+      offset += element->Count * ply_element_stride( *element );
+      }
+    else
+      {
+      LOG_ERROR( Io, "[read_ply] Elements with lists before the vertices are not supported" );
+      return false;
+      }
+    }
 
-  for (std::vector<int>::const_iterator iter = points_index.begin(); iter != points_index.end(); iter++)
-  {
-    cv::Vec3f const& p = points_data[*iter];
-    // We only keep the points corresponding to the line we are reconstructing
-    if (p[2] > 0)
+  // Properties read : position in the vertex ( offset in binary, column in ascii ) and type
+  enum { X, Y, Z, NX, NY, NZ, Red, Green, Blue, NbFields };
+  const char * names[ NbFields ] = { "x", "y", "z", "nx", "ny", "nz", "red", "green", "blue" };
+  int columns[ NbFields ];
+  size_t offsets[ NbFields ];
+  PlyType types[ NbFields ];
+  std::fill( columns, columns + NbFields, -1 );
+  size_t property_offset = 0;
+  bool lists = false;
+  for( size_t p = 0; vertex != NULL && p < vertex->Properties.size(); p++ )
     {
-      if (binary)
+    PlyProperty const& property = vertex->Properties[ p ];
+    lists = lists || property.CountType != PlyInvalid;
+    for( int f = 0; f < NbFields; f++ )
       {
-        outfile.write(reinterpret_cast<const char *>(&(p[0])), sizeof(float));
-        outfile.write(reinterpret_cast<const char *>(&(p[1])), sizeof(float));
-        outfile.write(reinterpret_cast<const char *>(&(p[2])), sizeof(float));
+      if( property.CountType == PlyInvalid && property.Name == names[ f ] )
+        {
+        columns[ f ] = static_cast<int>( p );
+        offsets[ f ] = property_offset;
+        types[ f ] = property.Type;
+        }
+      }
+    property_offset += ply_type_size( property.Type );
+    }
+  if( vertex == NULL || columns[ X ] < 0 || columns[ Y ] < 0 || columns[ Z ] < 0 )
+    {
+    LOG_ERROR( Io, "[read_ply] No vertex position in " << filename );
+    return false;
+    }
+  if( lists )
+    {
+    LOG_ERROR( Io, "[read_ply] Vertices with lists are not supported" );
+    return false;
+    }
+  bool normals = ( columns[ NX ] >= 0 && columns[ NY ] >= 0 && columns[ NZ ] >= 0 );
+  bool colors = ( columns[ Red ] >= 0 && columns[ Green ] >= 0 && columns[ Blue ] >= 0 );
+  // Fields written in the matrices, in the order of their channels
+  const int point_fields[ 3 ] = { X, Y, Z }, normal_fields[ 3 ] = { NX, NY, NZ }, color_fields[ 3 ] = { Blue, Green, Red };
 
-        if( colors )
+  int n = static_cast<int>( vertex->Count );
+  if( binary )
+    {
+    size_t stride = ply_element_stride( *vertex );
+    if( stride == 0 || offset + vertex->Count * stride > static_cast<size_t>( size ) )
+      {
+      LOG_ERROR( Io, "[read_ply] Invalid vertices in " << filename );
+      return false;
+      }
+    uchar * begin = data + offset;
+
+    // Three consecutive floats are seen in place when they are aligned on a float, in the
+    // mapping and from one vertex to the next : the stride is a whole number of floats.
+    // The ply files written by write_ply are padded for it, other files are often not.
+    auto view = [ & ]( const int fields[ 3 ], cv::Mat & mat ) -> bool
+      {
+      bool consecutive = ( stride % sizeof( float ) == 0 )
+        && ( reinterpret_cast<uintptr_t>( begin + offsets[ fields[ 0 ] ] ) % sizeof( float ) == 0 );
+      for( int k = 0; k < 3; k++ )
+        {
+        consecutive = consecutive && types[ fields[ k ] ] == PlyFloat32 && offsets[ fields[ k ] ] == offsets[ fields[ 0 ] ] + k * sizeof( float );
+        }
+      if( consecutive && n > 0 )
+        {
+        mat = cv::Mat( n, 1, CV_32FC3, begin + offsets[ fields[ 0 ] ], stride );
+        }
+      return !mat.empty();
+      };
+    bool points_view = view( point_fields, cloud->Points );
+    bool normals_view = normals && view( normal_fields, cloud->Normals );
+    if( !points_view )
+      {
+      cloud->Points.create( n, 1, CV_32FC3 );
+      }
+    if( normals && !normals_view )
+      {
+      cloud->Normals.create( n, 1, CV_32FC3 );
+      }
+    if( colors )
+      {
+      cloud->Colors.create( n, 1, CV_8UC3 );
+      }
+    cv::parallel_for_( cv::Range( 0, n ), [ & ]( const cv::Range & range )
+      {
+      for( int i = range.start; i < range.end; i++ )
+        {
+        const uchar * item = begin + i * stride;
+        for( int k = 0; k < 3; k++ )
           {
-          cv::Vec3b const& c = colors_data[ *iter ];
-          const unsigned char a = 255U;
-          outfile.write( reinterpret_cast<const char *>( &( c[ 2 ] ) ), sizeof( unsigned char ) );
-          outfile.write( reinterpret_cast<const char *>( &( c[ 1 ] ) ), sizeof( unsigned char ) );
-          outfile.write( reinterpret_cast<const char *>( &( c[ 0 ] ) ), sizeof( unsigned char ) );
-          outfile.write( reinterpret_cast<const char *>( &a ), sizeof( unsigned char ) );
+          if( !points_view )
+            {
+            cloud->Points.at<cv::Vec3f>( i )[ k ] = static_cast<float>( read_ply_value( item + offsets[ point_fields[ k ] ], types[ point_fields[ k ] ] ) );
+            }
+          if( normals && !normals_view )
+            {
+            cloud->Normals.at<cv::Vec3f>( i )[ k ] = static_cast<float>( read_ply_value( item + offsets[ normal_fields[ k ] ], types[ normal_fields[ k ] ] ) );
+            }
+          if( colors )
+            {
+            cloud->Colors.at<cv::Vec3b>( i )[ k ] = cv::saturate_cast<uchar>( read_ply_value( item + offsets[ color_fields[ k ] ], types[ color_fields[ k ] ] ) );
+            }
           }
+        }
+      } );
+    if( points_view || normals_view )
+      {
+      cloud->Mapping = file;
       }
-      else
+    }
+  else
+    {
+    // Blocks starting at the beginning of a line are parsed in parallel, the index of their
+    // first line being known from the number of lines in the previous blocks
+    const char * text = reinterpret_cast<const char *>( data ) + offset;
+    size_t length = static_cast<size_t>( size ) - offset;
+    const int NbBlocks = 64;
+    std::vector<size_t> starts( NbBlocks + 1, length );
+    starts[ 0 ] = 0;
+    for( int b = 1; b < NbBlocks; b++ )
       {
-        outfile << p[0] << " " << p[1] << " " << p[2];
-        if( colors )
+      size_t start = std::max( length * b / NbBlocks, starts[ b - 1 ] );
+      while( start > 0 && start < length && text[ start - 1 ] != '\n' )
+        {
+        start++;
+        }
+      starts[ b ] = start;
+      }
+    std::vector<size_t> first_lines( NbBlocks + 1, 0 );
+    cv::parallel_for_( cv::Range( 0, NbBlocks ), [ & ]( const cv::Range & range )
+      {
+      for( int b = range.start; b < range.end; b++ )
+        {
+        first_lines[ b + 1 ] = std::count( text + starts[ b ], text + starts[ b + 1 ], '\n' );
+        }
+      } );
+    for( int b = 0; b < NbBlocks; b++ )
+      {
+      first_lines[ b + 1 ] += first_lines[ b ];
+      }
+    if( first_lines[ NbBlocks ] + ( length > 0 && text[ length - 1 ] != '\n' ? 1 : 0 ) < first_line + vertex->Count )
+      {
+      LOG_ERROR( Io, "[read_ply] Missing vertices in " << filename );
+      return false;
+      }
+
+    cloud->Points.create( n, 1, CV_32FC3 );
+    if( normals )
+      {
+      cloud->Normals.create( n, 1, CV_32FC3 );
+      }
+    if( colors )
+      {
+      cloud->Colors.create( n, 1, CV_8UC3 );
+      }
+    int last_column = *std::max_element( columns, columns + NbFields );
+    std::vector<char> valid( NbBlocks, 1 );
+    cv::parallel_for_( cv::Range( 0, NbBlocks ), [ & ]( const cv::Range & range )
+      {
+      std::vector<double> values( last_column + 1 );
+      for( int b = range.start; b < range.end; b++ )
+        {
+        size_t line = first_lines[ b ];
+        const char * end = text + starts[ b + 1 ];
+        for( const char * begin = text + starts[ b ]; begin < end && line < first_line + vertex->Count; line++ )
           {
-          cv::Vec3b const& c = colors_data[ *iter ];
-          outfile << " " << static_cast<int>( c[ 2 ] ) << " " << static_cast<int>( c[ 1 ] ) << " " << static_cast<int>( c[ 0 ] ) << " 255";
+          const char * line_end = std::find( begin, end, '\n' );
+          if( line >= first_line )
+            {
+            const char * value = begin;
+            for( int c = 0; c <= last_column; c++ )
+              {
+              valid[ b ] = valid[ b ] && read_ascii_value( value, line_end, &values[ c ] );
+              }
+            int i = static_cast<int>( line - first_line );
+            for( int k = 0; k < 3; k++ )
+              {
+              cloud->Points.at<cv::Vec3f>( i )[ k ] = static_cast<float>( values[ columns[ point_fields[ k ] ] ] );
+              if( normals )
+                {
+                cloud->Normals.at<cv::Vec3f>( i )[ k ] = static_cast<float>( values[ columns[ normal_fields[ k ] ] ] );
+                }
+              if( colors )
+                {
+                cloud->Colors.at<cv::Vec3b>( i )[ k ] = cv::saturate_cast<uchar>( values[ columns[ color_fields[ k ] ] ] );
+                }
+              }
+            }
+          begin = line_end + 1;
           }
-        outfile << std::endl;
+        }
+      } );
+    if( std::find( valid.begin(), valid.end(), 0 ) != valid.end() )
+      {
+      LOG_ERROR( Io, "[read_ply] Invalid vertices in " << filename );
+      return false;
       }
     }
-  }
 
+  LOG_DEBUG( Io, "[read_ply] Loaded " << n << " points (" << filename << ( cloud->Mapping ? ", mapped" : "" ) << ")" );
+  return true;
+}
+
+namespace
+{
+  struct ArchiveHeader
+    {
+    char Magic[ 4 ];
+    int Version;
+    qint64 NbPoints;
+    int NbChunks;
+    int HasColors;
+    double Precision;
+    double Origin[ 3 ];
+    };
+
+  // Number of points and compressed size of each chunk, after the header
+  struct ArchiveChunk
+    {
+    qint64 NbPoints;
+    qint64 Size;
+    };
+
+  const char ArchiveMagic[ 4 ] = { 'P', 'C', 'A', 'R' };
+  const int MortonBits = 21;
+
+  // Bits of a 21 bits value spread every 3 bits
+  uint64 spread_bits( uint64 v )
+    {
+    v &= 0x1FFFFF;
+    v = ( v | v << 32 ) & 0x1F00000000FFFFULL;
+    v = ( v | v << 16 ) & 0x1F0000FF0000FFULL;
+    v = ( v | v << 8 ) & 0x100F00F00F00F00FULL;
+    v = ( v | v << 4 ) & 0x10C30C30C30C30C3ULL;
+    v = ( v | v << 2 ) & 0x1249249249249249ULL;
+    return v;
+    }
+
+  uint64 compact_bits( uint64 v )
+    {
+    v &= 0x1249249249249249ULL;
+    v = ( v ^ ( v >> 2 ) ) & 0x10C30C30C30C30C3ULL;
+    v = ( v ^ ( v >> 4 ) ) & 0x100F00F00F00F00FULL;
+    v = ( v ^ ( v >> 8 ) ) & 0x1F0000FF0000FFULL;
+    v = ( v ^ ( v >> 16 ) ) & 0x1F00000000FFFFULL;
+    v = ( v ^ ( v >> 32 ) ) & 0x1FFFFF;
+    return v;
+    }
+
+  void write_varint( uint64 v, std::vector<char> & buffer )
+    {
+    while( v >= 0x80 )
+      {
+      buffer.push_back( static_cast<char>( ( v & 0x7F ) | 0x80 ) );
+      v >>= 7;
+      }
+    buffer.push_back( static_cast<char>( v ) );
+    }
+
+  bool read_varint( const uchar * & data, const uchar * end, uint64 * v )
+    {
+    *v = 0;
+    for( int shift = 0; data < end && shift < 64; shift += 7 )
+      {
+      uchar byte = *data++;
+      *v |= static_cast<uint64>( byte & 0x7F ) << shift;
+      if( !( byte & 0x80 ) )
+        {
+        return true;
+        }
+      }
+    return false;
+    }
+}
+
+bool io_util::write_archive( const std::string & filename, cv::Mat const& pointcloud_points, cv::Mat const& pointcloud_colors,
+  float precision, int chunk_size )
+{
+  if( !pointcloud_points.data || pointcloud_points.type() != CV_32FC3 || precision <= 0 || chunk_size <= 0
+    || ( pointcloud_colors.data && ( pointcloud_colors.size() != pointcloud_points.size() || pointcloud_colors.type() != CV_8UC3 ) ) )
+    {
+    LOG_ERROR( Io, "[write_archive] Invalid pointcloud" );
+    return false;
+    }
+  bool colors = ( pointcloud_colors.data != NULL );
+
+  // Valid points and their bounding box
+  std::vector<cv::Vec3f> points;
+  std::vector<cv::Vec3b> points_colors;
+  points.reserve( pointcloud_points.total() );
+  cv::Vec3d low( DBL_MAX, DBL_MAX, DBL_MAX ), high( -DBL_MAX, -DBL_MAX, -DBL_MAX );
+  for( int row = 0; row < pointcloud_points.rows; row++ )
+    {
+    const cv::Vec3f * points_row = pointcloud_points.ptr<cv::Vec3f>( row );
+    for( int col = 0; col < pointcloud_points.cols; col++ )
+      {
+      cv::Vec3f const& p = points_row[ col ];
+      if( p[ 2 ] <= 0 )
+        {
+        continue;
+        }
+      points.push_back( p );
+      if( colors )
+        {
+        points_colors.push_back( pointcloud_colors.ptr<cv::Vec3b>( row )[ col ] );
+        }
+      for( int a = 0; a < 3; a++ )
+        {
+        low[ a ] = std::min( low[ a ], static_cast<double>( p[ a ] ) );
+        high[ a ] = std::max( high[ a ], static_cast<double>( p[ a ] ) );
+        }
+      }
+    }
+  int n = static_cast<int>( points.size() );
+
+  // The coarser precision that fits the largest side in 21 bits is used if needed
+  double step = precision;
+  for( int a = 0; a < 3 && n > 0; a++ )
+    {
+    step = std::max( step, ( high[ a ] - low[ a ] ) / ( ( 1 << MortonBits ) - 1 ) );
+    }
+  if( step > precision )
+    {
+    LOG_WARNING( Io, "[write_archive] The precision is reduced to " << step << " to fit the cloud" );
+    }
+
+  // Morton codes, sorted with the index of their point
+  std::vector< std::pair<uint64, int> > codes( n );
+  cv::parallel_for_( cv::Range( 0, n ), [ & ]( const cv::Range & range )
+    {
+    for( int i = range.start; i < range.end; i++ )
+      {
+      uint64 code = 0;
+      for( int a = 0; a < 3; a++ )
+        {
+        uint64 q = static_cast<uint64>( std::floor( ( points[ i ][ a ] - low[ a ] ) / step + 0.5 ) );
+        code |= spread_bits( q ) << a;
+        }
+      codes[ i ] = std::make_pair( code, i );
+      }
+    } );
+  std::sort( codes.begin(), codes.end() );
+
+  // Each chunk starts with an absolute code : the chunks are independent
+  int nb_chunks = ( n + chunk_size - 1 ) / chunk_size;
+  std::vector<QByteArray> chunks( nb_chunks );
+  cv::parallel_for_( cv::Range( 0, nb_chunks ), [ & ]( const cv::Range & range )
+    {
+    std::vector<char> raw;
+    for( int c = range.start; c < range.end; c++ )
+      {
+      int first = c * chunk_size, last = std::min( n, first + chunk_size );
+      raw.clear();
+      uint64 previous = 0;
+      for( int i = first; i < last; i++ )
+        {
+        write_varint( codes[ i ].first - previous, raw );
+        previous = codes[ i ].first;
+        }
+      // One plane per channel, delta encoded : neighbor points have close colors
+      for( int k = 0; k < 3 && colors; k++ )
+        {
+        uchar previous_color = 0;
+        for( int i = first; i < last; i++ )
+          {
+          uchar color = points_colors[ codes[ i ].second ][ k ];
+          raw.push_back( static_cast<char>( color - previous_color ) );
+          previous_color = color;
+          }
+        }
+      chunks[ c ] = qCompress( reinterpret_cast<const uchar *>( raw.data() ), static_cast<int>( raw.size() ) );
+      }
+    } );
+
+  ArchiveHeader header;
+  memcpy( header.Magic, ArchiveMagic, sizeof( header.Magic ) );
+  header.Version = ARCHIVE_FILE_VERSION;
+  header.NbPoints = n;
+  header.NbChunks = nb_chunks;
+  header.HasColors = ( colors ? 1 : 0 );
+  header.Precision = step;
+  for( int a = 0; a < 3; a++ )
+    {
+    header.Origin[ a ] = ( n > 0 ? low[ a ] : 0 );
+    }
+  std::vector<ArchiveChunk> table( nb_chunks );
+  for( int c = 0; c < nb_chunks; c++ )
+    {
+    table[ c ].NbPoints = std::min( n, ( c + 1 ) * chunk_size ) - c * chunk_size;
+    table[ c ].Size = chunks[ c ].size();
+    }
+
+  std::ofstream outfile( filename.c_str(), std::ios::out | std::ios::trunc | std::ios::binary );
+  outfile.write( reinterpret_cast<const char *>( &header ), sizeof( header ) );
+  outfile.write( reinterpret_cast<const char *>( table.data() ), table.size() * sizeof( ArchiveChunk ) );
+  for( int c = 0; c < nb_chunks; c++ )
+    {
+    outfile.write( chunks[ c ].constData(), chunks[ c ].size() );
+    }
   outfile.close();
-  std::cerr << "[write_ply] Saved " << points_index.size() << " points (" << filename << ")" << std::endl;
+  if( !outfile )
+    {
+    LOG_ERROR( Io, "[write_archive] Impossible to write " << filename );
+    return false;
+    }
+  LOG_DEBUG( Io, "[write_archive] Saved " << n << " points (" << filename << ")" );
+  return true;
+}
+
+bool io_util::read_archive( const std::string & filename, cv::Mat & pointcloud_points, cv::Mat & pointcloud_colors )
+{
+  pointcloud_points.release();
+  pointcloud_colors.release();
+
+  QFile file( QString::fromStdString( filename ) );
+  qint64 size = file.size();
+  uchar * data = NULL;
+  if( !file.open( QIODevice::ReadOnly ) || size < static_cast<qint64>( sizeof( ArchiveHeader ) ) || ( data = file.map( 0, size ) ) == NULL )
+    {
+    LOG_ERROR( Io, "[read_archive] Impossible to read " << filename );
+    return false;
+    }
+  ArchiveHeader header;
+  memcpy( &header, data, sizeof( header ) );
+  if( memcmp( header.Magic, ArchiveMagic, sizeof( header.Magic ) ) != 0 || header.Version != ARCHIVE_FILE_VERSION
+    || header.NbChunks < 0 || header.NbPoints < 0 || header.NbPoints > INT_MAX
+    || size < static_cast<qint64>( sizeof( ArchiveHeader ) + header.NbChunks * sizeof( ArchiveChunk ) ) )
+    {
+    LOG_ERROR( Io, "[read_archive] Invalid archive " << filename );
+    return false;
+    }
+
+  // Position of the chunks
+  int nb_chunks = header.NbChunks;
+  std::vector<ArchiveChunk> table( nb_chunks );
+  memcpy( table.data(), data + sizeof( ArchiveHeader ), nb_chunks * sizeof( ArchiveChunk ) );
+  std::vector<qint64> offsets( nb_chunks + 1, sizeof( ArchiveHeader ) + nb_chunks * sizeof( ArchiveChunk ) );
+  std::vector<int> firsts( nb_chunks + 1, 0 );
+  for( int c = 0; c < nb_chunks; c++ )
+    {
+    if( table[ c ].Size < 0 || table[ c ].NbPoints < 0 )
+      {
+      LOG_ERROR( Io, "[read_archive] Invalid archive " << filename );
+      return false;
+      }
+    offsets[ c + 1 ] = offsets[ c ] + table[ c ].Size;
+    firsts[ c + 1 ] = firsts[ c ] + static_cast<int>( table[ c ].NbPoints );
+    }
+  if( offsets[ nb_chunks ] > size || firsts[ nb_chunks ] != header.NbPoints )
+    {
+    LOG_ERROR( Io, "[read_archive] Truncated archive " << filename );
+    return false;
+    }
+
+  bool colors = ( header.HasColors != 0 );
+  pointcloud_points.create( static_cast<int>( header.NbPoints ), 1, CV_32FC3 );
+  if( colors )
+    {
+    pointcloud_colors.create( static_cast<int>( header.NbPoints ), 1, CV_8UC3 );
+    }
+  std::vector<char> valid( nb_chunks, 0 );
+  cv::parallel_for_( cv::Range( 0, nb_chunks ), [ & ]( const cv::Range & range )
+    {
+    for( int c = range.start; c < range.end; c++ )
+      {
+      QByteArray raw = qUncompress( data + offsets[ c ], static_cast<int>( table[ c ].Size ) );
+      const uchar * begin = reinterpret_cast<const uchar *>( raw.constData() );
+      const uchar * end = begin + raw.size();
+      int nb = firsts[ c + 1 ] - firsts[ c ];
+      uint64 code = 0;
+      bool decoded = true;
+      for( int i = firsts[ c ]; i < firsts[ c + 1 ] && decoded; i++ )
+        {
+        uint64 delta = 0;
+        decoded = read_varint( begin, end, &delta );
+        code += delta;
+        cv::Vec3f & p = pointcloud_points.at<cv::Vec3f>( i );
+        for( int a = 0; a < 3; a++ )
+          {
+          p[ a ] = static_cast<float>( header.Origin[ a ] + header.Precision * compact_bits( code >> a ) );
+          }
+        }
+      if( colors && decoded && end - begin == 3 * nb )
+        {
+        for( int k = 0; k < 3; k++ )
+          {
+          uchar color = 0;
+          for( int i = firsts[ c ]; i < firsts[ c + 1 ]; i++ )
+            {
+            color = static_cast<uchar>( color + *begin++ );
+            pointcloud_colors.at<cv::Vec3b>( i )[ k ] = color;
+            }
+          }
+        }
+      valid[ c ] = ( decoded && begin == end );
+      }
+    } );
+  file.unmap( data );
+  if( std::find( valid.begin(), valid.end(), 0 ) != valid.end() )
+    {
+    LOG_ERROR( Io, "[read_archive] Corrupted archive " << filename );
+    pointcloud_points.release();
+    pointcloud_colors.release();
+    return false;
+    }
+  LOG_DEBUG( Io, "[read_archive] Loaded " << header.NbPoints << " points (" << filename << ")" );
   return true;
-}
\ No newline at end of file
+}